@@ -9,6 +9,10 @@
 /* Prototype for assembly function */
 void sha256_ce_transform(uint32_t state[8], const void *src,
 			 unsigned int block_count);
+#ifdef ARM64
+void sha256_ce_transform_x2(uint32_t state[2][8], const void *src0,
+			    const void *src1, unsigned int block_count);
+#endif
 
 void crypto_accel_sha256_compress(uint32_t state[8], const void *src,
 				  unsigned int block_count)
@@ -19,3 +23,18 @@ void crypto_accel_sha256_compress(uint32_t state[8], const void *src,
 	sha256_ce_transform(state, src, block_count);
 	thread_kernel_disable_vfp(vfp_state);
 }
+
+void crypto_accel_sha256_compress_x2(uint32_t state[2][8], const void *src[2],
+				     unsigned int block_count)
+{
+	uint32_t vfp_state = 0;
+
+	vfp_state = thread_kernel_enable_vfp();
+#ifdef ARM64
+	sha256_ce_transform_x2(state, src[0], src[1], block_count);
+#else
+	sha256_ce_transform(state[0], src[0], block_count);
+	sha256_ce_transform(state[1], src[1], block_count);
+#endif
+	thread_kernel_disable_vfp(vfp_state);
+}
@@ -5,15 +5,36 @@
 #ifndef KERNEL_MUTEX_H
 #define KERNEL_MUTEX_H
 
+#include <compiler.h>
 #include <kernel/refcount.h>
 #include <kernel/wait_queue.h>
 #include <sys/queue.h>
 #include <types_ext.h>
 
+/*
+ * struct mutex_stats - Contention counters of a mutex
+ * @contended:	Number of times the mutex was locked when requested
+ * @spin_acquired: Number of contended requests which got the mutex while
+ *		spinning, without sleeping in normal world
+ * @slept:	Number of times a request slept in normal world
+ */
+struct mutex_stats {
+	unsigned int contended;
+	unsigned int spin_acquired;
+	unsigned int slept;
+};
+
 struct mutex {
 	unsigned spin_lock;	/* used when operating on this struct */
 	struct wait_queue wq;
-	short state;		/* -1: write, 0: unlocked, > 0: readers */
+	unsigned int state;	/* write and waiters flags, readers */
+	/* thread id, only valid when write locked */
+	short owner;
+	short num_waiters;	/* protected by spin_lock */
+	short num_write_waiters; /* protected by spin_lock */
+#ifdef CFG_MUTEX_STATS
+	struct mutex_stats stats;
+#endif
 };
 
 #define MUTEX_INITIALIZER { .wq = WAIT_QUEUE_INITIALIZER }
@@ -36,6 +57,27 @@ void mutex_init_recursive(struct recursive_mutex *m);
 void mutex_destroy_recursive(struct recursive_mutex *m);
 unsigned int mutex_get_recursive_lock_depth(struct recursive_mutex *m);
 
+/*
+ * Returns true if @m is read or write locked by any thread, intended for
+ * assertions.
+ */
+bool mutex_is_locked(struct mutex *m);
+
+#ifdef CFG_MUTEX_STATS
+/*
+ * mutex_get_stats() - Get and reset the contention counters of a mutex
+ * @m:		Mutex
+ * @stats:	Receives the counters
+ */
+void mutex_get_stats(struct mutex *m, struct mutex_stats *stats);
+#else
+static inline void mutex_get_stats(struct mutex *m __unused,
+				   struct mutex_stats *stats)
+{
+	*stats = (struct mutex_stats){ };
+}
+#endif
+
 #ifdef CFG_MUTEX_DEBUG
 void mutex_unlock_debug(struct mutex *m, const char *fname, int lineno);
 #define mutex_unlock(m) mutex_unlock_debug((m), __FILE__, __LINE__)
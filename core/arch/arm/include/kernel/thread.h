@@ -310,6 +310,26 @@ short int thread_get_id(void);
  */
 short int thread_get_id_may_fail(void);
 
+/*
+ * Returns the number of threads, at most CFG_NUM_THREADS. Thread ids are
+ * less than this number.
+ */
+size_t thread_get_count(void);
+
+/*
+ * Sets the number of threads, 1 to CFG_NUM_THREADS. Only supposed to be
+ * used during initialization before the threads are initialized.
+ */
+void thread_set_count(size_t count);
+
+#ifdef CFG_WITH_STATS
+/*
+ * Returns the time in microseconds thread @thread_id has been active since
+ * boot, that is executing in secure world.
+ */
+uint64_t thread_get_busy_time(size_t thread_id);
+#endif
+
 /* Returns Thread Specific Data (TSD) pointer. */
 struct thread_specific_data *thread_get_tsd(void);
 
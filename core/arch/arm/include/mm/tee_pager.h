@@ -29,6 +29,8 @@ struct tee_pager_area {
 	vaddr_t base;
 	size_t size;
 	struct pgt *pgt;
+	vaddr_t ra_next_va;	/* next fault expected if sequential */
+	size_t ra_window;	/* pages to read ahead on sequential fault */
 	TAILQ_ENTRY(tee_pager_area) link;
 	TAILQ_ENTRY(tee_pager_area) fobj_link;
 };
@@ -265,10 +267,36 @@ struct tee_pager_stats {
 	size_t zi_released;
 	size_t npages;		/* number of load pages */
 	size_t npages_all;	/* number of pages */
+	size_t evictions;	/* number of loaded pages evicted */
+	/* number of recently evicted pages reloaded */
+	size_t ghost_hits;
+	size_t readahead;	/* number of pages read ahead */
+	size_t readahead_hits;	/* pages read ahead which were used */
+	size_t readahead_waste;	/* pages read ahead evicted unused */
+};
+
+/*
+ * Page fault latency on a core, from entering tee_pager_handle_fault()
+ * until the fault is handled. Percentiles are rounded up to a power of
+ * two, all times are in microseconds.
+ */
+struct tee_pager_fault_latency {
+	size_t count;		/* number of faults */
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t max;
 };
 
 #ifdef CFG_WITH_PAGER
 void tee_pager_get_stats(struct tee_pager_stats *stats);
+/*
+ * tee_pager_get_fault_latency() - Get and reset fault latency of a core
+ * @core_pos:	Core number, less than CFG_TEE_CORE_NB_CORE
+ * @lat:	Receives the latency figures
+ */
+void tee_pager_get_fault_latency(size_t core_pos,
+				 struct tee_pager_fault_latency *lat);
 bool tee_pager_handle_fault(struct abort_info *ai);
 #else /*CFG_WITH_PAGER*/
 static inline bool tee_pager_handle_fault(struct abort_info *ai __unused)
@@ -280,6 +308,13 @@ static inline void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
 	memset(stats, 0, sizeof(struct tee_pager_stats));
 }
+
+static inline void
+tee_pager_get_fault_latency(size_t core_pos __unused,
+			    struct tee_pager_fault_latency *lat)
+{
+	memset(lat, 0, sizeof(*lat));
+}
 #endif /*CFG_WITH_PAGER*/
 
 void tee_pager_invalidate_fobj(struct fobj *fobj);
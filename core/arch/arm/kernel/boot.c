@@ -29,6 +29,7 @@
 #include <mm/tee_pager.h>
 #include <sm/psci.h>
 #include <stdio.h>
+#include <string_ext.h>
 #include <trace.h>
 #include <utee_defines.h>
 #include <util.h>
@@ -380,9 +381,49 @@ static struct fobj *ro_paged_alloc(tee_mm_entry_t *mm, void *hashes,
 #endif
 }
 
+/*
+ * Pages are hashed a few at a time so that hash_sha256_multi() can
+ * interleave them.
+ */
+static void check_pageable_hashes(const uint8_t *hashes,
+				  const uint8_t *pages, size_t num_pages)
+{
+	uint8_t digests[4][TEE_SHA256_HASH_SIZE] = { };
+	struct hash_sha256_msg msgs[ARRAY_SIZE(digests)] = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t num = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	for (n = 0; n < num_pages; n += num) {
+		num = MIN(num_pages - n, ARRAY_SIZE(msgs));
+		for (m = 0; m < num; m++) {
+			msgs[m].data = pages + (n + m) * SMALL_PAGE_SIZE;
+			msgs[m].data_size = SMALL_PAGE_SIZE;
+			msgs[m].digest = digests[m];
+		}
+
+		res = hash_sha256_multi(msgs, num);
+		for (m = 0; m < num; m++) {
+			const uint8_t *hash = hashes +
+					      (n + m) * TEE_SHA256_HASH_SIZE;
+
+			DMSG("hash pg_idx %zu hash %p page %p", n + m, hash,
+			     msgs[m].data);
+			if (!res && consttime_memcmp(digests[m], hash,
+						     TEE_SHA256_HASH_SIZE))
+				res = TEE_ERROR_SECURITY;
+			if (res != TEE_SUCCESS) {
+				EMSG("Hash failed for page %zu at %p: res 0x%x",
+				     n + m, (void *)msgs[m].data, res);
+				panic();
+			}
+		}
+	}
+}
+
 static void init_runtime(unsigned long pageable_part)
 {
-	size_t n;
 	size_t init_size = (size_t)(__init_end - __init_start);
 	size_t pageable_start = (size_t)__pageable_start;
 	size_t pageable_end = (size_t)__pageable_end;
@@ -451,19 +492,8 @@ static void init_runtime(unsigned long pageable_part)
 
 	/* Check that hashes of what's in pageable area is OK */
 	DMSG("Checking hashes of pageable area");
-	for (n = 0; (n * SMALL_PAGE_SIZE) < pageable_size; n++) {
-		const uint8_t *hash = hashes + n * TEE_SHA256_HASH_SIZE;
-		const uint8_t *page = paged_store + n * SMALL_PAGE_SIZE;
-		TEE_Result res;
-
-		DMSG("hash pg_idx %zu hash %p page %p", n, hash, page);
-		res = hash_sha256_check(hash, page, SMALL_PAGE_SIZE);
-		if (res != TEE_SUCCESS) {
-			EMSG("Hash failed for page %zu at %p: res 0x%x",
-			     n, (void *)page, res);
-			panic();
-		}
-	}
+	check_pageable_hashes(hashes, paged_store,
+			      pageable_size / SMALL_PAGE_SIZE);
 
 	/*
 	 * Assert prepaged init sections are page aligned so that nothing
@@ -1176,6 +1206,36 @@ void init_tee_runtime(void)
 	call_initcalls();
 }
 
+#if defined(CFG_DT)
+/*
+ * Lowers the number of threads used to the property "optee,num-threads"
+ * in /secure-chosen of the embedded DT, if present.
+ */
+static void init_thread_count(void)
+{
+	void *fdt = get_embedded_dt();
+	const fdt32_t *prop = NULL;
+	int offs = 0;
+	int len = 0;
+
+	if (!fdt)
+		return;
+
+	offs = fdt_path_offset(fdt, "/secure-chosen");
+	if (offs < 0)
+		return;
+	prop = fdt_getprop(fdt, offs, "optee,num-threads", &len);
+	if (!prop || len != sizeof(*prop))
+		return;
+
+	thread_set_count(fdt32_to_cpu(*prop));
+}
+#else
+static void init_thread_count(void)
+{
+}
+#endif
+
 static void init_primary(unsigned long pageable_part, unsigned long nsec_entry)
 {
 	/*
@@ -1196,6 +1256,7 @@ static void init_primary(unsigned long pageable_part, unsigned long nsec_entry)
 	 */
 	thread_get_core_local()->curr_thread = 0;
 	init_runtime(pageable_part);
+	init_thread_count();
 
 	if (IS_ENABLED(CFG_VIRTUALIZATION)) {
 		/*
@@ -3,14 +3,18 @@
  * Copyright (c) 2015-2017, Linaro Limited
  */
 
+#include <atomic.h>
+#include <kernel/delay.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/refcount.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <trace.h>
+#include <util.h>
 
 #include "mutex_lockdep.h"
+#include "thread_private.h"
 
 void mutex_init(struct mutex *m)
 {
@@ -22,19 +26,178 @@ void mutex_init_recursive(struct recursive_mutex *m)
 	*m = (struct recursive_mutex)RECURSIVE_MUTEX_INITIALIZER;
 }
 
-static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
+/*
+ * m->state holds the number of readers in the bits below
+ * MUTEX_STATE_WAITERS, MUTEX_STATE_WRITE when write locked and
+ * MUTEX_STATE_WAITERS while m->num_waiters > 0.
+ *
+ * Uncontended lock and unlock are a single compare and swap on m->state.
+ * The fast paths fail as soon as MUTEX_STATE_WAITERS is set, everything
+ * else is done while holding m->spin_lock which also protects
+ * m->num_waiters and m->num_write_waiters. The waiters flag is only
+ * updated under m->spin_lock and in the same atomic update as the lock
+ * bits, so an unlocker either sees the flag and takes the slow path to
+ * wake the waiters, or the waiter sees the mutex as released.
+ *
+ * Writers are preferred: a reader which hasn't slept yet doesn't take a
+ * read lock in the slow path while there are writers waiting. Readers
+ * woken from the wait queue are woken as a batch by wq_wake_next().
+ */
+#define MUTEX_STATE_WRITE	BIT(31)
+#define MUTEX_STATE_WAITERS	BIT(30)
+#define MUTEX_STATE_LOCKED	(~MUTEX_STATE_WAITERS)
+
+#ifdef CFG_MUTEX_STATS
+/* Called with m->spin_lock held */
+static void stat_contended(struct mutex *m, bool can_lock, bool slept)
 {
-	assert_have_no_spinlock();
-	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
-	assert(thread_is_in_normal_mode());
+	if (!slept)
+		m->stats.contended++;
+	if (can_lock && !slept)
+		m->stats.spin_acquired++;
+	else if (!can_lock)
+		m->stats.slept++;
+}
 
-	mutex_lock_check(m);
+void mutex_get_stats(struct mutex *m, struct mutex_stats *stats)
+{
+	uint32_t old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
 
-	while (true) {
-		uint32_t old_itr_status;
-		bool can_lock;
-		struct wait_queue_elem wqe;
+	*stats = m->stats;
+	m->stats = (struct mutex_stats){ };
+
+	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
+}
+#else
+static void stat_contended(struct mutex *m __unused, bool can_lock __unused,
+			   bool slept __unused)
+{
+}
+#endif
+
+/*
+ * Returns true if the thread holding the write lock of @m is running on a
+ * core. It may be suspended, for instance while serving a foreign
+ * interrupt in normal world, in which case it's pointless to spin.
+ */
+static bool owner_is_running(struct mutex *m)
+{
+	short int owner = atomic_load_short(&m->owner);
+
+	/* No locking, it's only a hint */
+	return owner >= 0 && owner < CFG_NUM_THREADS &&
+	       threads[owner].state == THREAD_STATE_ACTIVE;
+}
+
+/*
+ * Spins until @m is likely to be available, for at most CFG_MUTEX_SPIN_US
+ * microseconds and only as long as the owner is running, since the mutex
+ * is then likely to be released soon. This saves the two RPCs needed to
+ * sleep in and be woken up from normal world.
+ */
+static void mutex_spin(struct mutex *m, bool read)
+{
+	uint64_t expire = 0;
+	unsigned int state = 0;
+
+	if (!CFG_MUTEX_SPIN_US)
+		return;
+
+	expire = timeout_init_us(CFG_MUTEX_SPIN_US);
+	while (!timeout_elapsed(expire)) {
+		state = atomic_load_uint(&m->state);
+		if (!(state & MUTEX_STATE_LOCKED) ||
+		    (read && !(state & MUTEX_STATE_WRITE)))
+			return;
+		if ((state & MUTEX_STATE_WRITE) && !owner_is_running(m))
+			return;
+	}
+}
+
+static bool write_trylock_fast(struct mutex *m)
+{
+	unsigned int state = 0;
+
+	return atomic_cas_uint(&m->state, &state, MUTEX_STATE_WRITE);
+}
+
+static bool read_trylock_fast(struct mutex *m)
+{
+	unsigned int state = atomic_load_uint(&m->state);
+
+	while (!(state & (MUTEX_STATE_WRITE | MUTEX_STATE_WAITERS)))
+		if (atomic_cas_uint(&m->state, &state, state + 1))
+			return true;
+
+	return false;
+}
+
+/*
+ * Called with m->spin_lock held. Takes the lock if possible, else
+ * accounts the caller as a waiter. In both cases MUTEX_STATE_WAITERS is
+ * updated to match m->num_waiters in the same atomic update.
+ */
+static bool slow_trylock(struct mutex *m, bool read, bool slept)
+{
+	unsigned int state = atomic_load_uint(&m->state);
+	unsigned int new_state = 0;
+	bool can_lock = false;
+
+	do {
+		if (read)
+			can_lock = !(state & MUTEX_STATE_WRITE) &&
+				   (slept || !m->num_write_waiters);
+		else
+			can_lock = !(state & MUTEX_STATE_LOCKED);
+
+		new_state = state & MUTEX_STATE_LOCKED;
+		if (can_lock) {
+			if (read)
+				new_state++;
+			else
+				new_state = MUTEX_STATE_WRITE;
+		}
+		if (m->num_waiters || !can_lock)
+			new_state |= MUTEX_STATE_WAITERS;
+	} while (!atomic_cas_uint(&m->state, &state, new_state));
+
+	if (!can_lock) {
+		m->num_waiters++;
+		if (!read)
+			m->num_write_waiters++;
+	}
+
+	return can_lock;
+}
+
+/* Called with m->spin_lock held */
+static void update_waiters(struct mutex *m)
+{
+	unsigned int state = atomic_load_uint(&m->state);
+	unsigned int new_state = 0;
+
+	do {
+		new_state = state & MUTEX_STATE_LOCKED;
+		if (m->num_waiters)
+			new_state |= MUTEX_STATE_WAITERS;
+	} while (!atomic_cas_uint(&m->state, &state, new_state));
+}
+
+static void mutex_lock_slow(struct mutex *m, bool read, const char *fname,
+			    int lineno)
+{
+	struct wait_queue_elem wqe = { };
+	uint32_t old_itr_status = 0;
+	bool can_lock = false;
+	bool slept = false;
 
+	/*
+	 * Someone else is holding the lock, spin a while before trying
+	 * again and eventually sleeping.
+	 */
+	mutex_spin(m, read);
+
+	while (true) {
 		/*
 		 * If the mutex is locked we need to initialize the wqe
 		 * before releasing the spinlock to guarantee that we don't
@@ -46,26 +209,78 @@ static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
 
 		old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
 
-		can_lock = !m->state;
-		if (!can_lock) {
-			wq_wait_init(&m->wq, &wqe, false /* wait_read */);
-		} else {
-			m->state = -1; /* write locked */
+		if (slept) {
+			m->num_waiters--;
+			if (!read)
+				m->num_write_waiters--;
 		}
+		can_lock = slow_trylock(m, read, slept);
+		stat_contended(m, can_lock, slept);
+		if (!can_lock)
+			wq_wait_init(&m->wq, &wqe, read /* wait_read */);
 
 		cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
-		if (!can_lock) {
-			/*
-			 * Someone else is holding the lock, wait in normal
-			 * world for the lock to become available.
-			 */
-			wq_wait_final(&m->wq, &wqe, m, fname, lineno);
-		} else
+		if (can_lock)
 			return;
+
+		/*
+		 * The lock is still held, wait in normal world for the
+		 * lock to become available.
+		 */
+		wq_wait_final(&m->wq, &wqe, m, fname, lineno);
+		slept = true;
 	}
 }
 
+/*
+ * Releases one read lock or the write lock of @m and wakes eventual
+ * waiters if the mutex became unlocked.
+ */
+static void mutex_unlock_slow(struct mutex *m, bool read, const char *fname,
+			      int lineno)
+{
+	uint32_t old_itr_status = 0;
+	unsigned int state = 0;
+	unsigned int new_state = 0;
+
+	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
+
+	state = atomic_load_uint(&m->state);
+	do {
+		if (read) {
+			if (!(state & MUTEX_STATE_LOCKED) ||
+			    (state & MUTEX_STATE_WRITE))
+				panic();
+			new_state = state - 1;
+		} else {
+			if (!(state & MUTEX_STATE_WRITE))
+				panic();
+			new_state = state & ~MUTEX_STATE_WRITE;
+		}
+	} while (!atomic_cas_uint(&m->state, &state, new_state));
+
+	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
+
+	/* Wake eventual waiters if the mutex was unlocked */
+	if (new_state == MUTEX_STATE_WAITERS)
+		wq_wake_next(&m->wq, m, fname, lineno);
+}
+
+static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
+{
+	assert_have_no_spinlock();
+	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
+	assert(thread_is_in_normal_mode());
+
+	mutex_lock_check(m);
+
+	if (!write_trylock_fast(m))
+		mutex_lock_slow(m, false /* read */, fname, lineno);
+
+	atomic_store_short(&m->owner, thread_get_id());
+}
+
 static void __mutex_lock_recursive(struct recursive_mutex *m, const char *fname,
 				   int lineno)
 {
@@ -89,23 +304,17 @@ static void __mutex_lock_recursive(struct recursive_mutex *m, const char *fname,
 
 static void __mutex_unlock(struct mutex *m, const char *fname, int lineno)
 {
-	uint32_t old_itr_status;
+	unsigned int state = MUTEX_STATE_WRITE;
 
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 
 	mutex_unlock_check(m);
 
-	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
-
-	if (!m->state)
-		panic();
-
-	m->state = 0;
+	atomic_store_short(&m->owner, THREAD_ID_INVALID);
 
-	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
-
-	wq_wake_next(&m->wq, m, fname, lineno);
+	if (!atomic_cas_uint(&m->state, &state, 0))
+		mutex_unlock_slow(m, false /* read */, fname, lineno);
 }
 
 static void __mutex_unlock_recursive(struct recursive_mutex *m,
@@ -127,46 +336,41 @@ static void __mutex_unlock_recursive(struct recursive_mutex *m,
 static bool __mutex_trylock(struct mutex *m, const char *fname __unused,
 			int lineno __unused)
 {
-	uint32_t old_itr_status;
-	bool can_lock_write;
+	unsigned int state = 0;
 
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 
-	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
-
-	can_lock_write = !m->state;
-	if (can_lock_write)
-		m->state = -1;
-
-	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
-
-	if (can_lock_write)
-		mutex_trylock_check(m);
+	/* Keep MUTEX_STATE_WAITERS if set, see slow_trylock() */
+	state = atomic_load_uint(&m->state);
+	while (!(state & MUTEX_STATE_LOCKED)) {
+		if (atomic_cas_uint(&m->state, &state,
+				    state | MUTEX_STATE_WRITE)) {
+			atomic_store_short(&m->owner, thread_get_id());
+			mutex_trylock_check(m);
+			return true;
+		}
+	}
 
-	return can_lock_write;
+	return false;
 }
 
 static void __mutex_read_unlock(struct mutex *m, const char *fname, int lineno)
 {
-	uint32_t old_itr_status;
-	short new_state;
+	unsigned int state = 0;
 
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 
-	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
-
-	if (m->state <= 0)
-		panic();
-	m->state--;
-	new_state = m->state;
-
-	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
+	state = atomic_load_uint(&m->state);
+	while (!(state & MUTEX_STATE_WAITERS)) {
+		if (!state || (state & MUTEX_STATE_WRITE))
+			panic();
+		if (atomic_cas_uint(&m->state, &state, state - 1))
+			return;
+	}
 
-	/* Wake eventual waiters if the mutex was unlocked */
-	if (!new_state)
-		wq_wake_next(&m->wq, m, fname, lineno);
+	mutex_unlock_slow(m, true /* read */, fname, lineno);
 }
 
 static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
@@ -175,57 +379,31 @@ static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 	assert(thread_is_in_normal_mode());
 
-	while (true) {
-		uint32_t old_itr_status;
-		bool can_lock;
-		struct wait_queue_elem wqe;
-
-		/*
-		 * If the mutex is locked we need to initialize the wqe
-		 * before releasing the spinlock to guarantee that we don't
-		 * miss the wakeup from mutex_unlock().
-		 *
-		 * If the mutex is unlocked we don't need to use the wqe at
-		 * all.
-		 */
-
-		old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
-
-		can_lock = m->state != -1;
-		if (!can_lock) {
-			wq_wait_init(&m->wq, &wqe, true /* wait_read */);
-		} else {
-			m->state++; /* read_locked */
-		}
-
-		cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
-
-		if (!can_lock) {
-			/*
-			 * Someone else is holding the lock, wait in normal
-			 * world for the lock to become available.
-			 */
-			wq_wait_final(&m->wq, &wqe, m, fname, lineno);
-		} else
-			return;
-	}
+	if (!read_trylock_fast(m))
+		mutex_lock_slow(m, true /* read */, fname, lineno);
 }
 
 static bool __mutex_read_trylock(struct mutex *m, const char *fname __unused,
 				 int lineno __unused)
 {
-	uint32_t old_itr_status;
-	bool can_lock;
+	uint32_t old_itr_status = 0;
+	unsigned int state = 0;
+	bool can_lock = false;
 
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 	assert(thread_is_in_normal_mode());
 
+	if (read_trylock_fast(m))
+		return true;
+
 	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
 
-	can_lock = m->state != -1;
-	if (can_lock)
-		m->state++;
+	state = atomic_load_uint(&m->state);
+	do {
+		can_lock = !(state & MUTEX_STATE_WRITE) &&
+			   !m->num_write_waiters;
+	} while (can_lock && !atomic_cas_uint(&m->state, &state, state + 1));
 
 	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
@@ -334,6 +512,12 @@ void mutex_destroy_recursive(struct recursive_mutex *m)
 	mutex_destroy(&m->m);
 }
 
+bool mutex_is_locked(struct mutex *m)
+{
+	/* MUTEX_STATE_WAITERS alone doesn't mean that @m is locked */
+	return atomic_load_uint(&m->state) & MUTEX_STATE_LOCKED;
+}
+
 unsigned int mutex_get_recursive_lock_depth(struct recursive_mutex *m)
 {
 	assert_have_no_spinlock();
@@ -398,8 +582,9 @@ static void __condvar_wait(struct condvar *cv, struct mutex *m,
 {
 	uint32_t old_itr_status;
 	struct wait_queue_elem wqe;
-	short old_state;
-	short new_state;
+	unsigned int state = 0;
+	unsigned int new_state = 0;
+	bool read = false;
 
 	mutex_unlock_check(m);
 
@@ -413,30 +598,42 @@ static void __condvar_wait(struct condvar *cv, struct mutex *m,
 
 	cpu_spin_lock(&m->spin_lock);
 
-	if (!m->state)
+	state = atomic_load_uint(&m->state);
+	if (!(state & MUTEX_STATE_LOCKED))
 		panic();
-	old_state = m->state;
+	read = !(state & MUTEX_STATE_WRITE);
 	/* Add to mutex wait queue as a condvar waiter */
-	wq_wait_init_condvar(&m->wq, &wqe, cv, m->state > 0);
-
-	if (m->state > 1) {
-		/* Multiple read locks, remove one */
-		m->state--;
-	} else {
-		/* Only one lock (read or write), unlock the mutex */
-		m->state = 0;
-	}
-	new_state = m->state;
+	wq_wait_init_condvar(&m->wq, &wqe, cv, read);
+	/*
+	 * Count as a waiter so the unlock following a promotion by
+	 * condvar_signal() takes the slow path and wakes us.
+	 */
+	m->num_waiters++;
+
+	if (!read)
+		atomic_store_short(&m->owner, THREAD_ID_INVALID);
+	do {
+		if (read)
+			new_state = state - 1;
+		else
+			new_state = state & ~MUTEX_STATE_WRITE;
+		new_state |= MUTEX_STATE_WAITERS;
+	} while (!atomic_cas_uint(&m->state, &state, new_state));
 
 	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
 	/* Wake eventual waiters if the mutex was unlocked */
-	if (!new_state)
+	if (new_state == MUTEX_STATE_WAITERS)
 		wq_wake_next(&m->wq, m, fname, lineno);
 
 	wq_wait_final(&m->wq, &wqe, m, fname, lineno);
 
-	if (old_state > 0)
+	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
+	m->num_waiters--;
+	update_waiters(m);
+	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
+
+	if (read)
 		mutex_read_lock(m);
 	else
 		mutex_lock(m);
@@ -36,6 +36,26 @@
 
 struct thread_ctx threads[CFG_NUM_THREADS];
 
+/*
+ * Number of threads in use, at most CFG_NUM_THREADS. May be reduced at
+ * boot with thread_set_count() before the threads are initialized.
+ */
+size_t thread_count __nex_data = CFG_NUM_THREADS;
+
+/*
+ * Ids of free threads, used as a stack so the most recently freed thread,
+ * likely with a warm stack and cache, is used first. Protected by
+ * thread_global_lock.
+ */
+static short int thread_free_ids[CFG_NUM_THREADS];
+static size_t thread_num_free;
+
+#ifdef CFG_WITH_STATS
+/* Time each thread has been active, in counter ticks */
+static uint64_t thread_busy_ticks[CFG_NUM_THREADS];
+static uint64_t thread_busy_start[CFG_NUM_THREADS];
+#endif
+
 struct thread_core_local thread_core_local[CFG_TEE_CORE_NB_CORE] __nex_bss;
 
 /*
@@ -246,6 +266,84 @@ void thread_unlock_global(void)
 	cpu_spin_unlock(&thread_global_lock);
 }
 
+/* Called with thread_global_lock held */
+static void __nostackcheck put_free_thread(short int n)
+{
+	assert(thread_num_free < thread_count);
+	threads[n].state = THREAD_STATE_FREE;
+	thread_free_ids[thread_num_free] = n;
+	thread_num_free++;
+}
+
+/* Called with thread_global_lock held, returns -1 if no thread is free */
+static short int get_free_thread(void)
+{
+	short int n = 0;
+
+	if (!thread_num_free)
+		return -1;
+
+	thread_num_free--;
+	n = thread_free_ids[thread_num_free];
+	assert(threads[n].state == THREAD_STATE_FREE);
+	threads[n].state = THREAD_STATE_ACTIVE;
+
+	return n;
+}
+
+#ifdef CFG_WITH_STATS
+static void busy_start(short int n)
+{
+	thread_busy_start[n] = read_cntpct();
+}
+
+static void busy_stop(short int n)
+{
+	thread_busy_ticks[n] += read_cntpct() - thread_busy_start[n];
+}
+
+uint64_t thread_get_busy_time(size_t thread_id)
+{
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
+	uint64_t ticks = 0;
+
+	assert(thread_id < thread_count);
+
+	thread_lock_global();
+	ticks = thread_busy_ticks[thread_id];
+	if (threads[thread_id].state == THREAD_STATE_ACTIVE)
+		ticks += read_cntpct() - thread_busy_start[thread_id];
+	thread_unlock_global();
+
+	thread_unmask_exceptions(exceptions);
+
+	return ticks * 1000000 / read_cntfrq();
+}
+#else
+static void busy_start(short int n __unused)
+{
+}
+
+static void busy_stop(short int n __unused)
+{
+}
+#endif
+
+size_t thread_get_count(void)
+{
+	return thread_count;
+}
+
+void thread_set_count(size_t count)
+{
+	if (!count || count > CFG_NUM_THREADS) {
+		EMSG("Invalid number of threads %zu, using %d", count,
+		     CFG_NUM_THREADS);
+		return;
+	}
+	thread_count = count;
+}
+
 #ifdef ARM32
 uint32_t __nostackcheck thread_get_exceptions(void)
 {
@@ -348,7 +446,7 @@ static void print_stack_limits(void)
 		end = GET_STACK_BOTTOM(stack_abt, n);
 		DMSG("abt [%zu] 0x%" PRIxVA "..0x%" PRIxVA, n, start, end);
 	}
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		end = threads[n].stack_va_end;
 		start = end - STACK_THREAD_SIZE;
 		DMSG("thr [%zu] 0x%" PRIxVA "..0x%" PRIxVA, n, start, end);
@@ -514,41 +612,38 @@ void thread_init_boot_thread(void)
 
 	thread_init_threads();
 
-	l->curr_thread = 0;
-	threads[0].state = THREAD_STATE_ACTIVE;
+	thread_lock_global();
+	l->curr_thread = get_free_thread();
+	busy_start(l->curr_thread);
+	thread_unlock_global();
+	assert(l->curr_thread == 0);
 }
 
 void __nostackcheck thread_clr_boot_thread(void)
 {
 	struct thread_core_local *l = thread_get_core_local();
 
-	assert(l->curr_thread >= 0 && l->curr_thread < CFG_NUM_THREADS);
+	assert(l->curr_thread >= 0 && l->curr_thread < (int)thread_count);
 	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
-	threads[l->curr_thread].state = THREAD_STATE_FREE;
+	/* Only the boot CPU is running, no need to lock */
+	put_free_thread(l->curr_thread);
 	l->curr_thread = -1;
 }
 
 void thread_alloc_and_run(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
 {
-	size_t n;
+	short int n = 0;
 	struct thread_core_local *l = thread_get_core_local();
-	bool found_thread = false;
 
 	assert(l->curr_thread == -1);
 
 	thread_lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
-		}
-	}
-
+	n = get_free_thread();
+	if (n >= 0)
+		busy_start(n);
 	thread_unlock_global();
 
-	if (!found_thread)
+	if (n < 0)
 		return;
 
 	l->curr_thread = n;
@@ -655,8 +750,9 @@ void thread_resume_from_rpc(uint32_t thread_id, uint32_t a0, uint32_t a1,
 
 	thread_lock_global();
 
-	if (n < CFG_NUM_THREADS && threads[n].state == THREAD_STATE_SUSPENDED) {
+	if (n < thread_count && threads[n].state == THREAD_STATE_SUSPENDED) {
 		threads[n].state = THREAD_STATE_ACTIVE;
+		busy_start(n);
 		found_thread = true;
 	}
 
@@ -821,7 +917,8 @@ void thread_state_free(void)
 	thread_lock_global();
 
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
-	threads[ct].state = THREAD_STATE_FREE;
+	busy_stop(ct);
+	put_free_thread(ct);
 	threads[ct].flags = 0;
 	l->curr_thread = -1;
 
@@ -882,6 +979,7 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 	thread_lock_global();
 
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
+	busy_stop(ct);
 	threads[ct].flags |= flags;
 	threads[ct].regs.cpsr = cpsr;
 	threads[ct].regs.pc = pc;
@@ -941,7 +1039,7 @@ static void set_abt_stack(struct thread_core_local *l, vaddr_t sp)
 
 bool thread_init_stack(uint32_t thread_id, vaddr_t sp)
 {
-	if (thread_id >= CFG_NUM_THREADS)
+	if (thread_id >= thread_count)
 		return false;
 	threads[thread_id].stack_va_end = sp;
 	return true;
@@ -978,7 +1076,7 @@ static void init_thread_stacks(void)
 	/*
 	 * Allocate virtual memory for thread stacks.
 	 */
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		tee_mm_entry_t *mm = NULL;
 		vaddr_t sp = 0;
 		size_t num_pages = 0;
@@ -1014,7 +1112,7 @@ static void init_thread_stacks(void)
 	size_t n;
 
 	/* Assign the thread stacks */
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		if (!thread_init_stack(n, GET_STACK_BOTTOM(stack_thread, n)))
 			panic("thread_init_stack failed");
 	}
@@ -1056,10 +1154,15 @@ void thread_init_threads(void)
 
 	mutex_lockdep_init();
 
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		TAILQ_INIT(&threads[n].tsd.sess_stack);
 		SLIST_INIT(&threads[n].tsd.pgt_cache);
 	}
+
+	/* Thread 0 on top of the stack of free threads, used first */
+	thread_num_free = 0;
+	for (n = thread_count; n > 0; n--)
+		put_free_thread(n - 1);
 }
 
 void __nostackcheck thread_init_thread_core_local(void)
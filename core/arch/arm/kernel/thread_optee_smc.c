@@ -235,7 +235,7 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 
 	thread_lock_global();
 
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		if (threads[n].state != THREAD_STATE_FREE) {
 			rv = false;
 			goto out;
@@ -243,7 +243,7 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	}
 
 	rv = true;
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		if (threads[n].rpc_arg) {
 			*cookie = mobj_get_cookie(threads[n].rpc_mobj);
 			mobj_put(threads[n].rpc_mobj);
@@ -268,7 +268,7 @@ bool thread_enable_prealloc_rpc_cache(void)
 
 	thread_lock_global();
 
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
+	for (n = 0; n < thread_count; n++) {
 		if (threads[n].state != THREAD_STATE_FREE) {
 			rv = false;
 			goto out;
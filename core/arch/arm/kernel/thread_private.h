@@ -100,6 +100,7 @@ struct thread_ctx {
 extern const void *stack_tmp_export;
 extern const uint32_t stack_tmp_stride;
 extern struct thread_ctx threads[];
+extern size_t thread_count;
 
 /*
  * During boot note the part of code and data that needs to be mapped while
@@ -760,7 +760,7 @@ TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 	 * until this context is fully initialized. This is needed to
 	 * handle single instance TAs.
 	 */
-	TAILQ_INSERT_TAIL(&tee_ctxes, &utc->ta_ctx, link);
+	tee_ta_register_ctx(&utc->ta_ctx);
 	mutex_unlock(&tee_ta_mutex);
 
 	/*
@@ -781,7 +781,7 @@ TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 		utc->is_initializing = false;
 	} else {
 		s->ts_sess.ctx = NULL;
-		TAILQ_REMOVE(&tee_ctxes, &utc->ta_ctx, link);
+		tee_ta_unregister_ctx(&utc->ta_ctx);
 	}
 
 	/* The state has changed for the context, notify eventual waiters. */
@@ -12,6 +12,7 @@
 #include <kernel/refcount.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_misc.h>
+#include <mm/cookie_hash.h>
 #include <mm/core_mmu.h>
 #include <mm/mobj.h>
 #include <mm/tee_pager.h>
@@ -33,8 +34,7 @@ static size_t shm_release_waiters;
 
 struct mobj_reg_shm {
 	struct mobj mobj;
-	SLIST_ENTRY(mobj_reg_shm) next;
-	uint64_t cookie;
+	struct cookie_hash_elem ce;
 	tee_mm_entry_t *mm;
 	paddr_t page_offset;
 	struct refcount mapcount;
@@ -55,8 +55,7 @@ static size_t mobj_reg_shm_size(size_t nr_pages)
 	return s;
 }
 
-static SLIST_HEAD(reg_shm_head, mobj_reg_shm) reg_shm_list =
-	SLIST_HEAD_INITIALIZER(reg_shm_head);
+static struct cookie_hash reg_shm_hash = COOKIE_HASH_INITIALIZER;
 
 static unsigned int reg_shm_slist_lock = SPINLOCK_UNLOCK;
 static unsigned int reg_shm_map_lock = SPINLOCK_UNLOCK;
@@ -129,7 +128,7 @@ static void reg_shm_free_helper(struct mobj_reg_shm *mobj_reg_shm)
 
 	cpu_spin_unlock_xrestore(&reg_shm_map_lock, exceptions);
 
-	SLIST_REMOVE(&reg_shm_list, mobj_reg_shm, mobj_reg_shm, next);
+	cookie_hash_remove(&mobj_reg_shm->ce);
 	free(mobj_reg_shm);
 }
 
@@ -234,7 +233,7 @@ static bool mobj_reg_shm_matches(struct mobj *mobj, enum buf_is_attr attr);
 
 static uint64_t mobj_reg_shm_get_cookie(struct mobj *mobj)
 {
-	return to_mobj_reg_shm(mobj)->cookie;
+	return to_mobj_reg_shm(mobj)->ce.cookie;
 }
 
 static const struct mobj_ops mobj_reg_shm_ops __rodata_unpaged = {
@@ -285,7 +284,6 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 	mobj_reg_shm->mobj.size = num_pages * SMALL_PAGE_SIZE - page_offset;
 	mobj_reg_shm->mobj.phys_granule = SMALL_PAGE_SIZE;
 	refcount_set(&mobj_reg_shm->mobj.refc, 1);
-	mobj_reg_shm->cookie = cookie;
 	mobj_reg_shm->guarded = true;
 	mobj_reg_shm->page_offset = page_offset;
 	memcpy(mobj_reg_shm->pages, pages, sizeof(*pages) * num_pages);
@@ -302,7 +300,7 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 	}
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_INSERT_HEAD(&reg_shm_list, mobj_reg_shm, next);
+	cookie_hash_add(&reg_shm_hash, &mobj_reg_shm->ce, cookie);
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
 
 	return &mobj_reg_shm->mobj;
@@ -321,13 +319,11 @@ void mobj_reg_shm_unguard(struct mobj *mobj)
 
 static struct mobj_reg_shm *reg_shm_find_unlocked(uint64_t cookie)
 {
-	struct mobj_reg_shm *mobj_reg_shm = NULL;
-
-	SLIST_FOREACH(mobj_reg_shm, &reg_shm_list, next)
-		if (mobj_reg_shm->cookie == cookie)
-			return mobj_reg_shm;
+	struct cookie_hash_elem *ce = cookie_hash_find(&reg_shm_hash, cookie);
 
-	return NULL;
+	if (!ce)
+		return NULL;
+	return container_of(ce, struct mobj_reg_shm, ce);
 }
 
 struct mobj *mobj_reg_shm_get_by_cookie(uint64_t cookie)
@@ -9,31 +9,32 @@
 #include <keep.h>
 #include <kernel/refcount.h>
 #include <kernel/spinlock.h>
+#include <mm/cookie_hash.h>
 #include <mm/mobj.h>
-#include <sys/queue.h>
 
 struct mobj_ffa {
 	struct mobj mobj;
-	SLIST_ENTRY(mobj_ffa) link;
-	uint64_t cookie;
+	/* ce.cookie is valid also while the mobj isn't in shm_hash */
+	struct cookie_hash_elem ce;
 	tee_mm_entry_t *mm;
 	struct refcount mapcount;
 	uint16_t page_offset;
+	bool inactive;
 	bool registered_by_cookie;
 	bool unregistered_by_cookie;
 	paddr_t pages[];
 };
 
-SLIST_HEAD(mobj_ffa_head, mobj_ffa);
-
 #ifdef CFG_CORE_SEL1_SPMC
 #define NUM_SHMS	64
 static bitstr_t bit_decl(shm_bits, NUM_SHMS);
 #endif
 
-static struct mobj_ffa_head shm_head = SLIST_HEAD_INITIALIZER(shm_head);
-static struct mobj_ffa_head shm_inactive_head =
-	SLIST_HEAD_INITIALIZER(shm_inactive_head);
+/*
+ * Both active and inactive mobjs are indexed by cookie in shm_hash, a
+ * cookie is only used by one mobj at a time.
+ */
+static struct cookie_hash shm_hash = COOKIE_HASH_INITIALIZER;
 
 static unsigned int shm_lock = SPINLOCK_UNLOCK;
 
@@ -98,7 +99,7 @@ struct mobj_ffa *mobj_ffa_sel1_spmc_new(unsigned int num_pages)
 		 * + 1 to avoid a cookie value 0, setting bit 44 to use one
 		 * of the upper 32 bits too for testing.
 		 */
-		mf->cookie = (i + 1) | BIT64(44);
+		mf->ce.cookie = (i + 1) | BIT64(44);
 	}
 	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
 
@@ -116,62 +117,19 @@ static size_t get_page_count(struct mobj_ffa *mf)
 	return ROUNDUP(mf->mobj.size, SMALL_PAGE_SIZE) / SMALL_PAGE_SIZE;
 }
 
-static bool cmp_cookie(struct mobj_ffa *mf, uint64_t cookie)
-{
-	return mf->cookie == cookie;
-}
-
-static bool cmp_ptr(struct mobj_ffa *mf, uint64_t ptr)
+static struct mobj_ffa *find_in_hash(uint64_t cookie)
 {
-	return mf == (void *)(vaddr_t)ptr;
-}
-
-static struct mobj_ffa *pop_from_list(struct mobj_ffa_head *head,
-				      bool (*cmp_func)(struct mobj_ffa *mf,
-						       uint64_t val),
-				      uint64_t val)
-{
-	struct mobj_ffa *mf = SLIST_FIRST(head);
-	struct mobj_ffa *p = NULL;
+	struct cookie_hash_elem *ce = cookie_hash_find(&shm_hash, cookie);
 
-	if (!mf)
+	if (!ce)
 		return NULL;
-
-	if (cmp_func(mf, val)) {
-		SLIST_REMOVE_HEAD(head, link);
-		return mf;
-	}
-
-	while (true) {
-		p = SLIST_NEXT(mf, link);
-		if (!p)
-			return NULL;
-		if (cmp_func(p, val)) {
-			SLIST_REMOVE_AFTER(mf, link);
-			return p;
-		}
-		mf = p;
-	}
-}
-
-static struct mobj_ffa *find_in_list(struct mobj_ffa_head *head,
-				     bool (*cmp_func)(struct mobj_ffa *mf,
-						      uint64_t val),
-				     uint64_t val)
-{
-	struct mobj_ffa *mf = NULL;
-
-	SLIST_FOREACH(mf, head, link)
-		if (cmp_func(mf, val))
-			return mf;
-
-	return NULL;
+	return container_of(ce, struct mobj_ffa, ce);
 }
 
 #ifdef CFG_CORE_SEL1_SPMC
 void mobj_ffa_sel1_spmc_delete(struct mobj_ffa *mf)
 {
-	int i = (mf->cookie - 1) & ~BIT64(44);
+	int i = (mf->ce.cookie - 1) & ~BIT64(44);
 	uint32_t exceptions = 0;
 
 	assert(i >= 0 && i < NUM_SHMS);
@@ -207,7 +165,7 @@ TEE_Result mobj_ffa_add_pages_at(struct mobj_ffa *mf, unsigned int *idx,
 
 uint64_t mobj_ffa_get_cookie(struct mobj_ffa *mf)
 {
-	return mf->cookie;
+	return mf->ce.cookie;
 }
 
 uint64_t mobj_ffa_push_to_inactive(struct mobj_ffa *mf)
@@ -215,13 +173,12 @@ uint64_t mobj_ffa_push_to_inactive(struct mobj_ffa *mf)
 	uint32_t exceptions = 0;
 
 	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	assert(!find_in_list(&shm_inactive_head, cmp_ptr, (vaddr_t)mf));
-	assert(!find_in_list(&shm_inactive_head, cmp_cookie, mf->cookie));
-	assert(!find_in_list(&shm_head, cmp_cookie, mf->cookie));
-	SLIST_INSERT_HEAD(&shm_inactive_head, mf, link);
+	assert(!find_in_hash(mf->ce.cookie));
+	mf->inactive = true;
+	cookie_hash_add(&shm_hash, &mf->ce, mf->ce.cookie);
 	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
 
-	return mf->cookie;
+	return mf->ce.cookie;
 }
 
 static void unmap_helper(struct mobj_ffa *mf)
@@ -241,18 +198,16 @@ TEE_Result mobj_ffa_unregister_by_cookie(uint64_t cookie)
 	uint32_t exceptions = 0;
 
 	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	mf = find_in_list(&shm_head, cmp_cookie, cookie);
+	mf = find_in_hash(cookie);
 	/*
-	 * If the mobj is found here it's still active and cannot be
-	 * unregistered.
+	 * If the mobj is still active it cannot be unregistered.
 	 */
-	if (mf) {
+	if (mf && !mf->inactive) {
 		DMSG("cookie %#"PRIx64" busy refc %u",
 		     cookie, refcount_val(&mf->mobj.refc));
 		res = TEE_ERROR_BUSY;
 		goto out;
 	}
-	mf = find_in_list(&shm_inactive_head, cmp_cookie, cookie);
 	/*
 	 * If the mobj isn't found or if it already has been unregistered.
 	 */
@@ -276,19 +231,17 @@ TEE_Result mobj_ffa_sel1_spmc_reclaim(uint64_t cookie)
 	uint32_t exceptions = 0;
 
 	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	mf = find_in_list(&shm_head, cmp_cookie, cookie);
+	mf = find_in_hash(cookie);
 	/*
-	 * If the mobj is found here it's still active and cannot be
-	 * reclaimed.
+	 * If the mobj is still active it cannot be reclaimed.
 	 */
-	if (mf) {
+	if (mf && !mf->inactive) {
 		DMSG("cookie %#"PRIx64" busy refc %u",
 		     cookie, refcount_val(&mf->mobj.refc));
 		res = TEE_ERROR_BUSY;
 		goto out;
 	}
 
-	mf = find_in_list(&shm_inactive_head, cmp_cookie, cookie);
 	if (!mf) {
 		res = TEE_ERROR_ITEM_NOT_FOUND;
 		goto out;
@@ -303,8 +256,7 @@ TEE_Result mobj_ffa_sel1_spmc_reclaim(uint64_t cookie)
 		goto out;
 	}
 
-	if (!pop_from_list(&shm_inactive_head, cmp_ptr, (vaddr_t)mf))
-		panic();
+	cookie_hash_remove(&mf->ce);
 	res = TEE_SUCCESS;
 out:
 	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
@@ -324,8 +276,8 @@ struct mobj *mobj_ffa_get_by_cookie(uint64_t cookie, unsigned int internal_offs)
 
 	exceptions = cpu_spin_lock_xsave(&shm_lock);
 
-	mf = find_in_list(&shm_head, cmp_cookie, cookie);
-	if (mf) {
+	mf = find_in_hash(cookie);
+	if (mf && !mf->inactive) {
 		if (mf->page_offset == internal_offs) {
 			if (!refcount_inc(&mf->mobj.refc)) {
 				/*
@@ -343,20 +295,17 @@ struct mobj *mobj_ffa_get_by_cookie(uint64_t cookie, unsigned int internal_offs)
 			     cookie, mf->page_offset, internal_offs);
 			mf = NULL;
 		}
-	} else {
-		mf = pop_from_list(&shm_inactive_head, cmp_cookie, cookie);
-		if (mf) {
-			mf->unregistered_by_cookie = false;
-			mf->registered_by_cookie = true;
-			assert(refcount_val(&mf->mobj.refc) == 0);
-			refcount_set(&mf->mobj.refc, 1);
-			refcount_set(&mf->mapcount, 0);
-			mf->mobj.size += mf->page_offset;
-			assert(!(mf->mobj.size & SMALL_PAGE_MASK));
-			mf->mobj.size -= internal_offs;
-			mf->page_offset = internal_offs;
-			SLIST_INSERT_HEAD(&shm_head, mf, link);
-		}
+	} else if (mf) {
+		mf->inactive = false;
+		mf->unregistered_by_cookie = false;
+		mf->registered_by_cookie = true;
+		assert(refcount_val(&mf->mobj.refc) == 0);
+		refcount_set(&mf->mobj.refc, 1);
+		refcount_set(&mf->mapcount, 0);
+		mf->mobj.size += mf->page_offset;
+		assert(!(mf->mobj.size & SMALL_PAGE_MASK));
+		mf->mobj.size -= internal_offs;
+		mf->page_offset = internal_offs;
 	}
 
 	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
@@ -427,19 +376,19 @@ static void ffa_inactivate(struct mobj *mobj)
 	exceptions = cpu_spin_lock_xsave(&shm_lock);
 	/*
 	 * If refcount isn't 0 some other thread has found this mobj in
-	 * shm_head after the mobj_put() that put us here and before we got
+	 * shm_hash after the mobj_put() that put us here and before we got
 	 * the lock.
 	 */
 	if (refcount_val(&mobj->refc)) {
-		DMSG("cookie %#"PRIx64" was resurrected", mf->cookie);
+		DMSG("cookie %#"PRIx64" was resurrected", mf->ce.cookie);
 		goto out;
 	}
 
-	DMSG("cookie %#"PRIx64, mf->cookie);
-	if (!pop_from_list(&shm_head, cmp_ptr, (vaddr_t)mf))
+	DMSG("cookie %#"PRIx64, mf->ce.cookie);
+	if (mf->inactive)
 		panic();
 	unmap_helper(mf);
-	SLIST_INSERT_HEAD(&shm_inactive_head, mf, link);
+	mf->inactive = true;
 out:
 	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
 }
@@ -463,7 +412,7 @@ static bool ffa_matches(struct mobj *mobj __maybe_unused, enum buf_is_attr attr)
 
 static uint64_t ffa_get_cookie(struct mobj *mobj)
 {
-	return to_mobj_ffa(mobj)->cookie;
+	return to_mobj_ffa(mobj)->ce.cookie;
 }
 
 static TEE_Result ffa_inc_map(struct mobj *mobj)
@@ -19,20 +19,262 @@ static void *pmalloc(tee_mm_pool_t *pool, size_t size)
 		return malloc(size);
 }
 
-static void *pcalloc(tee_mm_pool_t *pool, size_t num_el, size_t size)
+static void pfree(tee_mm_pool_t *pool, void *ptr)
 {
 	if (pool->flags & TEE_MM_POOL_NEX_MALLOC)
-		return nex_calloc(num_el, size);
+		nex_free(ptr);
 	else
-		return calloc(num_el, size);
+		free(ptr);
 }
 
-static void pfree(tee_mm_pool_t *pool, void *ptr)
+static uint32_t pool_units(tee_mm_pool_t *pool)
 {
-	if (pool->flags & TEE_MM_POOL_NEX_MALLOC)
-		nex_free(ptr);
+	return (pool->hi - pool->lo) >> pool->shift;
+}
+
+static uint32_t entry_end(tee_mm_entry_t *e)
+{
+	return e->offset + e->size;
+}
+
+static unsigned int entry_height(tee_mm_entry_t *e)
+{
+	if (!e)
+		return 0;
+	return e->height;
+}
+
+static int entry_balance(tee_mm_entry_t *e)
+{
+	return (int)entry_height(e->left) - (int)entry_height(e->right);
+}
+
+static void entry_update(tee_mm_entry_t *e)
+{
+	unsigned int hl = entry_height(e->left);
+	unsigned int hr = entry_height(e->right);
+
+	e->height = MAX(hl, hr) + 1;
+	e->max_gap = e->gap;
+	if (e->left && e->left->max_gap > e->max_gap)
+		e->max_gap = e->left->max_gap;
+	if (e->right && e->right->max_gap > e->max_gap)
+		e->max_gap = e->right->max_gap;
+}
+
+static tee_mm_entry_t *entry_first(tee_mm_entry_t *e)
+{
+	if (e)
+		while (e->left)
+			e = e->left;
+	return e;
+}
+
+static tee_mm_entry_t *entry_last(tee_mm_entry_t *e)
+{
+	if (e)
+		while (e->right)
+			e = e->right;
+	return e;
+}
+
+static tee_mm_entry_t *entry_next(tee_mm_entry_t *e)
+{
+	if (e->right)
+		return entry_first(e->right);
+	while (e->parent && e->parent->right == e)
+		e = e->parent;
+	return e->parent;
+}
+
+static tee_mm_entry_t *entry_prev(tee_mm_entry_t *e)
+{
+	if (e->left)
+		return entry_last(e->left);
+	while (e->parent && e->parent->left == e)
+		e = e->parent;
+	return e->parent;
+}
+
+static void replace_child(tee_mm_pool_t *pool, tee_mm_entry_t *parent,
+			  tee_mm_entry_t *old, tee_mm_entry_t *new)
+{
+	if (!parent)
+		pool->root = new;
+	else if (parent->left == old)
+		parent->left = new;
 	else
-		free(ptr);
+		parent->right = new;
+	if (new)
+		new->parent = parent;
+}
+
+static tee_mm_entry_t *rotate_left(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *r = e->right;
+
+	e->right = r->left;
+	if (r->left)
+		r->left->parent = e;
+	replace_child(pool, e->parent, e, r);
+	r->left = e;
+	e->parent = r;
+	entry_update(e);
+	entry_update(r);
+
+	return r;
+}
+
+static tee_mm_entry_t *rotate_right(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *l = e->left;
+
+	e->left = l->right;
+	if (l->right)
+		l->right->parent = e;
+	replace_child(pool, e->parent, e, l);
+	l->right = e;
+	e->parent = l;
+	entry_update(e);
+	entry_update(l);
+
+	return l;
+}
+
+/*
+ * Updates height and max_gap of @e and all its ancestors, rebalancing the
+ * tree on the way up.
+ */
+static void fixup(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	int b = 0;
+
+	while (e) {
+		entry_update(e);
+		b = entry_balance(e);
+		if (b > 1) {
+			if (entry_balance(e->left) < 0)
+				rotate_left(pool, e->left);
+			e = rotate_right(pool, e);
+		} else if (b < -1) {
+			if (entry_balance(e->right) > 0)
+				rotate_right(pool, e->right);
+			e = rotate_left(pool, e);
+		}
+		e = e->parent;
+	}
+}
+
+/* Inserts @nn just before @next, or last if @next is NULL */
+static void insert_entry(tee_mm_pool_t *pool, tee_mm_entry_t *nn,
+			 tee_mm_entry_t *next)
+{
+	tee_mm_entry_t *prev = NULL;
+	tee_mm_entry_t *parent = NULL;
+
+	if (next)
+		prev = entry_prev(next);
+	else
+		prev = entry_last(pool->root);
+
+	nn->gap = nn->offset;
+	if (prev)
+		nn->gap -= entry_end(prev);
+	nn->left = NULL;
+	nn->right = NULL;
+
+	if (next && !next->left) {
+		parent = next;
+		parent->left = nn;
+	} else {
+		if (next)
+			parent = entry_last(next->left);
+		else
+			parent = prev;
+		if (parent)
+			parent->right = nn;
+		else
+			pool->root = nn;
+	}
+	nn->parent = parent;
+	fixup(pool, nn);
+
+	if (next) {
+		next->gap = next->offset - entry_end(nn);
+		fixup(pool, next);
+	}
+}
+
+static void remove_entry(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *next = entry_next(e);
+	tee_mm_entry_t *start = NULL;
+
+	if (!e->left || !e->right) {
+		start = e->parent;
+		replace_child(pool, e->parent, e, e->left ? e->left : e->right);
+	} else {
+		/* The next entry is the leftmost of the right subtree */
+		if (next->parent != e) {
+			start = next->parent;
+			replace_child(pool, next->parent, next, next->right);
+			next->right = e->right;
+			next->right->parent = next;
+		} else {
+			start = next;
+		}
+		replace_child(pool, e->parent, e, next);
+		next->left = e->left;
+		next->left->parent = next;
+	}
+	fixup(pool, start);
+
+	if (next) {
+		next->gap += e->gap + e->size;
+		fixup(pool, next);
+	}
+}
+
+/* Returns the lowest entry with a gap of at least @psize below it */
+static tee_mm_entry_t *find_first_gap(tee_mm_entry_t *e, size_t psize)
+{
+	if (!e || e->max_gap < psize)
+		return NULL;
+
+	while (true) {
+		if (e->left && e->left->max_gap >= psize)
+			e = e->left;
+		else if (e->gap >= psize)
+			return e;
+		else
+			e = e->right;
+	}
+}
+
+/* Returns the highest entry with a gap of at least @psize below it */
+static tee_mm_entry_t *find_last_gap(tee_mm_entry_t *e, size_t psize)
+{
+	if (!e || e->max_gap < psize)
+		return NULL;
+
+	while (true) {
+		if (e->right && e->right->max_gap >= psize)
+			e = e->right;
+		else if (e->gap >= psize)
+			return e;
+		else
+			e = e->left;
+	}
+}
+
+/* Returns the free pages/sections above the last entry */
+static uint32_t tail_gap(tee_mm_pool_t *pool)
+{
+	tee_mm_entry_t *last = entry_last(pool->root);
+
+	if (!last)
+		return pool_units(pool);
+	return pool_units(pool) - entry_end(last);
 }
 
 bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
@@ -50,53 +292,33 @@ bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
 	pool->hi = hi;
 	pool->shift = shift;
 	pool->flags = flags;
-	pool->entry = pcalloc(pool, 1, sizeof(tee_mm_entry_t));
-
-	if (pool->entry == NULL)
-		return false;
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		pool->entry->offset = ((hi - lo - 1) >> shift) + 1;
-	pool->entry->pool = pool;
+	pool->root = NULL;
+#ifdef CFG_WITH_STATS
+	pool->allocated = 0;
+#endif
 	pool->lock = SPINLOCK_UNLOCK;
+	pool->initialized = true;
 
 	return true;
 }
 
 void tee_mm_final(tee_mm_pool_t *pool)
 {
-	if (pool == NULL || pool->entry == NULL)
+	if (pool == NULL || !pool->initialized)
 		return;
 
-	while (pool->entry->next != NULL)
-		tee_mm_free(pool->entry->next);
-	pfree(pool, pool->entry);
-	pool->entry = NULL;
-}
-
-static void tee_mm_add(tee_mm_entry_t *p, tee_mm_entry_t *nn)
-{
-	/* add to list */
-	nn->next = p->next;
-	p->next = nn;
+	while (pool->root)
+		tee_mm_free(pool->root);
+	pool->initialized = false;
 }
 
 #ifdef CFG_WITH_STATS
 static size_t tee_mm_stats_allocated(tee_mm_pool_t *pool)
 {
-	tee_mm_entry_t *entry;
-	uint32_t sz = 0;
-
 	if (!pool)
 		return 0;
 
-	entry = pool->entry;
-	while (entry) {
-		sz += entry->size;
-		entry = entry->next;
-	}
-
-	return sz << pool->shift;
+	return pool->allocated << pool->shift;
 }
 
 void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
@@ -120,15 +342,25 @@ void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 }
 
-static void update_max_allocated(tee_mm_pool_t *pool)
+static void update_allocated(tee_mm_pool_t *pool, tee_mm_entry_t *mm,
+			     bool alloc)
 {
-	size_t sz = tee_mm_stats_allocated(pool);
+	size_t sz = 0;
 
+	if (!alloc) {
+		pool->allocated -= mm->size;
+		return;
+	}
+
+	pool->allocated += mm->size;
+	sz = tee_mm_stats_allocated(pool);
 	if (sz > pool->max_allocated)
 		pool->max_allocated = sz;
 }
 #else /* CFG_WITH_STATS */
-static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
+static inline void update_allocated(tee_mm_pool_t *pool __unused,
+				    tee_mm_entry_t *mm __unused,
+				    bool alloc __unused)
 {
 }
 #endif /* CFG_WITH_STATS */
@@ -136,13 +368,12 @@ static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
 tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 {
 	size_t psize;
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *next = NULL;
 	tee_mm_entry_t *nn;
-	size_t remaining;
 	uint32_t exceptions;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->initialized)
 		return NULL;
 
 	nn = pmalloc(pool, sizeof(tee_mm_entry_t));
@@ -151,65 +382,42 @@ tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	entry = pool->entry;
 	if (size == 0)
 		psize = 0;
 	else
 		psize = ((size - 1) >> pool->shift) + 1;
 
-	/* find free slot */
+	/*
+	 * Find a free slot, first fit starting from the low end of the
+	 * pool or, with TEE_MM_POOL_HI_ALLOC, from the high end of the
+	 * pool. The memory is taken from the end of the free slot where
+	 * the search started.
+	 */
 	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL && psize >
-		       (entry->offset - entry->next->offset -
-			entry->next->size))
-			entry = entry->next;
+		if (tail_gap(pool) >= psize) {
+			nn->offset = pool_units(pool) - psize;
+		} else {
+			next = find_last_gap(pool->root, psize);
+			if (!next)
+				goto err; /* out of memory */
+			nn->offset = next->offset - psize;
+		}
 	} else {
-		while (entry->next != NULL && psize >
-		       (entry->next->offset - entry->size - entry->offset))
-			entry = entry->next;
-	}
-
-	/* check if we have enough memory */
-	if (entry->next == NULL) {
-		if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-			/*
-			 * entry->offset is a "block count" offset from
-			 * pool->lo. The byte offset is
-			 * (entry->offset << pool->shift).
-			 * In the HI_ALLOC allocation scheme the memory is
-			 * allocated from the end of the segment, thus to
-			 * validate there is sufficient memory validate that
-			 * (entry->offset << pool->shift) > size.
-			 */
-			if ((entry->offset << pool->shift) < size) {
-				/* out of memory */
-				goto err;
-			}
+		next = find_first_gap(pool->root, psize);
+		if (next) {
+			nn->offset = next->offset - next->gap;
 		} else {
-			if (pool->hi <= pool->lo)
-				panic("invalid pool");
-
-			remaining = (pool->hi - pool->lo);
-			remaining -= ((entry->offset + entry->size) <<
-				      pool->shift);
-
-			if (remaining < size) {
-				/* out of memory */
-				goto err;
-			}
+			if (tail_gap(pool) < psize)
+				goto err; /* out of memory */
+			nn->offset = pool_units(pool) - tail_gap(pool);
 		}
 	}
 
-	tee_mm_add(entry, nn);
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		nn->offset = entry->offset - psize;
-	else
-		nn->offset = entry->offset + entry->size;
 	nn->size = psize;
 	nn->pool = pool;
+	insert_entry(pool, nn, next);
 
-	update_max_allocated(pool);
+	update_allocated(pool, nn, true);
 
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 	return nn;
@@ -219,37 +427,18 @@ err:
 	return NULL;
 }
 
-static inline bool fit_in_gap(tee_mm_pool_t *pool, tee_mm_entry_t *e,
-			      paddr_t offslo, paddr_t offshi)
-{
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		if (offshi > e->offset ||
-		    (e->next != NULL &&
-		     (offslo < e->next->offset + e->next->size)) ||
-		    (offshi << pool->shift) - 1 > (pool->hi - pool->lo))
-			/* memory not available */
-			return false;
-	} else {
-		if (offslo < (e->offset + e->size) ||
-		    (e->next != NULL && (offshi > e->next->offset)) ||
-		    (offshi << pool->shift) > (pool->hi - pool->lo))
-			/* memory not available */
-			return false;
-	}
-
-	return true;
-}
-
 tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 {
+	tee_mm_entry_t *next = NULL;
 	tee_mm_entry_t *entry;
 	paddr_t offslo;
 	paddr_t offshi;
+	paddr_t prev_end;
 	tee_mm_entry_t *mm;
 	uint32_t exceptions;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->initialized)
 		return NULL;
 
 	/* Wrapping and sanity check */
@@ -262,31 +451,40 @@ tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	entry = pool->entry;
 	offslo = (base - pool->lo) >> pool->shift;
 	offshi = ((base - pool->lo + size - 1) >> pool->shift) + 1;
 
-	/* find slot */
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL &&
-		       offshi < entry->next->offset + entry->next->size)
-			entry = entry->next;
-	} else {
-		while (entry->next != NULL && offslo > entry->next->offset)
-			entry = entry->next;
+	if (offshi > pool_units(pool))
+		goto err; /* memory not available */
+
+	/* find the first entry above offslo */
+	entry = pool->root;
+	while (entry) {
+		if (entry->offset > offslo) {
+			next = entry;
+			entry = entry->left;
+		} else {
+			entry = entry->right;
+		}
 	}
 
 	/* Check that memory is available */
-	if (!fit_in_gap(pool, entry, offslo, offshi))
+	if (next) {
+		if (offshi > next->offset)
+			goto err;
+		prev_end = next->offset - next->gap;
+	} else {
+		prev_end = pool_units(pool) - tail_gap(pool);
+	}
+	if (offslo < prev_end)
 		goto err;
 
-	tee_mm_add(entry, mm);
-
 	mm->offset = offslo;
 	mm->size = offshi - offslo;
 	mm->pool = pool;
+	insert_entry(pool, mm, next);
 
-	update_max_allocated(pool);
+	update_allocated(pool, mm, true);
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 	return mm;
 err:
@@ -304,16 +502,16 @@ void tee_mm_free(tee_mm_entry_t *p)
 		return;
 
 	exceptions = cpu_spin_lock_xsave(&p->pool->lock);
-	entry = p->pool->entry;
-
-	/* remove entry from list */
-	while (entry->next != NULL && entry->next != p)
-		entry = entry->next;
 
-	if (!entry->next)
+	/* check that the entry is in the tree */
+	entry = p;
+	while (entry->parent)
+		entry = entry->parent;
+	if (entry != p->pool->root)
 		panic("invalid mm_entry");
 
-	entry->next = entry->next->next;
+	remove_entry(p->pool, p);
+	update_allocated(p->pool, p, false);
 	cpu_spin_unlock_xrestore(&p->pool->lock, exceptions);
 
 	pfree(p->pool, p);
@@ -337,11 +535,11 @@ bool tee_mm_is_empty(tee_mm_pool_t *pool)
 	bool ret;
 	uint32_t exceptions;
 
-	if (pool == NULL || pool->entry == NULL)
+	if (pool == NULL || !pool->initialized)
 		return true;
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
-	ret = pool->entry == NULL || pool->entry->next == NULL;
+	ret = !pool->root;
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 
 	return ret;
@@ -358,8 +556,8 @@ tee_mm_pool_t tee_mm_shm;
 
 tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, paddr_t addr)
 {
-	tee_mm_entry_t *entry = pool->entry;
-	uint16_t offset = (addr - pool->lo) >> pool->shift;
+	tee_mm_entry_t *entry = NULL;
+	uint32_t offset = (addr - pool->lo) >> pool->shift;
 	uint32_t exceptions;
 
 	if (addr > pool->hi || addr < pool->lo)
@@ -367,19 +565,18 @@ tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, paddr_t addr)
 
 	exceptions = cpu_spin_lock_xsave(&((tee_mm_pool_t *)pool)->lock);
 
-	while (entry->next != NULL) {
-		entry = entry->next;
-
-		if ((offset >= entry->offset) &&
-		    (offset < (entry->offset + entry->size))) {
-			cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock,
-						 exceptions);
-			return entry;
-		}
+	entry = pool->root;
+	while (entry) {
+		if (offset < entry->offset)
+			entry = entry->left;
+		else if (offset >= entry_end(entry))
+			entry = entry->right;
+		else
+			break;
 	}
 
 	cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock, exceptions);
-	return NULL;
+	return entry;
 }
 
 uintptr_t tee_mm_get_smem(const tee_mm_entry_t *mm)
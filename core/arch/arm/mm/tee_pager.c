@@ -12,6 +12,7 @@
 #include <kernel/asan.h>
 #include <kernel/cache_helpers.h>
 #include <kernel/linker.h>
+#include <kernel/misc.h>
 #include <kernel/panic.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_misc.h>
@@ -38,6 +39,15 @@ static struct tee_pager_area_head tee_pager_area_head =
 #define INVALID_PGIDX		UINT_MAX
 #define PMEM_FLAG_DIRTY		BIT(0)
 #define PMEM_FLAG_HIDDEN	BIT(1)
+#define PMEM_FLAG_HOT		BIT(2)
+#define PMEM_FLAG_READAHEAD	BIT(3)
+#define PMEM_FLAG_LOADING	BIT(4)
+
+/*
+ * Maximum number of read ahead pages loaded and verified together, the
+ * dirty pages evicted to make room for them are saved together.
+ */
+#define PAGER_LOAD_BATCH	4
 
 /*
  * struct tee_pager_pmem - Represents a physical page used for paging.
@@ -48,6 +58,8 @@ static struct tee_pager_area_head tee_pager_area_head =
  * @va_alias	Virtual address where the physical page always is aliased.
  *		Used during remapping of the page when the content need to
  *		be updated before it's available at the new location.
+ * @link	Link in tee_pager_pmem_head or tee_pager_lock_pmem_head
+ * @policy_link	Link in a queue of the page replacement policy
  */
 struct tee_pager_pmem {
 	unsigned int flags;
@@ -55,9 +67,13 @@ struct tee_pager_pmem {
 	struct fobj *fobj;
 	void *va_alias;
 	TAILQ_ENTRY(tee_pager_pmem) link;
+	TAILQ_ENTRY(tee_pager_pmem) policy_link;
 };
 
-/* The list of physical pages. The first page in the list is the oldest */
+/*
+ * The list of pageable physical pages, in no particular order. The page
+ * replacement policy keeps track of the order in which pages are evicted.
+ */
 TAILQ_HEAD(tee_pager_pmem_head, tee_pager_pmem);
 
 static struct tee_pager_pmem_head tee_pager_pmem_head =
@@ -66,9 +82,6 @@ static struct tee_pager_pmem_head tee_pager_pmem_head =
 static struct tee_pager_pmem_head tee_pager_lock_pmem_head =
 	TAILQ_HEAD_INITIALIZER(tee_pager_lock_pmem_head);
 
-/* number of pages hidden */
-#define TEE_PAGER_NHIDE (tee_pager_npages / 3)
-
 /* Number of registered physical pages, used hiding pages. */
 static size_t tee_pager_npages;
 
@@ -95,6 +108,31 @@ static inline void incr_zi_released(void)
 	pager_stats.zi_released++;
 }
 
+static inline void incr_evictions(void)
+{
+	pager_stats.evictions++;
+}
+
+static inline void __maybe_unused incr_ghost_hits(void)
+{
+	pager_stats.ghost_hits++;
+}
+
+static inline void incr_readahead(void)
+{
+	pager_stats.readahead++;
+}
+
+static inline void incr_readahead_hits(void)
+{
+	pager_stats.readahead_hits++;
+}
+
+static inline void incr_readahead_waste(void)
+{
+	pager_stats.readahead_waste++;
+}
+
 static inline void incr_npages_all(void)
 {
 	pager_stats.npages_all++;
@@ -113,6 +151,85 @@ void tee_pager_get_stats(struct tee_pager_stats *stats)
 	pager_stats.ro_hits = 0;
 	pager_stats.rw_hits = 0;
 	pager_stats.zi_released = 0;
+	pager_stats.evictions = 0;
+	pager_stats.ghost_hits = 0;
+	pager_stats.readahead = 0;
+	pager_stats.readahead_hits = 0;
+	pager_stats.readahead_waste = 0;
+}
+
+/*
+ * Fault latency histogram of each core, bucket n > 0 counts the faults
+ * which took at least 2^(n - 1) but less than 2^n microseconds.
+ */
+#define FAULT_LAT_BUCKETS	32
+
+struct fault_latency {
+	size_t bucket[FAULT_LAT_BUCKETS];
+	uint32_t max;
+};
+
+static struct fault_latency pager_fault_latency[CFG_TEE_CORE_NB_CORE];
+
+static uint64_t stat_fault_start(void)
+{
+	return read_cntpct();
+}
+
+/* Called with the pager lock held */
+static void stat_fault_latency(uint64_t start)
+{
+	struct fault_latency *lat = pager_fault_latency + get_core_pos();
+	uint64_t us = (read_cntpct() - start) * 1000000 / read_cntfrq();
+	unsigned int n = 0;
+
+	if (us > UINT32_MAX)
+		us = UINT32_MAX;
+	if (us)
+		n = MIN(32 - __builtin_clz(us), FAULT_LAT_BUCKETS - 1);
+	lat->bucket[n]++;
+	if (us > lat->max)
+		lat->max = us;
+}
+
+static uint32_t fault_lat_percentile(struct fault_latency *lat, size_t count,
+				     unsigned int percent)
+{
+	size_t target = (count * percent + 99) / 100;
+	size_t sum = 0;
+	size_t n = 0;
+
+	for (n = 0; n < FAULT_LAT_BUCKETS; n++) {
+		sum += lat->bucket[n];
+		if (sum >= target)
+			return MIN((uint32_t)BIT(n), lat->max);
+	}
+
+	return lat->max;
+}
+
+void tee_pager_get_fault_latency(size_t core_pos,
+				 struct tee_pager_fault_latency *stats)
+{
+	struct fault_latency lat = { };
+	size_t n = 0;
+
+	assert(core_pos < CFG_TEE_CORE_NB_CORE);
+
+	/* Like tee_pager_get_stats() without locking, it's only statistics */
+	lat = pager_fault_latency[core_pos];
+	memset(pager_fault_latency + core_pos, 0, sizeof(lat));
+
+	memset(stats, 0, sizeof(*stats));
+	for (n = 0; n < FAULT_LAT_BUCKETS; n++)
+		stats->count += lat.bucket[n];
+	if (!stats->count)
+		return;
+
+	stats->p50 = fault_lat_percentile(&lat, stats->count, 50);
+	stats->p90 = fault_lat_percentile(&lat, stats->count, 90);
+	stats->p99 = fault_lat_percentile(&lat, stats->count, 99);
+	stats->max = lat.max;
 }
 
 #else /* CFG_WITH_STATS */
@@ -120,13 +237,27 @@ static inline void incr_ro_hits(void) { }
 static inline void incr_rw_hits(void) { }
 static inline void incr_hidden_hits(void) { }
 static inline void incr_zi_released(void) { }
+static inline void incr_evictions(void) { }
+static inline void __maybe_unused incr_ghost_hits(void) { }
+static inline void incr_readahead(void) { }
+static inline void incr_readahead_hits(void) { }
+static inline void incr_readahead_waste(void) { }
 static inline void incr_npages_all(void) { }
 static inline void set_npages(void) { }
 
+static inline uint64_t stat_fault_start(void) { return 0; }
+static inline void stat_fault_latency(uint64_t start __unused) { }
+
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
 	memset(stats, 0, sizeof(struct tee_pager_stats));
 }
+
+void tee_pager_get_fault_latency(size_t core_pos __unused,
+				 struct tee_pager_fault_latency *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
 #endif /* CFG_WITH_STATS */
 
 #define TBL_NUM_ENTRIES	(CORE_MMU_PGDIR_SIZE / SMALL_PAGE_SIZE)
@@ -214,6 +345,21 @@ static void pager_unlock(uint32_t exceptions)
 	cpu_spin_unlock_xrestore(&pager_spinlock, exceptions);
 }
 
+/*
+ * Releases the pager lock for a while with exceptions still masked, to
+ * load a page marked with PMEM_FLAG_LOADING without holding up faults on
+ * other cores.
+ */
+static void pager_lock_drop(void)
+{
+	cpu_spin_unlock(&pager_spinlock);
+}
+
+static void pager_lock_retake(void)
+{
+	cpu_spin_lock(&pager_spinlock);
+}
+
 void *tee_pager_phys_to_virt(paddr_t pa)
 {
 	struct core_mmu_table_info ti;
@@ -631,63 +777,476 @@ static paddr_t get_pmem_pa(struct tee_pager_pmem *pmem)
 	return pa;
 }
 
-static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
-			void *va_alias)
+static void set_alias_writable(void *va_alias, bool writable)
+{
+	struct core_mmu_table_info *ti = find_table_info((vaddr_t)va_alias);
+	unsigned int idx = core_mmu_va2idx(ti, (vaddr_t)va_alias);
+	uint32_t attr = 0;
+	paddr_t pa = 0;
+
+	core_mmu_get_entry(ti, idx, &pa, &attr);
+	if (!(attr & TEE_MATTR_PW) == !writable)
+		return;
+
+	if (writable)
+		attr |= TEE_MATTR_PW;
+	else
+		attr &= ~TEE_MATTR_PW;
+	core_mmu_set_entry(ti, idx, pa, attr);
+	tlbi_mva_allasid((vaddr_t)va_alias);
+}
+
+/*
+ * Loads the @num_pages consecutive pages starting at @page_va through the
+ * aliased virtual pages in @va_alias. The pages are handed to the fobj
+ * together so that it can verify them together.
+ */
+static void tee_pager_load_pages(struct tee_pager_area *area,
+				 vaddr_t page_va, void *const *va_alias,
+				 unsigned int num_pages)
 {
 	size_t fobj_pgoffs = ((page_va - area->base) >> SMALL_PAGE_SHIFT) +
 			     area->fobj_pgoffs;
-	struct core_mmu_table_info *ti;
-	uint32_t attr_alias;
-	paddr_t pa_alias;
-	unsigned int idx_alias;
-
-	/* Insure we are allowed to write to aliased virtual page */
-	ti = find_table_info((vaddr_t)va_alias);
-	idx_alias = core_mmu_va2idx(ti, (vaddr_t)va_alias);
-	core_mmu_get_entry(ti, idx_alias, &pa_alias, &attr_alias);
-	if (!(attr_alias & TEE_MATTR_PW)) {
-		attr_alias |= TEE_MATTR_PW;
-		core_mmu_set_entry(ti, idx_alias, pa_alias, attr_alias);
-		tlbi_mva_allasid((vaddr_t)va_alias);
+	unsigned int n = 0;
+
+	for (n = 0; n < num_pages; n++) {
+		/* Insure we are allowed to write to aliased virtual page */
+		set_alias_writable(va_alias[n], true);
+		asan_tag_access(va_alias[n],
+				(uint8_t *)va_alias[n] + SMALL_PAGE_SIZE);
 	}
 
-	asan_tag_access(va_alias, (uint8_t *)va_alias + SMALL_PAGE_SIZE);
-	if (fobj_load_page(area->fobj, fobj_pgoffs, va_alias)) {
+	if (fobj_load_pages(area->fobj, fobj_pgoffs, va_alias, num_pages)) {
 		EMSG("PH 0x%" PRIxVA " failed", page_va);
 		panic();
 	}
-	switch (area->type) {
-	case PAGER_AREA_TYPE_RO:
-		incr_ro_hits();
-		/* Forbid write to aliases for read-only (maybe exec) pages */
-		attr_alias &= ~TEE_MATTR_PW;
-		core_mmu_set_entry(ti, idx_alias, pa_alias, attr_alias);
-		tlbi_mva_allasid((vaddr_t)va_alias);
-		break;
-	case PAGER_AREA_TYPE_RW:
-		incr_rw_hits();
-		break;
-	case PAGER_AREA_TYPE_LOCK:
-		break;
-	default:
-		panic();
+
+	for (n = 0; n < num_pages; n++) {
+		switch (area->type) {
+		case PAGER_AREA_TYPE_RO:
+			/*
+			 * Forbid write to aliases for read-only (maybe
+			 * exec) pages
+			 */
+			set_alias_writable(va_alias[n], false);
+			break;
+		case PAGER_AREA_TYPE_RW:
+		case PAGER_AREA_TYPE_LOCK:
+			break;
+		default:
+			panic();
+		}
+		asan_tag_no_access(va_alias[n],
+				   (uint8_t *)va_alias[n] + SMALL_PAGE_SIZE);
+	}
+}
+
+/*
+ * Loads the @num_pages consecutive pages starting at @page_va into the
+ * pages in @pmem which must already be assigned to the pages but not yet
+ * be mapped or known by the replacement policy.
+ *
+ * Loading and verifying pages is the expensive part of a fault, so it's
+ * done with the pager lock released. The pages are marked as loading
+ * meanwhile, a fault on one of the pages from another core waits for the
+ * load to finish with pmem_wait_loaded(). Locked pages aren't found by
+ * pmem_find() and are only zero-initialized, so they're loaded with the
+ * lock held. Exceptions stay masked, but fobj_load_pages() may run on
+ * several cores at once and concurrently with fobj_save_pages().
+ */
+/*
+ * Number of pages being loaded with the pager lock released and number of
+ * loads completed so far, protected by the pager lock.
+ */
+static unsigned int pager_num_loading;
+static unsigned int pager_load_gen;
+
+static void pager_load_pages(struct tee_pager_area *area, vaddr_t page_va,
+			     struct tee_pager_pmem **pmem,
+			     unsigned int num_pages)
+{
+	void *va_alias[PAGER_LOAD_BATCH] = { };
+	unsigned int n = 0;
+
+	assert(num_pages <= PAGER_LOAD_BATCH);
+	for (n = 0; n < num_pages; n++)
+		va_alias[n] = pmem[n]->va_alias;
+
+	if (area->type == PAGER_AREA_TYPE_LOCK) {
+		tee_pager_load_pages(area, page_va, va_alias, num_pages);
+		return;
+	}
+
+	for (n = 0; n < num_pages; n++)
+		pmem[n]->flags |= PMEM_FLAG_LOADING;
+	pager_num_loading += num_pages;
+	pager_lock_drop();
+	tee_pager_load_pages(area, page_va, va_alias, num_pages);
+	pager_lock_retake();
+	for (n = 0; n < num_pages; n++)
+		pmem[n]->flags &= ~PMEM_FLAG_LOADING;
+	pager_num_loading -= num_pages;
+	pager_load_gen++;
+	/* Wake up cores waiting in pmem_wait_loaded() or wait_any_load() */
+	dsb_ishst();
+	sev();
+
+	for (n = 0; n < num_pages; n++) {
+		if (area->type == PAGER_AREA_TYPE_RO)
+			incr_ro_hits();
+		else
+			incr_rw_hits();
+	}
+}
+
+static void pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
+			    struct tee_pager_pmem *pmem)
+{
+	pager_load_pages(area, page_va, &pmem, 1);
+}
+
+/* Called with the pager lock released */
+static void pmem_wait_loaded(struct tee_pager_pmem *pmem)
+{
+	while (READ_ONCE(pmem->flags) & PMEM_FLAG_LOADING)
+		wfe();
+}
+
+/* Called with the pager lock released */
+static void wait_any_load(unsigned int load_gen)
+{
+	while (READ_ONCE(pager_load_gen) == load_gen)
+		wfe();
+}
+
+/*
+ * Page replacement policy
+ *
+ * The replacement policy orders the pageable physical pages in its own
+ * queues, linked with @policy_link in struct tee_pager_pmem, and decides
+ * which page to evict when a page needs to be loaded:
+ * policy_add()		a free page has become available for paging
+ * policy_get_victim()	returns the page to evict next
+ * policy_evict()	the page returned by policy_get_victim() is taken
+ * policy_loaded()	a page has been loaded with new content
+ * policy_hit()		a resident page has been mapped again
+ * policy_fault_done()	called at the end of each handled fault
+ * policy_forget_fobj()	@fobj is about to be freed
+ * policy_add_npages()	@npages more pages are available for paging
+ * policy_first()	returns the first page in eviction order
+ * policy_next()	returns the page following @pmem in eviction order
+ *
+ * The MMU doesn't provide any reference bits so pages are hidden instead,
+ * that is, unmapped while keeping the content. An access to a hidden page
+ * faults and is handled by mapping the page again, which serves as a
+ * reference.
+ */
+#ifdef CFG_PAGER_2Q
+/*
+ * 2Q: newly loaded pages enter the probation queue A1in which is evicted
+ * in FIFO order once it holds more than a quarter of the pages. Pages
+ * evicted from A1in are remembered in the ghost queue A1out and a page
+ * which faults again while remembered there is loaded into the hot queue
+ * Am instead. Am is managed with CLOCK where a mapped page counts as
+ * referenced: the clock hand hides mapped pages and evicts pages which
+ * still are hidden when the hand comes around again. This way a burst of
+ * pages used only once, like when a TA is loaded, can't push out the hot
+ * pages.
+ */
+/*
+ * A1out is a ring of ghosts indexed by a hash table on fobj and page
+ * index. Each bucket is a singly linked list of ghosts where links are
+ * the index + 1 of the next ghost in pager_ghosts, 0 ends the list.
+ */
+struct pager_ghost {
+	struct fobj *fobj;
+	unsigned int fobj_pgidx;
+	unsigned int hash_next;
+};
+
+static struct tee_pager_pmem_head pager_a1in_head =
+	TAILQ_HEAD_INITIALIZER(pager_a1in_head);
+static struct tee_pager_pmem_head pager_am_head =
+	TAILQ_HEAD_INITIALIZER(pager_am_head);
+static size_t pager_a1in_count;
+
+static struct pager_ghost *pager_ghosts;
+static size_t pager_num_ghosts;
+static size_t pager_ghost_next;
+static unsigned int *pager_ghost_hash;
+static size_t pager_ghost_hash_size;
+
+static unsigned int *ghost_bucket(struct fobj *fobj, unsigned int fobj_pgidx)
+{
+	size_t h = ((vaddr_t)fobj / sizeof(void *) + fobj_pgidx) * 0x9e3779b1U;
+
+	return pager_ghost_hash + (h & (pager_ghost_hash_size - 1));
+}
+
+static void ghost_link(size_t idx)
+{
+	struct pager_ghost *ghost = pager_ghosts + idx;
+	unsigned int *bucket = ghost_bucket(ghost->fobj, ghost->fobj_pgidx);
+
+	ghost->hash_next = *bucket;
+	*bucket = idx + 1;
+}
+
+static void ghost_unlink(size_t idx)
+{
+	struct pager_ghost *ghost = pager_ghosts + idx;
+	unsigned int *link = ghost_bucket(ghost->fobj, ghost->fobj_pgidx);
+
+	while (*link != idx + 1)
+		link = &pager_ghosts[*link - 1].hash_next;
+	*link = ghost->hash_next;
+	ghost->fobj = NULL;
+}
+
+static void policy_add(struct tee_pager_pmem *pmem)
+{
+	/* Free pages are used first */
+	if (pmem->fobj)
+		TAILQ_INSERT_TAIL(&pager_a1in_head, pmem, policy_link);
+	else
+		TAILQ_INSERT_HEAD(&pager_a1in_head, pmem, policy_link);
+	pager_a1in_count++;
+}
+
+static struct tee_pager_pmem *policy_get_victim(void)
+{
+	struct tee_pager_pmem *pmem = TAILQ_FIRST(&pager_a1in_head);
+
+	if (TAILQ_EMPTY(&pager_am_head))
+		return pmem;
+	if (pmem && (!pmem->fobj || pager_a1in_count > tee_pager_npages / 4))
+		return pmem;
+
+	/* Advance the clock hand until an unreferenced page is found */
+	while (true) {
+		pmem = TAILQ_FIRST(&pager_am_head);
+		if (!pmem->fobj || pmem_is_hidden(pmem))
+			return pmem;
+
+		pmem->flags |= PMEM_FLAG_HIDDEN;
+		pmem_unmap(pmem, NULL);
+		TAILQ_REMOVE(&pager_am_head, pmem, policy_link);
+		TAILQ_INSERT_TAIL(&pager_am_head, pmem, policy_link);
 	}
-	asan_tag_no_access(va_alias, (uint8_t *)va_alias + SMALL_PAGE_SIZE);
 }
 
-static void tee_pager_save_page(struct tee_pager_pmem *pmem)
+static void policy_evict(struct tee_pager_pmem *pmem)
 {
-	if (pmem_is_dirty(pmem)) {
-		asan_tag_access(pmem->va_alias,
-				(uint8_t *)pmem->va_alias + SMALL_PAGE_SIZE);
-		if (fobj_save_page(pmem->fobj, pmem->fobj_pgidx,
-				   pmem->va_alias))
-			panic("fobj_save_page");
-		asan_tag_no_access(pmem->va_alias,
-				   (uint8_t *)pmem->va_alias + SMALL_PAGE_SIZE);
+	struct pager_ghost *ghost = NULL;
+
+	if (pmem->flags & PMEM_FLAG_HOT) {
+		TAILQ_REMOVE(&pager_am_head, pmem, policy_link);
+		return;
+	}
+
+	TAILQ_REMOVE(&pager_a1in_head, pmem, policy_link);
+	pager_a1in_count--;
+
+	if (pmem->fobj && pager_num_ghosts) {
+		ghost = pager_ghosts + pager_ghost_next;
+		if (ghost->fobj)
+			ghost_unlink(pager_ghost_next);
+		ghost->fobj = pmem->fobj;
+		ghost->fobj_pgidx = pmem->fobj_pgidx;
+		ghost_link(pager_ghost_next);
+		pager_ghost_next = (pager_ghost_next + 1) % pager_num_ghosts;
 	}
 }
 
+static bool ghost_take(struct fobj *fobj, unsigned int fobj_pgidx)
+{
+	unsigned int *link = NULL;
+	struct pager_ghost *ghost = NULL;
+
+	if (!pager_num_ghosts)
+		return false;
+
+	for (link = ghost_bucket(fobj, fobj_pgidx); *link;
+	     link = &ghost->hash_next) {
+		ghost = pager_ghosts + *link - 1;
+		if (ghost->fobj == fobj && ghost->fobj_pgidx == fobj_pgidx) {
+			*link = ghost->hash_next;
+			ghost->fobj = NULL;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void policy_loaded(struct tee_pager_pmem *pmem)
+{
+	if (ghost_take(pmem->fobj, pmem->fobj_pgidx)) {
+		incr_ghost_hits();
+		pmem->flags |= PMEM_FLAG_HOT;
+		TAILQ_INSERT_TAIL(&pager_am_head, pmem, policy_link);
+	} else {
+		TAILQ_INSERT_TAIL(&pager_a1in_head, pmem, policy_link);
+		pager_a1in_count++;
+	}
+}
+
+static void policy_hit(struct tee_pager_pmem *pmem __unused)
+{
+	/* Being mapped again is the reference, see policy_get_victim() */
+}
+
+static void policy_fault_done(void)
+{
+}
+
+static void policy_forget_fobj(struct fobj *fobj)
+{
+	size_t n = 0;
+
+	for (n = 0; n < pager_num_ghosts; n++)
+		if (pager_ghosts[n].fobj == fobj)
+			ghost_unlink(n);
+}
+
+static struct tee_pager_pmem *policy_first(void)
+{
+	struct tee_pager_pmem *pmem = TAILQ_FIRST(&pager_a1in_head);
+
+	if (pmem)
+		return pmem;
+	return TAILQ_FIRST(&pager_am_head);
+}
+
+static struct tee_pager_pmem *policy_next(struct tee_pager_pmem *pmem)
+{
+	struct tee_pager_pmem *next = TAILQ_NEXT(pmem, policy_link);
+
+	if (next || (pmem->flags & PMEM_FLAG_HOT))
+		return next;
+	return TAILQ_FIRST(&pager_am_head);
+}
+
+/* A1out remembers as many pages as half the number of pages */
+static void policy_add_npages(size_t npages)
+{
+	size_t num_ghosts = pager_num_ghosts + npages / 2;
+	struct pager_ghost *ghosts = NULL;
+	size_t hash_size = pager_ghost_hash_size;
+	unsigned int *hash = NULL;
+	size_t n = 0;
+
+	if (num_ghosts == pager_num_ghosts)
+		return;
+
+	ghosts = realloc(pager_ghosts, num_ghosts * sizeof(*ghosts));
+	if (!ghosts)
+		panic("out of mem");
+	memset(ghosts + pager_num_ghosts, 0,
+	       (num_ghosts - pager_num_ghosts) * sizeof(*ghosts));
+	pager_ghosts = ghosts;
+	pager_num_ghosts = num_ghosts;
+
+	/* Keep the hash table a power of two at least as large as A1out */
+	if (!hash_size)
+		hash_size = 1;
+	while (hash_size < num_ghosts)
+		hash_size *= 2;
+	if (hash_size != pager_ghost_hash_size) {
+		hash = realloc(pager_ghost_hash, hash_size * sizeof(*hash));
+		if (!hash)
+			panic("out of mem");
+		pager_ghost_hash = hash;
+		pager_ghost_hash_size = hash_size;
+	}
+	memset(pager_ghost_hash, 0, hash_size * sizeof(*pager_ghost_hash));
+	for (n = 0; n < num_ghosts; n++)
+		if (ghosts[n].fobj)
+			ghost_link(n);
+}
+#else /*CFG_PAGER_2Q*/
+/*
+ * FIFO: the oldest page is evicted. To keep recently used pages around a
+ * bit longer the oldest third of the pages is hidden after each fault and
+ * a page which is mapped again is moved to the back of the queue.
+ */
+static struct tee_pager_pmem_head pager_fifo_head =
+	TAILQ_HEAD_INITIALIZER(pager_fifo_head);
+
+/* number of pages hidden */
+#define TEE_PAGER_NHIDE (tee_pager_npages / 3)
+
+static void policy_add(struct tee_pager_pmem *pmem)
+{
+	/* Free pages are used first */
+	if (pmem->fobj)
+		TAILQ_INSERT_TAIL(&pager_fifo_head, pmem, policy_link);
+	else
+		TAILQ_INSERT_HEAD(&pager_fifo_head, pmem, policy_link);
+}
+
+static struct tee_pager_pmem *policy_get_victim(void)
+{
+	return TAILQ_FIRST(&pager_fifo_head);
+}
+
+static void policy_evict(struct tee_pager_pmem *pmem)
+{
+	TAILQ_REMOVE(&pager_fifo_head, pmem, policy_link);
+}
+
+static void policy_loaded(struct tee_pager_pmem *pmem)
+{
+	TAILQ_INSERT_TAIL(&pager_fifo_head, pmem, policy_link);
+}
+
+static void policy_hit(struct tee_pager_pmem *pmem)
+{
+	TAILQ_REMOVE(&pager_fifo_head, pmem, policy_link);
+	TAILQ_INSERT_TAIL(&pager_fifo_head, pmem, policy_link);
+}
+
+static void policy_fault_done(void)
+{
+	struct tee_pager_pmem *pmem = NULL;
+	size_t n = 0;
+
+	TAILQ_FOREACH(pmem, &pager_fifo_head, policy_link) {
+		if (n >= TEE_PAGER_NHIDE)
+			break;
+		n++;
+
+		/* we cannot hide pages when pmem->fobj is not defined. */
+		if (!pmem->fobj)
+			continue;
+
+		if (pmem_is_hidden(pmem))
+			continue;
+
+		pmem->flags |= PMEM_FLAG_HIDDEN;
+		pmem_unmap(pmem, NULL);
+	}
+}
+
+static void policy_forget_fobj(struct fobj *fobj __unused)
+{
+}
+
+static struct tee_pager_pmem *policy_first(void)
+{
+	return TAILQ_FIRST(&pager_fifo_head);
+}
+
+static struct tee_pager_pmem *policy_next(struct tee_pager_pmem *pmem)
+{
+	return TAILQ_NEXT(pmem, policy_link);
+}
+
+static void policy_add_npages(size_t npages __unused)
+{
+}
+#endif /*CFG_PAGER_2Q*/
+
 #ifdef CFG_PAGED_USER_TA
 static void unlink_area(struct tee_pager_area_head *area_head,
 			struct tee_pager_area *area)
@@ -1118,8 +1677,17 @@ void tee_pager_invalidate_fobj(struct fobj *fobj)
 
 	exceptions = pager_lock_check_stack(64);
 
+	policy_forget_fobj(fobj);
+restart:
 	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
 		if (pmem->fobj == fobj) {
+			if (pmem->flags & PMEM_FLAG_LOADING) {
+				/* Let the load finish before the fobj goes */
+				pager_unlock(exceptions);
+				pmem_wait_loaded(pmem);
+				exceptions = pager_lock_check_stack(64);
+				goto restart;
+			}
 			pmem->fobj = NULL;
 			pmem->fobj_pgidx = INVALID_PGIDX;
 		}
@@ -1143,9 +1711,9 @@ static struct tee_pager_pmem *pmem_find(struct tee_pager_area *area,
 }
 
 static bool tee_pager_unhide_page(struct tee_pager_area *area,
+				  struct tee_pager_pmem *pmem,
 				  unsigned int tblidx)
 {
-	struct tee_pager_pmem *pmem = pmem_find(area, tblidx);
 	uint32_t a = get_area_mattr(area->flags);
 	uint32_t attr = 0;
 	paddr_t pa = 0;
@@ -1159,7 +1727,7 @@ static bool tee_pager_unhide_page(struct tee_pager_area *area,
 
 	/*
 	 * The page is hidden, or not not mapped yet. Unhide the page and
-	 * move it to the tail.
+	 * tell the replacement policy about the hit.
 	 *
 	 * Since the page isn't mapped there doesn't exist a valid TLB entry
 	 * for this address, so no TLB invalidation is required after setting
@@ -1207,32 +1775,13 @@ static bool tee_pager_unhide_page(struct tee_pager_area *area,
 	}
 	pgt_inc_used_entries(area->pgt);
 
-	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
-	TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	policy_hit(pmem);
 	incr_hidden_hits();
-	return true;
-}
-
-static void tee_pager_hide_pages(void)
-{
-	struct tee_pager_pmem *pmem = NULL;
-	size_t n = 0;
-
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		if (n >= TEE_PAGER_NHIDE)
-			break;
-		n++;
-
-		/* we cannot hide pages when pmem->fobj is not defined. */
-		if (!pmem->fobj)
-			continue;
-
-		if (pmem_is_hidden(pmem))
-			continue;
-
-		pmem->flags |= PMEM_FLAG_HIDDEN;
-		pmem_unmap(pmem, NULL);
+	if (pmem->flags & PMEM_FLAG_READAHEAD) {
+		pmem->flags &= ~PMEM_FLAG_READAHEAD;
+		incr_readahead_hits();
 	}
+	return true;
 }
 
 static unsigned int __maybe_unused
@@ -1280,6 +1829,7 @@ static bool tee_pager_release_one_phys(struct tee_pager_area *area,
 		tee_pager_npages++;
 		set_npages();
 		TAILQ_INSERT_HEAD(&tee_pager_pmem_head, pmem, link);
+		policy_add(pmem);
 		incr_zi_released();
 		return true;
 	}
@@ -1287,38 +1837,133 @@ static bool tee_pager_release_one_phys(struct tee_pager_area *area,
 	return false;
 }
 
-/* Finds the oldest page and unmaps it from all tables */
-static struct tee_pager_pmem *tee_pager_get_page(enum tee_pager_area_type at)
+/*
+ * Saves the dirty pages among the @num pages in @pmem which have been
+ * taken from the replacement policy. A page which can't be saved for lack
+ * of storage is handed back to the replacement policy, still dirty but
+ * hidden, and removed from @pmem.
+ *
+ * Returns the number of pages left in @pmem.
+ */
+static size_t save_victims(struct tee_pager_pmem **pmem, size_t num)
 {
-	struct tee_pager_pmem *pmem;
+	struct fobj_page pages[PAGER_LOAD_BATCH] = { };
+	struct tee_pager_pmem *p = NULL;
+	TEE_Result batch_res = TEE_SUCCESS;
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_dirty = 0;
+	size_t count = 0;
+	size_t n = 0;
 
-	pmem = TAILQ_FIRST(&tee_pager_pmem_head);
-	if (!pmem) {
-		EMSG("No pmem entries");
-		return NULL;
+	for (n = 0; n < num; n++) {
+		p = pmem[n];
+		if (!p->fobj || !pmem_is_dirty(p))
+			continue;
+		pages[num_dirty].fobj = p->fobj;
+		pages[num_dirty].page_idx = p->fobj_pgidx;
+		pages[num_dirty].va = p->va_alias;
+		asan_tag_access(p->va_alias,
+				(const uint8_t *)p->va_alias + SMALL_PAGE_SIZE);
+		num_dirty++;
 	}
-
-	if (pmem->fobj) {
-		pmem_unmap(pmem, NULL);
-		tee_pager_save_page(pmem);
+	if (!num_dirty)
+		return num;
+
+	batch_res = fobj_save_pages(pages, num_dirty);
+	for (n = 0; n < num; n++) {
+		p = pmem[n];
+		if (p->fobj && pmem_is_dirty(p)) {
+			/* Find out which pages failed, one at a time */
+			res = batch_res;
+			if (res) {
+				res = fobj_save_page(p->fobj, p->fobj_pgidx,
+						     p->va_alias);
+				if (res && res != TEE_ERROR_OUT_OF_MEMORY)
+					panic("fobj_save_page");
+			}
+			asan_tag_no_access(p->va_alias,
+					   (const uint8_t *)p->va_alias +
+					   SMALL_PAGE_SIZE);
+			if (res) {
+				p->flags &= ~PMEM_FLAG_HOT;
+				p->flags |= PMEM_FLAG_HIDDEN;
+				policy_add(p);
+				continue;
+			}
+		}
+		pmem[count] = p;
+		count++;
 	}
 
-	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
-	pmem->fobj = NULL;
-	pmem->fobj_pgidx = INVALID_PGIDX;
-	pmem->flags = 0;
-	if (at == PAGER_AREA_TYPE_LOCK) {
-		/* Move page to lock list */
-		if (tee_pager_npages <= 0)
-			panic("running out of page");
-		tee_pager_npages--;
-		set_npages();
-		TAILQ_INSERT_TAIL(&tee_pager_lock_pmem_head, pmem, link);
-	} else {
-		/* move page to back */
-		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	return count;
+}
+
+/*
+ * Takes up to @num pages selected by the replacement policy and unmaps
+ * them from all tables. The dirty pages among them are saved together
+ * since encrypting several pages at once is cheaper than one at a time.
+ * Unless the pages are to be locked the caller must hand them back to the
+ * replacement policy with policy_loaded() once they have been loaded.
+ *
+ * Returns the number of pages taken, which is less than @num if the
+ * replacement policy ran out of pages or pages which could be saved.
+ */
+static size_t tee_pager_get_pages(enum tee_pager_area_type at,
+				  struct tee_pager_pmem **pmem, size_t num)
+{
+	size_t max_victims = tee_pager_npages + num;
+	struct tee_pager_pmem *p = NULL;
+	size_t count = 0;
+	size_t start = 0;
+	size_t n = 0;
+
+	assert(num <= PAGER_LOAD_BATCH);
+	while (count < num && max_victims) {
+		start = count;
+		for (; count < num && max_victims; count++, max_victims--) {
+			p = policy_get_victim();
+			if (!p)
+				break;
+
+			if (p->fobj) {
+				pmem_unmap(p, NULL);
+				incr_evictions();
+				if (p->flags & PMEM_FLAG_READAHEAD)
+					incr_readahead_waste();
+			}
+			policy_evict(p);
+			pmem[count] = p;
+		}
+		if (count == start)
+			break;
+		count = start + save_victims(pmem + start, count - start);
+	}
+	for (n = 0; n < count; n++) {
+		p = pmem[n];
+		p->fobj = NULL;
+		p->fobj_pgidx = INVALID_PGIDX;
+		p->flags = 0;
+		if (at == PAGER_AREA_TYPE_LOCK) {
+			/* Move page to lock list */
+			if (tee_pager_npages <= 0)
+				panic("running out of page");
+			tee_pager_npages--;
+			set_npages();
+			TAILQ_REMOVE(&tee_pager_pmem_head, p, link);
+			TAILQ_INSERT_TAIL(&tee_pager_lock_pmem_head, p, link);
+		}
 	}
 
+	return count;
+}
+
+static struct tee_pager_pmem *tee_pager_get_page(enum tee_pager_area_type at)
+{
+	struct tee_pager_pmem *pmem = NULL;
+
+	if (!tee_pager_get_pages(at, &pmem, 1))
+		return NULL;
+
 	return pmem;
 }
 
@@ -1410,6 +2055,144 @@ static bool pager_update_permissions(struct tee_pager_area *area,
 	return true;
 }
 
+static unsigned int area_va2fobj_pgidx(struct tee_pager_area *area,
+				       vaddr_t page_va)
+{
+	return area_va2idx(area, page_va) + area->fobj_pgoffs -
+	       ((area->base & CORE_MMU_PGDIR_MASK) >> SMALL_PAGE_SHIFT);
+}
+
+static bool page_is_present(struct tee_pager_area *area, vaddr_t page_va)
+{
+	size_t tblidx = area_va2idx(area, page_va);
+	uint32_t attr = 0;
+
+	area_get_entry(area, tblidx, NULL, &attr);
+	return (attr & TEE_MATTR_VALID_BLOCK) || pmem_find(area, tblidx);
+}
+
+/*
+ * Loads the @num_pages consecutive pages at @page_va, none of which may
+ * be present, ahead of them being accessed. The pages are loaded and
+ * verified together and left hidden, so the first access is a fault
+ * which only has to map the page and tells that the readahead was
+ * useful.
+ *
+ * Returns the number of pages read ahead, which is less than @num_pages
+ * if the replacement policy ran out of pages.
+ */
+static unsigned int readahead_pages(struct tee_pager_area *area,
+				    vaddr_t page_va, unsigned int num_pages,
+				    bool clean_user_cache)
+{
+	struct tee_pager_pmem *pmem[PAGER_LOAD_BATCH] = { };
+	unsigned int num = 0;
+	unsigned int n = 0;
+	size_t tblidx = 0;
+	uint32_t attr = 0;
+	vaddr_t va = 0;
+
+	num = tee_pager_get_pages(area->type, pmem, num_pages);
+	if (!num)
+		return 0;
+	for (n = 0; n < num; n++) {
+		va = page_va + n * SMALL_PAGE_SIZE;
+		pmem[n]->fobj = area->fobj;
+		pmem[n]->fobj_pgidx = area_va2fobj_pgidx(area, va);
+	}
+
+	pager_load_pages(area, page_va, pmem, num);
+
+	for (n = 0; n < num; n++) {
+		va = page_va + n * SMALL_PAGE_SIZE;
+		pmem[n]->flags = PMEM_FLAG_HIDDEN | PMEM_FLAG_READAHEAD;
+		policy_loaded(pmem[n]);
+		incr_readahead();
+
+		if (!(area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)))
+			continue;
+
+		/*
+		 * Executable pages need the same cache maintenance as in
+		 * tee_pager_handle_fault(), done through a temporary
+		 * read-only mapping which is removed again afterwards.
+		 */
+		attr = get_area_mattr(area->flags) &
+		       ~(TEE_MATTR_PX | TEE_MATTR_UX | TEE_MATTR_PW |
+			 TEE_MATTR_UW);
+		tblidx = area_va2idx(area, va);
+		area_set_entry(area, tblidx, get_pmem_pa(pmem[n]), attr);
+		area_tlbi_entry(area, tblidx);
+
+		dcache_clean_range_pou((void *)va, SMALL_PAGE_SIZE);
+		if (clean_user_cache)
+			icache_inv_user_range((void *)va, SMALL_PAGE_SIZE);
+		else
+			icache_inv_range((void *)va, SMALL_PAGE_SIZE);
+
+		area_set_entry(area, tblidx, 0, 0);
+		area_tlbi_entry(area, tblidx);
+	}
+
+	return num;
+}
+
+/*
+ * Called after a page has been loaded due to a fault at @page_va. If the
+ * fault was expected from the previous faults in the area, that is the
+ * faults are sequential, the readahead window is doubled and the pages
+ * following @page_va are read ahead. Runs of pages which aren't present
+ * are read ahead up to PAGER_LOAD_BATCH pages at a time.
+ */
+static void readahead(struct tee_pager_area *area, vaddr_t page_va,
+		      bool clean_user_cache)
+{
+	vaddr_t end = area->base + area->size;
+	size_t max_window = CFG_PAGER_READAHEAD_PAGES;
+	vaddr_t va = page_va + SMALL_PAGE_SIZE;
+	unsigned int num = 0;
+	size_t n = 0;
+
+	if (!max_window || area->type != PAGER_AREA_TYPE_RO)
+		return;
+
+	/* Leave most of the pages to the replacement policy */
+	if (max_window > tee_pager_npages / 8)
+		max_window = tee_pager_npages / 8;
+
+	if (page_va == area->ra_next_va) {
+		if (area->ra_window)
+			area->ra_window *= 2;
+		else
+			area->ra_window = 2;
+		if (area->ra_window > max_window)
+			area->ra_window = max_window;
+	} else {
+		area->ra_window = 0;
+	}
+
+	while (n < area->ra_window && va < end) {
+		num = 0;
+		while (num < PAGER_LOAD_BATCH && n + num < area->ra_window &&
+		       va + num * SMALL_PAGE_SIZE < end &&
+		       !page_is_present(area, va + num * SMALL_PAGE_SIZE))
+			num++;
+
+		if (!num) {
+			/* Already present, skip it */
+			num = 1;
+		} else if (readahead_pages(area, va, num,
+					   clean_user_cache) < num) {
+			break;
+		}
+
+		n += num;
+		va += num * SMALL_PAGE_SIZE;
+	}
+
+	area->ra_next_va = va;
+}
+
 #ifdef CFG_TEE_CORE_DEBUG
 static void stat_handle_fault(void)
 {
@@ -1438,6 +2221,9 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 {
 	struct tee_pager_area *area;
 	vaddr_t page_va = ai->va & ~SMALL_PAGE_MASK;
+	struct tee_pager_pmem *pmem = NULL;
+	uint64_t start = stat_fault_start();
+	size_t tblidx = 0;
 	uint32_t exceptions;
 	bool ret;
 	bool clean_user_cache = false;
@@ -1478,11 +2264,22 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 		goto out;
 	}
 
-	if (!tee_pager_unhide_page(area, area_va2idx(area, page_va))) {
-		struct tee_pager_pmem *pmem = NULL;
+	tblidx = area_va2idx(area, page_va);
+	pmem = pmem_find(area, tblidx);
+	if (pmem && (pmem->flags & PMEM_FLAG_LOADING)) {
+		/*
+		 * Another core is loading the page, wait for it to finish
+		 * and let the access be retried.
+		 */
+		stat_fault_latency(start);
+		pager_unlock(exceptions);
+		pmem_wait_loaded(pmem);
+		return true;
+	}
+
+	if (!tee_pager_unhide_page(area, pmem, tblidx)) {
 		uint32_t attr = 0;
 		paddr_t pa = 0;
-		size_t tblidx = 0;
 
 		/*
 		 * The page wasn't hidden, but some other core may have
@@ -1499,20 +2296,32 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 		}
 
 		pmem = tee_pager_get_page(area->type);
+		if (!pmem && pager_num_loading) {
+			uint32_t load_gen = pager_load_gen;
+
+			/*
+			 * All pages which could be evicted are being loaded
+			 * by other cores, wait for one of the loads to
+			 * finish and let the access be retried.
+			 */
+			stat_fault_latency(start);
+			pager_unlock(exceptions);
+			wait_any_load(load_gen);
+			return true;
+		}
 		if (!pmem) {
+			EMSG("No pmem entries");
 			abort_print(ai);
 			panic();
 		}
 
 		/* load page code & data */
-		tee_pager_load_page(area, page_va, pmem->va_alias);
-
-
 		pmem->fobj = area->fobj;
-		pmem->fobj_pgidx = area_va2idx(area, page_va) +
-				   area->fobj_pgoffs -
-				   ((area->base & CORE_MMU_PGDIR_MASK) >>
-					SMALL_PAGE_SHIFT);
+		pmem->fobj_pgidx = area_va2fobj_pgidx(area, page_va);
+		pager_load_page(area, page_va, pmem);
+
+		if (area->type != PAGER_AREA_TYPE_LOCK)
+			policy_loaded(pmem);
 		tblidx = pmem_get_area_tblidx(pmem, area);
 		attr = get_area_mattr(area->flags);
 		/*
@@ -1576,17 +2385,20 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 
 		FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
 
+		readahead(area, page_va, clean_user_cache);
 	}
 
-	tee_pager_hide_pages();
+	policy_fault_done();
 	ret = true;
 out:
+	stat_fault_latency(start);
 	pager_unlock(exceptions);
 	return ret;
 }
 
 void tee_pager_add_pages(vaddr_t vaddr, size_t npages, bool unmap)
 {
+	size_t num_added = 0;
 	size_t n;
 
 	DMSG("0x%" PRIxVA " - 0x%" PRIxVA " : %d",
@@ -1648,8 +2460,12 @@ void tee_pager_add_pages(vaddr_t vaddr, size_t npages, bool unmap)
 		incr_npages_all();
 		set_npages();
 		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+		policy_add(pmem);
+		num_added++;
 	}
 
+	policy_add_npages(num_added);
+
 	/*
 	 * As this is done at inits, invalidate all TLBs once instead of
 	 * targeting only the modified entries.
@@ -11,6 +11,7 @@
 #include <kernel/tee_l2cc_mutex.h>
 #include <kernel/virtualization.h>
 #include <kernel/misc.h>
+#include <kernel/thread.h>
 #include <mm/core_mmu.h>
 
 #ifdef CFG_CORE_RESERVED_SHM
@@ -144,7 +145,7 @@ static void tee_entry_boot_secondary(struct thread_smc_args *args)
 static void tee_entry_get_thread_count(struct thread_smc_args *args)
 {
 	args->a0 = OPTEE_SMC_RETURN_OK;
-	args->a1 = CFG_NUM_THREADS;
+	args->a1 = thread_get_count();
 }
 
 #if defined(CFG_VIRTUALIZATION)
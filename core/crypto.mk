@@ -85,6 +85,10 @@ CFG_CRYPTO_SHA256_ARM_CE ?= $(CFG_CRYPTO_SHA256)
 CFG_CORE_CRYPTO_SHA256_ACCEL ?= $(CFG_CRYPTO_SHA256_ARM_CE)
 CFG_CRYPTO_SHA1_ARM_CE ?= $(CFG_CRYPTO_SHA1)
 CFG_CORE_CRYPTO_SHA1_ACCEL ?= $(CFG_CRYPTO_SHA1_ARM_CE)
+# The SHA-512 instructions are an optional ARMv8.2 extension (AArch64 only)
+# which isn't implied by CFG_CRYPTO_WITH_CE, the platform has to opt in.
+CFG_CRYPTO_SHA512_ARM_CE ?= n
+CFG_CORE_CRYPTO_SHA512_ACCEL ?= $(CFG_CRYPTO_SHA512_ARM_CE)
 CFG_CRYPTO_AES_ARM_CE ?= $(CFG_CRYPTO_AES)
 CFG_CORE_CRYPTO_AES_ACCEL ?= $(CFG_CRYPTO_AES_ARM_CE)
 
@@ -106,6 +110,12 @@ endif
 ifeq ($(CFG_CRYPTO_SHA1_ARM_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA1_ARM_CE)
 endif
+ifeq ($(CFG_CRYPTO_SHA512_ARM_CE),y)
+$(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA512_ARM_CE)
+ifeq ($(CFG_ARM32_core),y)
+$(error CFG_CRYPTO_SHA512_ARM_CE requires CFG_ARM64_core=y)
+endif
+endif
 ifeq ($(CFG_CRYPTO_AES_ARM_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_AES_ARM_CE)
 endif
@@ -175,6 +185,7 @@ _CFG_CORE_LTC_MPI := $(CFG_CORE_MBEDTLS_MPI)
 _CFG_CORE_LTC_AES_ACCEL := $(CFG_CORE_CRYPTO_AES_ACCEL)
 _CFG_CORE_LTC_SHA1_ACCEL := $(CFG_CORE_CRYPTO_SHA1_ACCEL)
 _CFG_CORE_LTC_SHA256_ACCEL := $(CFG_CORE_CRYPTO_SHA256_ACCEL)
+_CFG_CORE_LTC_SHA512_ACCEL := $(CFG_CORE_CRYPTO_SHA512_ACCEL)
 endif
 
 ###############################################################
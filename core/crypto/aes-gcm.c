@@ -66,8 +66,13 @@ static void ghash_update_lengths(struct internal_aes_gcm_state *state,
 	internal_aes_gcm_ghash_update(state, (uint8_t *)len_fields, NULL, 0);
 }
 
+/*
+ * The hash subkey only depends on the AES key, if @ghash_key is supplied
+ * it's used instead of deriving the hash subkey again.
+ */
 static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
 			     const struct internal_aes_gcm_key *ek,
+			     const struct internal_ghash_key *ghash_key,
 			     TEE_OperationMode mode, const void *nonce,
 			     size_t nonce_len, size_t tag_len)
 {
@@ -79,7 +84,10 @@ static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
 	memset(state, 0, sizeof(*state));
 
 	state->tag_len = tag_len;
-	internal_aes_gcm_set_key(state, ek);
+	if (ghash_key)
+		state->ghash_key = *ghash_key;
+	else
+		internal_aes_gcm_set_key(state, ek);
 
 	if (nonce_len == (96 / 8)) {
 		memcpy(state->ctr, nonce, nonce_len);
@@ -134,7 +142,8 @@ TEE_Result internal_aes_gcm_init(struct internal_aes_gcm_ctx *ctx,
 	if (res)
 		return res;
 
-	return __gcm_init(&ctx->state, ek, mode, nonce, nonce_len, tag_len);
+	return __gcm_init(&ctx->state, ek, NULL, mode, nonce, nonce_len,
+			  tag_len);
 }
 
 static TEE_Result __gcm_update_aad(struct internal_aes_gcm_state *state,
@@ -376,8 +385,8 @@ TEE_Result internal_aes_gcm_enc(const struct internal_aes_gcm_key *enc_key,
 	TEE_Result res;
 	struct internal_aes_gcm_state state;
 
-	res = __gcm_init(&state, enc_key, TEE_MODE_ENCRYPT, nonce, nonce_len,
-			 *tag_len);
+	res = __gcm_init(&state, enc_key, NULL, TEE_MODE_ENCRYPT, nonce,
+			 nonce_len, *tag_len);
 	if (res)
 		return res;
 
@@ -399,8 +408,8 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 	TEE_Result res;
 	struct internal_aes_gcm_state state;
 
-	res = __gcm_init(&state, enc_key, TEE_MODE_DECRYPT, nonce, nonce_len,
-			 tag_len);
+	res = __gcm_init(&state, enc_key, NULL, TEE_MODE_DECRYPT, nonce,
+			 nonce_len, tag_len);
 	if (res)
 		return res;
 
@@ -413,6 +422,34 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 	return __gcm_dec_final(&state, enc_key, src, len, dst, tag, tag_len);
 }
 
+TEE_Result
+internal_aes_gcm_enc_batch(const struct internal_aes_gcm_key *enc_key,
+			   struct internal_aes_gcm_batch *batch, size_t count)
+{
+	struct internal_aes_gcm_state state = { };
+	struct internal_aes_gcm_batch *b = NULL;
+	struct internal_ghash_key ghash_key = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	for (n = 0; n < count; n++) {
+		b = batch + n;
+		res = __gcm_init(&state, enc_key, n ? &ghash_key : NULL,
+				 TEE_MODE_ENCRYPT, b->nonce, b->nonce_len,
+				 b->tag_len);
+		if (res)
+			return res;
+		if (!n)
+			ghash_key = state.ghash_key;
+		res = __gcm_enc_final(&state, enc_key, b->src, b->len, b->dst,
+				      b->tag, &b->tag_len);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 
 #ifndef CFG_CRYPTO_AES_GCM_FROM_CRYPTOLIB
 #include <stdlib.h>
@@ -525,6 +525,10 @@ void crypto_acipher_free_rsa_keypair(struct rsa_keypair *s __unused)
 {
 }
 
+void crypto_acipher_rsa_keypair_changed(struct rsa_keypair *s __unused)
+{
+}
+
 TEE_Result crypto_acipher_gen_rsa_key(struct rsa_keypair *key __unused,
 				      size_t key_size __unused)
 {
@@ -81,6 +81,11 @@ void crypto_acipher_free_rsa_keypair(struct rsa_keypair *key)
 	}
 }
 
+void crypto_acipher_rsa_keypair_changed(struct rsa_keypair *key __unused)
+{
+	/* Nothing is cached for keys handled by a driver */
+}
+
 TEE_Result crypto_acipher_gen_rsa_key(struct rsa_keypair *key, size_t size_bits)
 {
 	TEE_Result ret = TEE_ERROR_NOT_IMPLEMENTED;
@@ -113,6 +113,12 @@ struct rsa_keypair {
 	struct bignum *qp;	/* 1/q mod p */
 	struct bignum *dp;	/* d mod (p-1) */
 	struct bignum *dq;	/* d mod (q-1) */
+
+	/*
+	 * State derived from the key by the crypto library, computed on
+	 * first use and released by crypto_acipher_rsa_keypair_changed()
+	 */
+	struct rsa_precomp *precomp;
 };
 
 struct rsa_public_key {
@@ -173,6 +179,11 @@ TEE_Result crypto_acipher_alloc_rsa_public_key(struct rsa_public_key *s,
 				   size_t key_size_bits);
 void crypto_acipher_free_rsa_public_key(struct rsa_public_key *s);
 void crypto_acipher_free_rsa_keypair(struct rsa_keypair *s);
+/*
+ * Releases the state cached in @s->precomp, must be called when the
+ * bignums of @s are updated or freed without crypto_acipher_*_rsa_*()
+ */
+void crypto_acipher_rsa_keypair_changed(struct rsa_keypair *s);
 TEE_Result crypto_acipher_alloc_dsa_keypair(struct dsa_keypair *s,
 				size_t key_size_bits);
 TEE_Result crypto_acipher_alloc_dsa_public_key(struct dsa_public_key *s,
@@ -283,6 +294,26 @@ TEE_Result crypto_acipher_sm2_kep_derive(struct ecc_keypair *my_key,
 TEE_Result hash_sha256_check(const uint8_t *hash, const uint8_t *data,
 		size_t data_size);
 
+/*
+ * struct hash_sha256_msg - one message hashed by hash_sha256_multi()
+ * @data:	message to hash
+ * @data_size:	size of the message
+ * @digest:	receives the TEE_SHA256_HASH_SIZE bytes of the hash
+ */
+struct hash_sha256_msg {
+	const uint8_t *data;
+	size_t data_size;
+	uint8_t *digest;
+};
+
+/*
+ * Computes the SHA-256 hashes of @num_msgs independent messages. With an
+ * accelerated SHA-256 the messages are processed in pairs with
+ * interleaved lanes, which is faster than hashing them one by one. Has
+ * the same properties as hash_sha256_check() regarding crypto_init().
+ */
+TEE_Result hash_sha256_multi(struct hash_sha256_msg *msgs, size_t num_msgs);
+
 /*
  * Computes a SHA-512/256 hash, vetted conditioner as per NIST.SP.800-90B.
  * It doesn't require crypto_init() to be called in advance and has as few
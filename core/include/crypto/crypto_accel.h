@@ -44,4 +44,12 @@ void crypto_accel_sha1_compress(uint32_t state[5], const void *src,
 				unsigned int block_count);
 void crypto_accel_sha256_compress(uint32_t state[8], const void *src,
 				  unsigned int block_count);
+/*
+ * Compresses @block_count blocks of two independent messages, @src[0]
+ * into @state[0] and @src[1] into @state[1]
+ */
+void crypto_accel_sha256_compress_x2(uint32_t state[2][8], const void *src[2],
+				     unsigned int block_count);
+void crypto_accel_sha512_compress(uint64_t state[8], const void *src,
+				  unsigned int block_count);
 #endif /*__CRYPTO_CRYPTO_ACCEL_H*/
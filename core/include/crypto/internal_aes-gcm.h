@@ -84,6 +84,37 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 				const void *src, size_t len, void *dst,
 				const void *tag, size_t tag_len);
 
+/*
+ * struct internal_aes_gcm_batch - one operation of a batch
+ * @nonce:	Nonce (IV)
+ * @nonce_len:	Length of @nonce
+ * @src:	Payload to encrypt
+ * @dst:	Receives the encrypted payload
+ * @len:	Length of @src and @dst
+ * @tag:	Receives the tag
+ * @tag_len:	Length of @tag, updated with the actual length
+ */
+struct internal_aes_gcm_batch {
+	const void *nonce;
+	size_t nonce_len;
+	const void *src;
+	void *dst;
+	size_t len;
+	void *tag;
+	size_t tag_len;
+};
+
+/*
+ * Encrypts a batch of independent payloads with the same key
+ * and without AAD. Setting up a GCM operation includes deriving the hash
+ * subkey, which is done once for the whole batch instead of once per
+ * payload. Returns the result of the first operation which fails, the
+ * operations following it are not processed.
+ */
+TEE_Result
+internal_aes_gcm_enc_batch(const struct internal_aes_gcm_key *enc_key,
+			   struct internal_aes_gcm_batch *batch, size_t count);
+
 void internal_aes_gcm_gfmul(const uint64_t X[2], const uint64_t Y[2],
 			    uint64_t product[2]);
 
@@ -5,14 +5,21 @@
 #ifndef KERNEL_HANDLE_H
 #define KERNEL_HANDLE_H
 
+#include <bitstring.h>
 #include <stdint.h>
 
+/*
+ * @ptrs:	registered pointers indexed by handle, NULL if unused
+ * @used:	bitmap of the used entries in @ptrs
+ * @max_ptrs:	number of entries in @ptrs
+ */
 struct handle_db {
 	void **ptrs;
+	bitstr_t *used;
 	size_t max_ptrs;
 };
 
-#define HANDLE_DB_INITIALIZER { NULL, 0 }
+#define HANDLE_DB_INITIALIZER { NULL, NULL, 0 }
 
 /*
  * Frees all internal data structures of the database, but does not free
@@ -24,7 +31,7 @@ void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr));
 
 /*
  * Allocates a new handle and assigns the supplied pointer to it,
- * ptr must not be NULL.
+ * ptr must not be NULL. The lowest free handle is always used.
  * The function returns
  * >= 0 on success and
  * -1 on failure
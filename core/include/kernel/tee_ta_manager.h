@@ -67,6 +67,7 @@ struct sample_buf {
 struct tee_ta_ctx {
 	uint32_t flags;		/* TA_FLAGS from TA header */
 	TAILQ_ENTRY(tee_ta_ctx) link;
+	LIST_ENTRY(tee_ta_ctx) hash_link; /* Link in hash of ctx by UUID */
 	struct ts_ctx ts_ctx;
 	uint32_t panicked;	/* True if TA has panicked, written from asm */
 	uint32_t panic_code;	/* Code supplied for panic */
@@ -78,6 +79,8 @@ struct tee_ta_ctx {
 
 struct tee_ta_session {
 	TAILQ_ENTRY(tee_ta_session) link;
+	LIST_ENTRY(tee_ta_session) hash_link; /* Link in hash of sessions */
+	struct tee_ta_session_head *head; /* List the session is linked in */
 	struct ts_session ts_sess;
 	uint32_t id;		/* Session handle (0 is invalid) */
 	TEE_Identity clnt_id;	/* Identify of client */
@@ -97,6 +100,22 @@ struct tee_ta_session {
 /* Registered contexts */
 extern struct tee_ta_ctx_head tee_ctxes;
 
+/*
+ * tee_ta_register_ctx() - Add a context to tee_ctxes
+ * @ctx:	Context to add
+ *
+ * Must be called with tee_ta_mutex held.
+ */
+void tee_ta_register_ctx(struct tee_ta_ctx *ctx);
+
+/*
+ * tee_ta_unregister_ctx() - Remove a context from tee_ctxes
+ * @ctx:	Context to remove
+ *
+ * Must be called with tee_ta_mutex held.
+ */
+void tee_ta_unregister_ctx(struct tee_ta_ctx *ctx);
+
 extern struct mutex tee_ta_mutex;
 extern struct condvar tee_ta_init_cv;
 
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#ifndef __MM_COOKIE_HASH_H
+#define __MM_COOKIE_HASH_H
+
+#include <sys/queue.h>
+#include <types_ext.h>
+#include <util.h>
+
+/*
+ * Hash table of shared memory objects indexed by the cookie used by
+ * normal world to refer to them. The table doesn't do any locking, the
+ * caller serializes all accesses.
+ */
+
+#define COOKIE_HASH_SHIFT	7
+#define COOKIE_HASH_NUM_BUCKETS	BIT(COOKIE_HASH_SHIFT)
+
+/*
+ * struct cookie_hash_elem - Element embedded in the object to index
+ * @link:	Link in a bucket of the table
+ * @cookie:	Cookie of the object
+ */
+struct cookie_hash_elem {
+	LIST_ENTRY(cookie_hash_elem) link;
+	uint64_t cookie;
+};
+
+LIST_HEAD(cookie_hash_bucket, cookie_hash_elem);
+
+struct cookie_hash {
+	struct cookie_hash_bucket bucket[COOKIE_HASH_NUM_BUCKETS];
+};
+
+#define COOKIE_HASH_INITIALIZER { }
+
+/*
+ * cookie_hash_add() - Add an element to a table
+ * @h:		Table
+ * @e:		Element, not already in a table
+ * @cookie:	Cookie to index @e with
+ *
+ * If another element already uses @cookie, @e will be found first by
+ * cookie_hash_find() until it is removed.
+ */
+void cookie_hash_add(struct cookie_hash *h, struct cookie_hash_elem *e,
+		     uint64_t cookie);
+
+/*
+ * cookie_hash_remove() - Remove an element from the table it's in
+ * @e:		Element
+ */
+void cookie_hash_remove(struct cookie_hash_elem *e);
+
+/*
+ * cookie_hash_find() - Find an element by cookie
+ * @h:		Table
+ * @cookie:	Cookie to look for
+ *
+ * Returns the element or NULL if not found.
+ */
+struct cookie_hash_elem *cookie_hash_find(struct cookie_hash *h,
+					  uint64_t cookie);
+
+#endif /*__MM_COOKIE_HASH_H*/
@@ -32,6 +32,8 @@ struct fobj {
  * struct fobj_ops - operations struct for struct fobj
  * @free:	Frees the @fobj
  * @load_page:	Loads page with index @page_idx at address @va
+ * @load_pages:	Optional, loads @num_pages pages starting with index
+ *		@page_idx at the addresses in @va
  * @save_page:	Saves page with index @page_idx from address @va
  * @get_pa:	Returns physical address of page at @page_idx if not paged
  */
@@ -40,6 +42,8 @@ struct fobj_ops {
 #ifdef CFG_WITH_PAGER
 	TEE_Result (*load_page)(struct fobj *fobj, unsigned int page_idx,
 				void *va);
+	TEE_Result (*load_pages)(struct fobj *fobj, unsigned int page_idx,
+				 void *const *va, unsigned int num_pages);
 	TEE_Result (*save_page)(struct fobj *fobj, unsigned int page_idx,
 				const void *va);
 #endif
@@ -69,6 +73,19 @@ struct fobj *fobj_locked_paged_alloc(unsigned int num_pages);
  */
 struct fobj *fobj_rw_paged_alloc(unsigned int num_pages);
 
+/*
+ * fobj_rw_compressed_paged_alloc() - Allocate compressed read/write storage
+ * @num_pages:	Number of pages covered
+ *
+ * Like fobj_rw_paged_alloc(), but pages are compressed before they are
+ * encrypted and saved, and pages with only zeroes aren't saved at all.
+ * Backing store for the worst case, one page of TA RAM per page, is
+ * reserved up front so evicting a page never fails for lack of TA RAM.
+ *
+ * Returns a valid pointer on success or NULL on failure.
+ */
+struct fobj *fobj_rw_compressed_paged_alloc(unsigned int num_pages);
+
 /*
  * fobj_ro_paged_alloc() - Allocate initialized read-only storage
  * @num_pages:	Number of pages covered
@@ -122,13 +139,50 @@ static inline TEE_Result fobj_load_page(struct fobj *fobj,
 	return TEE_ERROR_GENERIC;
 }
 
+/*
+ * fobj_load_pages() - Load consecutive pages into memory
+ * @fobj:	Fobj pointer
+ * @page_idx:	Index of the first page in @fobj
+ * @va:		Addresses where the content of each page should be stored
+ *		and verified
+ * @num_pages:	Number of pages to load
+ *
+ * Fobjs which can verify several pages at once do that, the pages of
+ * other fobjs are loaded one by one.
+ *
+ * Returns TEE_SUCCESS on success or TEE_ERROR_* on failure.
+ */
+static inline TEE_Result fobj_load_pages(struct fobj *fobj,
+					 unsigned int page_idx,
+					 void *const *va,
+					 unsigned int num_pages)
+{
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int n = 0;
+
+	if (!fobj)
+		return TEE_ERROR_GENERIC;
+
+	if (fobj->ops->load_pages)
+		return fobj->ops->load_pages(fobj, page_idx, va, num_pages);
+
+	for (n = 0; n < num_pages; n++) {
+		res = fobj->ops->load_page(fobj, page_idx + n, va[n]);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 /*
  * fobj_save_page() - Save a page into storage
  * @fobj:	Fobj pointer
  * @page_index:	Index of page in @fobj
  * @va:		Address of the page to store.
  *
- * Returns TEE_SUCCESS on success or TEE_ERROR_* on failure.
+ * Returns TEE_SUCCESS on success, TEE_ERROR_OUT_OF_MEMORY if there's no
+ * storage left for the page or TEE_ERROR_* on other failure.
  */
 static inline TEE_Result fobj_save_page(struct fobj *fobj,
 					unsigned int page_idx, const void *va)
@@ -138,18 +192,46 @@ static inline TEE_Result fobj_save_page(struct fobj *fobj,
 
 	return TEE_ERROR_GENERIC;
 }
+
+/*
+ * struct fobj_page - Page of a fobj
+ * @fobj:	Fobj pointer
+ * @page_idx:	Index of page in @fobj
+ * @va:		Address of the page
+ */
+struct fobj_page {
+	struct fobj *fobj;
+	unsigned int page_idx;
+	const void *va;
+};
+
+/*
+ * fobj_save_pages() - Save several pages into storage
+ * @pages:	Pages to save
+ * @count:	Number of pages
+ *
+ * Same as calling fobj_save_page() for each page, but pages of fobjs
+ * allocated with fobj_rw_paged_alloc() are encrypted in batches.
+ *
+ * Returns TEE_SUCCESS on success or TEE_ERROR_* on failure.
+ */
+TEE_Result fobj_save_pages(struct fobj_page *pages, size_t count);
 #endif
 
 /*
  * fobj_ta_mem_alloc() - Allocates TA memory
  * @num_pages:	Number of pages
  *
- * If paging of user TAs read/write paged fobj is allocated otherwise a
- * fobj which uses unpaged secure memory directly.
+ * If paging of user TAs read/write paged fobj is allocated, compressed
+ * with CFG_PAGED_RW_COMPRESSION=y, otherwise a fobj which uses unpaged
+ * secure memory directly.
  *
  * Returns a valid pointer on success or NULL on failure.
  */
-#ifdef CFG_PAGED_USER_TA
+#if defined(CFG_PAGED_USER_TA) && defined(CFG_PAGED_RW_COMPRESSION)
+#define fobj_ta_mem_alloc(num_pages) \
+	fobj_rw_compressed_paged_alloc(num_pages)
+#elif defined(CFG_PAGED_USER_TA)
 #define fobj_ta_mem_alloc(num_pages)	fobj_rw_paged_alloc(num_pages)
 #else
 /*
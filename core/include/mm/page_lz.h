@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#ifndef __MM_PAGE_LZ_H
+#define __MM_PAGE_LZ_H
+
+#include <tee_api_types.h>
+#include <types_ext.h>
+#include <util.h>
+
+/*
+ * Small LZ77 codec used to compress paged memory before it's saved in the
+ * backing store. It's tuned for speed rather than ratio since it runs on
+ * each page eviction.
+ */
+
+#define PAGE_LZ_HASH_BITS	10
+
+/*
+ * struct page_lz_work - Work area of page_lz_compress()
+ * @hash_table:	Positions of recently seen 4 byte sequences
+ *
+ * Doesn't need to be initialized, but may only be used by one call at a
+ * time.
+ */
+struct page_lz_work {
+	uint16_t hash_table[BIT(PAGE_LZ_HASH_BITS)];
+};
+
+/*
+ * page_lz_compress() - Compress a buffer
+ * @src:	Data to compress
+ * @len:	Length of @src, at most 64 KiB
+ * @dst:	Buffer receiving the compressed data
+ * @dst_size:	Size of @dst
+ * @work:	Work area
+ *
+ * Returns the length of the compressed data or 0 if it doesn't fit in
+ * @dst.
+ */
+size_t page_lz_compress(const void *src, size_t len, void *dst,
+			size_t dst_size, struct page_lz_work *work);
+
+/*
+ * page_lz_decompress() - Decompress a buffer
+ * @src:	Compressed data
+ * @len:	Length of @src
+ * @dst:	Buffer receiving the decompressed data
+ * @dst_size:	Expected length of the decompressed data
+ *
+ * Returns TEE_SUCCESS if exactly @dst_size bytes were decompressed or
+ * TEE_ERROR_CORRUPT_OBJECT if @src is malformed.
+ */
+TEE_Result page_lz_decompress(const void *src, size_t len, void *dst,
+			      size_t dst_size);
+
+#endif /*__MM_PAGE_LZ_H*/
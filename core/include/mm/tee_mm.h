@@ -16,22 +16,34 @@
 /* Flag to indicate that pool should use nex_malloc instead of malloc */
 #define TEE_MM_POOL_NEX_MALLOC             (1u << 1)
 
+/*
+ * The entries of a pool are kept in an AVL tree sorted by offset. Each
+ * entry also records the free gap just below it and the largest such gap
+ * in its subtree so that a free range can be found in O(log n).
+ */
 struct _tee_mm_entry_t {
 	struct _tee_mm_pool_t *pool;
-	struct _tee_mm_entry_t *next;
+	struct _tee_mm_entry_t *parent;
+	struct _tee_mm_entry_t *left;
+	struct _tee_mm_entry_t *right;
 	uint32_t offset;	/* offset in pages/sections */
 	uint32_t size;		/* size in pages/sections */
+	uint32_t gap;		/* free pages/sections below the entry */
+	uint32_t max_gap;	/* largest gap in the subtree */
+	unsigned int height;	/* height of the subtree */
 };
 typedef struct _tee_mm_entry_t tee_mm_entry_t;
 
 struct _tee_mm_pool_t {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *root;	/* tree of allocated entries */
 	paddr_t lo;		/* low boundary of the pool */
 	paddr_t hi;		/* high boundary of the pool */
 	uint32_t flags;		/* Config flags for the pool */
 	uint8_t shift;		/* size shift */
+	bool initialized;
 	unsigned int lock;
 #ifdef CFG_WITH_STATS
+	size_t allocated;	/* allocated pages/sections */
 	size_t max_allocated;
 #endif
 };
@@ -24,6 +24,9 @@
 #define TEE_FS_HTREE_FEK_SIZE		16
 #define TEE_FS_HTREE_TAG_SIZE		16
 
+/* Max number of data blocks transferred with one request */
+#define TEE_FS_HTREE_MAX_RUN_BLOCKS	8
+
 /* Internal struct provided to let the rpc callbacks know the size if needed */
 struct tee_fs_htree_node_image {
 	/* Note that calc_node_hash() depends on hash first in struct */
@@ -78,10 +81,18 @@ struct tee_fs_rpc_operation;
  *			operation
  * @rpc_write_init:	initialize a struct tee_fs_rpc_operation for an RPC
  *			write operation
+ * @rpc_read_blocks_init: optional, initialize a struct tee_fs_rpc_operation
+ *			for an RPC read of @num_blocks consecutive data
+ *			blocks, both versions, finalized with @rpc_read_final
  *
  * The @idx arguments starts counting from 0. The @vers arguments are either
  * 0 or 1. The @data arguments is a pointer to a buffer in non-secure shared
  * memory where the encrypted data is stored.
+ *
+ * The @offs argument of rpc_read_blocks_init() is a scatter list with
+ * 2 * @num_blocks entries supplied by the caller. On return
+ * @offs[2 * n + vers] holds the offset into @data of version @vers of
+ * data block @idx + n. @num_blocks is at most TEE_FS_HTREE_MAX_RUN_BLOCKS.
  */
 struct tee_fs_htree_storage {
 	size_t block_size;
@@ -94,6 +105,27 @@ struct tee_fs_htree_storage {
 				     enum tee_fs_htree_type type, size_t idx,
 				     uint8_t vers, void **data);
 	TEE_Result (*rpc_write_final)(struct tee_fs_rpc_operation *op);
+	TEE_Result (*rpc_read_blocks_init)(void *aux,
+					   struct tee_fs_rpc_operation *op,
+					   size_t idx, size_t num_blocks,
+					   void **data, size_t *offs);
+};
+
+/*
+ * struct tee_fs_htree_cache_stats - statistics of the data block cache
+ * enabled with CFG_FS_HTREE_CACHE_BLOCKS, counted for all hash trees
+ * @hits:		block reads served from the cache
+ * @misses:		block reads that had to go to storage
+ * @coalesced:		block writes to an already dirty cached block
+ * @write_backs:	dirty blocks encrypted and written to storage
+ * @evictions:		blocks evicted to make room for another block
+ */
+struct tee_fs_htree_cache_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t coalesced;
+	uint32_t write_backs;
+	uint32_t evictions;
 };
 
 struct tee_fs_htree;
@@ -170,4 +202,48 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht, size_t block_num,
 TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht, size_t block_num,
 				   void *block);
 
+/**
+ * tee_fs_htree_write_blocks() - encrypt and write consecutive data blocks
+ * to storage
+ * @ht:		hash tree
+ * @block_num:	number of the first block
+ * @num_blocks:	number of blocks
+ * @blocks:	pointer to @num_blocks blocks of stor->block_size size
+ *
+ * Each block is written with its own request, only to the version of the
+ * block which isn't referenced by the committed tree.
+ *
+ * Frees the hash tree and sets *ht to NULL on failure and returns an error code
+ */
+TEE_Result tee_fs_htree_write_blocks(struct tee_fs_htree **ht,
+				     size_t block_num, size_t num_blocks,
+				     const void *blocks);
+
+/**
+ * tee_fs_htree_read_blocks() - read and decrypt consecutive data blocks
+ * from storage
+ * @ht:		hash tree
+ * @block_num:	number of the first block
+ * @num_blocks:	number of blocks
+ * @blocks:	pointer to @num_blocks blocks of stor->block_size size
+ *
+ * If the storage supplies rpc_read_blocks_init() up to
+ * TEE_FS_HTREE_MAX_RUN_BLOCKS blocks are read with each request. Each
+ * block is decrypted into a bounce buffer and only copied to @blocks once
+ * it's authenticated.
+ *
+ * Frees the hash tree and sets *ht to NULL on failure and returns an error code
+ */
+TEE_Result tee_fs_htree_read_blocks(struct tee_fs_htree **ht,
+				    size_t block_num, size_t num_blocks,
+				    void *blocks);
+
+/**
+ * tee_fs_htree_get_cache_stats() - get statistics of the data block cache
+ * @stats:	returned statistics
+ * @reset:	if true the statistics are reset after being copied
+ */
+void tee_fs_htree_get_cache_stats(struct tee_fs_htree_cache_stats *stats,
+				  bool reset);
+
 #endif /*__TEE_FS_HTREE_H*/
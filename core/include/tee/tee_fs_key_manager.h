@@ -18,10 +18,28 @@
 
 TEE_Result tee_fs_generate_fek(const TEE_UUID *uuid, void *encrypted_fek,
 			       size_t fek_size);
-TEE_Result tee_fs_crypt_block(const TEE_UUID *uuid, uint8_t *out,
-			      const uint8_t *in, size_t size,
-			      uint16_t blk_idx, const uint8_t *encrypted_fek,
-			      TEE_OperationMode mode);
+
+/*
+ * Per-file block encryption context, holds the AES key schedules of the
+ * decrypted FEK and of the ESSIV salt. Must be released with
+ * tee_fs_crypt_ctx_free() which wipes the key material.
+ */
+struct tee_fs_crypt_ctx;
+
+TEE_Result tee_fs_crypt_ctx_alloc(const TEE_UUID *uuid,
+				  const uint8_t *encrypted_fek,
+				  struct tee_fs_crypt_ctx **ctx);
+void tee_fs_crypt_ctx_free(struct tee_fs_crypt_ctx *ctx);
+
+/*
+ * Encrypts or decrypts @num_blks consecutive blocks of @blk_size bytes,
+ * the first one having index @blk_idx. @in and @out may be the same
+ * buffer.
+ */
+TEE_Result tee_fs_crypt_blocks(struct tee_fs_crypt_ctx *ctx, uint8_t *out,
+			       const uint8_t *in, size_t blk_size,
+			       size_t num_blks, uint16_t blk_idx,
+			       TEE_OperationMode mode);
 
 TEE_Result tee_fs_fek_crypt(const TEE_UUID *uuid, TEE_OperationMode mode,
 			    const uint8_t *in_key, size_t size,
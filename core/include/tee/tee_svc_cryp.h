@@ -81,6 +81,9 @@ TEE_Result syscall_asymm_verify(unsigned long state,
 			size_t num_params, const void *data, size_t data_len,
 			const void *sig, size_t sig_len);
 
+TEE_Result syscall_cryp_update_batch(struct utee_cryp_update *upd,
+			size_t num_upd);
+
 TEE_Result tee_obj_set_type(struct tee_obj *o, uint32_t obj_type,
 			    size_t max_key_size);
 
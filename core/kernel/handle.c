@@ -2,6 +2,8 @@
 /*
  * Copyright (c) 2014, Linaro Limited
  */
+#include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/handle.h>
@@ -14,6 +16,42 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+/*
+ * The used entries of db->ptrs are tracked in the bitmap db->used, which
+ * lets bit_ffc() find the lowest free handle without comparing each
+ * pointer. A handle is looked up directly as an index into db->ptrs.
+ */
+static bool grow(struct handle_db *db)
+{
+	size_t new_max_ptrs = 0;
+	bitstr_t *u = NULL;
+	void *p = NULL;
+
+	if (db->max_ptrs)
+		new_max_ptrs = db->max_ptrs * 2;
+	else
+		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+	if (new_max_ptrs > INT_MAX)
+		return false;
+
+	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+	if (!p)
+		return false;
+	db->ptrs = p;
+	memset(db->ptrs + db->max_ptrs, 0,
+	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
+
+	u = realloc(db->used, bitstr_size(new_max_ptrs));
+	if (!u)
+		return false;
+	db->used = u;
+	memset(db->used + bitstr_size(db->max_ptrs), 0,
+	       bitstr_size(new_max_ptrs) - bitstr_size(db->max_ptrs));
+
+	db->max_ptrs = new_max_ptrs;
+	return true;
+}
+
 void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr))
 {
 	if (db) {
@@ -25,42 +63,30 @@ void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr))
 					ptr_destructor(db->ptrs[n]);
 		}
 		free(db->ptrs);
+		free(db->used);
 		db->ptrs = NULL;
+		db->used = NULL;
 		db->max_ptrs = 0;
 	}
 }
 
 int handle_get(struct handle_db *db, void *ptr)
 {
-	size_t n;
-	void *p;
-	size_t new_max_ptrs;
+	int n = -1;
 
 	if (!db || !ptr)
 		return -1;
 
-	/* Try to find an empty location */
-	for (n = 0; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
-	}
-
-	/* No location available, grow the ptrs array */
 	if (db->max_ptrs)
-		new_max_ptrs = db->max_ptrs * 2;
-	else
-		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
-	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
-	if (!p)
-		return -1;
-	db->ptrs = p;
-	memset(db->ptrs + db->max_ptrs, 0,
-	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
-	db->max_ptrs = new_max_ptrs;
+		bit_ffc(db->used, (int)db->max_ptrs, &n);
+	if (n < 0) {
+		/* No location available, grow the ptrs array */
+		n = db->max_ptrs;
+		if (!grow(db))
+			return -1;
+	}
 
-	/* Since n stopped at db->max_ptrs there is an empty location there */
+	bit_set(db->used, n);
 	db->ptrs[n] = ptr;
 	return n;
 }
@@ -73,6 +99,7 @@ void *handle_put(struct handle_db *db, int handle)
 		return NULL;
 
 	p = db->ptrs[handle];
+	bit_clear(db->used, handle);
 	db->ptrs[handle] = NULL;
 	return p;
 }
@@ -9,6 +9,7 @@
 #include <kernel/panic.h>
 #include <kernel/pseudo_ta.h>
 #include <kernel/secure_partition.h>
+#include <kernel/spinlock.h>
 #include <kernel/tee_common.h>
 #include <kernel/tee_misc.h>
 #include <kernel/tee_ta_manager.h>
@@ -40,6 +41,29 @@ struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
 struct condvar tee_ta_init_cv = CONDVAR_INITIALIZER;
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
 
+/*
+ * Open sessions are indexed by session list and session id, and contexts
+ * by UUID, so they can be found without walking the lists. Number of
+ * buckets must be a power of two.
+ */
+#define TEE_TA_SESS_HASH_SIZE	64
+#define TEE_TA_CTX_HASH_SIZE	16
+
+LIST_HEAD(tee_ta_sess_bucket, tee_ta_session);
+LIST_HEAD(tee_ta_ctx_bucket, tee_ta_ctx);
+
+static struct tee_ta_sess_bucket tee_ta_sess_hash[TEE_TA_SESS_HASH_SIZE];
+static struct tee_ta_ctx_bucket tee_ta_ctx_hash[TEE_TA_CTX_HASH_SIZE];
+
+/*
+ * Protects tee_ta_sess_hash and the fields ref_count, lock_thread and
+ * unlink of the sessions. Those fields are only updated with both
+ * tee_ta_mutex and this spinlock held, except that tee_ta_get_session()
+ * may take an unlocked session holding only this spinlock. That way
+ * sessions can be looked up without contending on tee_ta_mutex.
+ */
+static unsigned int tee_ta_sess_lock = SPINLOCK_UNLOCK;
+
 #ifndef CFG_CONCURRENT_SINGLE_INSTANCE_TA
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static short int tee_ta_single_instance_thread = THREAD_ID_INVALID;
@@ -159,91 +183,166 @@ static void tee_ta_clear_busy(struct tee_ta_ctx *ctx)
 	mutex_unlock(&tee_ta_mutex);
 }
 
-static void dec_session_ref_count(struct tee_ta_session *s)
+static struct tee_ta_sess_bucket *
+sess_bucket(uint32_t id, struct tee_ta_session_head *open_sessions)
+{
+	uint32_t h = id ^ ((vaddr_t)open_sessions >> 4);
+
+	return tee_ta_sess_hash + (h & (TEE_TA_SESS_HASH_SIZE - 1));
+}
+
+/* Called with tee_ta_sess_lock held */
+static struct tee_ta_session *sess_hash_find(uint32_t id,
+			struct tee_ta_session_head *open_sessions)
+{
+	struct tee_ta_session *s = NULL;
+
+	LIST_FOREACH(s, sess_bucket(id, open_sessions), hash_link)
+		if (s->id == id && s->head == open_sessions)
+			return s;
+
+	return NULL;
+}
+
+/* Called with tee_ta_mutex held */
+static void link_session(struct tee_ta_session *s,
+			 struct tee_ta_session_head *open_sessions)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
+
+	s->head = open_sessions;
+	TAILQ_INSERT_TAIL(open_sessions, s, link);
+	LIST_INSERT_HEAD(sess_bucket(s->id, open_sessions), s, hash_link);
+
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+}
+
+/* Called with tee_ta_mutex held */
+static void unlink_session(struct tee_ta_session *s,
+			   struct tee_ta_session_head *open_sessions)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
+
+	TAILQ_REMOVE(open_sessions, s, link);
+	LIST_REMOVE(s, hash_link);
+	s->head = NULL;
+
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+}
+
+/*
+ * Called with tee_ta_mutex and tee_ta_sess_lock held, returns true if
+ * refc_cv is to be signalled once tee_ta_sess_lock is released.
+ */
+static bool dec_session_ref_count(struct tee_ta_session *s)
 {
 	assert(s->ref_count > 0);
 	s->ref_count--;
-	if (s->ref_count == 1)
-		condvar_signal(&s->refc_cv);
+	return s->ref_count == 1;
 }
 
 void tee_ta_put_session(struct tee_ta_session *s)
 {
+	bool signal_lock = false;
+	bool signal_refc = false;
+	uint32_t exceptions = 0;
+
 	mutex_lock(&tee_ta_mutex);
+	exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
 
 	if (s->lock_thread == thread_get_id()) {
 		s->lock_thread = THREAD_ID_INVALID;
-		condvar_signal(&s->lock_cv);
+		signal_lock = true;
 	}
-	dec_session_ref_count(s);
+	signal_refc = dec_session_ref_count(s);
 
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+	if (signal_lock)
+		condvar_signal(&s->lock_cv);
+	if (signal_refc)
+		condvar_signal(&s->refc_cv);
 	mutex_unlock(&tee_ta_mutex);
 }
 
-static struct tee_ta_session *tee_ta_find_session_nolock(uint32_t id,
+struct tee_ta_session *tee_ta_find_session(uint32_t id,
 			struct tee_ta_session_head *open_sessions)
 {
 	struct tee_ta_session *s = NULL;
-	struct tee_ta_session *found = NULL;
+	uint32_t exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
 
-	TAILQ_FOREACH(s, open_sessions, link) {
-		if (s->id == id) {
-			found = s;
-			break;
-		}
-	}
+	s = sess_hash_find(id, open_sessions);
 
-	return found;
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+
+	return s;
 }
 
-struct tee_ta_session *tee_ta_find_session(uint32_t id,
-			struct tee_ta_session_head *open_sessions)
+/*
+ * Takes a reference to the session, and the session lock if @exclusive,
+ * unless the session lock is held by another thread. Called with
+ * tee_ta_sess_lock held.
+ */
+static bool sess_try_get(struct tee_ta_session *s, bool exclusive)
 {
-	struct tee_ta_session *s = NULL;
-
-	mutex_lock(&tee_ta_mutex);
-
-	s = tee_ta_find_session_nolock(id, open_sessions);
-
-	mutex_unlock(&tee_ta_mutex);
+	if (exclusive && s->lock_thread != THREAD_ID_INVALID)
+		return false;
 
-	return s;
+	s->ref_count++;
+	if (exclusive)
+		s->lock_thread = thread_get_id();
+	return true;
 }
 
 struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 			struct tee_ta_session_head *open_sessions)
 {
-	struct tee_ta_session *s;
+	struct tee_ta_session *s = NULL;
+	bool signal_refc = false;
+	uint32_t exceptions = 0;
+
+	/* Fast path, the session is found and not locked by another thread */
+	exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
+	s = sess_hash_find(id, open_sessions);
+	if (s && s->unlink)
+		s = NULL;
+	if (!s || sess_try_get(s, exclusive)) {
+		cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+		return s;
+	}
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
 
 	mutex_lock(&tee_ta_mutex);
+	exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
 
-	while (true) {
-		s = tee_ta_find_session_nolock(id, open_sessions);
-		if (!s)
-			break;
-		if (s->unlink) {
-			s = NULL;
-			break;
-		}
-		s->ref_count++;
-		if (!exclusive)
-			break;
-
-		assert(s->lock_thread != thread_get_id());
+	s = sess_hash_find(id, open_sessions);
+	if (!s || s->unlink) {
+		s = NULL;
+		goto out;
+	}
+	s->ref_count++;
+	if (!exclusive)
+		goto out;
 
-		while (s->lock_thread != THREAD_ID_INVALID && !s->unlink)
-			condvar_wait(&s->lock_cv, &tee_ta_mutex);
+	assert(s->lock_thread != thread_get_id());
 
-		if (s->unlink) {
-			dec_session_ref_count(s);
-			s = NULL;
-			break;
-		}
+	while (s->lock_thread != THREAD_ID_INVALID && !s->unlink) {
+		cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+		condvar_wait(&s->lock_cv, &tee_ta_mutex);
+		exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
+	}
 
-		s->lock_thread = thread_get_id();
-		break;
+	if (s->unlink) {
+		signal_refc = dec_session_ref_count(s);
+		cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
+		if (signal_refc)
+			condvar_signal(&s->refc_cv);
+		mutex_unlock(&tee_ta_mutex);
+		return NULL;
 	}
 
+	s->lock_thread = thread_get_id();
+out:
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
 	mutex_unlock(&tee_ta_mutex);
 	return s;
 }
@@ -251,19 +350,24 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 static void tee_ta_unlink_session(struct tee_ta_session *s,
 			struct tee_ta_session_head *open_sessions)
 {
+	uint32_t exceptions = 0;
+
 	mutex_lock(&tee_ta_mutex);
 
 	assert(s->ref_count >= 1);
 	assert(s->lock_thread == thread_get_id());
 	assert(!s->unlink);
 
+	exceptions = cpu_spin_lock_xsave(&tee_ta_sess_lock);
 	s->unlink = true;
+	cpu_spin_unlock_xrestore(&tee_ta_sess_lock, exceptions);
 	condvar_broadcast(&s->lock_cv);
 
+	/* No new references can be taken once s->unlink is set */
 	while (s->ref_count != 1)
 		condvar_wait(&s->refc_cv, &tee_ta_mutex);
 
-	TAILQ_REMOVE(open_sessions, s, link);
+	unlink_session(s, open_sessions);
 
 	mutex_unlock(&tee_ta_mutex);
 }
@@ -350,7 +454,7 @@ static void destroy_ta_ctx_from_session(struct tee_ta_session *s)
 	ctx = to_ta_ctx(s->ts_sess.ctx);
 	assert(count == ctx->ref_count);
 
-	TAILQ_REMOVE(&tee_ctxes, ctx, link);
+	tee_ta_unregister_ctx(ctx);
 	mutex_unlock(&tee_ta_mutex);
 
 	destroy_context(ctx);
@@ -358,20 +462,50 @@ static void destroy_ta_ctx_from_session(struct tee_ta_session *s)
 	s->ts_sess.ctx = NULL;
 }
 
+static struct tee_ta_ctx_bucket *ctx_bucket(const TEE_UUID *uuid)
+{
+	uint32_t w[sizeof(TEE_UUID) / sizeof(uint32_t)] = { };
+	uint32_t h = 0;
+
+	memcpy(w, uuid, sizeof(w));
+	h = w[0] ^ w[1] ^ w[2] ^ w[3];
+	h ^= h >> 16;
+	h ^= h >> 8;
+
+	return tee_ta_ctx_hash + (h & (TEE_TA_CTX_HASH_SIZE - 1));
+}
+
+void tee_ta_register_ctx(struct tee_ta_ctx *ctx)
+{
+	TAILQ_INSERT_TAIL(&tee_ctxes, ctx, link);
+	LIST_INSERT_HEAD(ctx_bucket(&ctx->ts_ctx.uuid), ctx, hash_link);
+}
+
+void tee_ta_unregister_ctx(struct tee_ta_ctx *ctx)
+{
+	TAILQ_REMOVE(&tee_ctxes, ctx, link);
+	LIST_REMOVE(ctx, hash_link);
+}
+
 /*
  * tee_ta_context_find - Find TA in session list based on a UUID (input)
  * Returns a pointer to the session
  */
 static struct tee_ta_ctx *tee_ta_context_find(const TEE_UUID *uuid)
 {
-	struct tee_ta_ctx *ctx;
+	struct tee_ta_ctx *ctx = NULL;
+	struct tee_ta_ctx *found = NULL;
 
-	TAILQ_FOREACH(ctx, &tee_ctxes, link) {
-		if (memcmp(&ctx->ts_ctx.uuid, uuid, sizeof(TEE_UUID)) == 0)
-			return ctx;
-	}
+	/*
+	 * Return the first registered context with this UUID, as when
+	 * walking tee_ctxes. New contexts are inserted at the head of the
+	 * bucket.
+	 */
+	LIST_FOREACH(ctx, ctx_bucket(uuid), hash_link)
+		if (!memcmp(&ctx->ts_ctx.uuid, uuid, sizeof(TEE_UUID)))
+			found = ctx;
 
-	return NULL;
+	return found;
 }
 
 /* check if requester (client ID) matches session initial client */
@@ -539,7 +673,7 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 	keep_alive = (ctx->flags & TA_FLAG_INSTANCE_KEEP_ALIVE) &&
 			(ctx->flags & TA_FLAG_SINGLE_INSTANCE);
 	if (!ctx->ref_count && !keep_alive) {
-		TAILQ_REMOVE(&tee_ctxes, ctx, link);
+		tee_ta_unregister_ctx(ctx);
 		mutex_unlock(&tee_ta_mutex);
 
 		destroy_context(ctx);
@@ -610,7 +744,7 @@ static uint32_t new_session_id(struct tee_ta_session_head *open_sessions)
 
 	saved = id;
 	do {
-		if (!tee_ta_find_session_nolock(id, open_sessions))
+		if (!tee_ta_find_session(id, open_sessions))
 			return id;
 		id++;
 		if (!id)
@@ -645,7 +779,7 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 		goto err_mutex_unlock;
 	}
 
-	TAILQ_INSERT_TAIL(open_sessions, s, link);
+	link_session(s, open_sessions);
 
 	/* Look for already loaded TA */
 	res = tee_ta_init_session_with_context(s, uuid);
@@ -673,7 +807,7 @@ out:
 	}
 
 	mutex_lock(&tee_ta_mutex);
-	TAILQ_REMOVE(open_sessions, s, link);
+	unlink_session(s, open_sessions);
 err_mutex_unlock:
 	mutex_unlock(&tee_ta_mutex);
 	free(s);
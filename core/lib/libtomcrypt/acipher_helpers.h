@@ -44,6 +44,15 @@ TEE_Result ecc_populate_ltc_public_key(ecc_key *ltc_key,
 				       uint32_t algo, size_t *key_size_bytes);
 #endif
 
+#ifdef LTC_MECC
+/*
+ * ltc_ecc_mulmod() with precomputed tables when @G is the generator of a
+ * NIST P-256, P-384 or P-521 curve, used as ltc_mp.ecc_ptmul
+ */
+int ecc_fixed_base_mulmod(void *k, const ecc_point *G, ecc_point *R,
+			  void *a, void *modulus, int map);
+#endif
+
 /* Write bignum to fixed size buffer in big endian order */
 #define mp_to_unsigned_bin2(a, b, c) \
         do { \
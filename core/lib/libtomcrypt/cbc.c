@@ -7,6 +7,7 @@
 #include <crypto/crypto.h>
 #include <crypto/crypto_impl.h>
 #include <stdlib.h>
+#include <stdlib_ext.h>
 #include <tee_api_types.h>
 #include <tomcrypt_private.h>
 #include <util.h>
@@ -78,7 +79,7 @@ static void ltc_cbc_final(struct crypto_cipher_ctx *ctx)
 
 static void ltc_cbc_free_ctx(struct crypto_cipher_ctx *ctx)
 {
-	free(to_cbc_ctx(ctx));
+	free_wipe(to_cbc_ctx(ctx));
 }
 
 static void ltc_cbc_copy_state(struct crypto_cipher_ctx *dst_ctx,
@@ -7,6 +7,7 @@
 #include <crypto/crypto.h>
 #include <crypto/crypto_impl.h>
 #include <stdlib.h>
+#include <stdlib_ext.h>
 #include <tee_api_types.h>
 #include <tomcrypt_private.h>
 #include <util.h>
@@ -76,7 +77,7 @@ static void ltc_ecb_final(struct crypto_cipher_ctx *ctx)
 
 static void ltc_ecb_free_ctx(struct crypto_cipher_ctx *ctx)
 {
-	free(to_ecb_ctx(ctx));
+	free_wipe(to_ecb_ctx(ctx));
 }
 
 static void ltc_ecb_copy_state(struct crypto_cipher_ctx *dst_ctx,
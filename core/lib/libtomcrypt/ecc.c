@@ -4,11 +4,14 @@
  */
 
 #include <crypto/crypto.h>
+#include <initcall.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string_ext.h>
 #include <tee_api_types.h>
 #include <trace.h>
 #include <utee_defines.h>
+#include <util.h>
 
 #include "acipher_helpers.h"
 
@@ -379,3 +382,481 @@ out:
 	ecc_free(&ltc_public_key);
 	return res;
 }
+
+/*
+ * Fixed-base comb multiplication of the generators of the NIST P-256,
+ * P-384 and P-521 curves. Key generation and the ephemeral key of ECDSA
+ * signatures multiply the generator by a secret scalar, with the comb
+ * that takes one doubling and one addition per COMB_TEETH bits of the
+ * scalar instead of one of each per bit.
+ *
+ * The comb uses the signed odd digits of mbedtls' ecp_comb_recode_core()
+ * so that every column adds a point, and every table lookup reads the
+ * whole table. As with ltc_ecc_mulmod() the sequence of point operations
+ * doesn't depend on the scalar.
+ *
+ * The tables are computed at boot and are read-only afterwards. They're
+ * stored as bytes since the bignums of LibTomCrypt are allocated from a
+ * scratch memory pool.
+ */
+#define COMB_TEETH		5
+#define COMB_NUM_POINTS		BIT(COMB_TEETH - 1)
+#define COMB_MAX_BYTES		66
+#define COMB_MAX_DIGITS		((521 + COMB_TEETH - 1) / COMB_TEETH + 1)
+
+struct ecc_comb {
+	const char *name;
+	/* Size of the prime, the order and the coordinates in bytes */
+	size_t len;
+	/* The scalar is recoded in @d + 1 digits */
+	size_t d;
+	/*
+	 * Prime, order, x and y of the generator followed by the x, y and
+	 * -y coordinates of the COMB_NUM_POINTS points of the table in
+	 * Montgomery form, all big endian and @len bytes long.
+	 */
+	uint8_t *buf;
+};
+
+static struct ecc_comb ecc_combs[] = {
+	{ .name = "NISTP256" },
+	{ .name = "NISTP384" },
+	{ .name = "NISTP521" },
+};
+
+static const uint8_t *comb_prime(const struct ecc_comb *c)
+{
+	return c->buf;
+}
+
+static const uint8_t *comb_order(const struct ecc_comb *c)
+{
+	return c->buf + c->len;
+}
+
+static const uint8_t *comb_gx(const struct ecc_comb *c)
+{
+	return c->buf + 2 * c->len;
+}
+
+static const uint8_t *comb_gy(const struct ecc_comb *c)
+{
+	return c->buf + 3 * c->len;
+}
+
+static uint8_t *comb_point(const struct ecc_comb *c, size_t idx)
+{
+	return c->buf + (4 + 3 * idx) * c->len;
+}
+
+/* Returns 0xff if @a == @b and 0 otherwise without branches */
+static uint8_t ct_mask_eq(unsigned int a, unsigned int b)
+{
+	return ((a ^ b) - 1) >> 8;
+}
+
+static void ct_select(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		      uint8_t mask_b, size_t len)
+{
+	size_t n = 0;
+
+	for (n = 0; n < len; n++)
+		dst[n] = (a[n] & ~mask_b) | (b[n] & mask_b);
+}
+
+/* Writes @a to the fixed size big endian buffer @buf */
+static void comb_write(void *a, uint8_t *buf, size_t len)
+{
+	memset(buf, 0, len);
+	mp_to_unsigned_bin2(a, buf, len);
+}
+
+/*
+ * Sets @x and @y to the table point of @digit, negated if the sign bit
+ * of @digit is set, see comb_recode(). All points are read.
+ */
+static void comb_select(const struct ecc_comb *c, uint8_t digit, uint8_t *x,
+			uint8_t *y)
+{
+	uint8_t neg = -(digit >> 7);
+	unsigned int idx = (digit & 0x7f) >> 1;
+	const uint8_t *p = NULL;
+	uint8_t mask = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	memset(x, 0, c->len);
+	memset(y, 0, c->len);
+	for (n = 0; n < COMB_NUM_POINTS; n++) {
+		p = comb_point(c, n);
+		mask = ct_mask_eq(n, idx);
+		for (m = 0; m < c->len; m++) {
+			x[m] |= p[m] & mask;
+			y[m] |= p[c->len + m] & mask & ~neg;
+			y[m] |= p[2 * c->len + m] & mask & neg;
+		}
+	}
+}
+
+static unsigned int comb_get_bit(const uint8_t *m, size_t len, size_t bit)
+{
+	if (bit >= len * 8)
+		return 0;
+	return (m[len - 1 - bit / 8] >> (bit % 8)) & 1;
+}
+
+/*
+ * Recodes the odd scalar @m into the @d + 1 odd digits @x, the low bits
+ * of a digit select a point in the table and the top bit is the sign.
+ * From ecp_comb_recode_core() in mbedtls.
+ */
+static void comb_recode(const struct ecc_comb *c, const uint8_t *m,
+			uint8_t *x)
+{
+	uint8_t adjust = 0;
+	uint8_t cc = 0;
+	uint8_t cr = 0;
+	size_t n = 0;
+	size_t t = 0;
+
+	memset(x, 0, c->d + 1);
+	for (n = 0; n < c->d; n++)
+		for (t = 0; t < COMB_TEETH; t++)
+			x[n] |= comb_get_bit(m, c->len, n + c->d * t) << t;
+
+	/* Make x[1] .. x[d] odd */
+	for (n = 1; n <= c->d; n++) {
+		cc = x[n] & cr;
+		x[n] ^= cr;
+		cr = cc;
+
+		adjust = 1 - (x[n] & 1);
+		cr |= x[n] & (x[n - 1] * adjust);
+		x[n] ^= x[n - 1] * adjust;
+		x[n - 1] |= adjust << 7;
+	}
+}
+
+static int comb_read_point(const struct ecc_comb *c, uint8_t digit,
+			   ecc_point *p, uint8_t *x, uint8_t *y)
+{
+	int err = CRYPT_OK;
+
+	comb_select(c, digit, x, y);
+	err = mp_read_unsigned_bin(p->x, x, c->len);
+	if (err == CRYPT_OK)
+		err = mp_read_unsigned_bin(p->y, y, c->len);
+
+	return err;
+}
+
+static const struct ecc_comb *find_comb(const ecc_point *G, void *modulus)
+{
+	uint8_t buf[COMB_MAX_BYTES] = { };
+	const struct ecc_comb *c = NULL;
+	size_t n = 0;
+
+	if (mp_cmp_d(G->z, 1) != LTC_MP_EQ)
+		return NULL;
+
+	for (n = 0; n < ARRAY_SIZE(ecc_combs); n++) {
+		c = ecc_combs + n;
+		if (!c->buf || mp_unsigned_bin_size(modulus) != c->len)
+			continue;
+		comb_write(modulus, buf, c->len);
+		if (memcmp(buf, comb_prime(c), c->len))
+			continue;
+		if (mp_unsigned_bin_size(G->x) > c->len ||
+		    mp_unsigned_bin_size(G->y) > c->len)
+			return NULL;
+		comb_write(G->x, buf, c->len);
+		if (memcmp(buf, comb_gx(c), c->len))
+			return NULL;
+		comb_write(G->y, buf, c->len);
+		if (memcmp(buf, comb_gy(c), c->len))
+			return NULL;
+		return c;
+	}
+
+	return NULL;
+}
+
+static int comb_mulmod(const struct ecc_comb *c, void *k, ecc_point *R,
+		       void *modulus, int map)
+{
+	uint8_t digits[COMB_MAX_DIGITS + 1] = { };
+	uint8_t m[COMB_MAX_BYTES] = { };
+	uint8_t t[COMB_MAX_BYTES] = { };
+	uint8_t negate = 0;
+	ecc_point *P = NULL;
+	void *order = NULL;
+	void *tmp = NULL;
+	void *mp = NULL;
+	int err = CRYPT_OK;
+	size_t n = 0;
+
+	err = mp_init_multi(&order, &tmp, NULL);
+	if (err != CRYPT_OK)
+		return err;
+	P = ltc_ecc_new_point();
+	if (!P) {
+		err = CRYPT_MEM;
+		goto out;
+	}
+	err = mp_montgomery_setup(modulus, &mp);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_montgomery_normalization(P->z, modulus);
+	if (err != CRYPT_OK)
+		goto out;
+
+	/*
+	 * The recoding needs an odd scalar, the order is odd so one of k
+	 * and order - k is. In the latter case the result is negated.
+	 */
+	err = mp_read_unsigned_bin(order, (uint8_t *)comb_order(c), c->len);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_sub(order, k, tmp);
+	if (err != CRYPT_OK)
+		goto out;
+	comb_write(k, m, c->len);
+	comb_write(tmp, t, c->len);
+	negate = (m[c->len - 1] & 1) - 1;
+	ct_select(m, m, t, negate, c->len);
+	comb_recode(c, m, digits);
+
+	/* R->z is Montgomery one, like P->z */
+	err = mp_copy(P->z, R->z);
+	if (err != CRYPT_OK)
+		goto out;
+	err = comb_read_point(c, digits[c->d], R, m, t);
+	if (err != CRYPT_OK)
+		goto out;
+
+	for (n = c->d; n > 0; n--) {
+		err = ltc_mp.ecc_ptdbl(R, R, NULL, modulus, mp);
+		if (err != CRYPT_OK)
+			goto out;
+		err = comb_read_point(c, digits[n - 1], P, m, t);
+		if (err != CRYPT_OK)
+			goto out;
+		err = ltc_mp.ecc_ptadd(R, P, R, NULL, modulus, mp);
+		if (err != CRYPT_OK)
+			goto out;
+	}
+
+	err = mp_sub(modulus, R->y, tmp);
+	if (err != CRYPT_OK)
+		goto out;
+	comb_write(R->y, m, c->len);
+	comb_write(tmp, t, c->len);
+	ct_select(m, m, t, negate, c->len);
+	err = mp_read_unsigned_bin(R->y, m, c->len);
+	if (err != CRYPT_OK)
+		goto out;
+
+	if (map)
+		err = ltc_ecc_map(R, modulus, mp);
+out:
+	memzero_explicit(digits, sizeof(digits));
+	memzero_explicit(m, sizeof(m));
+	memzero_explicit(t, sizeof(t));
+	ltc_ecc_del_point(P);
+	mp_clear_multi(order, tmp, NULL);
+	if (mp)
+		mp_montgomery_free(mp);
+	return err;
+}
+
+/* The recoding in comb_mulmod() needs 0 < @k < order */
+static bool comb_scalar_is_valid(const struct ecc_comb *c, void *k)
+{
+	void *order = NULL;
+	bool ret = false;
+
+	if (mp_init(&order) != CRYPT_OK)
+		return false;
+	if (mp_read_unsigned_bin(order, (uint8_t *)comb_order(c),
+				 c->len) == CRYPT_OK)
+		ret = !mp_iszero(k) && mp_cmp(k, order) == LTC_MP_LT;
+	mp_clear(order);
+
+	return ret;
+}
+
+int ecc_fixed_base_mulmod(void *k, const ecc_point *G, ecc_point *R,
+			  void *a, void *modulus, int map)
+{
+	const struct ecc_comb *c = find_comb(G, modulus);
+
+	if (c && comb_scalar_is_valid(c, k))
+		return comb_mulmod(c, k, R, modulus, map);
+
+	return ltc_ecc_mulmod(k, G, R, a, modulus, map);
+}
+
+/*
+ * Computes T[i] = i_{w-1} 2^{(w-1)d} G + ... + i_1 2^d G + G for
+ * i = 0 .. COMB_NUM_POINTS - 1 where i_{w-1} .. i_1 are the bits of i, as
+ * ecp_precompute_comb() in mbedtls.
+ */
+static int comb_init_table(struct ecc_comb *c, void *prime, ecc_point *G)
+{
+	ecc_point *T[COMB_NUM_POINTS] = { };
+	uint8_t *p = NULL;
+	void *mu = NULL;
+	void *mp = NULL;
+	int err = CRYPT_MEM;
+	size_t i = 0;
+	size_t j = 0;
+
+	for (i = 0; i < COMB_NUM_POINTS; i++) {
+		T[i] = ltc_ecc_new_point();
+		if (!T[i])
+			goto out;
+	}
+	err = mp_init(&mu);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_montgomery_setup(prime, &mp);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_montgomery_normalization(mu, prime);
+	if (err != CRYPT_OK)
+		goto out;
+
+	err = mp_mulmod(G->x, mu, prime, T[0]->x);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_mulmod(G->y, mu, prime, T[0]->y);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_copy(mu, T[0]->z);
+	if (err != CRYPT_OK)
+		goto out;
+
+	/* T[2^(l - 1)] = 2^(dl) G for l = 1 .. w - 1 */
+	for (j = 0; j < c->d * (COMB_TEETH - 1); j++) {
+		i = BIT(j / c->d);
+		if (!(j % c->d)) {
+			err = ltc_ecc_copy_point(T[i >> 1], T[i]);
+			if (err != CRYPT_OK)
+				goto out;
+		}
+		err = ltc_mp.ecc_ptdbl(T[i], T[i], NULL, prime, mp);
+		if (err != CRYPT_OK)
+			goto out;
+	}
+
+	/* T[2^l] is updated last since the other sums use it */
+	for (i = 1; i < COMB_NUM_POINTS; i <<= 1) {
+		for (j = i; j--;) {
+			err = ltc_mp.ecc_ptadd(T[j], T[i], T[i + j], NULL,
+					       prime, mp);
+			if (err != CRYPT_OK)
+				goto out;
+		}
+	}
+
+	for (i = 0; i < COMB_NUM_POINTS; i++) {
+		p = comb_point(c, i);
+		err = ltc_ecc_map(T[i], prime, mp);
+		if (err != CRYPT_OK)
+			goto out;
+		err = mp_mulmod(T[i]->x, mu, prime, T[i]->x);
+		if (err != CRYPT_OK)
+			goto out;
+		err = mp_mulmod(T[i]->y, mu, prime, T[i]->y);
+		if (err != CRYPT_OK)
+			goto out;
+		comb_write(T[i]->x, p, c->len);
+		comb_write(T[i]->y, p + c->len, c->len);
+		err = mp_sub(prime, T[i]->y, T[i]->z);
+		if (err != CRYPT_OK)
+			goto out;
+		comb_write(T[i]->z, p + 2 * c->len, c->len);
+	}
+out:
+	for (i = 0; i < COMB_NUM_POINTS; i++)
+		ltc_ecc_del_point(T[i]);
+	if (mu)
+		mp_clear(mu);
+	if (mp)
+		mp_montgomery_free(mp);
+	return err;
+}
+
+static int comb_init(struct ecc_comb *c)
+{
+	const ltc_ecc_curve *cu = NULL;
+	ecc_point *G = NULL;
+	void *prime = NULL;
+	void *order = NULL;
+	int err = CRYPT_OK;
+
+	err = ecc_find_curve(c->name, &cu);
+	if (err != CRYPT_OK)
+		return err;
+	err = mp_init_multi(&prime, &order, NULL);
+	if (err != CRYPT_OK)
+		return err;
+	G = ltc_ecc_new_point();
+	if (!G) {
+		err = CRYPT_MEM;
+		goto out;
+	}
+
+	err = mp_read_radix(prime, cu->prime, 16);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_read_radix(order, cu->order, 16);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_read_radix(G->x, cu->Gx, 16);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_read_radix(G->y, cu->Gy, 16);
+	if (err != CRYPT_OK)
+		goto out;
+
+	c->len = mp_unsigned_bin_size(prime);
+	c->d = (mp_count_bits(order) + COMB_TEETH - 1) / COMB_TEETH;
+	if (c->len > COMB_MAX_BYTES || c->d > COMB_MAX_DIGITS ||
+	    mp_unsigned_bin_size(order) > c->len) {
+		err = CRYPT_INVALID_ARG;
+		goto out;
+	}
+
+	c->buf = calloc(4 + 3 * COMB_NUM_POINTS, c->len);
+	if (!c->buf) {
+		err = CRYPT_MEM;
+		goto out;
+	}
+	comb_write(prime, c->buf, c->len);
+	comb_write(order, c->buf + c->len, c->len);
+	comb_write(G->x, c->buf + 2 * c->len, c->len);
+	comb_write(G->y, c->buf + 3 * c->len, c->len);
+
+	err = comb_init_table(c, prime, G);
+	if (err != CRYPT_OK) {
+		free(c->buf);
+		c->buf = NULL;
+	}
+out:
+	ltc_ecc_del_point(G);
+	mp_clear_multi(prime, order, NULL);
+	return err;
+}
+
+static TEE_Result ecc_init_combs(void)
+{
+	size_t n = 0;
+
+	for (n = 0; n < ARRAY_SIZE(ecc_combs); n++)
+		if (comb_init(ecc_combs + n) != CRYPT_OK)
+			DMSG("No comb table for %s", ecc_combs[n].name);
+
+	return TEE_SUCCESS;
+}
+service_init_late(ecc_init_combs);
@@ -4,6 +4,7 @@
  */
 
 #include <assert.h>
+#include <crypto/crypto_accel.h>
 #include <crypto/crypto.h>
 #include <crypto/crypto_impl.h>
 #include <stdlib.h>
@@ -184,6 +185,82 @@ TEE_Result hash_sha256_check(const uint8_t *hash, const uint8_t *data,
 		return TEE_ERROR_SECURITY;
 	return TEE_SUCCESS;
 }
+
+static TEE_Result sha256_finish(hash_state *hs, const uint8_t *data,
+				size_t data_size, uint8_t *digest)
+{
+	if (sha256_process(hs, data, data_size) != CRYPT_OK)
+		return TEE_ERROR_GENERIC;
+	if (sha256_done(hs, digest) != CRYPT_OK)
+		return TEE_ERROR_GENERIC;
+	return TEE_SUCCESS;
+}
+
+#if defined(_CFG_CORE_LTC_SHA256_ACCEL)
+/*
+ * Compresses the full blocks the two messages have in common with both
+ * lanes interleaved, the tails are completed separately in @hs. The
+ * caller's hash state is reused to save stack, this may run on the abort
+ * stack when the pager loads pages.
+ */
+static TEE_Result sha256_pair(hash_state *hs, struct hash_sha256_msg *msgs)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t state[2][8] = { };
+	const void *src[2] = { msgs[0].data, msgs[1].data };
+	size_t blocks = MIN(msgs[0].data_size, msgs[1].data_size) / 64;
+	size_t n = 0;
+
+	blocks = MIN(blocks, (size_t)UINT_MAX);
+	if (sha256_init(hs) != CRYPT_OK)
+		return TEE_ERROR_GENERIC;
+	for (n = 0; n < 2; n++)
+		memcpy(state[n], hs->sha256.state, sizeof(state[n]));
+
+	if (blocks)
+		crypto_accel_sha256_compress_x2(state, src, blocks);
+
+	for (n = 0; n < 2; n++) {
+		if (sha256_init(hs) != CRYPT_OK)
+			return TEE_ERROR_GENERIC;
+		memcpy(hs->sha256.state, state[n], sizeof(state[n]));
+		hs->sha256.length = (ulong64)blocks * 64 * 8;
+		res = sha256_finish(hs, msgs[n].data + blocks * 64,
+				    msgs[n].data_size - blocks * 64,
+				    msgs[n].digest);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+#endif
+
+TEE_Result hash_sha256_multi(struct hash_sha256_msg *msgs, size_t num_msgs)
+{
+	TEE_Result res = TEE_SUCCESS;
+	hash_state hs = { };
+	size_t n = 0;
+
+#if defined(_CFG_CORE_LTC_SHA256_ACCEL)
+	for (; n + 1 < num_msgs; n += 2) {
+		res = sha256_pair(&hs, msgs + n);
+		if (res)
+			return res;
+	}
+#endif
+
+	for (; n < num_msgs; n++) {
+		if (sha256_init(&hs) != CRYPT_OK)
+			return TEE_ERROR_GENERIC;
+		res = sha256_finish(&hs, msgs[n].data, msgs[n].data_size,
+				    msgs[n].digest);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
 #endif
 
 #if defined(_CFG_CORE_LTC_SHA512_256)
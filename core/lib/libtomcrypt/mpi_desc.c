@@ -9,23 +9,37 @@
 #include <mempool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <tomcrypt_private.h>
 #include <tomcrypt_mp.h>
 #include <util.h>
 
+#include "acipher_helpers.h"
+
 #if defined(_CFG_CORE_LTC_PAGER)
 #include <mm/core_mmu.h>
 #include <mm/tee_pager.h>
 #endif
 
-/* Size needed for xtest to pass reliably on both ARM32 and ARM64 */
-#define MPI_MEMPOOL_SIZE	(42 * 1024)
+#define MPI_MEMPOOL_SIZE	CFG_CORE_BIGNUM_MEMPOOL_SIZE
+
+#if defined(CFG_CORE_BIGNUM_MEMPOOL_PER_THREAD)
+#define MPI_MEMPOOL_COUNT	CFG_NUM_THREADS
+#else
+#define MPI_MEMPOOL_COUNT	1
+#endif
 
 /* From mbedtls/library/bignum.c */
 #define ciL		(sizeof(mbedtls_mpi_uint))	/* chars in limb  */
 #define biL		(ciL << 3)			/* bits  in limb  */
 #define BITS_TO_LIMBS(i)	((i) / biL + ((i) % biL != 0))
 
+static struct mempool *alloc_pool(void *data, size_t size,
+				  void (*release_mem)(void *ptr, size_t size))
+{
+	if (MPI_MEMPOOL_COUNT > 1)
+		return mempool_alloc_thread_pools(data, size, release_mem);
+	return mempool_alloc_pool(data, size, release_mem);
+}
+
 #if defined(_CFG_CORE_LTC_PAGER)
 /* allocate pageable_zi vmem for mp scratch memory pool */
 static struct mempool *get_mp_scratch_memory_pool(void)
@@ -33,19 +47,22 @@ static struct mempool *get_mp_scratch_memory_pool(void)
 	size_t size;
 	void *data;
 
+	/* Each pool is released separately, keep them page aligned */
 	size = ROUNDUP(MPI_MEMPOOL_SIZE, SMALL_PAGE_SIZE);
-	data = tee_pager_alloc(size);
+	data = tee_pager_alloc(size * MPI_MEMPOOL_COUNT);
 	if (!data)
 		panic();
 
-	return mempool_alloc_pool(data, size, tee_pager_release_phys);
+	return alloc_pool(data, size, tee_pager_release_phys);
 }
 #else /* _CFG_CORE_LTC_PAGER */
 static struct mempool *get_mp_scratch_memory_pool(void)
 {
-	static uint8_t data[MPI_MEMPOOL_SIZE] __aligned(MEMPOOL_ALIGN);
+	static uint8_t data[MPI_MEMPOOL_COUNT][ROUNDUP(MPI_MEMPOOL_SIZE,
+						       MEMPOOL_ALIGN)]
+		__aligned(MEMPOOL_ALIGN);
 
-	return mempool_alloc_pool(data, sizeof(data), NULL);
+	return alloc_pool(data, sizeof(data[0]), NULL);
 }
 #endif
 
@@ -683,7 +700,7 @@ ltc_math_descriptor ltc_mp = {
 #ifdef LTC_MECC_FP
 	.ecc_ptmul = &ltc_ecc_fp_mulmod,
 #else
-	.ecc_ptmul = &ltc_ecc_mulmod,
+	.ecc_ptmul = &ecc_fixed_base_mulmod,
 #endif /* LTC_MECC_FP */
 	.ecc_ptadd = &ltc_ecc_projective_add_point,
 	.ecc_ptdbl = &ltc_ecc_projective_dbl_point,
@@ -699,7 +716,7 @@ ltc_math_descriptor ltc_mp = {
 
 #ifdef LTC_MRSA
 	.rsa_keygen = &rsa_make_key,
-	.rsa_me = &rsa_exptmod,
+	.rsa_me = &rsa_exptmod_precomp,
 #endif
 	.addmod = addmod,
 	.submod = submod,
@@ -4,6 +4,7 @@
  */
 
 #include <crypto/crypto.h>
+#include <mbedtls/bignum.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tee_api_types.h>
@@ -82,6 +83,215 @@ static TEE_Result tee_algo_to_ltc_hashindex(uint32_t algo, int *ltc_hashindex)
 		return TEE_SUCCESS;
 }
 
+/*
+ * Private key operations on a struct rsa_keypair are done by
+ * rsa_exptmod_precomp() using state kept with the key: the Montgomery
+ * constants of the moduli, computed by the first mbedtls_mpi_exp_mod()
+ * with each modulus, and the blinding values which are updated by
+ * squaring between operations instead of being drawn again.
+ */
+struct rsa_precomp {
+	mbedtls_mpi rn;		/* Montgomery constant for N */
+	mbedtls_mpi rp;		/* Montgomery constant for p */
+	mbedtls_mpi rq;		/* Montgomery constant for q */
+	mbedtls_mpi vi;		/* Blinding value, vf^-e mod N */
+	mbedtls_mpi vf;		/* Unblinding value */
+};
+
+static struct rsa_precomp *get_precomp(struct rsa_keypair *key)
+{
+	struct rsa_precomp *pc = key->precomp;
+
+	if (!pc) {
+		pc = malloc(sizeof(*pc));
+		if (!pc)
+			return NULL;
+		mbedtls_mpi_init(&pc->rn);
+		mbedtls_mpi_init(&pc->rp);
+		mbedtls_mpi_init(&pc->rq);
+		mbedtls_mpi_init(&pc->vi);
+		mbedtls_mpi_init(&pc->vf);
+		key->precomp = pc;
+	}
+
+	return pc;
+}
+
+void crypto_acipher_rsa_keypair_changed(struct rsa_keypair *s)
+{
+	struct rsa_precomp *pc = s->precomp;
+
+	if (!pc)
+		return;
+
+	mbedtls_mpi_free(&pc->rn);
+	mbedtls_mpi_free(&pc->rp);
+	mbedtls_mpi_free(&pc->rq);
+	mbedtls_mpi_free(&pc->vi);
+	mbedtls_mpi_free(&pc->vf);
+	free(pc);
+	s->precomp = NULL;
+}
+
+static void ltc_key_from_keypair(rsa_key *ltc_key, struct rsa_keypair *key)
+{
+	ltc_key->type = PK_PRIVATE;
+	ltc_key->e = key->e;
+	ltc_key->N = key->n;
+	ltc_key->d = key->d;
+	if (key->p && crypto_bignum_num_bytes(key->p)) {
+		ltc_key->p = key->p;
+		ltc_key->q = key->q;
+		ltc_key->qP = key->qp;
+		ltc_key->dP = key->dp;
+		ltc_key->dQ = key->dq;
+	}
+	/* Falls back to rsa_exptmod() if NULL */
+	ltc_key->precomp = get_precomp(key);
+}
+
+static int rng_read(void *ignored __unused, unsigned char *buf, size_t blen)
+{
+	if (crypto_rng_read(buf, blen))
+		return MBEDTLS_ERR_MPI_FILE_IO_ERROR;
+	return 0;
+}
+
+static int mulmod(mbedtls_mpi *x, const mbedtls_mpi *a, const mbedtls_mpi *m)
+{
+	int res = mbedtls_mpi_mul_mpi(x, x, a);
+
+	if (res)
+		return res;
+	return mbedtls_mpi_mod_mpi(x, x, m);
+}
+
+static int update_blinding(struct rsa_precomp *pc, const rsa_key *key)
+{
+	size_t n_size = mbedtls_mpi_size(key->N);
+	int count = 0;
+	int res = 0;
+
+	if (pc->vf.p) {
+		res = mulmod(&pc->vi, &pc->vi, key->N);
+		if (!res)
+			res = mulmod(&pc->vf, &pc->vf, key->N);
+		return res;
+	}
+
+	/* vf is a random number invertible mod N */
+	do {
+		if (count++ > 10)
+			return MBEDTLS_ERR_MPI_NOT_ACCEPTABLE;
+		res = mbedtls_mpi_fill_random(&pc->vf, n_size - 1, rng_read,
+					      NULL);
+		if (!res)
+			res = mbedtls_mpi_gcd(&pc->vi, &pc->vf, key->N);
+		if (res)
+			goto err;
+	} while (mbedtls_mpi_cmp_int(&pc->vi, 1));
+
+	res = mbedtls_mpi_inv_mod(&pc->vi, &pc->vf, key->N);
+	if (!res)
+		res = mbedtls_mpi_exp_mod(&pc->vi, &pc->vi, key->e, key->N,
+					  &pc->rn);
+err:
+	if (res) {
+		/* Don't leave a half initialized pair behind */
+		mbedtls_mpi_free(&pc->vi);
+		mbedtls_mpi_free(&pc->vf);
+	}
+	return res;
+}
+
+int rsa_exptmod_precomp(const unsigned char *in, unsigned long inlen,
+			unsigned char *out, unsigned long *outlen, int which,
+			const rsa_key *key)
+{
+	struct rsa_precomp *pc = key->precomp;
+	size_t n_size = 0;
+	mbedtls_mpi t = { };
+	mbedtls_mpi ta = { };
+	mbedtls_mpi tb = { };
+	int err = CRYPT_MEM;
+	int res = 0;
+
+	if (which != PK_PRIVATE || key->type != PK_PRIVATE || !pc)
+		return rsa_exptmod(in, inlen, out, outlen, which, key);
+
+	n_size = mbedtls_mpi_size(key->N);
+	if (n_size > *outlen) {
+		*outlen = n_size;
+		return CRYPT_BUFFER_OVERFLOW;
+	}
+
+	mbedtls_mpi_init_mempool(&t);
+	mbedtls_mpi_init_mempool(&ta);
+	mbedtls_mpi_init_mempool(&tb);
+
+	res = mbedtls_mpi_read_binary(&t, in, inlen);
+	if (res)
+		goto out;
+	if (mbedtls_mpi_cmp_mpi(key->N, &t) < 0) {
+		err = CRYPT_PK_INVALID_SIZE;
+		goto out;
+	}
+
+	res = update_blinding(pc, key);
+	if (!res)
+		res = mulmod(&t, &pc->vi, key->N);
+	if (res)
+		goto out;
+
+	if (!key->p) {
+		res = mbedtls_mpi_exp_mod(&t, &t, key->d, key->N, &pc->rn);
+	} else {
+		/* t = tb + q * ((ta - tb) * qP mod p) */
+		res = mbedtls_mpi_exp_mod(&ta, &t, key->dP, key->p, &pc->rp);
+		if (!res)
+			res = mbedtls_mpi_exp_mod(&tb, &t, key->dQ, key->q,
+						  &pc->rq);
+		if (!res)
+			res = mbedtls_mpi_sub_mpi(&t, &ta, &tb);
+		if (!res)
+			res = mulmod(&t, key->qP, key->p);
+		if (!res)
+			res = mbedtls_mpi_mul_mpi(&t, &t, key->q);
+		if (!res)
+			res = mbedtls_mpi_add_mpi(&t, &t, &tb);
+	}
+	if (!res)
+		res = mulmod(&t, &pc->vf, key->N);
+	if (res)
+		goto out;
+
+#ifdef LTC_RSA_CRT_HARDENING
+	if (key->p) {
+		res = mbedtls_mpi_exp_mod(&ta, &t, key->e, key->N, &pc->rn);
+		if (!res)
+			res = mbedtls_mpi_read_binary(&tb, in, inlen);
+		if (res)
+			goto out;
+		if (mbedtls_mpi_cmp_mpi(&ta, &tb)) {
+			err = CRYPT_ERROR;
+			goto out;
+		}
+	}
+#endif
+
+	res = mbedtls_mpi_write_binary(&t, out, n_size);
+	if (res)
+		goto out;
+	*outlen = n_size;
+	err = CRYPT_OK;
+out:
+	mbedtls_mpi_free(&t);
+	mbedtls_mpi_free(&ta);
+	mbedtls_mpi_free(&tb);
+
+	return err;
+}
+
 TEE_Result crypto_acipher_alloc_rsa_keypair(struct rsa_keypair *s,
 					    size_t key_size_bits __unused)
 {
@@ -142,6 +352,7 @@ void crypto_acipher_free_rsa_keypair(struct rsa_keypair *s)
 {
 	if (!s)
 		return;
+	crypto_acipher_rsa_keypair_changed(s);
 	crypto_bignum_free(s->e);
 	crypto_bignum_free(s->d);
 	crypto_bignum_free(s->n);
@@ -179,6 +390,7 @@ TEE_Result crypto_acipher_gen_rsa_key(struct rsa_keypair *key, size_t key_size)
 		ltc_mp.copy(ltc_tmp_key.qP, key->qp);
 		ltc_mp.copy(ltc_tmp_key.dP, key->dp);
 		ltc_mp.copy(ltc_tmp_key.dQ, key->dq);
+		crypto_acipher_rsa_keypair_changed(key);
 
 		/* Free the temporary key */
 		rsa_free(&ltc_tmp_key);
@@ -208,8 +420,8 @@ static TEE_Result rsadorep(rsa_key *ltc_key, const uint8_t *src,
 		goto out;
 	}
 
-	ltc_res = rsa_exptmod(src, src_len, buf, &blen, ltc_key->type,
-			      ltc_key);
+	ltc_res = rsa_exptmod_precomp(src, src_len, buf, &blen, ltc_key->type,
+				      ltc_key);
 	switch (ltc_res) {
 	case CRYPT_PK_NOT_PRIVATE:
 	case CRYPT_PK_INVALID_TYPE:
@@ -271,17 +483,7 @@ TEE_Result crypto_acipher_rsanopad_decrypt(struct rsa_keypair *key,
 	TEE_Result res;
 	rsa_key ltc_key = { 0, };
 
-	ltc_key.type = PK_PRIVATE;
-	ltc_key.e = key->e;
-	ltc_key.N = key->n;
-	ltc_key.d = key->d;
-	if (key->p && crypto_bignum_num_bytes(key->p)) {
-		ltc_key.p = key->p;
-		ltc_key.q = key->q;
-		ltc_key.qP = key->qp;
-		ltc_key.dP = key->dp;
-		ltc_key.dQ = key->dq;
-	}
+	ltc_key_from_keypair(&ltc_key, key);
 
 	res = rsadorep(&ltc_key, src, src_len, dst, dst_len);
 	return res;
@@ -299,17 +501,7 @@ TEE_Result crypto_acipher_rsaes_decrypt(uint32_t algo, struct rsa_keypair *key,
 	size_t mod_size;
 	rsa_key ltc_key = { 0, };
 
-	ltc_key.type = PK_PRIVATE;
-	ltc_key.e = key->e;
-	ltc_key.d = key->d;
-	ltc_key.N = key->n;
-	if (key->p && crypto_bignum_num_bytes(key->p)) {
-		ltc_key.p = key->p;
-		ltc_key.q = key->q;
-		ltc_key.qP = key->qp;
-		ltc_key.dP = key->dp;
-		ltc_key.dQ = key->dq;
-	}
+	ltc_key_from_keypair(&ltc_key, key);
 
 	/* Get the algorithm */
 	res = tee_algo_to_ltc_hashindex(algo, &ltc_hashindex);
@@ -451,17 +643,7 @@ TEE_Result crypto_acipher_rsassa_sign(uint32_t algo, struct rsa_keypair *key,
 	unsigned long ltc_sig_len;
 	rsa_key ltc_key = { 0, };
 
-	ltc_key.type = PK_PRIVATE;
-	ltc_key.e = key->e;
-	ltc_key.N = key->n;
-	ltc_key.d = key->d;
-	if (key->p && crypto_bignum_num_bytes(key->p)) {
-		ltc_key.p = key->p;
-		ltc_key.q = key->q;
-		ltc_key.qP = key->qp;
-		ltc_key.dP = key->dp;
-		ltc_key.dQ = key->dq;
-	}
+	ltc_key_from_keypair(&ltc_key, key);
 
 	switch (algo) {
 	case TEE_ALG_RSASSA_PKCS1_V1_5:
@@ -49,6 +49,8 @@ typedef struct Rsa_key {
     void *dP;
     /** The d mod (q - 1) CRT param */
     void *dQ;
+    /** OP-TEE: state cached for private key operations, may be NULL */
+    struct rsa_precomp *precomp;
 } rsa_key;
 
 int rsa_make_key(prng_state *prng, int wprng, int size, long e, rsa_key *key);
@@ -59,6 +61,11 @@ int rsa_exptmod(const unsigned char *in,   unsigned long inlen,
                       unsigned char *out,  unsigned long *outlen, int which,
                 const rsa_key *key);
 
+/* OP-TEE: rsa_exptmod() using the state in key->precomp if available */
+int rsa_exptmod_precomp(const unsigned char *in,   unsigned long inlen,
+                              unsigned char *out,  unsigned long *outlen,
+                              int which, const rsa_key *key);
+
 void rsa_free(rsa_key *key);
 
 /* These use PKCS #1 v2.0 padding */
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <mm/cookie_hash.h>
+#include <types_ext.h>
+
+static struct cookie_hash_bucket *get_bucket(struct cookie_hash *h,
+					     uint64_t cookie)
+{
+	/*
+	 * Cookies are often addresses or counters, multiplicative hashing
+	 * spreads them over the buckets either way.
+	 */
+	uint64_t idx = (cookie * 0x9e3779b97f4a7c15ULL) >>
+		       (64 - COOKIE_HASH_SHIFT);
+
+	return h->bucket + idx;
+}
+
+void cookie_hash_add(struct cookie_hash *h, struct cookie_hash_elem *e,
+		     uint64_t cookie)
+{
+	e->cookie = cookie;
+	LIST_INSERT_HEAD(get_bucket(h, cookie), e, link);
+}
+
+void cookie_hash_remove(struct cookie_hash_elem *e)
+{
+	LIST_REMOVE(e, link);
+}
+
+struct cookie_hash_elem *cookie_hash_find(struct cookie_hash *h,
+					  uint64_t cookie)
+{
+	struct cookie_hash_elem *e = NULL;
+
+	LIST_FOREACH(e, get_bucket(h, cookie), link)
+		if (e->cookie == cookie)
+			return e;
+
+	return NULL;
+}
@@ -180,7 +180,7 @@ struct file_slice *file_find_slice(struct file *f, unsigned int page_offset)
 {
 	struct file_slice_elem *fse = NULL;
 
-	assert(f->mu.state);
+	assert(mutex_is_locked(&f->mu));
 
 	SLIST_FOREACH(fse, &f->slice_head, link) {
 		struct file_slice *fs = &fse->slice;
@@ -7,13 +7,18 @@
 #include <crypto/internal_aes-gcm.h>
 #include <initcall.h>
 #include <kernel/boot.h>
+#include <kernel/misc.h>
 #include <kernel/panic.h>
+#include <kernel/spinlock.h>
 #include <mm/core_memprot.h>
 #include <mm/core_mmu.h>
 #include <mm/fobj.h>
+#include <mm/page_lz.h>
 #include <mm/tee_mm.h>
 #include <stdlib.h>
+#include <string_ext.h>
 #include <string.h>
+#include <sys/queue.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
 #include <util.h>
@@ -210,12 +215,504 @@ static const struct fobj_ops ops_rw_paged __rodata_unpaged = {
 	.save_page = rwp_save_page,
 };
 
+#define RWP_SAVE_BATCH	8
+
+static TEE_Result rwp_save_pages(struct fobj_page **pages, size_t count)
+{
+	struct internal_aes_gcm_batch batch[RWP_SAVE_BATCH] = { };
+	struct rwp_aes_gcm_iv iv[RWP_SAVE_BATCH] = { };
+	struct rwp_state *state = NULL;
+	struct fobj_rwp *rwp = NULL;
+	size_t n = 0;
+
+	assert(count <= RWP_SAVE_BATCH);
+
+	for (n = 0; n < count; n++) {
+		rwp = to_rwp(pages[n]->fobj);
+		assert(pages[n]->page_idx < rwp->fobj.num_pages);
+		state = rwp->state + pages[n]->page_idx;
+		assert(state->iv + 1 > state->iv);
+
+		/* IV constructed as in rwp_save_page() */
+		state->iv++;
+		iv[n].iv[0] = (vaddr_t)state;
+		iv[n].iv[1] = state->iv >> 32;
+		iv[n].iv[2] = state->iv;
+
+		batch[n].nonce = iv + n;
+		batch[n].nonce_len = sizeof(iv[n]);
+		batch[n].src = pages[n]->va;
+		batch[n].dst = rwp->store + pages[n]->page_idx *
+			       SMALL_PAGE_SIZE;
+		batch[n].len = SMALL_PAGE_SIZE;
+		batch[n].tag = state->tag;
+		batch[n].tag_len = sizeof(state->tag);
+	}
+
+	return internal_aes_gcm_enc_batch(&rwp_ae_key, batch, count);
+}
+
+TEE_Result fobj_save_pages(struct fobj_page *pages, size_t count)
+{
+	struct fobj_page *batch[RWP_SAVE_BATCH] = { };
+	TEE_Result res = TEE_SUCCESS;
+	struct fobj_page *p = NULL;
+	size_t num = 0;
+	size_t n = 0;
+
+	for (n = 0; n < count; n++) {
+		p = pages + n;
+		/* Fobjs being teared down are handled by rwp_save_page() */
+		if (!p->fobj || p->fobj->ops != &ops_rw_paged ||
+		    !refcount_val(&p->fobj->refc)) {
+			res = fobj_save_page(p->fobj, p->page_idx, p->va);
+			if (res)
+				return res;
+			continue;
+		}
+
+		batch[num] = p;
+		num++;
+		if (num == RWP_SAVE_BATCH) {
+			res = rwp_save_pages(batch, num);
+			if (res)
+				return res;
+			num = 0;
+		}
+	}
+
+	if (num)
+		return rwp_save_pages(batch, num);
+
+	return TEE_SUCCESS;
+}
+DECLARE_KEEP_PAGER(fobj_save_pages);
+
+#ifdef CFG_PAGED_RW_COMPRESSION
+/*
+ * Compressed pages are stored in slots carved out of slabs of one page of
+ * TA RAM. All slots of a slab have the same size, a power of two from
+ * 64 bytes up to a full page. A page which doesn't compress to
+ * at most half a page is stored uncompressed in a full page slot, a page
+ * with only zeroes isn't stored at all.
+ *
+ * Since most pages compress well only CFG_PAGED_RW_COMPRESSION_RESERVE
+ * percent of the pages of a fobj are reserved as slabs when the fobj is
+ * allocated, kept in rwpc_spare_slabs while unused. Further slabs are
+ * allocated from TA RAM when needed and released again once empty. If
+ * that fails too the page can't be saved and rwpc_save_page() returns
+ * TEE_ERROR_OUT_OF_MEMORY, the pager then keeps the page and evicts
+ * another page instead.
+ */
+#define RWPC_MIN_SLOT_SHIFT	6
+#define RWPC_NUM_CLASSES	(SMALL_PAGE_SHIFT - RWPC_MIN_SLOT_SHIFT + 1)
+
+struct rwpc_slab {
+	tee_mm_entry_t *mm;
+	uint8_t *store;
+	uint64_t free_slots;
+	unsigned int class;
+	LIST_ENTRY(rwpc_slab) link;
+};
+
+LIST_HEAD(rwpc_slab_head, rwpc_slab);
+
+struct rwpc_state {
+	uint64_t iv;
+	uint8_t tag[RWP_AES_GCM_TAG_LEN];
+	struct rwpc_slab *slab;
+	uint16_t slot;
+	uint16_t len;
+};
+
+struct fobj_rwpc {
+	struct rwpc_state *state;
+	struct fobj fobj;
+};
+
+static const struct fobj_ops ops_rw_compressed_paged;
+
+/* Slabs with at least one free slot, indexed by size class */
+static struct rwpc_slab_head rwpc_partial_slabs[RWPC_NUM_CLASSES];
+/* Reserved slabs not currently in use */
+static struct rwpc_slab_head rwpc_spare_slabs =
+	LIST_HEAD_INITIALIZER(rwpc_spare_slabs);
+/* Number of allocated slabs and how many of them are reserved */
+static size_t rwpc_num_slabs;
+static size_t rwpc_num_reserved;
+static unsigned int rwpc_slab_lock = SPINLOCK_UNLOCK;
+
+/*
+ * Holds the compressed page while it's encrypted or decrypted. Pages are
+ * loaded without the pager lock held, possibly on several cores at once,
+ * but load and save always run with exceptions masked so a buffer and a
+ * compression work area per core is enough.
+ */
+static uint8_t rwpc_buf[CFG_TEE_CORE_NB_CORE][SMALL_PAGE_SIZE];
+static struct page_lz_work rwpc_lz_work[CFG_TEE_CORE_NB_CORE];
+
+static uint8_t *rwpc_core_buf(void)
+{
+	return rwpc_buf[get_core_pos()];
+}
+
+static unsigned int rwpc_num_reserve(unsigned int num_pages)
+{
+	return (num_pages * CFG_PAGED_RW_COMPRESSION_RESERVE + 99) / 100;
+}
+
+static unsigned int rwpc_class(size_t len)
+{
+	unsigned int class = 0;
+
+	while (BIT(RWPC_MIN_SLOT_SHIFT + class) < len)
+		class++;
+
+	return class;
+}
+
+static uint64_t rwpc_all_slots(unsigned int class)
+{
+	unsigned int n = BIT(SMALL_PAGE_SHIFT - RWPC_MIN_SLOT_SHIFT - class);
+
+	if (n == 64)
+		return UINT64_MAX;
+	return BIT64(n) - 1;
+}
+
+static void *rwpc_slot_va(struct rwpc_state *state)
+{
+	struct rwpc_slab *slab = state->slab;
+
+	return slab->store + (state->slot << (RWPC_MIN_SLOT_SHIFT +
+					      slab->class));
+}
+
+static struct rwpc_slab *rwpc_slab_alloc(void)
+{
+	struct rwpc_slab *slab = calloc(1, sizeof(*slab));
+
+	if (!slab)
+		return NULL;
+	slab->mm = tee_mm_alloc(&tee_mm_sec_ddr, SMALL_PAGE_SIZE);
+	if (!slab->mm) {
+		free(slab);
+		return NULL;
+	}
+	slab->store = phys_to_virt(tee_mm_get_smem(slab->mm),
+				   MEM_AREA_TA_RAM);
+
+	return slab;
+}
+
+static void rwpc_free_slabs(struct rwpc_slab_head *head)
+{
+	struct rwpc_slab *slab = NULL;
+
+	while ((slab = LIST_FIRST(head))) {
+		LIST_REMOVE(slab, link);
+		tee_mm_free(slab->mm);
+		free(slab);
+	}
+}
+
+/* Returns false if there's no free slot and no slab could be allocated */
+static bool rwpc_slot_alloc(struct rwpc_state *state, size_t len)
+{
+	unsigned int class = rwpc_class(len);
+	struct rwpc_slab *new_slab = NULL;
+	struct rwpc_slab *slab = NULL;
+	uint32_t exceptions = 0;
+	unsigned int slot = 0;
+
+	exceptions = cpu_spin_lock_xsave(&rwpc_slab_lock);
+	slab = LIST_FIRST(rwpc_partial_slabs + class);
+	if (!slab) {
+		slab = LIST_FIRST(&rwpc_spare_slabs);
+		if (slab) {
+			LIST_REMOVE(slab, link);
+		} else {
+			cpu_spin_unlock_xrestore(&rwpc_slab_lock, exceptions);
+			new_slab = rwpc_slab_alloc();
+			if (!new_slab)
+				return false;
+			exceptions = cpu_spin_lock_xsave(&rwpc_slab_lock);
+			rwpc_num_slabs++;
+			slab = new_slab;
+		}
+		slab->class = class;
+		slab->free_slots = rwpc_all_slots(class);
+		LIST_INSERT_HEAD(rwpc_partial_slabs + class, slab, link);
+	}
+
+	slot = __builtin_ctzll(slab->free_slots);
+	slab->free_slots &= ~BIT64(slot);
+	if (!slab->free_slots)
+		LIST_REMOVE(slab, link);
+	cpu_spin_unlock_xrestore(&rwpc_slab_lock, exceptions);
+
+	state->slab = slab;
+	state->slot = slot;
+
+	return true;
+}
+
+static void rwpc_slot_free(struct rwpc_state *state)
+{
+	struct rwpc_slab_head head = LIST_HEAD_INITIALIZER(head);
+	struct rwpc_slab *slab = state->slab;
+	uint32_t exceptions = 0;
+
+	if (!slab)
+		return;
+	state->slab = NULL;
+
+	exceptions = cpu_spin_lock_xsave(&rwpc_slab_lock);
+	if (!slab->free_slots)
+		LIST_INSERT_HEAD(rwpc_partial_slabs + slab->class, slab, link);
+	slab->free_slots |= BIT64(state->slot);
+	if (slab->free_slots == rwpc_all_slots(slab->class)) {
+		LIST_REMOVE(slab, link);
+		if (rwpc_num_slabs > rwpc_num_reserved) {
+			rwpc_num_slabs--;
+			LIST_INSERT_HEAD(&head, slab, link);
+		} else {
+			LIST_INSERT_HEAD(&rwpc_spare_slabs, slab, link);
+		}
+	}
+	cpu_spin_unlock_xrestore(&rwpc_slab_lock, exceptions);
+
+	rwpc_free_slabs(&head);
+}
+
+/* Reserves slabs for a fobj of @num_pages pages */
+static bool rwpc_reserve(unsigned int num_pages)
+{
+	struct rwpc_slab_head head = LIST_HEAD_INITIALIZER(head);
+	unsigned int num = rwpc_num_reserve(num_pages);
+	struct rwpc_slab *slab = NULL;
+	uint32_t exceptions = 0;
+	unsigned int n = 0;
+
+	for (n = 0; n < num; n++) {
+		slab = rwpc_slab_alloc();
+		if (!slab) {
+			rwpc_free_slabs(&head);
+			return false;
+		}
+		LIST_INSERT_HEAD(&head, slab, link);
+	}
+
+	exceptions = cpu_spin_lock_xsave(&rwpc_slab_lock);
+	while ((slab = LIST_FIRST(&head))) {
+		LIST_REMOVE(slab, link);
+		LIST_INSERT_HEAD(&rwpc_spare_slabs, slab, link);
+	}
+	rwpc_num_slabs += num;
+	rwpc_num_reserved += num;
+	cpu_spin_unlock_xrestore(&rwpc_slab_lock, exceptions);
+
+	return true;
+}
+
+/*
+ * Releases the reservation of a fobj of @num_pages pages. Spare slabs
+ * beyond the remaining reservation are freed, slabs still in use are
+ * freed once they are empty.
+ */
+static void rwpc_unreserve(unsigned int num_pages)
+{
+	struct rwpc_slab_head head = LIST_HEAD_INITIALIZER(head);
+	struct rwpc_slab *slab = NULL;
+	uint32_t exceptions = 0;
+
+	exceptions = cpu_spin_lock_xsave(&rwpc_slab_lock);
+	rwpc_num_reserved -= rwpc_num_reserve(num_pages);
+	while (rwpc_num_slabs > rwpc_num_reserved &&
+	       (slab = LIST_FIRST(&rwpc_spare_slabs))) {
+		LIST_REMOVE(slab, link);
+		LIST_INSERT_HEAD(&head, slab, link);
+		rwpc_num_slabs--;
+	}
+	cpu_spin_unlock_xrestore(&rwpc_slab_lock, exceptions);
+
+	rwpc_free_slabs(&head);
+}
+
+struct fobj *fobj_rw_compressed_paged_alloc(unsigned int num_pages)
+{
+	struct fobj_rwpc *rwpc = NULL;
+
+	assert(num_pages);
+
+	rwpc = calloc(1, sizeof(*rwpc));
+	if (!rwpc)
+		return NULL;
+
+	rwpc->state = calloc(num_pages, sizeof(*rwpc->state));
+	if (!rwpc->state)
+		goto err;
+
+	if (!rwpc_reserve(num_pages))
+		goto err;
+
+	fobj_init(&rwpc->fobj, &ops_rw_compressed_paged, num_pages);
+
+	return &rwpc->fobj;
+err:
+	free(rwpc->state);
+	free(rwpc);
+	return NULL;
+}
+
+static struct fobj_rwpc *to_rwpc(struct fobj *fobj)
+{
+	assert(fobj->ops == &ops_rw_compressed_paged);
+
+	return container_of(fobj, struct fobj_rwpc, fobj);
+}
+
+static void rwpc_free(struct fobj *fobj)
+{
+	struct fobj_rwpc *rwpc = to_rwpc(fobj);
+	unsigned int n = 0;
+
+	fobj_uninit(fobj);
+	for (n = 0; n < fobj->num_pages; n++)
+		rwpc_slot_free(rwpc->state + n);
+	rwpc_unreserve(fobj->num_pages);
+	free(rwpc->state);
+	free(rwpc);
+}
+
+static TEE_Result rwpc_load_page(struct fobj *fobj, unsigned int page_idx,
+				 void *va)
+{
+	struct fobj_rwpc *rwpc = to_rwpc(fobj);
+	struct rwpc_state *state = rwpc->state + page_idx;
+	struct rwp_aes_gcm_iv iv = {
+		.iv = { (vaddr_t)state, state->iv >> 32, state->iv }
+	};
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *buf = NULL;
+
+	assert(refcount_val(&fobj->refc));
+	assert(page_idx < fobj->num_pages);
+
+	if (!state->slab) {
+		/* Previously unused page or a page with only zeroes */
+		memset(va, 0, SMALL_PAGE_SIZE);
+		return TEE_SUCCESS;
+	}
+
+	if (state->len == SMALL_PAGE_SIZE)
+		return internal_aes_gcm_dec(&rwp_ae_key, &iv, sizeof(iv),
+					    NULL, 0, rwpc_slot_va(state),
+					    SMALL_PAGE_SIZE, va, state->tag,
+					    sizeof(state->tag));
+
+	buf = rwpc_core_buf();
+	res = internal_aes_gcm_dec(&rwp_ae_key, &iv, sizeof(iv), NULL, 0,
+				   rwpc_slot_va(state), state->len, buf,
+				   state->tag, sizeof(state->tag));
+	if (res)
+		return res;
+
+	return page_lz_decompress(buf, state->len, va, SMALL_PAGE_SIZE);
+}
+DECLARE_KEEP_PAGER(rwpc_load_page);
+
+static bool page_is_zero(const void *va)
+{
+	const uint64_t *p = va;
+	size_t n = 0;
+
+	for (n = 0; n < SMALL_PAGE_SIZE / sizeof(*p); n++)
+		if (p[n])
+			return false;
+
+	return true;
+}
+
+static TEE_Result rwpc_save_page(struct fobj *fobj, unsigned int page_idx,
+				 const void *va)
+{
+	struct fobj_rwpc *rwpc = to_rwpc(fobj);
+	struct rwpc_state *state = rwpc->state + page_idx;
+	size_t tag_len = sizeof(state->tag);
+	struct rwp_aes_gcm_iv iv = { };
+	const void *src = va;
+	uint8_t *buf = NULL;
+	size_t len = 0;
+
+	if (!refcount_val(&fobj->refc)) {
+		/*
+		 * This fobj is being teared down, it just hasn't had the time
+		 * to call tee_pager_invalidate_fobj() yet.
+		 */
+		assert(TAILQ_EMPTY(&fobj->areas));
+		return TEE_SUCCESS;
+	}
+
+	assert(page_idx < fobj->num_pages);
+	assert(state->iv + 1 > state->iv);
+
+	rwpc_slot_free(state);
+	if (page_is_zero(va))
+		return TEE_SUCCESS;
+
+	buf = rwpc_core_buf();
+	len = page_lz_compress(va, SMALL_PAGE_SIZE, buf, SMALL_PAGE_SIZE / 2,
+			       rwpc_lz_work + get_core_pos());
+	if (len)
+		src = buf;
+	else
+		len = SMALL_PAGE_SIZE;
+
+	if (!rwpc_slot_alloc(state, len))
+		return TEE_ERROR_OUT_OF_MEMORY;
+	state->len = len;
+
+	/* IV constructed as in rwp_save_page() */
+	state->iv++;
+	iv.iv[0] = (vaddr_t)state;
+	iv.iv[1] = state->iv >> 32;
+	iv.iv[2] = state->iv;
+
+	return internal_aes_gcm_enc(&rwp_ae_key, &iv, sizeof(iv),
+				    NULL, 0, src, len, rwpc_slot_va(state),
+				    state->tag, &tag_len);
+}
+DECLARE_KEEP_PAGER(rwpc_save_page);
+
+static const struct fobj_ops ops_rw_compressed_paged __rodata_unpaged = {
+	.free = rwpc_free,
+	.load_page = rwpc_load_page,
+	.save_page = rwpc_save_page,
+};
+#endif /*CFG_PAGED_RW_COMPRESSION*/
+
 struct fobj_rop {
 	uint8_t *hashes;
 	uint8_t *store;
 	struct fobj fobj;
 };
 
+/* Number of pages verified together when loading several pages */
+#define ROP_HASH_BATCH		4
+
+/*
+ * Digests of the pages being verified. This is kept off the stack since
+ * pages are loaded on the abort stack, loads run with exceptions masked
+ * so one per core is enough.
+ */
+struct rop_hash_batch {
+	uint8_t digest[ROP_HASH_BATCH][TEE_SHA256_HASH_SIZE];
+	struct hash_sha256_msg msg[ROP_HASH_BATCH];
+};
+
+static struct rop_hash_batch rop_hash_batch[CFG_TEE_CORE_NB_CORE];
+
 static const struct fobj_ops ops_ro_paged;
 
 static void rop_init(struct fobj_rop *rop, const struct fobj_ops *ops,
@@ -277,6 +774,54 @@ static TEE_Result rop_load_page_helper(struct fobj_rop *rop,
 	return hash_sha256_check(hash, va, SMALL_PAGE_SIZE);
 }
 
+/*
+ * Pages are verified a few at a time so that hash_sha256_multi() can
+ * interleave the hashing of them while keeping the stack usage down.
+ */
+static TEE_Result rop_load_pages_helper(struct fobj_rop *rop,
+					unsigned int page_idx,
+					void *const *va,
+					unsigned int num_pages)
+{
+	struct rop_hash_batch *b = rop_hash_batch + get_core_pos();
+	TEE_Result res = TEE_SUCCESS;
+	const uint8_t *hash = NULL;
+	unsigned int num = 0;
+	unsigned int n = 0;
+
+	assert(refcount_val(&rop->fobj.refc));
+	assert(page_idx + num_pages <= rop->fobj.num_pages);
+
+	while (num_pages) {
+		num = MIN(num_pages, (unsigned int)ROP_HASH_BATCH);
+		for (n = 0; n < num; n++) {
+			memcpy(va[n], rop->store + (page_idx + n) *
+			       SMALL_PAGE_SIZE, SMALL_PAGE_SIZE);
+			b->msg[n].data = va[n];
+			b->msg[n].data_size = SMALL_PAGE_SIZE;
+			b->msg[n].digest = b->digest[n];
+		}
+
+		res = hash_sha256_multi(b->msg, num);
+		if (res)
+			return res;
+
+		for (n = 0; n < num; n++) {
+			hash = rop->hashes + (page_idx + n) *
+			       TEE_SHA256_HASH_SIZE;
+			if (consttime_memcmp(b->digest[n], hash,
+					     TEE_SHA256_HASH_SIZE))
+				return TEE_ERROR_SECURITY;
+		}
+
+		page_idx += num;
+		va += num;
+		num_pages -= num;
+	}
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result rop_load_page(struct fobj *fobj, unsigned int page_idx,
 				void *va)
 {
@@ -284,6 +829,13 @@ static TEE_Result rop_load_page(struct fobj *fobj, unsigned int page_idx,
 }
 DECLARE_KEEP_PAGER(rop_load_page);
 
+static TEE_Result rop_load_pages(struct fobj *fobj, unsigned int page_idx,
+				 void *const *va, unsigned int num_pages)
+{
+	return rop_load_pages_helper(to_rop(fobj), page_idx, va, num_pages);
+}
+DECLARE_KEEP_PAGER(rop_load_pages);
+
 static TEE_Result rop_save_page(struct fobj *fobj __unused,
 				unsigned int page_idx __unused,
 				const void *va __unused)
@@ -295,6 +847,7 @@ DECLARE_KEEP_PAGER(rop_save_page);
 static const struct fobj_ops ops_ro_paged __rodata_unpaged = {
 	.free = rop_free,
 	.load_page = rop_load_page,
+	.load_pages = rop_load_pages,
 	.save_page = rop_save_page,
 };
 
@@ -434,21 +987,15 @@ static void rrp_free(struct fobj *fobj)
 	free(rrp);
 }
 
-static TEE_Result rrp_load_page(struct fobj *fobj, unsigned int page_idx,
-				void *va)
+static void rrp_apply_relocs(struct fobj_ro_reloc_paged *rrp,
+			     unsigned int page_idx, void *va)
 {
-	struct fobj_ro_reloc_paged *rrp = to_rrp(fobj);
 	unsigned int end_rel = rrp->num_relocs;
-	TEE_Result res = TEE_SUCCESS;
 	unsigned long *where = NULL;
 	unsigned int n = 0;
 
-	res = rop_load_page_helper(&rrp->rop, page_idx, va);
-	if (res)
-		return res;
-
 	/* Find the reloc index of the next page to tell when we're done */
-	for (n = page_idx + 1; n < fobj->num_pages; n++) {
+	for (n = page_idx + 1; n < rrp->rop.fobj.num_pages; n++) {
 		if (rrp->page_reloc_idx[n] != UINT16_MAX) {
 			end_rel = rrp->page_reloc_idx[n];
 			break;
@@ -459,14 +1006,46 @@ static TEE_Result rrp_load_page(struct fobj *fobj, unsigned int page_idx,
 		where = (void *)((vaddr_t)va + rrp->relocs[n]);
 		*where += boot_mmu_config.load_offset;
 	}
+}
+
+static TEE_Result rrp_load_page(struct fobj *fobj, unsigned int page_idx,
+				void *va)
+{
+	struct fobj_ro_reloc_paged *rrp = to_rrp(fobj);
+	TEE_Result res = TEE_SUCCESS;
+
+	res = rop_load_page_helper(&rrp->rop, page_idx, va);
+	if (res)
+		return res;
+
+	rrp_apply_relocs(rrp, page_idx, va);
 
 	return TEE_SUCCESS;
 }
 DECLARE_KEEP_PAGER(rrp_load_page);
 
+static TEE_Result rrp_load_pages(struct fobj *fobj, unsigned int page_idx,
+				 void *const *va, unsigned int num_pages)
+{
+	struct fobj_ro_reloc_paged *rrp = to_rrp(fobj);
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int n = 0;
+
+	res = rop_load_pages_helper(&rrp->rop, page_idx, va, num_pages);
+	if (res)
+		return res;
+
+	for (n = 0; n < num_pages; n++)
+		rrp_apply_relocs(rrp, page_idx + n, va[n]);
+
+	return TEE_SUCCESS;
+}
+DECLARE_KEEP_PAGER(rrp_load_pages);
+
 static const struct fobj_ops ops_ro_reloc_paged __rodata_unpaged = {
 	.free = rrp_free,
 	.load_page = rrp_load_page,
+	.load_pages = rrp_load_pages,
 	.save_page = rop_save_page, /* Direct reuse */
 };
 #endif /*CFG_CORE_ASLR*/
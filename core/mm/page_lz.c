@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <mm/page_lz.h>
+#include <string.h>
+#include <types_ext.h>
+#include <util.h>
+
+/*
+ * The compressed format is a sequence of the following:
+ * - a token byte, the number of literals in the upper nibble and the match
+ *   length minus MIN_MATCH in the lower nibble. A nibble of 15 means that
+ *   the length continues in the following bytes, each adding up to 255
+ *   until a byte less than 255 is found
+ * - the literal length continuation bytes, if any
+ * - the literals
+ * - the match offset as 16 bits little endian, always at least 1
+ * - the match length continuation bytes, if any
+ * The last sequence stops after the literals, it may have no literals.
+ *
+ * This is roughly the LZ4 block format but without its end of block
+ * restrictions.
+ */
+
+#define MIN_MATCH	4
+#define NIBBLE_MAX	15
+#define MAX_LEN		(UINT16_MAX + 1)
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	uint32_t v = 0;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static unsigned int hash_u32(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - PAGE_LZ_HASH_BITS);
+}
+
+static uint8_t *put_len(uint8_t *out, uint8_t *end, size_t len)
+{
+	len -= NIBBLE_MAX;
+	while (len >= UINT8_MAX) {
+		if (out == end)
+			return NULL;
+		*out++ = UINT8_MAX;
+		len -= UINT8_MAX;
+	}
+	if (out == end)
+		return NULL;
+	*out++ = len;
+
+	return out;
+}
+
+static uint8_t *put_seq(uint8_t *out, uint8_t *end, const uint8_t *lit,
+			size_t lit_len, size_t offs, size_t match_len)
+{
+	uint8_t *token = out;
+
+	if (out == end)
+		return NULL;
+	out++;
+
+	*token = MIN(lit_len, (size_t)NIBBLE_MAX) << 4;
+	if (lit_len >= NIBBLE_MAX) {
+		out = put_len(out, end, lit_len);
+		if (!out)
+			return NULL;
+	}
+	if ((size_t)(end - out) < lit_len)
+		return NULL;
+	memcpy(out, lit, lit_len);
+	out += lit_len;
+
+	if (!match_len)
+		return out;
+
+	if (end - out < 2)
+		return NULL;
+	*out++ = offs;
+	*out++ = offs >> 8;
+
+	match_len -= MIN_MATCH;
+	*token |= MIN(match_len, (size_t)NIBBLE_MAX);
+	if (match_len >= NIBBLE_MAX)
+		out = put_len(out, end, match_len);
+
+	return out;
+}
+
+/*
+ * work->hash_table holds the position of the last occurrence of each
+ * hashed 4 byte sequence. It isn't cleared since stale or uninitialized
+ * entries are harmless, a candidate is always verified before being used
+ * as a match.
+ */
+size_t page_lz_compress(const void *src, size_t len, void *dst,
+			size_t dst_size, struct page_lz_work *work)
+{
+	uint16_t *hash_table = work->hash_table;
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	uint8_t *end = out + dst_size;
+	size_t match_len = 0;
+	size_t anchor = 0;
+	unsigned int h = 0;
+	size_t ref = 0;
+	size_t pos = 0;
+	uint32_t v = 0;
+
+	if (len > MAX_LEN)
+		return 0;
+
+	while (pos + MIN_MATCH <= len) {
+		v = get_u32(in + pos);
+		h = hash_u32(v);
+		ref = hash_table[h];
+		hash_table[h] = pos;
+
+		if (ref >= pos || get_u32(in + ref) != v) {
+			pos++;
+			continue;
+		}
+
+		match_len = MIN_MATCH;
+		while (pos + match_len < len &&
+		       in[ref + match_len] == in[pos + match_len])
+			match_len++;
+
+		out = put_seq(out, end, in + anchor, pos - anchor, pos - ref,
+			      match_len);
+		if (!out)
+			return 0;
+
+		pos += match_len;
+		anchor = pos;
+	}
+
+	out = put_seq(out, end, in + anchor, len - anchor, 0, 0);
+	if (!out)
+		return 0;
+
+	return out - (uint8_t *)dst;
+}
+
+static bool get_len(const uint8_t *in, size_t len, size_t *pos, size_t *l)
+{
+	uint8_t b = 0;
+
+	do {
+		if (*pos == len)
+			return false;
+		b = in[*pos];
+		(*pos)++;
+		*l += b;
+	} while (b == UINT8_MAX && *l < MAX_LEN);
+
+	return *l < MAX_LEN;
+}
+
+TEE_Result page_lz_decompress(const void *src, size_t len, void *dst,
+			      size_t dst_size)
+{
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	size_t match_len = 0;
+	size_t lit_len = 0;
+	uint8_t token = 0;
+	size_t offs = 0;
+	size_t opos = 0;
+	size_t pos = 0;
+	size_t n = 0;
+
+	while (true) {
+		/* The last sequence has no match, nothing may follow it */
+		if (pos == len)
+			return TEE_ERROR_CORRUPT_OBJECT;
+		token = in[pos++];
+
+		lit_len = token >> 4;
+		if (lit_len == NIBBLE_MAX && !get_len(in, len, &pos, &lit_len))
+			return TEE_ERROR_CORRUPT_OBJECT;
+		if (lit_len > len - pos || lit_len > dst_size - opos)
+			return TEE_ERROR_CORRUPT_OBJECT;
+		memcpy(out + opos, in + pos, lit_len);
+		pos += lit_len;
+		opos += lit_len;
+
+		if (pos == len)
+			break;
+
+		if (len - pos < 2)
+			return TEE_ERROR_CORRUPT_OBJECT;
+		offs = in[pos] | (in[pos + 1] << 8);
+		pos += 2;
+
+		match_len = token & NIBBLE_MAX;
+		if (match_len == NIBBLE_MAX &&
+		    !get_len(in, len, &pos, &match_len))
+			return TEE_ERROR_CORRUPT_OBJECT;
+		match_len += MIN_MATCH;
+
+		if (!offs || offs > opos || match_len > dst_size - opos)
+			return TEE_ERROR_CORRUPT_OBJECT;
+		/* Byte by byte since the match may overlap with itself */
+		for (n = 0; n < match_len; n++)
+			out[opos + n] = out[opos - offs + n];
+		opos += match_len;
+	}
+
+	if (opos != dst_size)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	return TEE_SUCCESS;
+}
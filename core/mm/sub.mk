@@ -1,3 +1,5 @@
 srcs-y += fobj.c
 srcs-y += file.c
 srcs-y += vm.c
+srcs-y += cookie_hash.c
+srcs-$(CFG_PAGED_RW_COMPRESSION) += page_lz.c
@@ -6,11 +6,14 @@
 #include <stdio.h>
 #include <trace.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/thread.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
 #include <string.h>
+#include <tee/fs_htree.h>
 #include <string_ext.h>
 #include <malloc.h>
+#include <util.h>
 
 #define TA_NAME		"stats.ta"
 
@@ -21,6 +24,9 @@
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
 #define STATS_CMD_MEMLEAK_STATS		2
+#define STATS_CMD_FS_HTREE_CACHE_STATS	3
+#define STATS_CMD_PAGER_FAULT_LATENCY	4
+#define STATS_CMD_THREAD_STATS		5
 
 #define STATS_NB_POOLS			4
 
@@ -105,11 +111,19 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 {
 	struct tee_pager_stats stats;
 
+	/*
+	 * p[3] is optional, when present:
+	 * p[3].value.a = evictions, p[3].value.b = ghost hits
+	 */
 	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_NONE) != type) {
-		EMSG("expect 3 output values as argument");
+			    TEE_PARAM_TYPE_NONE) != type &&
+	    TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		EMSG("expect 3 or 4 output values as argument");
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
@@ -120,6 +134,67 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	p[1].value.b = stats.rw_hits;
 	p[2].value.a = stats.hidden_hits;
 	p[2].value.b = stats.zi_released;
+	if (TEE_PARAM_TYPE_GET(type, 3) == TEE_PARAM_TYPE_VALUE_OUTPUT) {
+		p[3].value.a = stats.evictions;
+		p[3].value.b = stats.ghost_hits;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_pager_fault_latency(uint32_t type,
+					  TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_pager_fault_latency lat = { };
+
+	/*
+	 * p[0].value.a = core number
+	 * p[1].value.a = number of faults, p[1].value.b = max latency
+	 * p[2].value.a = 50th percentile, p[2].value.b = 90th percentile
+	 * p[3].value.a = 99th percentile
+	 * Latencies are in microseconds, the figures are reset when read.
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (p[0].value.a >= CFG_TEE_CORE_NB_CORE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_pager_get_fault_latency(p[0].value.a, &lat);
+	p[1].value.a = lat.count;
+	p[1].value.b = lat.max;
+	p[2].value.a = lat.p50;
+	p[2].value.b = lat.p90;
+	p[3].value.a = lat.p99;
+	p[3].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_thread_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	uint64_t busy = 0;
+
+	/*
+	 * p[0].value.a = thread id
+	 * p[1].value.a = number of threads
+	 * p[2].value.a = busy time in microseconds, bits [31:0]
+	 * p[2].value.b = busy time in microseconds, bits [63:32]
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (p[0].value.a >= thread_get_count())
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	busy = thread_get_busy_time(p[0].value.a);
+	p[1].value.a = thread_get_count();
+	p[1].value.b = 0;
+	reg_pair_from_64(busy, &p[2].value.b, &p[2].value.a);
 
 	return TEE_SUCCESS;
 }
@@ -137,6 +212,36 @@ static TEE_Result get_memleak_stats(uint32_t type,
 	return TEE_SUCCESS;
 }
 
+#if defined(CFG_WITH_USER_TA) && defined(CFG_REE_FS)
+static TEE_Result get_fs_htree_cache_stats(uint32_t type,
+					   TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_fs_htree_cache_stats stats = { };
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = hits, p[1].value.b = misses
+	 * p[2].value.a = coalesced writes, p[2].value.b = write backs
+	 * p[3].value.a = evictions
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_fs_htree_get_cache_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.hits;
+	p[1].value.b = stats.misses;
+	p[2].value.a = stats.coalesced;
+	p[2].value.b = stats.write_backs;
+	p[3].value.a = stats.evictions;
+	p[3].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+#endif
+
 /*
  * Trusted Application Entry Points
  */
@@ -148,10 +253,18 @@ static TEE_Result invoke_command(void *psess __unused,
 	switch (cmd) {
 	case STATS_CMD_PAGER_STATS:
 		return get_pager_stats(ptypes, params);
+	case STATS_CMD_PAGER_FAULT_LATENCY:
+		return get_pager_fault_latency(ptypes, params);
+	case STATS_CMD_THREAD_STATS:
+		return get_thread_stats(ptypes, params);
 	case STATS_CMD_ALLOC_STATS:
 		return get_alloc_stats(ptypes, params);
 	case STATS_CMD_MEMLEAK_STATS:
 		return get_memleak_stats(ptypes, params);
+#if defined(CFG_WITH_USER_TA) && defined(CFG_REE_FS)
+	case STATS_CMD_FS_HTREE_CACHE_STATS:
+		return get_fs_htree_cache_stats(ptypes, params);
+#endif
 	default:
 		break;
 	}
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <kernel/tee_time.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "misc.h"
+
+/*
+ * Signs a random digest with a freshly generated key and verifies the
+ * signature, timing each operation separately. Signing multiplies the
+ * curve generator by the ephemeral key, verifying also multiplies the
+ * public key.
+ */
+
+#define MAX_DIGEST_LEN	TEE_SHA512_HASH_SIZE
+/* r and s of the largest supported curve, P-521 */
+#define MAX_SIG_LEN	(2 * 66)
+
+static uint32_t elapsed_ms(TEE_Time *start)
+{
+	TEE_Time now = { };
+	TEE_Time diff = { };
+
+	tee_time_get_sys_time(&now);
+	TEE_TIME_SUB(now, *start, diff);
+
+	return diff.seconds * TEE_TIME_MILLIS_BASE + diff.millis;
+}
+
+static TEE_Result get_curve(uint32_t curve, uint32_t *algo,
+			    size_t *key_size, size_t *digest_len)
+{
+	switch (curve) {
+	case TEE_ECC_CURVE_NIST_P256:
+		*algo = TEE_ALG_ECDSA_P256;
+		*key_size = 256;
+		*digest_len = TEE_SHA256_HASH_SIZE;
+		return TEE_SUCCESS;
+	case TEE_ECC_CURVE_NIST_P384:
+		*algo = TEE_ALG_ECDSA_P384;
+		*key_size = 384;
+		*digest_len = TEE_SHA384_HASH_SIZE;
+		return TEE_SUCCESS;
+	case TEE_ECC_CURVE_NIST_P521:
+		*algo = TEE_ALG_ECDSA_P521;
+		*key_size = 521;
+		*digest_len = TEE_SHA512_HASH_SIZE;
+		return TEE_SUCCESS;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+}
+
+TEE_Result core_ecc_perf_tests(uint32_t param_types,
+			       TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[MAX_DIGEST_LEN] = { };
+	uint8_t sig[MAX_SIG_LEN] = { };
+	struct ecc_public_key pub = { };
+	struct ecc_keypair key = { };
+	size_t rep_count = params[0].value.b;
+	TEE_Result res = TEE_SUCCESS;
+	size_t digest_len = 0;
+	size_t sig_len = 0;
+	size_t key_size = 0;
+	uint32_t algo = 0;
+	TEE_Time t = { };
+	size_t n = 0;
+
+	if (param_types != exp_pt || !rep_count)
+		return TEE_ERROR_BAD_PARAMETERS;
+	res = get_curve(params[0].value.a, &algo, &key_size, &digest_len);
+	if (res)
+		return res;
+
+	res = crypto_acipher_alloc_ecc_keypair(&key, key_size);
+	if (res)
+		return res;
+	res = crypto_acipher_alloc_ecc_public_key(&pub, key_size);
+	if (res)
+		goto out;
+
+	key.curve = params[0].value.a;
+	res = crypto_acipher_gen_ecc_key(&key, key_size);
+	if (res)
+		goto out;
+	pub.curve = key.curve;
+	crypto_bignum_copy(pub.x, key.x);
+	crypto_bignum_copy(pub.y, key.y);
+
+	res = crypto_rng_read(digest, digest_len);
+	if (res)
+		goto out;
+
+	tee_time_get_sys_time(&t);
+	for (n = 0; n < rep_count; n++) {
+		sig_len = sizeof(sig);
+		res = crypto_acipher_ecc_sign(algo, &key, digest, digest_len,
+					      sig, &sig_len);
+		if (res)
+			goto out;
+	}
+	params[1].value.a = elapsed_ms(&t);
+
+	tee_time_get_sys_time(&t);
+	for (n = 0; n < rep_count; n++) {
+		res = crypto_acipher_ecc_verify(algo, &pub, digest, digest_len,
+						sig, sig_len);
+		if (res) {
+			EMSG("Signature verification failed: %#"PRIx32, res);
+			goto out;
+		}
+	}
+	params[1].value.b = elapsed_ms(&t);
+
+	/* A modified digest must not verify */
+	digest[0] ^= 1;
+	if (crypto_acipher_ecc_verify(algo, &pub, digest, digest_len, sig,
+				      sig_len) != TEE_ERROR_SIGNATURE_INVALID) {
+		EMSG("Signature of modified digest not rejected");
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	IMSG("ecc: %zu bits x %zu: sign %"PRIu32" ms, verify %"PRIu32" ms",
+	     key_size, rep_count, params[1].value.a, params[1].value.b);
+
+out:
+	crypto_bignum_free(key.d);
+	crypto_bignum_free(key.x);
+	crypto_bignum_free(key.y);
+	crypto_acipher_free_ecc_public_key(&pub);
+	return res;
+}
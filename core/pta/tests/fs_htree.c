@@ -25,6 +25,7 @@ struct test_aux {
 	size_t data_len;
 	size_t data_alloced;
 	uint8_t *block;
+	uint8_t *run;
 };
 
 static TEE_Result test_get_offs_size(enum tee_fs_htree_type type, size_t idx,
@@ -104,6 +105,7 @@ static TEE_Result test_read_init(void *aux, struct tee_fs_rpc_operation *op,
 		op->params[0].u.value.a = (vaddr_t)aux;
 		op->params[0].u.value.b = offs;
 		op->params[0].u.value.c = sz;
+		op->params[1].u.value.a = (vaddr_t)a->block;
 		*data = a->block;
 	}
 
@@ -121,6 +123,7 @@ static TEE_Result test_read_final(struct tee_fs_rpc_operation *op,
 	struct test_aux *a = uint_to_ptr(op->params[0].u.value.a);
 	size_t offs = op->params[0].u.value.b;
 	size_t sz = op->params[0].u.value.c;
+	uint8_t *buf = uint_to_ptr(op->params[1].u.value.a);
 
 	if (offs + sz <= a->data_len)
 		*bytes = sz;
@@ -129,7 +132,7 @@ static TEE_Result test_read_final(struct tee_fs_rpc_operation *op,
 	else
 		*bytes = 0;
 
-	memcpy(a->block, a->data + offs, *bytes);
+	memcpy(buf, a->data + offs, *bytes);
 	return TEE_SUCCESS;
 }
 
@@ -145,6 +148,7 @@ static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
 	struct test_aux *a = uint_to_ptr(op->params[0].u.value.a);
 	size_t offs = op->params[0].u.value.b;
 	size_t sz = op->params[0].u.value.c;
+	uint8_t *buf = uint_to_ptr(op->params[1].u.value.a);
 	size_t end = offs + sz;
 
 	if (end > a->data_alloced) {
@@ -152,13 +156,47 @@ static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
 		return TEE_ERROR_GENERIC;
 	}
 
-	memcpy(a->data + offs, a->block, sz);
+	memcpy(a->data + offs, buf, sz);
 	if (end > a->data_len)
 		a->data_len = end;
 	return TEE_SUCCESS;
 
 }
 
+static TEE_Result test_read_blocks_init(void *aux,
+					struct tee_fs_rpc_operation *op,
+					size_t idx, size_t num_blocks,
+					void **data, size_t *offs)
+{
+	TEE_Result res;
+	struct test_aux *a = aux;
+	size_t offs0;
+	size_t o;
+	size_t sz;
+	size_t n;
+
+	res = test_get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx, 0, &offs0, &sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num_blocks * 2; n++) {
+		res = test_get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx + n / 2,
+					 n & 1, &o, &sz);
+		if (res != TEE_SUCCESS)
+			return res;
+		offs[n] = o - offs0;
+	}
+
+	memset(op, 0, sizeof(*op));
+	op->params[0].u.value.a = (vaddr_t)aux;
+	op->params[0].u.value.b = offs0;
+	op->params[0].u.value.c = o + sz - offs0;
+	op->params[1].u.value.a = (vaddr_t)a->run;
+	*data = a->run;
+
+	return TEE_SUCCESS;
+}
+
 static const struct tee_fs_htree_storage test_htree_ops = {
 	.block_size = TEST_BLOCK_SIZE,
 	.rpc_read_init = test_read_init,
@@ -167,6 +205,15 @@ static const struct tee_fs_htree_storage test_htree_ops = {
 	.rpc_write_final = test_write_final,
 };
 
+static const struct tee_fs_htree_storage test_htree_run_ops = {
+	.block_size = TEST_BLOCK_SIZE,
+	.rpc_read_init = test_read_init,
+	.rpc_read_final = test_read_final,
+	.rpc_write_init = test_write_init,
+	.rpc_write_final = test_write_final,
+	.rpc_read_blocks_init = test_read_blocks_init,
+};
+
 #define CHECK_RES(res, cleanup)						\
 		do {							\
 			TEE_Result _res = (res);			\
@@ -217,6 +264,56 @@ static TEE_Result read_block(struct tee_fs_htree **ht, size_t bn, uint8_t salt)
 	return TEE_SUCCESS;
 }
 
+static TEE_Result write_blocks(struct tee_fs_htree **ht, size_t bn,
+			       size_t num_blocks, uint8_t salt)
+{
+	const size_t bn_words = TEST_BLOCK_SIZE / sizeof(uint32_t);
+	TEE_Result res;
+	uint32_t *b;
+	size_t n;
+
+	b = malloc(num_blocks * TEST_BLOCK_SIZE);
+	if (!b)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < num_blocks * bn_words; n++)
+		b[n] = val_from_bn_n_salt(bn + n / bn_words, n % bn_words,
+					  salt);
+
+	res = tee_fs_htree_write_blocks(ht, bn, num_blocks, b);
+	free(b);
+	return res;
+}
+
+static TEE_Result read_blocks(struct tee_fs_htree **ht, size_t bn,
+			      size_t num_blocks, uint8_t salt)
+{
+	const size_t bn_words = TEST_BLOCK_SIZE / sizeof(uint32_t);
+	TEE_Result res;
+	uint32_t *b;
+	size_t n;
+
+	b = malloc(num_blocks * TEST_BLOCK_SIZE);
+	if (!b)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = tee_fs_htree_read_blocks(ht, bn, num_blocks, b);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	for (n = 0; n < num_blocks * bn_words; n++) {
+		if (b[n] != val_from_bn_n_salt(bn + n / bn_words,
+					       n % bn_words, salt)) {
+			DMSG("Unpected b[%zu] %#" PRIx32, n, b[n]);
+			res = TEE_ERROR_TIME_NOT_SET;
+			goto out;
+		}
+	}
+out:
+	free(b);
+	return res;
+}
+
 static TEE_Result do_range(TEE_Result (*fn)(struct tee_fs_htree **ht,
 					    size_t bn, uint8_t salt),
 			   struct tee_fs_htree **ht, size_t begin,
@@ -392,11 +489,82 @@ out:
 	return res;
 }
 
+static TEE_Result htree_test_runs(struct test_aux *aux, size_t num_blocks,
+				  size_t begin, size_t num)
+{
+	struct ts_session *sess = ts_get_current_session();
+	const TEE_UUID *uuid = &sess->ctx->uuid;
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_fs_htree *ht = NULL;
+	size_t salt = 23;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE] = { 0 };
+
+	assert(begin + num <= num_blocks);
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_run_ops, aux,
+				&ht);
+	CHECK_RES(res, goto out);
+
+	/*
+	 * Initialize all blocks in runs and verify that they read back as
+	 * expected both in runs and one by one.
+	 */
+	res = write_blocks(&ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+	res = read_blocks(&ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+	res = do_range(read_block, &ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+
+	/* Mix single block writes and runs before the first sync */
+	salt++;
+	res = do_range(write_block, &ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+	res = write_blocks(&ht, begin, num, salt);
+	CHECK_RES(res, goto out);
+	res = read_blocks(&ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_run_ops, aux,
+				&ht);
+	CHECK_RES(res, goto out);
+	res = read_blocks(&ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+
+	/*
+	 * Rewrite a run without syncing, the committed versions must
+	 * survive the run write and be seen after reopening.
+	 */
+	res = write_blocks(&ht, begin, num, salt + 1);
+	CHECK_RES(res, goto out);
+	res = read_blocks(&ht, begin, num, salt + 1);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_run_ops, aux,
+				&ht);
+	CHECK_RES(res, goto out);
+	res = read_blocks(&ht, 0, num_blocks, salt);
+	CHECK_RES(res, goto out);
+
+out:
+	tee_fs_htree_close(&ht);
+	if (res == TEE_ERROR_TIME_NOT_SET)
+		res = TEE_ERROR_SECURITY;
+	return res;
+}
+
 static void aux_free(struct test_aux *aux)
 {
 	if (aux) {
 		free(aux->data);
 		free(aux->block);
+		free(aux->run);
 		free(aux);
 	}
 }
@@ -423,6 +591,15 @@ static struct test_aux *aux_alloc(size_t num_blocks)
 	if (!aux->block)
 		goto err;
 
+	/*
+	 * Both versions of a run of blocks and the node blocks in
+	 * between, with TEST_BLOCK_SIZE there's one node block per data
+	 * block.
+	 */
+	aux->run = malloc(TEST_BLOCK_SIZE * 4 * TEE_FS_HTREE_MAX_RUN_BLOCKS);
+	if (!aux->run)
+		goto err;
+
 	return aux;
 err:
 	aux_free(aux);
@@ -463,6 +640,28 @@ out:
 	return res;
 }
 
+static TEE_Result test_runs(size_t num_blocks)
+{
+	struct test_aux *aux = aux_alloc(num_blocks);
+	TEE_Result res = TEE_SUCCESS;
+	size_t m;
+	size_t o;
+
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (m = 0; m < num_blocks; m += 3) {
+		for (o = 1; o <= num_blocks - m; o += 4) {
+			res = htree_test_runs(aux, num_blocks, m, o);
+			CHECK_RES(res, goto out);
+		}
+	}
+
+out:
+	aux_free(aux);
+	return res;
+}
+
 static TEE_Result test_corrupt_type(const TEE_UUID *uuid, uint8_t *hash,
 				    size_t num_blocks, struct test_aux *aux,
 				    enum tee_fs_htree_type type, size_t idx)
@@ -619,5 +818,9 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 	if (res)
 		return res;
 
+	res = test_runs(TEE_FS_HTREE_MAX_RUN_BLOCKS * 2 + 3);
+	if (res)
+		return res;
+
 	return test_corrupt(5);
 }
@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <kernel/tee_time.h>
+#include <malloc.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "misc.h"
+
+/*
+ * Hashes a buffer of random data a number of times to measure the
+ * throughput of the SHA-2 implementation in use, for instance the
+ * ARMv8.2 Crypto Extensions one with CFG_CRYPTO_SHA512_ARM_CE=y. The
+ * digests are first checked against two block test vectors from FIPS
+ * 180-4 and the buffer is hashed both in one go and in odd sized pieces
+ * to catch errors in the handling of partial blocks.
+ */
+
+static const uint8_t msg_sha256[] =
+	"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+static const uint8_t msg_sha512[] =
+	"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+	"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+
+static const uint8_t digest_sha256[TEE_SHA256_HASH_SIZE] = {
+	0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+	0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+	0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+};
+
+static const uint8_t digest_sha384[TEE_SHA384_HASH_SIZE] = {
+	0x09, 0x33, 0x0c, 0x33, 0xf7, 0x11, 0x47, 0xe8,
+	0x3d, 0x19, 0x2f, 0xc7, 0x82, 0xcd, 0x1b, 0x47,
+	0x53, 0x11, 0x1b, 0x17, 0x3b, 0x3b, 0x05, 0xd2,
+	0x2f, 0xa0, 0x80, 0x86, 0xe3, 0xb0, 0xf7, 0x12,
+	0xfc, 0xc7, 0xc7, 0x1a, 0x55, 0x7e, 0x2d, 0xb9,
+	0x66, 0xc3, 0xe9, 0xfa, 0x91, 0x74, 0x60, 0x39,
+};
+
+static const uint8_t digest_sha512[TEE_SHA512_HASH_SIZE] = {
+	0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+	0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+	0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+	0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+	0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+	0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+	0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+	0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09,
+};
+
+static uint32_t elapsed_ms(TEE_Time *start)
+{
+	TEE_Time now = { };
+	TEE_Time diff = { };
+
+	tee_time_get_sys_time(&now);
+	TEE_TIME_SUB(now, *start, diff);
+
+	return diff.seconds * TEE_TIME_MILLIS_BASE + diff.millis;
+}
+
+static TEE_Result hash(void *ctx, const uint8_t *data, size_t len,
+		       size_t chunk, uint8_t *digest, size_t digest_len)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	res = crypto_hash_init(ctx);
+	if (res)
+		return res;
+	for (n = 0; n < len; n += chunk) {
+		res = crypto_hash_update(ctx, data + n, MIN(chunk, len - n));
+		if (res)
+			return res;
+	}
+
+	return crypto_hash_final(ctx, digest, digest_len);
+}
+
+static TEE_Result check_kat(void *ctx, uint32_t algo, size_t digest_len)
+{
+	uint8_t digest[TEE_MAX_HASH_SIZE] = { };
+	const uint8_t *expect = NULL;
+	const uint8_t *msg = NULL;
+	size_t msg_len = 0;
+	TEE_Result res = TEE_SUCCESS;
+
+	switch (algo) {
+	case TEE_ALG_SHA256:
+		msg = msg_sha256;
+		msg_len = sizeof(msg_sha256) - 1;
+		expect = digest_sha256;
+		break;
+	case TEE_ALG_SHA384:
+		msg = msg_sha512;
+		msg_len = sizeof(msg_sha512) - 1;
+		expect = digest_sha384;
+		break;
+	default:
+		msg = msg_sha512;
+		msg_len = sizeof(msg_sha512) - 1;
+		expect = digest_sha512;
+		break;
+	}
+
+	res = hash(ctx, msg, msg_len, msg_len, digest, digest_len);
+	if (res)
+		return res;
+	if (memcmp(digest, expect, digest_len)) {
+		EMSG("Digest of test vector mismatch");
+		return TEE_ERROR_GENERIC;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result check_chunks(void *ctx, const uint8_t *buf, size_t len,
+			       size_t digest_len)
+{
+	static const size_t chunks[] = { 1, 3, 17, 111, 129, 1000 };
+	uint8_t digest[TEE_MAX_HASH_SIZE] = { };
+	uint8_t ref[TEE_MAX_HASH_SIZE] = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	res = hash(ctx, buf, len, len, ref, digest_len);
+	if (res)
+		return res;
+
+	for (n = 0; n < ARRAY_SIZE(chunks); n++) {
+		res = hash(ctx, buf, len, chunks[n], digest, digest_len);
+		if (res)
+			return res;
+		if (memcmp(digest, ref, digest_len)) {
+			EMSG("Digest mismatch with %zu byte updates",
+			     chunks[n]);
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_hash_perf_tests(uint32_t param_types,
+				TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[TEE_MAX_HASH_SIZE] = { };
+	size_t rep_count = params[0].value.b;
+	uint32_t algo = params[0].value.a;
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t ps_per_byte = 0;
+	uint64_t total_bytes = 0;
+	size_t digest_len = 0;
+	uint8_t *buf = NULL;
+	void *ctx = NULL;
+	uint32_t ms = 0;
+	TEE_Time t = { };
+	size_t n = 0;
+
+	if (param_types != exp_pt || !rep_count)
+		return TEE_ERROR_BAD_PARAMETERS;
+	switch (algo) {
+	case TEE_ALG_SHA256:
+		digest_len = TEE_SHA256_HASH_SIZE;
+		break;
+	case TEE_ALG_SHA384:
+		digest_len = TEE_SHA384_HASH_SIZE;
+		break;
+	case TEE_ALG_SHA512:
+		digest_len = TEE_SHA512_HASH_SIZE;
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	res = crypto_hash_alloc_ctx(&ctx, algo);
+	if (res)
+		return res;
+	buf = malloc(PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE);
+	if (!buf) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	res = crypto_rng_read(buf, PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE);
+	if (res)
+		goto out;
+
+	res = check_kat(ctx, algo, digest_len);
+	if (res)
+		goto out;
+	res = check_chunks(ctx, buf, PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE,
+			   digest_len);
+	if (res)
+		goto out;
+
+	tee_time_get_sys_time(&t);
+	for (n = 0; n < rep_count; n++) {
+		res = hash(ctx, buf, PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE,
+			   PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE, digest,
+			   digest_len);
+		if (res)
+			goto out;
+	}
+	ms = elapsed_ms(&t);
+
+	total_bytes = (uint64_t)rep_count * PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE;
+	ps_per_byte = (uint64_t)ms * 1000000000 / total_bytes;
+	params[1].value.a = ms;
+	if (ms)
+		params[1].value.b = total_bytes * TEE_TIME_MILLIS_BASE /
+				    ((uint64_t)ms * 1024);
+	else
+		params[1].value.b = 0;
+
+	IMSG("hash %#"PRIx32": %"PRIu64" bytes, %"PRIu32" ms, %"PRIu32" KiB/s",
+	     algo, total_bytes, ms, params[1].value.b);
+	IMSG("hash %#"PRIx32": %"PRIu64".%03"PRIu64" ns/byte", algo,
+	     ps_per_byte / 1000, ps_per_byte % 1000);
+
+out:
+	free(buf);
+	crypto_hash_free_ctx(ctx);
+	return res;
+}
@@ -434,6 +434,16 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 		return core_lockdep_tests(nParamTypes, pParams);
 	case PTA_INVOKE_TEST_CMD_AES_PERF:
 		return core_aes_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_TEE_MM_PERF:
+		return core_tee_mm_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_PAGE_ENC_PERF:
+		return core_page_enc_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_PAGE_LZ:
+		return core_page_lz_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_ECC_PERF:
+		return core_ecc_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_HASH_PERF:
+		return core_hash_perf_tests(nParamTypes, pParams);
 	default:
 		break;
 	}
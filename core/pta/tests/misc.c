@@ -7,6 +7,8 @@
 #include <stdbool.h>
 #include <trace.h>
 #include <kernel/panic.h>
+#include <kernel/thread.h>
+#include <string.h>
 #include <util.h>
 
 #include "misc.h"
@@ -382,6 +384,124 @@ static int self_test_malloc(void)
 	return ret;
 }
 
+#if defined(CFG_CORE_MALLOC_MAGAZINES) && !defined(ENABLE_MDBG)
+/* Largest allocation served from the magazines, see bget_malloc.c */
+#define MAG_MAX_SIZE	512
+
+static bool buf_is_filled(const uint8_t *buf, size_t len, uint8_t val)
+{
+	size_t n = 0;
+
+	for (n = 0; n < len; n++)
+		if (buf[n] != val)
+			return false;
+
+	return true;
+}
+
+/* test malloc magazines */
+static int self_test_malloc_magazines(void)
+{
+	uint8_t *p1 = NULL;
+	uint8_t *p2 = NULL;
+	bool r = false;
+	int ret = 0;
+
+	LOG("malloc magazine tests:");
+
+	/* realloc of a slab object up across the size boundary and back */
+	p1 = malloc(16);
+	LOG("- p1 = malloc(16)");
+	r = p1 && malloc_buffer_is_within_alloced(p1, 16) &&
+	    !malloc_buffer_is_within_alloced(p1, MAG_MAX_SIZE);
+	if (p1)
+		memset(p1, 0xa5, 16);
+	p2 = realloc(p1, 64);
+	LOG("- p2 = realloc(p1, 64)");
+	if (p2) {
+		p1 = NULL;
+		r = r && buf_is_filled(p2, 16, 0xa5);
+		memset(p2, 0xa5, 64);
+		p1 = realloc(p2, MAG_MAX_SIZE + 1);
+		LOG("- p1 = realloc(p2, %d)", MAG_MAX_SIZE + 1);
+		if (p1)
+			p2 = NULL;
+	}
+	r = r && p1 && buf_is_filled(p1, 64, 0xa5) &&
+	    malloc_buffer_is_within_alloced(p1, MAG_MAX_SIZE + 1);
+	if (p1) {
+		p2 = realloc(p1, 32);
+		LOG("- p2 = realloc(p1, 32)");
+		if (p2)
+			p1 = NULL;
+	}
+	r = r && p2 && buf_is_filled(p2, 32, 0xa5);
+	free(p1);
+	free(p2);
+	p1 = NULL;
+	p2 = NULL;
+	if (!r)
+		ret = -1;
+	LOG("  => test %s", r ? "ok" : "FAILED");
+
+	/* a freed object cached in a magazine isn't allocated */
+	p1 = calloc(1, MAG_MAX_SIZE);
+	LOG("- p1 = calloc(1, %d)", MAG_MAX_SIZE);
+	r = p1 && buf_is_filled(p1, MAG_MAX_SIZE, 0) &&
+	    malloc_buffer_is_within_alloced(p1, MAG_MAX_SIZE) &&
+	    !malloc_buffer_is_within_alloced(p1, MAG_MAX_SIZE + 1) &&
+	    !malloc_buffer_is_within_alloced(p1 - 1, 1);
+	free(p1);
+	LOG("- free p1");
+	r = r && !malloc_buffer_is_within_alloced(p1, 1);
+	p1 = NULL;
+	if (!r)
+		ret = -1;
+	LOG("  => test %s", r ? "ok" : "FAILED");
+
+#ifdef CFG_WITH_STATS
+	{
+		struct malloc_stats s1 = { };
+		struct malloc_stats s2 = { };
+		struct malloc_stats s3 = { };
+		uint32_t exceptions = 0;
+
+		/*
+		 * Stay on this CPU so the object freed to warm up the
+		 * magazine is the one allocated again, cached objects
+		 * must not be accounted as allocated.
+		 */
+		exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
+		free(malloc(48));
+		malloc_get_stats(&s1);
+		p1 = malloc(48);
+		malloc_get_stats(&s2);
+		free(p1);
+		malloc_get_stats(&s3);
+		thread_unmask_exceptions(exceptions);
+		LOG("- allocated %u, %u after malloc(48), %u after free",
+		    (unsigned)s1.allocated, (unsigned)s2.allocated,
+		    (unsigned)s3.allocated);
+		r = p1 && s2.allocated == s1.allocated + 64 &&
+		    s3.allocated == s1.allocated;
+		p1 = NULL;
+		if (!r)
+			ret = -1;
+		LOG("  => test %s", r ? "ok" : "FAILED");
+	}
+#endif
+
+	LOG("malloc magazine test done");
+
+	return ret;
+}
+#else
+static int self_test_malloc_magazines(void)
+{
+	return 0;
+}
+#endif
+
 #ifdef CFG_VIRTUALIZATION
 /* test nex_malloc support. resulting trace shall be manually checked */
 static int self_test_nex_malloc(void)
@@ -473,7 +593,7 @@ TEE_Result core_self_tests(uint32_t nParamTypes __unused,
 	if (self_test_mul_signed_overflow() || self_test_add_overflow() ||
 	    self_test_sub_overflow() || self_test_mul_unsigned_overflow() ||
 	    self_test_division() || self_test_malloc() ||
-	    self_test_nex_malloc()) {
+	    self_test_malloc_magazines() || self_test_nex_malloc()) {
 		EMSG("some self_test_xxx failed! you should enable local LOG");
 		return TEE_ERROR_GENERIC;
 	}
@@ -34,4 +34,37 @@ static inline TEE_Result core_lockdep_tests(
 TEE_Result core_aes_perf_tests(uint32_t param_types,
 			       TEE_Param params[TEE_NUM_PARAMS]);
 
+TEE_Result core_tee_mm_perf_tests(uint32_t param_types,
+				  TEE_Param params[TEE_NUM_PARAMS]);
+
+TEE_Result core_page_enc_perf_tests(uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS]);
+
+#ifdef CFG_PAGED_RW_COMPRESSION
+TEE_Result core_page_lz_tests(uint32_t param_types,
+			      TEE_Param params[TEE_NUM_PARAMS]);
+#else
+static inline TEE_Result core_page_lz_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+#endif
+
+TEE_Result core_hash_perf_tests(uint32_t param_types,
+				TEE_Param params[TEE_NUM_PARAMS]);
+
+#ifdef CFG_CRYPTO_ECC
+TEE_Result core_ecc_perf_tests(uint32_t param_types,
+			       TEE_Param params[TEE_NUM_PARAMS]);
+#else
+static inline TEE_Result core_ecc_perf_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+#endif
+
 #endif /*CORE_PTA_TESTS_MISC_H*/
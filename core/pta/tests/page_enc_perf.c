@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <crypto/internal_aes-gcm.h>
+#include <kernel/tee_time.h>
+#include <malloc.h>
+#include <mm/core_mmu.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "misc.h"
+
+/*
+ * Encrypts pages with the same key and IV layout as the read/write paged
+ * fobjs, first one page at a time with internal_aes_gcm_enc() and then in
+ * batches with internal_aes_gcm_enc_batch(). All batches encrypt the same
+ * source page with different IVs, the results of both ways must match.
+ */
+
+#define TAG_LEN		16
+
+struct page_iv {
+	uint32_t iv[3];
+};
+
+static uint32_t elapsed_ms(TEE_Time *start)
+{
+	TEE_Time now = { };
+	TEE_Time diff = { };
+
+	tee_time_get_sys_time(&now);
+	TEE_TIME_SUB(now, *start, diff);
+
+	return diff.seconds * TEE_TIME_MILLIS_BASE + diff.millis;
+}
+
+static void init_batch(struct internal_aes_gcm_batch *batch,
+		       struct page_iv *iv, uint8_t *tags, const void *src,
+		       uint8_t *dst, size_t count, uint32_t ctr)
+{
+	size_t n = 0;
+
+	for (n = 0; n < count; n++) {
+		iv[n].iv[0] = n;
+		iv[n].iv[1] = 0;
+		iv[n].iv[2] = ctr;
+
+		batch[n].nonce = iv + n;
+		batch[n].nonce_len = sizeof(iv[n]);
+		batch[n].src = src;
+		batch[n].dst = dst + n * SMALL_PAGE_SIZE;
+		batch[n].len = SMALL_PAGE_SIZE;
+		batch[n].tag = tags + n * TAG_LEN;
+		batch[n].tag_len = TAG_LEN;
+	}
+}
+
+static TEE_Result enc_one_by_one(const struct internal_aes_gcm_key *key,
+				 struct internal_aes_gcm_batch *batch,
+				 size_t count)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	for (n = 0; n < count; n++) {
+		res = internal_aes_gcm_enc(key, batch[n].nonce,
+					   batch[n].nonce_len, NULL, 0,
+					   batch[n].src, batch[n].len,
+					   batch[n].dst, batch[n].tag,
+					   &batch[n].tag_len);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * @page holds the source page of the batch followed by a page used for
+ * reference results.
+ */
+static TEE_Result check_batch(const struct internal_aes_gcm_key *key,
+			      struct internal_aes_gcm_batch *batch,
+			      size_t count, uint8_t *page)
+{
+	uint8_t *ref = page + SMALL_PAGE_SIZE;
+	uint8_t tag[TAG_LEN] = { };
+	size_t tag_len = sizeof(tag);
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	res = internal_aes_gcm_enc_batch(key, batch, count);
+	if (res)
+		return res;
+
+	for (n = 0; n < count; n++) {
+		res = internal_aes_gcm_enc(key, batch[n].nonce,
+					   batch[n].nonce_len, NULL, 0,
+					   batch[n].src, batch[n].len, ref,
+					   tag, &tag_len);
+		if (res)
+			return res;
+		if (memcmp(ref, batch[n].dst, SMALL_PAGE_SIZE) ||
+		    memcmp(tag, batch[n].tag, TAG_LEN)) {
+			EMSG("Batch entry %zu mismatch", n);
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	/* Decrypt in place and check that the source page is recovered */
+	for (n = 0; n < count; n++) {
+		res = internal_aes_gcm_dec(key, batch[n].nonce,
+					   batch[n].nonce_len, NULL, 0,
+					   batch[n].dst, batch[n].len,
+					   batch[n].dst, batch[n].tag,
+					   batch[n].tag_len);
+		if (res)
+			return res;
+		if (memcmp(batch[n].dst, page, SMALL_PAGE_SIZE)) {
+			EMSG("Batch entry %zu decrypt mismatch", n);
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_page_enc_perf_tests(uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct internal_aes_gcm_batch
+		batch[PTA_INVOKE_TESTS_PAGE_ENC_MAX_BATCH] = { };
+	struct page_iv iv[PTA_INVOKE_TESTS_PAGE_ENC_MAX_BATCH] = { };
+	uint8_t tags[PTA_INVOKE_TESTS_PAGE_ENC_MAX_BATCH * TAG_LEN] = { };
+	uint8_t key_data[32] = { };
+	struct internal_aes_gcm_key key = { };
+	size_t rep_count = params[0].value.a;
+	size_t count = params[0].value.b;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *page = NULL;
+	uint8_t *dst = NULL;
+	TEE_Time t = { };
+	size_t n = 0;
+
+	if (param_types != exp_pt || !count ||
+	    count > PTA_INVOKE_TESTS_PAGE_ENC_MAX_BATCH)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	page = malloc(2 * SMALL_PAGE_SIZE);
+	dst = malloc(count * SMALL_PAGE_SIZE);
+	if (!page || !dst) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	res = crypto_rng_read(key_data, sizeof(key_data));
+	if (res)
+		goto out;
+	res = crypto_aes_expand_enc_key(key_data, sizeof(key_data), key.data,
+					sizeof(key.data), &key.rounds);
+	if (res)
+		goto out;
+	res = crypto_rng_read(page, SMALL_PAGE_SIZE);
+	if (res)
+		goto out;
+
+	tee_time_get_sys_time(&t);
+	for (n = 0; n < rep_count; n++) {
+		init_batch(batch, iv, tags, page, dst, count, n);
+		res = enc_one_by_one(&key, batch, count);
+		if (res)
+			goto out;
+	}
+	params[1].value.a = elapsed_ms(&t);
+
+	tee_time_get_sys_time(&t);
+	for (n = 0; n < rep_count; n++) {
+		init_batch(batch, iv, tags, page, dst, count, n);
+		res = internal_aes_gcm_enc_batch(&key, batch, count);
+		if (res)
+			goto out;
+	}
+	params[1].value.b = elapsed_ms(&t);
+
+	init_batch(batch, iv, tags, page, dst, count, rep_count);
+	res = check_batch(&key, batch, count, page);
+	if (res)
+		goto out;
+
+	IMSG("page enc: %zu x %zu pages: %"PRIu32" ms, batched: %"PRIu32" ms",
+	     rep_count, count, params[1].value.a, params[1].value.b);
+
+out:
+	free(page);
+	free(dst);
+	return res;
+}
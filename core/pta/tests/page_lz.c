@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <malloc.h>
+#include <mm/core_mmu.h>
+#include <mm/page_lz.h>
+#include <string.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "misc.h"
+
+/*
+ * Round trip tests of the page compression used by
+ * fobj_rw_compressed_paged_alloc(). Decompression of truncated or
+ * corrupted data must fail, or at least not write outside the output
+ * buffer which is followed by a guard area checked after each call.
+ */
+
+#define GUARD_SIZE	64
+#define GUARD_BYTE	0xa5
+/* Large enough for an incompressible page */
+#define CBUF_SIZE	(2 * SMALL_PAGE_SIZE)
+#define NUM_CORRUPT	256
+
+struct lz_test {
+	struct page_lz_work work;
+	uint8_t page[SMALL_PAGE_SIZE];
+	uint8_t cbuf[CBUF_SIZE];
+	uint8_t out[SMALL_PAGE_SIZE + GUARD_SIZE];
+};
+
+static bool guard_is_intact(struct lz_test *t)
+{
+	size_t n = 0;
+
+	for (n = 0; n < GUARD_SIZE; n++)
+		if (t->out[SMALL_PAGE_SIZE + n] != GUARD_BYTE)
+			return false;
+
+	return true;
+}
+
+static TEE_Result decompress(struct lz_test *t, size_t len)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	memset(t->out, GUARD_BYTE, sizeof(t->out));
+	res = page_lz_decompress(t->cbuf, len, t->out, SMALL_PAGE_SIZE);
+	if (!guard_is_intact(t)) {
+		EMSG("Write past the end of the output");
+		return TEE_ERROR_GENERIC;
+	}
+
+	return res;
+}
+
+static TEE_Result test_round_trip(struct lz_test *t, const char *name,
+				  bool compressible)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t len = 0;
+
+	len = page_lz_compress(t->page, SMALL_PAGE_SIZE, t->cbuf,
+			       SMALL_PAGE_SIZE / 2, &t->work);
+	if ((len != 0) != compressible) {
+		EMSG("%s: unexpected compressed length %zu", name, len);
+		return TEE_ERROR_GENERIC;
+	}
+	if (!len) {
+		len = page_lz_compress(t->page, SMALL_PAGE_SIZE, t->cbuf,
+				       CBUF_SIZE, &t->work);
+		if (!len) {
+			EMSG("%s: compression failed", name);
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	res = decompress(t, len);
+	if (res) {
+		EMSG("%s: decompress: %#"PRIx32, name, res);
+		return res;
+	}
+	if (memcmp(t->out, t->page, SMALL_PAGE_SIZE)) {
+		EMSG("%s: decompressed data mismatch", name);
+		return TEE_ERROR_GENERIC;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result test_bad_input(struct lz_test *t, const char *name)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t rnd[2] = { };
+	size_t len = 0;
+	size_t n = 0;
+
+	len = page_lz_compress(t->page, SMALL_PAGE_SIZE, t->cbuf, CBUF_SIZE,
+			       &t->work);
+	if (!len)
+		return TEE_ERROR_GENERIC;
+
+	for (n = 0; n < len; n++) {
+		res = decompress(t, n);
+		if (res == TEE_ERROR_GENERIC)
+			return res;
+		if (res != TEE_ERROR_CORRUPT_OBJECT) {
+			EMSG("%s: truncated to %zu bytes: %#"PRIx32,
+			     name, n, res);
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	/*
+	 * A flipped bit may still decompress to a page of the expected
+	 * size, so only check that the output buffer isn't overrun.
+	 */
+	for (n = 0; n < NUM_CORRUPT; n++) {
+		page_lz_compress(t->page, SMALL_PAGE_SIZE, t->cbuf, CBUF_SIZE,
+				 &t->work);
+		res = crypto_rng_read(rnd, sizeof(rnd));
+		if (res)
+			return res;
+		t->cbuf[rnd[0] % len] ^= BIT(rnd[1] % 8);
+		if (decompress(t, len) == TEE_ERROR_GENERIC) {
+			EMSG("%s: corrupted byte %zu", name,
+			     (size_t)(rnd[0] % len));
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	/* A match before the start of the output */
+	t->cbuf[0] = 0x00;
+	t->cbuf[1] = 0x01;
+	t->cbuf[2] = 0x00;
+	t->cbuf[3] = 0x00;
+	if (decompress(t, 4) != TEE_ERROR_CORRUPT_OBJECT) {
+		EMSG("%s: match before output not detected", name);
+		return TEE_ERROR_GENERIC;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result test_page(struct lz_test *t, const char *name,
+			    bool compressible)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	res = test_round_trip(t, name, compressible);
+	if (!res)
+		res = test_bad_input(t, name);
+
+	return res;
+}
+
+TEE_Result core_page_lz_tests(uint32_t param_types,
+			      TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	TEE_Result res = TEE_SUCCESS;
+	struct lz_test *t = NULL;
+	size_t n = 0;
+
+	if (param_types != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	t = malloc(sizeof(*t));
+	if (!t)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	memset(t->page, 0, SMALL_PAGE_SIZE);
+	res = test_page(t, "zero page", true);
+	if (res)
+		goto out;
+
+	res = crypto_rng_read(t->page, SMALL_PAGE_SIZE);
+	if (res)
+		goto out;
+	res = test_page(t, "random page", false);
+	if (res)
+		goto out;
+
+	/* Random bytes repeated in runs of random length */
+	for (n = 0; n < SMALL_PAGE_SIZE; n++)
+		if (n && t->page[n] & 0x3f)
+			t->page[n] = t->page[n - 1];
+	res = test_page(t, "random runs", true);
+	if (res)
+		goto out;
+
+	/* Short repeated pattern with mismatches, like a table of structs */
+	for (n = 0; n < SMALL_PAGE_SIZE; n++)
+		t->page[n] = (n % 24 < 8) ? n / 24 : n % 24;
+	res = test_page(t, "pattern", true);
+	if (res)
+		goto out;
+
+	IMSG("page_lz tests passed");
+out:
+	free(t);
+	return res;
+}
@@ -6,3 +6,8 @@ srcs-y += misc.c
 cflags-misc.c-y += -fno-builtin
 srcs-y += mutex.c
 srcs-y += aes_perf.c
+srcs-y += tee_mm_perf.c
+srcs-y += page_enc_perf.c
+srcs-y += hash_perf.c
+srcs-$(CFG_PAGED_RW_COMPRESSION) += page_lz.c
+srcs-$(CFG_CRYPTO_ECC) += ecc_perf.c
@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <kernel/tee_time.h>
+#include <malloc.h>
+#include <mm/core_mmu.h>
+#include <mm/tee_mm.h>
+#include <pta_invoke_tests.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "misc.h"
+
+/*
+ * Compares tee_mm against a reference allocator using the singly linked
+ * list first fit search tee_mm used before the entries were kept in a
+ * tree. Both allocators are fed the same sequence of allocations and
+ * frees, which must end up at the same offsets.
+ */
+
+#define TEST_SHIFT	SMALL_PAGE_SHIFT
+#define TEST_MAX_PAGES	4
+
+struct ref_entry {
+	struct ref_entry *next;
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct ref_pool {
+	struct ref_entry head;
+	uint32_t units;
+	bool hi_alloc;
+};
+
+static void ref_init(struct ref_pool *pool, uint32_t units, bool hi_alloc)
+{
+	pool->units = units;
+	pool->hi_alloc = hi_alloc;
+	pool->head.next = NULL;
+	pool->head.size = 0;
+	if (hi_alloc)
+		pool->head.offset = units;
+	else
+		pool->head.offset = 0;
+}
+
+static bool ref_alloc(struct ref_pool *pool, struct ref_entry *nn,
+		      uint32_t size)
+{
+	struct ref_entry *e = &pool->head;
+
+	if (pool->hi_alloc) {
+		while (e->next &&
+		       size > e->offset - e->next->offset - e->next->size)
+			e = e->next;
+		if (!e->next && e->offset < size)
+			return false;
+		nn->offset = e->offset - size;
+	} else {
+		while (e->next && size > e->next->offset - e->size - e->offset)
+			e = e->next;
+		if (!e->next && pool->units - e->offset - e->size < size)
+			return false;
+		nn->offset = e->offset + e->size;
+	}
+
+	nn->size = size;
+	nn->next = e->next;
+	e->next = nn;
+
+	return true;
+}
+
+static void ref_free(struct ref_pool *pool, struct ref_entry *p)
+{
+	struct ref_entry *e = &pool->head;
+
+	while (e->next != p)
+		e = e->next;
+	e->next = p->next;
+}
+
+/* Simple deterministic pseudo random number generator */
+static uint32_t next_rand(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 16;
+}
+
+static uint32_t elapsed_ms(TEE_Time *start)
+{
+	TEE_Time now = { };
+	TEE_Time diff = { };
+
+	tee_time_get_sys_time(&now);
+	TEE_TIME_SUB(now, *start, diff);
+
+	return diff.seconds * TEE_TIME_MILLIS_BASE + diff.millis;
+}
+
+static TEE_Result run_tee_mm(tee_mm_pool_t *pool, tee_mm_entry_t **mm,
+			     size_t num_entries, size_t rep_count,
+			     uint32_t *ms)
+{
+	uint32_t rnd = 1;
+	TEE_Time t = { };
+	size_t n = 0;
+	size_t i = 0;
+
+	tee_time_get_sys_time(&t);
+
+	for (n = 0; n < num_entries; n++) {
+		i = 1 + next_rand(&rnd) % TEST_MAX_PAGES;
+		mm[n] = tee_mm_alloc(pool, i << TEST_SHIFT);
+		if (!mm[n])
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	for (n = 0; n < rep_count; n++) {
+		i = next_rand(&rnd) % num_entries;
+		tee_mm_free(mm[i]);
+		mm[i] = tee_mm_alloc(pool, (1 + next_rand(&rnd) %
+					    TEST_MAX_PAGES) << TEST_SHIFT);
+		if (!mm[i])
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	*ms = elapsed_ms(&t);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result run_ref(struct ref_pool *pool, struct ref_entry *re,
+			  size_t num_entries, size_t rep_count, uint32_t *ms)
+{
+	uint32_t rnd = 1;
+	TEE_Time t = { };
+	size_t n = 0;
+	size_t i = 0;
+
+	tee_time_get_sys_time(&t);
+
+	for (n = 0; n < num_entries; n++)
+		if (!ref_alloc(pool, re + n,
+			       1 + next_rand(&rnd) % TEST_MAX_PAGES))
+			return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < rep_count; n++) {
+		i = next_rand(&rnd) % num_entries;
+		ref_free(pool, re + i);
+		if (!ref_alloc(pool, re + i,
+			       1 + next_rand(&rnd) % TEST_MAX_PAGES))
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	*ms = elapsed_ms(&t);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_tee_mm_perf_tests(uint32_t param_types,
+				  TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_entries = params[0].value.a;
+	size_t rep_count = params[0].value.b;
+	uint32_t flags = TEE_MM_POOL_NO_FLAGS;
+	struct ref_pool ref_pool = { };
+	tee_mm_pool_t pool = { };
+	struct ref_entry *re = NULL;
+	tee_mm_entry_t **mm = NULL;
+	size_t units = 0;
+	size_t n = 0;
+
+	if (param_types != exp_pt || !num_entries)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (rep_count & PTA_INVOKE_TESTS_TEE_MM_HI_ALLOC) {
+		flags = TEE_MM_POOL_HI_ALLOC;
+		rep_count &= ~PTA_INVOKE_TESTS_TEE_MM_HI_ALLOC;
+	}
+
+	/* Leave some slack so there's always room for a new entry */
+	if (MUL_OVERFLOW(num_entries, TEST_MAX_PAGES + 1, &units) ||
+	    units > (UINT32_MAX >> TEST_SHIFT))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	mm = calloc(num_entries, sizeof(*mm));
+	re = calloc(num_entries, sizeof(*re));
+	if (!mm || !re) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	if (!tee_mm_init(&pool, 0, units << TEST_SHIFT, TEST_SHIFT, flags)) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	ref_init(&ref_pool, units, flags & TEE_MM_POOL_HI_ALLOC);
+
+	res = run_tee_mm(&pool, mm, num_entries, rep_count,
+			 &params[1].value.a);
+	if (res)
+		goto out_final;
+	res = run_ref(&ref_pool, re, num_entries, rep_count,
+		      &params[1].value.b);
+	if (res)
+		goto out_final;
+
+	for (n = 0; n < num_entries; n++) {
+		if (tee_mm_get_offset(mm[n]) != re[n].offset ||
+		    tee_mm_find(&pool, tee_mm_get_smem(mm[n])) != mm[n]) {
+			EMSG("Entry %zu mismatch", n);
+			res = TEE_ERROR_GENERIC;
+			goto out_final;
+		}
+	}
+
+	IMSG("tee_mm: %zu entries, %zu reallocations: %"PRIu32" ms, "
+	     "list: %"PRIu32" ms", num_entries, rep_count,
+	     params[1].value.a, params[1].value.b);
+
+out_final:
+	tee_mm_final(&pool);
+out:
+	free(mm);
+	free(re);
+	return res;
+}
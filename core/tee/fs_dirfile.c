@@ -10,13 +10,32 @@
 #include <string.h>
 #include <tee/fs_dirfile.h>
 #include <types_ext.h>
+#include <util.h>
 
+#define DIRF_IDX_MIN_SLOTS	16
+#define DIRF_IDX_EMPTY		-1
+
+/*
+ * The dirfile entries in use are indexed in memory to avoid reading the
+ * dirfile from the start for each lookup.
+ *
+ * @dent_used tells which dirfile entries are in use and @dent_hash holds
+ * a hash of TA UUID and object ID of each such entry. @idx_slots is an
+ * open addressing table with linear probing holding the index of each
+ * used entry, so a lookup only reads the entries with a matching hash.
+ */
 struct tee_fs_dirfile_dirh {
 	const struct tee_fs_dirfile_operations *fops;
 	struct tee_file_handle *fh;
 	int nbits;
 	bitstr_t *files;
 	size_t ndents;
+	size_t dent_cap;
+	bitstr_t *dent_used;
+	uint32_t *dent_hash;
+	size_t idx_nslots;
+	size_t idx_count;
+	int32_t *idx_slots;
 };
 
 struct dirfile_entry {
@@ -79,6 +98,160 @@ static bool test_file(struct tee_fs_dirfile_dirh *dirh, int idx)
 	return false;
 }
 
+static uint32_t dent_key_hash(const TEE_UUID *uuid, const void *oid,
+			      size_t oidlen)
+{
+	const uint8_t *p = (const uint8_t *)uuid;
+	uint32_t h = 2166136261; /* FNV-1a */
+	size_t n = 0;
+
+	for (n = 0; n < sizeof(*uuid); n++)
+		h = (h ^ p[n]) * 16777619;
+	p = oid;
+	for (n = 0; n < oidlen; n++)
+		h = (h ^ p[n]) * 16777619;
+
+	return h;
+}
+
+static bool dent_is_used(struct tee_fs_dirfile_dirh *dirh, size_t idx)
+{
+	if (idx < dirh->dent_cap)
+		return bit_test(dirh->dent_used, idx);
+
+	return false;
+}
+
+static TEE_Result idx_grow_dents(struct tee_fs_dirfile_dirh *dirh, size_t idx)
+{
+	size_t cap = 0;
+	void *p = NULL;
+
+	if (idx < dirh->dent_cap)
+		return TEE_SUCCESS;
+
+	cap = MAX(dirh->dent_cap * 2, (size_t)DIRF_IDX_MIN_SLOTS);
+	cap = MAX(cap, idx + 1);
+
+	p = realloc(dirh->dent_hash, cap * sizeof(*dirh->dent_hash));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	dirh->dent_hash = p;
+
+	p = realloc(dirh->dent_used, bitstr_size(cap));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	dirh->dent_used = p;
+
+	bit_nclear(dirh->dent_used, dirh->dent_cap, cap - 1);
+	dirh->dent_cap = cap;
+
+	return TEE_SUCCESS;
+}
+
+static void idx_slot_insert(int32_t *slots, size_t nslots, uint32_t hash,
+			    size_t idx)
+{
+	size_t mask = nslots - 1;
+	size_t n = hash & mask;
+
+	while (slots[n] != DIRF_IDX_EMPTY)
+		n = (n + 1) & mask;
+	slots[n] = idx;
+}
+
+static TEE_Result idx_grow_slots(struct tee_fs_dirfile_dirh *dirh,
+				 size_t count)
+{
+	size_t nslots = MAX(dirh->idx_nslots, (size_t)DIRF_IDX_MIN_SLOTS);
+	int32_t *slots = NULL;
+	size_t n = 0;
+
+	/* Keep the load factor at or below 1/2 */
+	if (dirh->idx_slots && count * 2 <= dirh->idx_nslots)
+		return TEE_SUCCESS;
+
+	while (count * 2 > nslots)
+		nslots *= 2;
+
+	slots = malloc(nslots * sizeof(*slots));
+	if (!slots)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < nslots; n++)
+		slots[n] = DIRF_IDX_EMPTY;
+	for (n = 0; n < dirh->dent_cap; n++)
+		if (bit_test(dirh->dent_used, n))
+			idx_slot_insert(slots, nslots, dirh->dent_hash[n], n);
+
+	free(dirh->idx_slots);
+	dirh->idx_slots = slots;
+	dirh->idx_nslots = nslots;
+
+	return TEE_SUCCESS;
+}
+
+/* Makes sure that idx_update() can't fail for entry @idx */
+static TEE_Result idx_reserve(struct tee_fs_dirfile_dirh *dirh, size_t idx)
+{
+	TEE_Result res = idx_grow_dents(dirh, idx);
+
+	if (res)
+		return res;
+
+	return idx_grow_slots(dirh, dirh->idx_count + 1);
+}
+
+static void idx_remove(struct tee_fs_dirfile_dirh *dirh, size_t idx)
+{
+	size_t mask = dirh->idx_nslots - 1;
+	size_t i = dirh->dent_hash[idx] & mask;
+	size_t j = 0;
+	size_t k = 0;
+
+	while (dirh->idx_slots[i] != (int32_t)idx)
+		i = (i + 1) & mask;
+
+	/*
+	 * Backward shift deletion, move each following entry of the
+	 * cluster into the hole unless its home slot lies cyclically
+	 * in (i, j].
+	 */
+	j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (dirh->idx_slots[j] == DIRF_IDX_EMPTY)
+			break;
+		k = dirh->dent_hash[dirh->idx_slots[j]] & mask;
+		if ((j > i && (k <= i || k > j)) ||
+		    (j < i && k <= i && k > j)) {
+			dirh->idx_slots[i] = dirh->idx_slots[j];
+			i = j;
+		}
+	}
+	dirh->idx_slots[i] = DIRF_IDX_EMPTY;
+
+	bit_clear(dirh->dent_used, idx);
+	dirh->idx_count--;
+}
+
+/* Records the new content of entry @idx, idx_reserve() must succeed first */
+static void idx_update(struct tee_fs_dirfile_dirh *dirh, size_t idx,
+		       const struct dirfile_entry *dent)
+{
+	if (dent_is_used(dirh, idx))
+		idx_remove(dirh, idx);
+
+	if (dent->oidlen) {
+		dirh->dent_hash[idx] = dent_key_hash(&dent->uuid, dent->oid,
+						     dent->oidlen);
+		bit_set(dirh->dent_used, idx);
+		idx_slot_insert(dirh->idx_slots, dirh->idx_nslots,
+				dirh->dent_hash[idx], idx);
+		dirh->idx_count++;
+	}
+}
+
 static TEE_Result read_dent(struct tee_fs_dirfile_dirh *dirh, int idx,
 			    struct dirfile_entry *dent)
 {
@@ -99,12 +272,20 @@ static TEE_Result write_dent(struct tee_fs_dirfile_dirh *dirh, size_t n,
 {
 	TEE_Result res;
 
+	res = idx_reserve(dirh, n);
+	if (res)
+		return res;
+
 	res = dirh->fops->write(dirh->fh, sizeof(*dent) * n,
 				dent, sizeof(*dent));
-	if (!res && n >= dirh->ndents)
+	if (res)
+		return res;
+
+	idx_update(dirh, n, dent);
+	if (n >= dirh->ndents)
 		dirh->ndents = n + 1;
 
-	return res;
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
@@ -149,8 +330,15 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 		res = set_file(dirh, dent.file_number);
 		if (res != TEE_SUCCESS)
 			goto out;
+
+		res = idx_reserve(dirh, n);
+		if (res != TEE_SUCCESS)
+			goto out;
+		idx_update(dirh, n, &dent);
 	}
 out:
+	if (!res && n)
+		res = idx_grow_dents(dirh, n - 1);
 	if (!res) {
 		dirh->ndents = n;
 		*dirh_ret = dirh;
@@ -165,6 +353,9 @@ void tee_fs_dirfile_close(struct tee_fs_dirfile_dirh *dirh)
 	if (dirh) {
 		dirh->fops->close(dirh->fh);
 		free(dirh->files);
+		free(dirh->dent_used);
+		free(dirh->dent_hash);
+		free(dirh->idx_slots);
 		free(dirh);
 	}
 }
@@ -198,37 +389,47 @@ TEE_Result tee_fs_dirfile_find(struct tee_fs_dirfile_dirh *dirh,
 			       const TEE_UUID *uuid, const void *oid,
 			       size_t oidlen, struct tee_fs_dirfile_fileh *dfh)
 {
-	TEE_Result res;
-	struct dirfile_entry dent;
-	int n;
-	int first_free = -1;
+	TEE_Result res = TEE_SUCCESS;
+	struct dirfile_entry dent = { };
+	size_t mask = dirh->idx_nslots - 1;
+	uint32_t hash = 0;
+	int32_t n = 0;
+	size_t i = 0;
+
+	if (!oidlen) {
+		/* Return the first free entry, or the one past the end */
+		n = -1;
+		if (dirh->ndents)
+			bit_ffc(dirh->dent_used, (int)dirh->ndents, &n);
+		if (n == -1)
+			n = dirh->ndents;
+		goto out;
+	}
+
+	if (!dirh->idx_count)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	hash = dent_key_hash(uuid, oid, oidlen);
+	for (i = hash & mask;; i = (i + 1) & mask) {
+		n = dirh->idx_slots[i];
+		if (n == DIRF_IDX_EMPTY)
+			return TEE_ERROR_ITEM_NOT_FOUND;
+		if (dirh->dent_hash[n] != hash)
+			continue;
 
-	for (n = 0;; n++) {
 		res = read_dent(dirh, n, &dent);
-		if (res == TEE_ERROR_ITEM_NOT_FOUND && !oidlen) {
-			memset(&dent, 0, sizeof(dent));
-			if (first_free != -1)
-				n = first_free;
-			break;
-		}
 		if (res)
 			return res;
 
-		/* TODO check this loop when oidlen == 0 */
-
-		if (!dent.oidlen && first_free == -1)
-			first_free = n;
-		if (dent.oidlen != oidlen)
-			continue;
+		assert(test_file(dirh, dent.file_number));
 
-		assert(!oidlen || !dent.oidlen ||
-		       test_file(dirh, dent.file_number));
-
-		if (!memcmp(&dent.uuid, uuid, sizeof(dent.uuid)) &&
+		if (dent.oidlen == oidlen &&
+		    !memcmp(&dent.uuid, uuid, sizeof(dent.uuid)) &&
 		    !memcmp(&dent.oid, oid, oidlen))
 			break;
 	}
 
+out:
 	if (dfh) {
 		dfh->idx = n;
 		dfh->file_number = dent.file_number;
@@ -348,6 +549,11 @@ TEE_Result tee_fs_dirfile_get_next(struct tee_fs_dirfile_dirh *dirh,
 		i = 0;
 
 	for (;; i++) {
+		if ((size_t)i >= dirh->ndents)
+			return TEE_ERROR_ITEM_NOT_FOUND;
+		if (!dent_is_used(dirh, i))
+			continue;
+
 		res = read_dent(dirh, i, &dent);
 		if (res)
 			return res;
@@ -4,10 +4,12 @@
  */
 
 #include <assert.h>
+#include <atomic.h>
 #include <crypto/crypto.h>
 #include <initcall.h>
 #include <kernel/tee_common_otp.h>
 #include <stdlib.h>
+#include <stdlib_ext.h>
 #include <string_ext.h>
 #include <string.h>
 #include <tee/fs_htree.h>
@@ -85,6 +87,24 @@ struct htree_node {
 	struct htree_node *child[2];
 };
 
+/*
+ * Write-back cache of plaintext data blocks, used when
+ * CFG_FS_HTREE_CACHE_BLOCKS > 0. A write only updates the cache, dirty
+ * blocks are encrypted and written to storage when evicted or when the
+ * hash tree is synchronized to storage. Repeated writes to a block
+ * between two commits are this way only encrypted and sent once.
+ *
+ * The cache is allocated on first use, if that fails the hash tree is
+ * used uncached.
+ */
+struct htree_cache_entry {
+	size_t block_num;
+	uint32_t last_use;
+	bool valid;
+	bool dirty;
+	uint8_t *data;
+};
+
 struct tee_fs_htree {
 	struct htree_node root;
 	struct tee_fs_htree_image head;
@@ -94,6 +114,34 @@ struct tee_fs_htree {
 	const TEE_UUID *uuid;
 	const struct tee_fs_htree_storage *stor;
 	void *stor_aux;
+	struct htree_cache_entry *cache;
+	size_t cache_size;
+	uint8_t *cache_data;
+	uint32_t cache_clock;
+};
+
+static struct tee_fs_htree_cache_stats cache_stats;
+
+/* Size of the data covered by the hash of the root node */
+#define NODE_HASH_DATA_MAX	(sizeof(struct tee_fs_htree_node_image) - \
+				 TEE_FS_HTREE_HASH_SIZE + \
+				 sizeof(struct tee_fs_htree_meta) + \
+				 2 * TEE_FS_HTREE_HASH_SIZE)
+
+/*
+ * Number of dirty nodes hashed together with hash_sha256_multi() when
+ * syncing. The hash of a node covers the hashes of its children, so only
+ * nodes of the same level are hashed together, see
+ * htree_sync_nodes_to_storage().
+ */
+#define HTREE_SYNC_BATCH	8
+
+struct htree_sync_batch {
+	struct htree_node *node[HTREE_SYNC_BATCH];
+	uint8_t vers[HTREE_SYNC_BATCH];
+	uint8_t data[HTREE_SYNC_BATCH][NODE_HASH_DATA_MAX];
+	struct hash_sha256_msg msg[HTREE_SYNC_BATCH];
+	size_t num;
 };
 
 struct traverse_arg;
@@ -396,42 +444,58 @@ static TEE_Result init_tree_from_data(struct tee_fs_htree *ht)
 	return TEE_SUCCESS;
 }
 
-static TEE_Result calc_node_hash(struct htree_node *node,
-				 struct tee_fs_htree_meta *meta, void *ctx,
-				 uint8_t *digest)
+/*
+ * Collects the data covered by the hash of @node in @buf, which must hold
+ * NODE_HASH_DATA_MAX bytes: the node image except the hash itself, @meta
+ * if supplied and the hashes of the children. Returns the number of bytes
+ * stored.
+ */
+static size_t get_node_hash_data(struct htree_node *node,
+				 struct tee_fs_htree_meta *meta, uint8_t *buf)
 {
-	TEE_Result res;
 	uint8_t *ndata = (uint8_t *)&node->node + sizeof(node->node.hash);
 	size_t nsize = sizeof(node->node) - sizeof(node->node.hash);
+	size_t n = 0;
 
-	res = crypto_hash_init(ctx);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	res = crypto_hash_update(ctx, ndata, nsize);
-	if (res != TEE_SUCCESS)
-		return res;
+	memcpy(buf, ndata, nsize);
+	n = nsize;
 
 	if (meta) {
-		res = crypto_hash_update(ctx, (void *)meta, sizeof(*meta));
-		if (res != TEE_SUCCESS)
-			return res;
+		memcpy(buf + n, meta, sizeof(*meta));
+		n += sizeof(*meta);
 	}
 
 	if (node->child[0]) {
-		res = crypto_hash_update(ctx, node->child[0]->node.hash,
-					 sizeof(node->child[0]->node.hash));
-		if (res != TEE_SUCCESS)
-			return res;
+		memcpy(buf + n, node->child[0]->node.hash,
+		       sizeof(node->child[0]->node.hash));
+		n += sizeof(node->child[0]->node.hash);
 	}
 
 	if (node->child[1]) {
-		res = crypto_hash_update(ctx, node->child[1]->node.hash,
-					 sizeof(node->child[1]->node.hash));
-		if (res != TEE_SUCCESS)
-			return res;
+		memcpy(buf + n, node->child[1]->node.hash,
+		       sizeof(node->child[1]->node.hash));
+		n += sizeof(node->child[1]->node.hash);
 	}
 
+	return n;
+}
+
+static TEE_Result calc_node_hash(struct htree_node *node,
+				 struct tee_fs_htree_meta *meta, void *ctx,
+				 uint8_t *digest)
+{
+	TEE_Result res;
+	uint8_t data[NODE_HASH_DATA_MAX];
+	size_t dsize = get_node_hash_data(node, meta, data);
+
+	res = crypto_hash_init(ctx);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = crypto_hash_update(ctx, data, dsize);
+	if (res != TEE_SUCCESS)
+		return res;
+
 	return crypto_hash_final(ctx, digest, TEE_FS_HTREE_HASH_SIZE);
 }
 
@@ -693,16 +757,387 @@ void tee_fs_htree_close(struct tee_fs_htree **ht)
 	if (!*ht)
 		return;
 	htree_traverse_post_order(*ht, free_node, NULL);
+	/* Dirty blocks not synchronized to storage are discarded here */
+	free_wipe((*ht)->cache_data);
+	free((*ht)->cache);
 	free(*ht);
 	*ht = NULL;
 }
 
-static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
-					     struct htree_node *node)
+static TEE_Result get_block_node(struct tee_fs_htree *ht, bool create,
+				 size_t block_num, struct htree_node **node)
+{
+	TEE_Result res;
+	struct htree_node *nd;
+
+	res = get_node(ht, create, BLOCK_NUM_TO_NODE_ID(block_num), &nd);
+	if (res == TEE_SUCCESS)
+		*node = nd;
+
+	return res;
+}
+
+static TEE_Result write_block(struct tee_fs_htree *ht, size_t block_num,
+			      const void *block)
 {
 	TEE_Result res;
-	uint8_t vers;
+	struct tee_fs_rpc_operation op;
+	struct htree_node *node = NULL;
+	uint8_t block_vers;
+	void *ctx;
+	void *enc_block;
+
+	res = get_block_node(ht, true, block_num, &node);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!node->block_updated)
+		node->node.flags ^= HTREE_NODE_COMMITTED_BLOCK;
+
+	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
+	res = ht->stor->rpc_write_init(ht->stor_aux, &op,
+				       TEE_FS_HTREE_TYPE_BLOCK, block_num,
+				       block_vers, &enc_block);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
+			   ht->stor->block_size);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = authenc_encrypt_final(ctx, node->node.tag, block,
+				    ht->stor->block_size, enc_block);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = ht->stor->rpc_write_final(&op);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	node->block_updated = true;
+	node->dirty = true;
+	ht->dirty = true;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result read_block(struct tee_fs_htree *ht, size_t block_num,
+			     void *block)
+{
+	TEE_Result res;
+	struct tee_fs_rpc_operation op;
+	struct htree_node *node;
+	uint8_t block_vers;
+	size_t len;
+	void *ctx;
+	void *enc_block;
+
+	res = get_block_node(ht, false, block_num, &node);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
+	res = ht->stor->rpc_read_init(ht->stor_aux, &op,
+				      TEE_FS_HTREE_TYPE_BLOCK, block_num,
+				      block_vers, &enc_block);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = ht->stor->rpc_read_final(&op, &len);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (len != ht->stor->block_size)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node,
+			   ht->stor->block_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return authenc_decrypt_final(ctx, node->node.tag, enc_block,
+				     ht->stor->block_size, block);
+}
+
+/*
+ * Reads a run of blocks with a single request. Each block is decrypted
+ * from the payload into @bounce and copied to the destination once its
+ * tag is verified.
+ */
+static TEE_Result read_run(struct tee_fs_htree *ht, size_t block_num,
+			   size_t num_blocks, uint8_t *blocks, uint8_t *bounce)
+{
+	size_t offs[TEE_FS_HTREE_MAX_RUN_BLOCKS * 2] = { };
+	const size_t bs = ht->stor->block_size;
+	struct tee_fs_rpc_operation op = { };
+	TEE_Result res = TEE_SUCCESS;
+	struct htree_node *node = NULL;
+	uint8_t block_vers = 0;
+	void *data = NULL;
+	void *ctx = NULL;
+	size_t len = 0;
+	size_t o = 0;
+	size_t n = 0;
+
+	assert(num_blocks && num_blocks <= TEE_FS_HTREE_MAX_RUN_BLOCKS);
+
+	res = ht->stor->rpc_read_blocks_init(ht->stor_aux, &op, block_num,
+					     num_blocks, &data, offs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = ht->stor->rpc_read_final(&op, &len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num_blocks; n++) {
+		res = get_block_node(ht, false, block_num + n, &node);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
+		o = offs[n * 2 + block_vers];
+		if (o > len || len - o < bs)
+			return TEE_ERROR_CORRUPT_OBJECT;
+
+		res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node, bs);
+		if (res != TEE_SUCCESS)
+			return res;
+		res = authenc_decrypt_final(ctx, node->node.tag,
+					    (uint8_t *)data + o, bs, bounce);
+		if (res != TEE_SUCCESS)
+			return res;
+		memcpy(blocks + n * bs, bounce, bs);
+	}
+
+	return TEE_SUCCESS;
+}
+
+static bool cache_init(struct tee_fs_htree *ht)
+{
+	const size_t bs = ht->stor->block_size;
+	size_t n = 0;
+
+	if (!CFG_FS_HTREE_CACHE_BLOCKS)
+		return false;
+	if (ht->cache)
+		return true;
+
+	ht->cache = calloc(CFG_FS_HTREE_CACHE_BLOCKS, sizeof(*ht->cache));
+	ht->cache_data = calloc(CFG_FS_HTREE_CACHE_BLOCKS, bs);
+	if (!ht->cache || !ht->cache_data) {
+		free(ht->cache);
+		free(ht->cache_data);
+		ht->cache = NULL;
+		ht->cache_data = NULL;
+		return false;
+	}
+
+	ht->cache_size = CFG_FS_HTREE_CACHE_BLOCKS;
+	for (n = 0; n < ht->cache_size; n++)
+		ht->cache[n].data = ht->cache_data + n * bs;
+
+	return true;
+}
+
+static struct htree_cache_entry *cache_find(struct tee_fs_htree *ht,
+					    size_t block_num)
+{
+	size_t n = 0;
+
+	for (n = 0; n < ht->cache_size; n++) {
+		struct htree_cache_entry *ce = ht->cache + n;
+
+		if (ce->valid && ce->block_num == block_num) {
+			ce->last_use = ++ht->cache_clock;
+			return ce;
+		}
+	}
+
+	return NULL;
+}
+
+static TEE_Result cache_write_back(struct tee_fs_htree *ht,
+				   struct htree_cache_entry *ce)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!ce->dirty)
+		return TEE_SUCCESS;
+
+	res = write_block(ht, ce->block_num, ce->data);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	ce->dirty = false;
+	atomic_inc32(&cache_stats.write_backs);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Returns an unused entry assigned to @block_num, if needed the least
+ * recently used entry is evicted and written back first.
+ */
+static TEE_Result cache_alloc(struct tee_fs_htree *ht, size_t block_num,
+			      struct htree_cache_entry **ce_ret)
+{
+	struct htree_cache_entry *ce = ht->cache;
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	for (n = 0; n < ht->cache_size; n++) {
+		if (!ht->cache[n].valid) {
+			ce = ht->cache + n;
+			break;
+		}
+		if (ht->cache[n].last_use < ce->last_use)
+			ce = ht->cache + n;
+	}
+
+	if (ce->valid) {
+		res = cache_write_back(ht, ce);
+		if (res != TEE_SUCCESS)
+			return res;
+		atomic_inc32(&cache_stats.evictions);
+	}
+
+	ce->valid = true;
+	ce->dirty = false;
+	ce->block_num = block_num;
+	ce->last_use = ++ht->cache_clock;
+	*ce_ret = ce;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result cache_flush(struct tee_fs_htree *ht, size_t block_num,
+			      size_t num_blocks)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	for (n = 0; n < ht->cache_size; n++) {
+		struct htree_cache_entry *ce = ht->cache + n;
+
+		if (ce->valid && ce->block_num >= block_num &&
+		    ce->block_num - block_num < num_blocks) {
+			res = cache_write_back(ht, ce);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
+static void cache_invalidate(struct tee_fs_htree *ht, size_t block_num,
+			     size_t num_blocks)
+{
+	size_t n = 0;
+
+	for (n = 0; n < ht->cache_size; n++) {
+		struct htree_cache_entry *ce = ht->cache + n;
+
+		if (ce->valid && ce->block_num >= block_num &&
+		    ce->block_num - block_num < num_blocks) {
+			ce->valid = false;
+			ce->dirty = false;
+		}
+	}
+}
+
+static TEE_Result cache_write_block(struct tee_fs_htree *ht,
+				    size_t block_num, const void *block)
+{
+	struct htree_cache_entry *ce = NULL;
+	struct htree_node *node = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	/*
+	 * The node is added right away so the hash tree has the right
+	 * shape, the block itself is written when the entry is written
+	 * back.
+	 */
+	res = get_block_node(ht, true, block_num, &node);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	ce = cache_find(ht, block_num);
+	if (ce) {
+		if (ce->dirty)
+			atomic_inc32(&cache_stats.coalesced);
+	} else {
+		res = cache_alloc(ht, block_num, &ce);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	memcpy(ce->data, block, ht->stor->block_size);
+	ce->dirty = true;
+	ht->dirty = true;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result cache_read_block(struct tee_fs_htree *ht, size_t block_num,
+				   void *block)
+{
+	struct htree_cache_entry *ce = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	ce = cache_find(ht, block_num);
+	if (ce) {
+		atomic_inc32(&cache_stats.hits);
+	} else {
+		atomic_inc32(&cache_stats.misses);
+		res = cache_alloc(ht, block_num, &ce);
+		if (res != TEE_SUCCESS)
+			return res;
+		res = read_block(ht, block_num, ce->data);
+		if (res != TEE_SUCCESS) {
+			ce->valid = false;
+			return res;
+		}
+	}
+
+	memcpy(block, ce->data, ht->stor->block_size);
+	return TEE_SUCCESS;
+}
+
+void tee_fs_htree_get_cache_stats(struct tee_fs_htree_cache_stats *stats,
+				  bool reset)
+{
+	*stats = cache_stats;
+	if (reset)
+		memset(&cache_stats, 0, sizeof(cache_stats));
+}
+
+static TEE_Result sync_batch_flush(struct tee_fs_htree *ht,
+				   struct htree_sync_batch *b)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	res = hash_sha256_multi(b->msg, b->num);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < b->num; n++) {
+		res = rpc_write_node(ht, b->node[n]->id, b->vers[n],
+				     &b->node[n]->node);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	b->num = 0;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result sync_batch_add(struct tee_fs_htree *ht,
+				 struct htree_sync_batch *b,
+				 struct htree_node *node)
+{
 	struct tee_fs_htree_meta *meta = NULL;
+	size_t n = b->num;
 
 	/*
 	 * The node can be dirty while the block isn't updated due to
@@ -719,24 +1154,94 @@ static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 
 		node->parent->dirty = true;
 		node->parent->node.flags ^= f;
-		vers = !!(node->parent->node.flags & f);
+		b->vers[n] = !!(node->parent->node.flags & f);
 	} else {
 		/*
 		 * Counter isn't updated yet, it's increased just before
 		 * writing the header.
 		 */
-		vers = !(targ->ht->head.counter & 1);
-		meta = &targ->ht->imeta.meta;
+		b->vers[n] = !(ht->head.counter & 1);
+		meta = &ht->imeta.meta;
 	}
 
-	res = calc_node_hash(node, meta, targ->arg, node->node.hash);
-	if (res != TEE_SUCCESS)
-		return res;
+	b->node[n] = node;
+	b->msg[n].data = b->data[n];
+	b->msg[n].data_size = get_node_hash_data(node, meta, b->data[n]);
+	b->msg[n].digest = node->node.hash;
+	b->num++;
 
 	node->dirty = false;
 	node->block_updated = false;
 
-	return rpc_write_node(targ->ht, node->id, vers, &node->node);
+	if (b->num == HTREE_SYNC_BATCH)
+		return sync_batch_flush(ht, b);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Returns the node following @node on the same level of the tree, or NULL
+ * if @node is the last one. Node ids are contiguous so the next node is
+ * found by going up to the closest ancestor having @node in its left
+ * subtree and back down along the leftmost path of the right subtree.
+ * Walking a whole level this way visits each node of the levels above at
+ * most twice.
+ */
+static struct htree_node *next_node_on_level(struct htree_node *node)
+{
+	size_t depth = 0;
+
+	while (node->parent && (node->id & 1)) {
+		node = node->parent;
+		depth++;
+	}
+	if (!node->parent)
+		return NULL;
+
+	node = node->parent->child[1];
+	while (node && depth--)
+		node = node->child[0];
+
+	return node;
+}
+
+/*
+ * Hashes and writes all dirty nodes, one level at a time starting with
+ * the leaves. All children are hashed before their parent, as with a
+ * post-order traversal, while the nodes of a level are independent of
+ * each other and are hashed together in batches.
+ */
+static TEE_Result htree_sync_nodes_to_storage(struct tee_fs_htree *ht)
+{
+	size_t max_node_id = MAX(ht->imeta.max_node_id, 1U);
+	size_t level = node_id_to_level(max_node_id);
+	struct htree_sync_batch *b = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	struct htree_node *node = NULL;
+	size_t n = 0;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (; level; level--) {
+		/* The first node of a level is the leftmost one */
+		node = &ht->root;
+		for (n = 1; n < level && node; n++)
+			node = node->child[0];
+
+		for (; node; node = next_node_on_level(node)) {
+			res = sync_batch_add(ht, b, node);
+			if (res != TEE_SUCCESS)
+				goto out;
+		}
+
+		res = sync_batch_flush(ht, b);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+out:
+	free(b);
+	return res;
 }
 
 static TEE_Result update_root(struct tee_fs_htree *ht)
@@ -759,7 +1264,6 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 {
 	TEE_Result res;
 	struct tee_fs_htree *ht = *ht_arg;
-	void *ctx;
 
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
@@ -767,11 +1271,11 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 	if (!ht->dirty)
 		return TEE_SUCCESS;
 
-	res = crypto_hash_alloc_ctx(&ctx, TEE_FS_HTREE_HASH_ALG);
+	res = cache_flush(ht, 0, SIZE_MAX);
 	if (res != TEE_SUCCESS)
-		return res;
+		goto out;
 
-	res = htree_traverse_post_order(ht, htree_sync_node_to_storage, ctx);
+	res = htree_sync_nodes_to_storage(ht);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -788,117 +1292,130 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 	if (hash)
 		memcpy(hash, ht->root.node.hash, sizeof(ht->root.node.hash));
 out:
-	crypto_hash_free_ctx(ctx);
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
 	return res;
 }
 
-static TEE_Result get_block_node(struct tee_fs_htree *ht, bool create,
-				 size_t block_num, struct htree_node **node)
+TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
+				    size_t block_num, const void *block)
 {
 	TEE_Result res;
-	struct htree_node *nd;
 
-	res = get_node(ht, create, BLOCK_NUM_TO_NODE_ID(block_num), &nd);
-	if (res == TEE_SUCCESS)
-		*node = nd;
+	if (!*ht_arg)
+		return TEE_ERROR_CORRUPT_OBJECT;
 
+	if (cache_init(*ht_arg))
+		res = cache_write_block(*ht_arg, block_num, block);
+	else
+		res = write_block(*ht_arg, block_num, block);
+	if (res != TEE_SUCCESS)
+		tee_fs_htree_close(ht_arg);
 	return res;
 }
 
-TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
-				    size_t block_num, const void *block)
+TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
+				   size_t block_num, void *block)
 {
-	struct tee_fs_htree *ht = *ht_arg;
 	TEE_Result res;
-	struct tee_fs_rpc_operation op;
-	struct htree_node *node = NULL;
-	uint8_t block_vers;
-	void *ctx;
-	void *enc_block;
 
-	if (!ht)
+	if (!*ht_arg)
 		return TEE_ERROR_CORRUPT_OBJECT;
 
-	res = get_block_node(ht, true, block_num, &node);
+	if (cache_init(*ht_arg))
+		res = cache_read_block(*ht_arg, block_num, block);
+	else
+		res = read_block(*ht_arg, block_num, block);
 	if (res != TEE_SUCCESS)
-		goto out;
+		tee_fs_htree_close(ht_arg);
+	return res;
+}
 
-	if (!node->block_updated)
-		node->node.flags ^= HTREE_NODE_COMMITTED_BLOCK;
+TEE_Result tee_fs_htree_write_blocks(struct tee_fs_htree **ht_arg,
+				     size_t block_num, size_t num_blocks,
+				     const void *blocks)
+{
+	struct tee_fs_htree *ht = *ht_arg;
+	TEE_Result res = TEE_SUCCESS;
+	const uint8_t *b = blocks;
 
-	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
-	res = ht->stor->rpc_write_init(ht->stor_aux, &op,
-				       TEE_FS_HTREE_TYPE_BLOCK, block_num,
-				       block_vers, &enc_block);
-	if (res != TEE_SUCCESS)
-		goto out;
+	if (!ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
 
-	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
-			   ht->stor->block_size);
-	if (res != TEE_SUCCESS)
-		goto out;
-	res = authenc_encrypt_final(ctx, node->node.tag, block,
-				    ht->stor->block_size, enc_block);
-	if (res != TEE_SUCCESS)
-		goto out;
+	/* Cached copies of the blocks are superseded by this write */
+	cache_invalidate(ht, block_num, num_blocks);
 
-	res = ht->stor->rpc_write_final(&op);
-	if (res != TEE_SUCCESS)
-		goto out;
+	/*
+	 * Only the version of each block not referenced by the committed
+	 * tree may be written, so a torn or failed write can't damage
+	 * committed data. The storage protocol can only write a contiguous
+	 * range per request, which leaves one request per block.
+	 */
+	while (num_blocks) {
+		res = write_block(ht, block_num, b);
+		if (res != TEE_SUCCESS) {
+			tee_fs_htree_close(ht_arg);
+			return res;
+		}
 
-	node->block_updated = true;
-	node->dirty = true;
-	ht->dirty = true;
-out:
-	if (res != TEE_SUCCESS)
-		tee_fs_htree_close(ht_arg);
-	return res;
+		b += ht->stor->block_size;
+		block_num++;
+		num_blocks--;
+	}
+
+	return TEE_SUCCESS;
 }
 
-TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
-				   size_t block_num, void *block)
+TEE_Result tee_fs_htree_read_blocks(struct tee_fs_htree **ht_arg,
+				    size_t block_num, size_t num_blocks,
+				    void *blocks)
 {
 	struct tee_fs_htree *ht = *ht_arg;
-	TEE_Result res;
-	struct tee_fs_rpc_operation op;
-	struct htree_node *node;
-	uint8_t block_vers;
-	size_t len;
-	void *ctx;
-	void *enc_block;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *bounce = NULL;
+	uint8_t *b = blocks;
+	size_t bs = 0;
+	size_t n = 0;
 
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
+	bs = ht->stor->block_size;
 
-	res = get_block_node(ht, false, block_num, &node);
+	/* Blocks are read from storage, so dirty cached blocks go first */
+	res = cache_flush(ht, block_num, num_blocks);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
-	res = ht->stor->rpc_read_init(ht->stor_aux, &op,
-				      TEE_FS_HTREE_TYPE_BLOCK, block_num,
-				      block_vers, &enc_block);
-	if (res != TEE_SUCCESS)
-		goto out;
-
-	res = ht->stor->rpc_read_final(&op, &len);
-	if (res != TEE_SUCCESS)
-		goto out;
-	if (len != ht->stor->block_size) {
-		res = TEE_ERROR_CORRUPT_OBJECT;
+	/*
+	 * @blocks may be memory of the TA, nothing is stored there before
+	 * it has been authenticated.
+	 */
+	bounce = malloc(bs);
+	if (!bounce) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out;
 	}
 
-	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node,
-			   ht->stor->block_size);
-	if (res != TEE_SUCCESS)
-		goto out;
+	while (num_blocks) {
+		if (num_blocks == 1 || !ht->stor->rpc_read_blocks_init) {
+			n = 1;
+			res = read_block(ht, block_num, bounce);
+			if (res == TEE_SUCCESS)
+				memcpy(b, bounce, bs);
+		} else {
+			n = MIN(num_blocks,
+				(size_t)TEE_FS_HTREE_MAX_RUN_BLOCKS);
+			res = read_run(ht, block_num, n, b, bounce);
+		}
+		if (res != TEE_SUCCESS)
+			goto out;
 
-	res = authenc_decrypt_final(ctx, node->node.tag, enc_block,
-				    ht->stor->block_size, block);
+		b += n * bs;
+		block_num += n;
+		num_blocks -= n;
+	}
 out:
+	free_wipe(bounce);
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
 	return res;
@@ -913,6 +1430,8 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
 
+	cache_invalidate(ht, block_num, SIZE_MAX - block_num);
+
 	while (node_id < ht->imeta.max_node_id) {
 		node = find_closest_node(ht, ht->imeta.max_node_id);
 		assert(node && node->id == ht->imeta.max_node_id);
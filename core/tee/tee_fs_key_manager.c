@@ -174,102 +174,181 @@ static TEE_Result sha256(uint8_t *out, size_t out_size, const uint8_t *in,
 				     out, out_size);
 }
 
-static TEE_Result aes_ecb(uint8_t out[TEE_AES_BLOCK_SIZE],
-			  const uint8_t in[TEE_AES_BLOCK_SIZE],
-			  const uint8_t *key, size_t key_size)
+/*
+ * Key schedules of a file encrypted with AES CBC with ESSIV, kept for as
+ * long as the file is open to avoid re-deriving the TSK, decrypting the
+ * FEK and expanding it for each block. Since the IV changes with each
+ * block, CBC is done on top of AES ECB contexts keyed once with the FEK.
+ */
+struct tee_fs_crypt_ctx {
+	void *essiv_ctx;
+	void *enc_ctx;
+	void *dec_ctx;
+};
+
+void tee_fs_crypt_ctx_free(struct tee_fs_crypt_ctx *ctx)
 {
-	TEE_Result res;
-	void *ctx = NULL;
+	if (!ctx)
+		return;
+
+	/* The cipher contexts wipe their key schedules when freed */
+	crypto_cipher_free_ctx(ctx->essiv_ctx);
+	crypto_cipher_free_ctx(ctx->enc_ctx);
+	crypto_cipher_free_ctx(ctx->dec_ctx);
+	memzero_explicit(ctx, sizeof(*ctx));
+	free(ctx);
+}
+
+TEE_Result tee_fs_crypt_ctx_alloc(const TEE_UUID *uuid,
+				  const uint8_t *encrypted_fek,
+				  struct tee_fs_crypt_ctx **ret_ctx)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	struct tee_fs_crypt_ctx *ctx = NULL;
+	uint8_t fek[TEE_FS_KM_FEK_SIZE] = { 0 };
+	uint8_t sha[TEE_SHA256_HASH_SIZE] = { 0 };
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
-	res = crypto_cipher_alloc_ctx(&ctx, TEE_ALG_AES_ECB_NOPAD);
+	/* Decrypt FEK */
+	res = tee_fs_fek_crypt(uuid, TEE_MODE_DECRYPT, encrypted_fek,
+			       TEE_FS_KM_FEK_SIZE, fek);
 	if (res != TEE_SUCCESS)
-		return res;
+		goto err;
 
-	res = crypto_cipher_init(ctx, TEE_MODE_ENCRYPT, key,
-				 key_size, NULL, 0, NULL, 0);
+	/* ESSIV salt is the first half of SHA-256(FEK), used as AES key */
+	res = sha256(sha, sizeof(sha), fek, sizeof(fek));
 	if (res != TEE_SUCCESS)
-		goto out;
+		goto err;
 
-	res = crypto_cipher_update(ctx, TEE_MODE_ENCRYPT, true, in,
-				   TEE_AES_BLOCK_SIZE, out);
+	res = crypto_cipher_alloc_ctx(&ctx->essiv_ctx, TEE_ALG_AES_ECB_NOPAD);
 	if (res != TEE_SUCCESS)
-		goto out;
+		goto err;
 
-	crypto_cipher_final(ctx);
-	res = TEE_SUCCESS;
+	res = crypto_cipher_init(ctx->essiv_ctx, TEE_MODE_ENCRYPT, sha, 16,
+				 NULL, 0, NULL, 0);
+	if (res != TEE_SUCCESS)
+		goto err;
 
-out:
-	crypto_cipher_free_ctx(ctx);
+	res = crypto_cipher_alloc_ctx(&ctx->enc_ctx, TEE_ALG_AES_ECB_NOPAD);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = crypto_cipher_init(ctx->enc_ctx, TEE_MODE_ENCRYPT, fek,
+				 sizeof(fek), NULL, 0, NULL, 0);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = crypto_cipher_alloc_ctx(&ctx->dec_ctx, TEE_ALG_AES_ECB_NOPAD);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = crypto_cipher_init(ctx->dec_ctx, TEE_MODE_DECRYPT, fek,
+				 sizeof(fek), NULL, 0, NULL, 0);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	memzero_explicit(fek, sizeof(fek));
+	memzero_explicit(sha, sizeof(sha));
+	*ret_ctx = ctx;
+	return TEE_SUCCESS;
+err:
+	memzero_explicit(fek, sizeof(fek));
+	memzero_explicit(sha, sizeof(sha));
+	tee_fs_crypt_ctx_free(ctx);
 	return res;
 }
 
-static TEE_Result essiv(uint8_t iv[TEE_AES_BLOCK_SIZE],
-			const uint8_t fek[TEE_FS_KM_FEK_SIZE],
-			uint16_t blk_idx)
+static TEE_Result essiv(struct tee_fs_crypt_ctx *ctx,
+			uint8_t iv[TEE_AES_BLOCK_SIZE], uint16_t blk_idx)
 {
-	TEE_Result res;
-	uint8_t sha[TEE_SHA256_HASH_SIZE];
 	uint8_t pad_blkid[TEE_AES_BLOCK_SIZE] = { 0, };
 
-	res = sha256(sha, sizeof(sha), fek, TEE_FS_KM_FEK_SIZE);
-	if (res != TEE_SUCCESS)
-		return res;
-
 	pad_blkid[0] = (blk_idx & 0xFF);
 	pad_blkid[1] = (blk_idx & 0xFF00) >> 8;
 
-	res = aes_ecb(iv, pad_blkid, sha, 16);
-
-	memzero_explicit(sha, sizeof(sha));
-	return res;
+	return crypto_cipher_update(ctx->essiv_ctx, TEE_MODE_ENCRYPT, true,
+				    pad_blkid, TEE_AES_BLOCK_SIZE, iv);
 }
 
 /*
- * Encryption/decryption of RPMB FS file data. This is AES CBC with ESSIV.
+ * AES CBC of one block of @size bytes with @iv, done AES block by AES
+ * block with the ECB contexts so the key schedules are reused. Each
+ * ciphertext AES block is saved before it may be overwritten, which makes
+ * this safe also when @in and @out are the same buffer.
  */
-TEE_Result tee_fs_crypt_block(const TEE_UUID *uuid, uint8_t *out,
-			      const uint8_t *in, size_t size,
-			      uint16_t blk_idx, const uint8_t *encrypted_fek,
-			      TEE_OperationMode mode)
+static TEE_Result cbc_crypt_block(struct tee_fs_crypt_ctx *ctx,
+				  TEE_OperationMode mode, const uint8_t *iv,
+				  const uint8_t *in, size_t size, uint8_t *out)
 {
-	TEE_Result res;
-	uint8_t fek[TEE_FS_KM_FEK_SIZE];
-	uint8_t iv[TEE_AES_BLOCK_SIZE];
-	void *ctx;
+	uint8_t prev[TEE_AES_BLOCK_SIZE] = { 0 };
+	uint8_t tmp[TEE_AES_BLOCK_SIZE] = { 0 };
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+	size_t m = 0;
+
+	memcpy(prev, iv, sizeof(prev));
+	for (n = 0; n < size; n += TEE_AES_BLOCK_SIZE) {
+		if (mode == TEE_MODE_ENCRYPT) {
+			for (m = 0; m < sizeof(tmp); m++)
+				tmp[m] = in[n + m] ^ prev[m];
+			res = crypto_cipher_update(ctx->enc_ctx, mode, false,
+						   tmp, sizeof(tmp), out + n);
+			if (res != TEE_SUCCESS)
+				break;
+			memcpy(prev, out + n, sizeof(prev));
+		} else {
+			memcpy(tmp, in + n, sizeof(tmp));
+			res = crypto_cipher_update(ctx->dec_ctx, mode, false,
+						   tmp, sizeof(tmp), out + n);
+			if (res != TEE_SUCCESS)
+				break;
+			for (m = 0; m < sizeof(prev); m++)
+				out[n + m] ^= prev[m];
+			memcpy(prev, tmp, sizeof(prev));
+		}
+	}
 
-	DMSG("%scrypt block #%u", (mode == TEE_MODE_ENCRYPT) ? "En" : "De",
-	     blk_idx);
+	memzero_explicit(tmp, sizeof(tmp));
+	return res;
+}
 
-	/* Decrypt FEK */
-	res = tee_fs_fek_crypt(uuid, TEE_MODE_DECRYPT, encrypted_fek,
-			       TEE_FS_KM_FEK_SIZE, fek);
-	if (res != TEE_SUCCESS)
-		goto wipe;
+/*
+ * Encryption/decryption of RPMB FS file data. This is AES CBC with ESSIV,
+ * the IV is derived from the index of each block of @blk_size bytes.
+ */
+TEE_Result tee_fs_crypt_blocks(struct tee_fs_crypt_ctx *ctx, uint8_t *out,
+			       const uint8_t *in, size_t blk_size,
+			       size_t num_blks, uint16_t blk_idx,
+			       TEE_OperationMode mode)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t iv[TEE_AES_BLOCK_SIZE] = { 0 };
+	size_t n = 0;
 
-	/* Compute initialization vector for this block */
-	res = essiv(iv, fek, blk_idx);
-	if (res != TEE_SUCCESS)
-		goto wipe;
+	if (!ctx || !blk_size || blk_size % TEE_AES_BLOCK_SIZE ||
+	    num_blks > (size_t)UINT16_MAX + 1 - blk_idx ||
+	    (mode != TEE_MODE_ENCRYPT && mode != TEE_MODE_DECRYPT))
+		return TEE_ERROR_BAD_PARAMETERS;
 
-	/* Run AES CBC */
-	res = crypto_cipher_alloc_ctx(&ctx, TEE_ALG_AES_CBC_NOPAD);
-	if (res != TEE_SUCCESS)
-		goto wipe;
+	DMSG("%scrypt %zu block%s at #%u",
+	     (mode == TEE_MODE_ENCRYPT) ? "En" : "De", num_blks,
+	     (num_blks > 1) ? "s" : "", blk_idx);
 
-	res = crypto_cipher_init(ctx, mode, fek, sizeof(fek), NULL,
-				 0, iv, TEE_AES_BLOCK_SIZE);
-	if (res != TEE_SUCCESS)
-		goto exit;
-	res = crypto_cipher_update(ctx, mode, true, in, size, out);
-	if (res != TEE_SUCCESS)
-		goto exit;
+	for (n = 0; n < num_blks; n++) {
+		/* Compute initialization vector for this block */
+		res = essiv(ctx, iv, blk_idx + n);
+		if (res != TEE_SUCCESS)
+			break;
 
-	crypto_cipher_final(ctx);
+		res = cbc_crypt_block(ctx, mode, iv, in + n * blk_size,
+				      blk_size, out + n * blk_size);
+		if (res != TEE_SUCCESS)
+			break;
+	}
 
-exit:
-	crypto_cipher_free_ctx(ctx);
-wipe:
-	memzero_explicit(fek, sizeof(fek));
 	memzero_explicit(iv, sizeof(iv));
 	return res;
 }
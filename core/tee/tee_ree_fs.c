@@ -60,6 +60,29 @@ static void put_tmp_block(void *tmp_block)
 	mempool_free(mempool_default, tmp_block);
 }
 
+static TEE_Result update_block(struct tee_fs_fd *fdp, size_t block_num,
+			       uint8_t *block, size_t offset,
+			       const uint8_t *data, size_t size)
+{
+	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
+	TEE_Result res;
+
+	if (block_num * BLOCK_SIZE < ROUNDUP(meta->length, BLOCK_SIZE)) {
+		res = tee_fs_htree_read_block(&fdp->ht, block_num, block);
+		if (res != TEE_SUCCESS)
+			return res;
+	} else {
+		memset(block, 0, BLOCK_SIZE);
+	}
+
+	if (data)
+		memcpy(block + offset, data, size);
+	else
+		memset(block + offset, 0, size);
+
+	return tee_fs_htree_write_block(&fdp->ht, block_num, block);
+}
+
 static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 				     const void *buf, size_t len)
 {
@@ -86,34 +109,32 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_write = MIN(remain_bytes, (size_t)BLOCK_SIZE);
+		size_t num_blocks = 1;
 
 		if (size_to_write + offset > BLOCK_SIZE)
 			size_to_write = BLOCK_SIZE - offset;
 
-		if (start_block_num * BLOCK_SIZE <
-		    ROUNDUP(meta->length, BLOCK_SIZE)) {
-			res = tee_fs_htree_read_block(&fdp->ht,
-						      start_block_num, block);
-			if (res != TEE_SUCCESS)
-				goto exit;
+		/*
+		 * Whole blocks are encrypted straight from the source
+		 * without reading the old content first.
+		 */
+		if (data_ptr && !offset && remain_bytes >= BLOCK_SIZE) {
+			num_blocks = remain_bytes / BLOCK_SIZE;
+			size_to_write = num_blocks * BLOCK_SIZE;
+			res = tee_fs_htree_write_blocks(&fdp->ht,
+							start_block_num,
+							num_blocks, data_ptr);
 		} else {
-			memset(block, 0, BLOCK_SIZE);
+			res = update_block(fdp, start_block_num, block, offset,
+					   data_ptr, size_to_write);
 		}
-
-		if (data_ptr)
-			memcpy(block + offset, data_ptr, size_to_write);
-		else
-			memset(block + offset, 0, size_to_write);
-
-		res = tee_fs_htree_write_block(&fdp->ht, start_block_num,
-					       block);
 		if (res != TEE_SUCCESS)
 			goto exit;
 
 		if (data_ptr)
 			data_ptr += size_to_write;
 		remain_bytes -= size_to_write;
-		start_block_num++;
+		start_block_num += num_blocks;
 		pos += size_to_write;
 	}
 
@@ -247,12 +268,62 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 				     offs, size, data);
 }
 
+/*
+ * Data blocks @idx to @idx + @num_blocks - 1 occupy a contiguous range of
+ * the file with both versions of each block, interleaved with a node
+ * block every 2 * block_nodes - 1 data blocks. Returns the range and the
+ * offset of each block version within it.
+ */
+static TEE_Result get_run_offs_size(size_t idx, size_t num_blocks,
+				    size_t *offs, size_t *size,
+				    size_t *blk_offs)
+{
+	TEE_Result res;
+	size_t o;
+	size_t sz;
+	size_t n;
+
+	res = get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx, 0, offs, &sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num_blocks * 2; n++) {
+		res = get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx + n / 2, n & 1,
+				    &o, &sz);
+		if (res != TEE_SUCCESS)
+			return res;
+		blk_offs[n] = o - *offs;
+	}
+
+	*size = o + sz - *offs;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ree_fs_rpc_read_blocks_init(void *aux,
+					      struct tee_fs_rpc_operation *op,
+					      size_t idx, size_t num_blocks,
+					      void **data, size_t *offs)
+{
+	struct tee_fs_fd *fdp = aux;
+	TEE_Result res;
+	size_t run_offs;
+	size_t run_size;
+
+	res = get_run_offs_size(idx, num_blocks, &run_offs, &run_size, offs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_fs_rpc_read_init(op, OPTEE_RPC_CMD_FS, fdp->fd,
+				    run_offs, run_size, data);
+}
+
 static const struct tee_fs_htree_storage ree_fs_storage_ops = {
 	.block_size = BLOCK_SIZE,
 	.rpc_read_init = ree_fs_rpc_read_init,
 	.rpc_read_final = tee_fs_rpc_read_final,
 	.rpc_write_init = ree_fs_rpc_write_init,
 	.rpc_write_final = tee_fs_rpc_write_final,
+	.rpc_read_blocks_init = ree_fs_rpc_read_blocks_init,
 };
 
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
@@ -322,30 +393,45 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 	start_block_num = pos_to_block_num(pos);
 	end_block_num = pos_to_block_num(pos + remain_bytes - 1);
 
-	block = get_tmp_block();
-	if (!block) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto exit;
-	}
-
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_read = MIN(remain_bytes, (size_t)BLOCK_SIZE);
+		size_t num_blocks = 1;
 
 		if (size_to_read + offset > BLOCK_SIZE)
 			size_to_read = BLOCK_SIZE - offset;
 
-		res = tee_fs_htree_read_block(&fdp->ht, start_block_num, block);
-		if (res != TEE_SUCCESS)
-			goto exit;
+		/* Whole blocks are read in runs, without a temporary block */
+		if (!offset && remain_bytes >= BLOCK_SIZE) {
+			num_blocks = remain_bytes / BLOCK_SIZE;
+			size_to_read = num_blocks * BLOCK_SIZE;
+			res = tee_fs_htree_read_blocks(&fdp->ht,
+						       start_block_num,
+						       num_blocks, data_ptr);
+			if (res != TEE_SUCCESS)
+				goto exit;
+		} else {
+			if (!block) {
+				block = get_tmp_block();
+				if (!block) {
+					res = TEE_ERROR_OUT_OF_MEMORY;
+					goto exit;
+				}
+			}
 
-		memcpy(data_ptr, block + offset, size_to_read);
+			res = tee_fs_htree_read_block(&fdp->ht,
+						      start_block_num, block);
+			if (res != TEE_SUCCESS)
+				goto exit;
+
+			memcpy(data_ptr, block + offset, size_to_read);
+		}
 
 		data_ptr += size_to_read;
 		remain_bytes -= size_to_read;
 		pos += size_to_read;
 
-		start_block_num++;
+		start_block_num += num_blocks;
 	}
 	res = TEE_SUCCESS;
 exit:
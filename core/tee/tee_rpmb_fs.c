@@ -4,6 +4,8 @@
  */
 
 #include <assert.h>
+#include <bitstring.h>
+#include <config.h>
 #include <crypto/crypto.h>
 #include <kernel/huk_subkey.h>
 #include <kernel/misc.h>
@@ -19,6 +21,7 @@
 #include <mm/tee_mm.h>
 #include <optee_rpc_cmd.h>
 #include <stdlib.h>
+#include <stdlib_ext.h>
 #include <string_ext.h>
 #include <string.h>
 #include <sys/queue.h>
@@ -43,14 +46,6 @@
 
 #define TEE_RPMB_FS_FILENAME_LENGTH 224
 
-/**
- * Utilized when caching is enabled, i.e., when CFG_RPMB_FS_CACHE_ENTRIES > 0.
- * Cache size + the number of entries that are repeatedly read in and buffered
- * once the cache is full.
- */
-#define RPMB_BUF_MAX_ENTRIES (CFG_RPMB_FS_CACHE_ENTRIES + \
-			      CFG_RPMB_FS_RD_ENTRIES)
-
 /**
  * FS parameters: Information often used by internal functions.
  * fat_start_address will be set by rpmb_fs_setup().
@@ -74,25 +69,33 @@ struct rpmb_fat_entry {
 };
 
 /**
- * Structure that describes buffered/cached FAT FS entries in RPMB storage.
- * This structure is used in functions traversing the FAT FS.
+ * Resident copy of the FAT FS entries in RPMB storage. It's read in once
+ * by rpmb_fs_setup() and then kept in sync by write_fat_entry(), so
+ * functions looking up or traversing the FAT FS don't need any RPMB I/O.
+ * If an update of the FAT in RPMB storage fails the copy is marked stale
+ * and is read in again by the next call to rpmb_fs_setup().
  */
-struct rpmb_fat_entry_dir {
+struct rpmb_fat {
+	/* All FAT FS entries, up to and including the last entry. */
+	struct rpmb_fat_entry *entries;
+	uint32_t num_entries;
+	uint32_t max_entries;
+	/* Extent in @pool of each active file with data, else NULL. */
+	tee_mm_entry_t **extents;
+	/* Inactive FAT FS entries which can be reused for a new file. */
+	bitstr_t *unused;
 	/*
-	 * Buffer storing the FAT FS entries read in from RPMB storage. It
-	 * includes the optional cache entries (CFG_RPMB_FS_CACHE_ENTRIES)
-	 * and entries temporary read for current FAT FS traversal
-	 * (CFG_RPMB_FS_RD_ENTRIES) when not found from cached entries.
+	 * Open addressed hash table of the active FAT FS entries keyed on
+	 * filename. Each used slot holds the index of the entry + 1.
 	 */
-	struct rpmb_fat_entry *rpmb_fat_entry_buf;
-	/* Current index of FAT FS entry to read from buffer. */
-	uint32_t idx_curr;
-	/* Total number of FAT FS entries in buffer. */
-	uint32_t num_buffered;
-	/* Total number of FAT FS entries read during traversal. */
-	uint32_t num_total_read;
-	/* Indicates that last FAT FS entry was read. */
-	bool last_reached;
+	uint32_t *name_slots;
+	uint32_t num_name_slots;
+	uint32_t num_names;
+	/* Allocated space in RPMB storage: FS header, FAT and file data. */
+	tee_mm_pool_t pool;
+	tee_mm_entry_t *fat_extent;
+	/* Set when the copy may differ from the FAT in RPMB storage. */
+	bool stale;
 };
 
 /**
@@ -105,6 +108,8 @@ struct rpmb_file_handle {
 	char filename[TEE_RPMB_FS_FILENAME_LENGTH];
 	/* Address for current entry in RPMB */
 	uint32_t rpmb_fat_address;
+	/* Key schedule for file data, set up on first access */
+	struct tee_fs_crypt_ctx *crypt_ctx;
 };
 
 /**
@@ -140,7 +145,7 @@ struct tee_fs_dir {
 };
 
 static struct rpmb_fs_parameters *fs_par;
-static struct rpmb_fat_entry_dir *fat_entry_dir;
+static struct rpmb_fat *rpmb_fat;
 
 /*
  * Lower interface to RPMB device
@@ -182,6 +187,12 @@ static struct rpmb_fat_entry_dir *fat_entry_dir;
 
 #define RPMB_SIZE_SINGLE (128 * 1024)
 
+/* Max number of data frames in a single authenticated write (eMMC 5.1) */
+#define RPMB_MAX_REL_WR_BLKCNT 32
+
+/* Max number of file data blocks decrypted at a time when reading */
+#define RPMB_CRYPT_CHUNK_BLKS 8
+
 /* Error codes for get_dev_info request/response. */
 #define RPMB_CMD_GET_DEV_INFO_RET_OK     0x00
 #define RPMB_CMD_GET_DEV_INFO_RET_ERROR  0x01
@@ -476,65 +487,21 @@ static bool is_zero(const uint8_t *buf, size_t size)
 	return true;
 }
 
-static TEE_Result encrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek,
-				const TEE_UUID *uuid)
-{
-	return tee_fs_crypt_block(uuid, out, in, RPMB_DATA_SIZE,
-				  blk_idx, fek, TEE_MODE_ENCRYPT);
-}
-
-static TEE_Result decrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek,
-				const TEE_UUID *uuid)
-{
-	return tee_fs_crypt_block(uuid, out, in, RPMB_DATA_SIZE,
-				  blk_idx, fek, TEE_MODE_DECRYPT);
-}
-
-/* Decrypt/copy at most one block of data */
-static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
-			  size_t size, size_t offset,
-			  uint16_t blk_idx __maybe_unused, const uint8_t *fek,
-			  const TEE_UUID *uuid)
+/* Copy at most one block of plain data */
+static TEE_Result copy_plain(uint8_t *out, const struct rpmb_data_frame *frm,
+			     size_t size, size_t offset)
 {
-	uint8_t *tmp __maybe_unused;
-
-
 	if ((size + offset < size) || (size + offset > RPMB_DATA_SIZE))
 		panic("invalid size or offset");
 
-	if (!fek) {
-		/* Block is not encrypted (not a file data block) */
-		memcpy(out, frm->data + offset, size);
-	} else if (is_zero(fek, TEE_FS_KM_FEK_SIZE)) {
-		/* The file was created with encryption disabled */
-		return TEE_ERROR_SECURITY;
-	} else {
-		/* Block is encrypted */
-		if (size < RPMB_DATA_SIZE) {
-			/*
-			 * Since output buffer is not large enough to hold one
-			 * block we must allocate a temporary buffer.
-			 */
-			tmp = malloc(RPMB_DATA_SIZE);
-			if (!tmp)
-				return TEE_ERROR_OUT_OF_MEMORY;
-			decrypt_block(tmp, frm->data, blk_idx, fek, uuid);
-			memcpy(out, tmp + offset, size);
-			free(tmp);
-		} else {
-			decrypt_block(out, frm->data, blk_idx, fek, uuid);
-		}
-	}
+	memcpy(out, frm->data + offset, size);
 
 	return TEE_SUCCESS;
 }
 
 static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 				    struct rpmb_raw_data *rawdata,
-				    uint16_t nbr_frms, uint16_t dev_id,
-				    const uint8_t *fek, const TEE_UUID *uuid)
+				    uint16_t nbr_frms, uint16_t dev_id)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	int i;
@@ -587,21 +554,10 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 			memcpy(datafrm[i].nonce, rawdata->nonce,
 			       RPMB_NONCE_SIZE);
 
-		if (rawdata->data) {
-			if (fek) {
-				res = encrypt_block(datafrm[i].data,
-						    rawdata->data +
-						    (i * RPMB_DATA_SIZE),
-						    *rawdata->blk_idx + i,
-						    fek, uuid);
-				if (res != TEE_SUCCESS)
-					goto func_exit;
-			} else {
-				memcpy(datafrm[i].data,
-				       rawdata->data + (i * RPMB_DATA_SIZE),
-				       RPMB_DATA_SIZE);
-			}
-		}
+		if (rawdata->data)
+			memcpy(datafrm[i].data,
+			       rawdata->data + (i * RPMB_DATA_SIZE),
+			       RPMB_DATA_SIZE);
 	}
 
 	if (rawdata->key_mac) {
@@ -636,12 +592,9 @@ func_exit:
 }
 
 static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
-				       struct rpmb_data_frame *frm,
-				       const uint8_t *fek, const TEE_UUID *uuid)
+				       struct rpmb_data_frame *frm)
 {
 	TEE_Result res;
-	uint8_t *data;
-	uint16_t idx;
 
 	if (rawdata->len + rawdata->byte_offset > RPMB_DATA_SIZE)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -651,11 +604,102 @@ static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	data = rawdata->data;
-	bytes_to_u16(frm->address, &idx);
+	return copy_plain(rawdata->data, frm, rawdata->len,
+			  rawdata->byte_offset);
+}
+
+/*
+ * Gather the encrypted payload of the frames into secure memory while
+ * computing the MAC and decrypt it, a bounded number of blocks at a time
+ * to keep the heap usage independent of the size of the extent.
+ */
+static TEE_Result data_decrypt_mac_calc(struct rpmb_data_frame *datafrm,
+					struct rpmb_raw_data *rawdata,
+					uint16_t nbr_frms,
+					struct rpmb_data_frame *lastfrm,
+					struct tee_fs_crypt_ctx *cctx)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	size_t end = rawdata->byte_offset + rawdata->len;
+	struct rpmb_data_frame localfrm;
+	size_t chunk_start = 0;
+	size_t chunk_end = 0;
+	uint8_t *blks = NULL;
+	uint16_t start_idx = 0;
+	void *ctx = NULL;
+	size_t b = 0;
+	size_t e = 0;
+	size_t i = 0;
+	size_t m = 0;
+	size_t n = 0;
+
+	if (end > (size_t)nbr_frms * RPMB_DATA_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	blks = malloc(MIN(nbr_frms, RPMB_CRYPT_CHUNK_BLKS) * RPMB_DATA_SIZE);
+	if (!blks)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = crypto_mac_alloc_ctx(&ctx, TEE_ALG_HMAC_SHA256);
+	if (res)
+		goto func_exit;
+
+	res = crypto_mac_init(ctx, rpmb_ctx->key, RPMB_KEY_MAC_SIZE);
+	if (res != TEE_SUCCESS)
+		goto func_exit;
+
+	/*
+	 * Note: JEDEC JESD84-B51: "In every packet the address is the start
+	 * address of the full access (not address of the individual half a
+	 * sector)"
+	 */
+	bytes_to_u16(lastfrm->address, &start_idx);
+
+	for (i = 0; i < nbr_frms; i += n) {
+		n = MIN(nbr_frms - i, (size_t)RPMB_CRYPT_CHUNK_BLKS);
 
-	res = decrypt(data, frm, rawdata->len, rawdata->byte_offset, idx, fek,
-		      uuid);
+		for (m = 0; m < n; m++) {
+			const struct rpmb_data_frame *frm = datafrm + i + m;
+
+			if (i + m == nbr_frms - 1U)
+				frm = lastfrm;
+			/*
+			 * The MAC is computed over the same local copy that
+			 * is decrypted, so the payload can't be modified in
+			 * between.
+			 */
+			memcpy(&localfrm, frm, RPMB_DATA_FRAME_SIZE);
+
+			res = crypto_mac_update(ctx, localfrm.data,
+						RPMB_MAC_PROTECT_DATA_SIZE);
+			if (res != TEE_SUCCESS)
+				goto func_exit;
+
+			memcpy(blks + m * RPMB_DATA_SIZE, localfrm.data,
+			       RPMB_DATA_SIZE);
+		}
+
+		res = tee_fs_crypt_blocks(cctx, blks, blks, RPMB_DATA_SIZE, n,
+					  start_idx + i, TEE_MODE_DECRYPT);
+		if (res != TEE_SUCCESS)
+			goto func_exit;
+
+		/* Copy out the part of this chunk that was asked for */
+		chunk_start = i * RPMB_DATA_SIZE;
+		chunk_end = chunk_start + n * RPMB_DATA_SIZE;
+		b = MAX(chunk_start, (size_t)rawdata->byte_offset);
+		e = MIN(chunk_end, end);
+		if (b < e)
+			memcpy(rawdata->data + b - rawdata->byte_offset,
+			       blks + b - chunk_start, e - b);
+	}
+
+	res = crypto_mac_final(ctx, rawdata->key_mac, RPMB_KEY_MAC_SIZE);
+
+func_exit:
+	crypto_mac_free_ctx(ctx);
+	memzero_explicit(&localfrm, sizeof(localfrm));
+	free_wipe(blks);
 	return res;
 }
 
@@ -663,8 +707,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 					     struct rpmb_raw_data *rawdata,
 					     uint16_t nbr_frms,
 					     struct rpmb_data_frame *lastfrm,
-					     const uint8_t *fek,
-					     const TEE_UUID *uuid)
+					     struct tee_fs_crypt_ctx *cctx)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	int i;
@@ -672,14 +715,17 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	uint16_t offset;
 	uint32_t size;
 	uint8_t *data;
-	uint16_t start_idx;
 	struct rpmb_data_frame localfrm;
 
 	if (!datafrm || !rawdata || !nbr_frms || !lastfrm)
 		return TEE_ERROR_BAD_PARAMETERS;
 
+	if (cctx)
+		return data_decrypt_mac_calc(datafrm, rawdata, nbr_frms,
+					     lastfrm, cctx);
+
 	if (nbr_frms == 1)
-		return data_cpy_mac_calc_1b(rawdata, lastfrm, fek, uuid);
+		return data_cpy_mac_calc_1b(rawdata, lastfrm);
 
 	/* nbr_frms > 1 */
 
@@ -693,19 +739,12 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
-	/*
-	 * Note: JEDEC JESD84-B51: "In every packet the address is the start
-	 * address of the full access (not address of the individual half a
-	 * sector)"
-	 */
-	bytes_to_u16(lastfrm->address, &start_idx);
-
 	for (i = 0; i < (nbr_frms - 1); i++) {
 
 		/*
 		 * By working on a local copy of the RPMB frame, we ensure that
 		 * the data can not be modified after the MAC is computed but
-		 * before the payload is decrypted/copied to the output buffer.
+		 * before the payload is copied to the output buffer.
 		 */
 		memcpy(&localfrm, &datafrm[i], RPMB_DATA_FRAME_SIZE);
 
@@ -724,8 +763,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 			offset = 0;
 		}
 
-		res = decrypt(data, &localfrm, size, offset, start_idx + i,
-			      fek, uuid);
+		res = copy_plain(data, &localfrm, size, offset);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 
@@ -736,8 +774,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	size = (rawdata->len + rawdata->byte_offset) % RPMB_DATA_SIZE;
 	if (size == 0)
 		size = RPMB_DATA_SIZE;
-	res = decrypt(data, lastfrm, size, 0, start_idx + nbr_frms - 1, fek,
-		      uuid);
+	res = copy_plain(data, lastfrm, size, 0);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -760,8 +797,7 @@ func_exit:
 static TEE_Result tee_rpmb_resp_unpack_verify(struct rpmb_data_frame *datafrm,
 					      struct rpmb_raw_data *rawdata,
 					      uint16_t nbr_frms,
-					      const uint8_t *fek,
-					      const TEE_UUID *uuid)
+					      struct tee_fs_crypt_ctx *cctx)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	uint16_t msg_type;
@@ -836,7 +872,7 @@ static TEE_Result tee_rpmb_resp_unpack_verify(struct rpmb_data_frame *datafrm,
 
 			res = tee_rpmb_data_cpy_mac_calc(datafrm, rawdata,
 							 nbr_frms, &lastfrm,
-							 fek, uuid);
+							 cctx);
 
 			if (res != TEE_SUCCESS)
 				return res;
@@ -959,7 +995,7 @@ static TEE_Result tee_rpmb_init_read_wr_cnt(uint16_t dev_id,
 	rawdata.msg_type = msg_type;
 	rawdata.nonce = nonce;
 
-	res = tee_rpmb_req_pack(req, &rawdata, 1, dev_id, NULL, NULL);
+	res = tee_rpmb_req_pack(req, &rawdata, 1, dev_id);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -976,7 +1012,7 @@ static TEE_Result tee_rpmb_init_read_wr_cnt(uint16_t dev_id,
 	rawdata.nonce = nonce;
 	rawdata.key_mac = hmac;
 
-	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, 1, NULL, NULL);
+	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, 1, NULL);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -1028,7 +1064,7 @@ static TEE_Result tee_rpmb_write_key(uint16_t dev_id)
 	rawdata.msg_type = msg_type;
 	rawdata.key_mac = rpmb_ctx->key;
 
-	res = tee_rpmb_req_pack(req, &rawdata, 1, dev_id, NULL, NULL);
+	res = tee_rpmb_req_pack(req, &rawdata, 1, dev_id);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -1041,7 +1077,7 @@ static TEE_Result tee_rpmb_write_key(uint16_t dev_id)
 	memset(&rawdata, 0x00, sizeof(struct rpmb_raw_data));
 	rawdata.msg_type = msg_type;
 
-	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, 1, NULL, NULL);
+	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, 1, NULL);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -1123,11 +1159,18 @@ static TEE_Result tee_rpmb_init(uint16_t dev_id)
 
 		memcpy(rpmb_ctx->cid, dev_info.cid, RPMB_EMMC_CID_SIZE);
 
-#ifdef RPMB_DRIVER_MULTIPLE_WRITE_FIXED
-		rpmb_ctx->rel_wr_blkcnt = dev_info.rel_wr_sec_c * 2;
-#else
+		/*
+		 * The reliable write sector count is in units of 512 bytes,
+		 * that is two RPMB data frames.
+		 */
 		rpmb_ctx->rel_wr_blkcnt = 1;
-#endif
+		if (IS_ENABLED(CFG_RPMB_MULTIPLE_BLOCK_WRITE) &&
+		    dev_info.rel_wr_sec_c)
+			rpmb_ctx->rel_wr_blkcnt =
+				MIN(dev_info.rel_wr_sec_c * 2,
+				    RPMB_MAX_REL_WR_BLKCNT);
+		DMSG("RPMB: Writing up to %d blocks per request",
+		     rpmb_ctx->rel_wr_blkcnt);
 
 		rpmb_ctx->dev_info_synced = true;
 	}
@@ -1175,11 +1218,10 @@ func_exit:
  * @addr       Byte address of data.
  * @data       Pointer to the data.
  * @len        Size of data in bytes.
- * @fek        Encrypted File Encryption Key or NULL.
+ * @cctx       File data crypto context or NULL if data isn't encrypted.
  */
 static TEE_Result tee_rpmb_read(uint16_t dev_id, uint32_t addr, uint8_t *data,
-				uint32_t len, const uint8_t *fek,
-				const TEE_UUID *uuid)
+				uint32_t len, struct tee_fs_crypt_ctx *cctx)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	struct tee_rpmb_mem mem = { 0 };
@@ -1227,7 +1269,7 @@ static TEE_Result tee_rpmb_read(uint16_t dev_id, uint32_t addr, uint8_t *data,
 	rawdata.msg_type = msg_type;
 	rawdata.nonce = nonce;
 	rawdata.blk_idx = &blk_idx;
-	res = tee_rpmb_req_pack(req, &rawdata, 1, dev_id, NULL, NULL);
+	res = tee_rpmb_req_pack(req, &rawdata, 1, dev_id);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -1253,7 +1295,7 @@ static TEE_Result tee_rpmb_read(uint16_t dev_id, uint32_t addr, uint8_t *data,
 	rawdata.len = len;
 	rawdata.byte_offset = byte_offset;
 
-	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, blkcnt, fek, uuid);
+	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, blkcnt, cctx);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -1266,10 +1308,11 @@ func_exit:
 
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
-				     const uint8_t *fek, const TEE_UUID *uuid)
+				     struct tee_fs_crypt_ctx *cctx)
 {
 	TEE_Result res;
-	struct tee_rpmb_mem mem;
+	struct tee_rpmb_mem mem = { 0 };
+	uint8_t *enc_blks = NULL;
 	uint16_t msg_type;
 	uint32_t wr_cnt;
 	uint8_t hmac[RPMB_KEY_MAC_SIZE];
@@ -1293,6 +1336,14 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	if (cctx) {
+		/* Each write is encrypted just before it's packed */
+		enc_blks = malloc(MIN(blkcnt, rpmb_ctx->rel_wr_blkcnt) *
+				  RPMB_DATA_SIZE);
+		if (!enc_blks)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
 	/*
 	 * We need to split data when block count
 	 * is bigger than reliable block write count.
@@ -1308,7 +1359,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	res = tee_rpmb_alloc(req_size, resp_size, &mem,
 			     (void *)&req, (void *)&resp);
 	if (res != TEE_SUCCESS)
-		return res;
+		goto out;
 
 	nbr_writes = blkcnt / rpmb_ctx->rel_wr_blkcnt;
 	if (blkcnt % rpmb_ctx->rel_wr_blkcnt > 0)
@@ -1339,9 +1390,17 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 		rawdata.key_mac = hmac;
 		rawdata.data = (uint8_t *)data_blks +
 				i * rpmb_ctx->rel_wr_blkcnt * RPMB_DATA_SIZE;
+		if (enc_blks) {
+			res = tee_fs_crypt_blocks(cctx, enc_blks, rawdata.data,
+						  RPMB_DATA_SIZE, tmp_blkcnt,
+						  tmp_blk_idx,
+						  TEE_MODE_ENCRYPT);
+			if (res != TEE_SUCCESS)
+				goto out;
+			rawdata.data = enc_blks;
+		}
 
-		res = tee_rpmb_req_pack(req, &rawdata, tmp_blkcnt, dev_id,
-					fek, uuid);
+		res = tee_rpmb_req_pack(req, &rawdata, tmp_blkcnt, dev_id);
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -1364,8 +1423,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 		rawdata.write_counter = &wr_cnt;
 		rawdata.key_mac = hmac;
 
-		res = tee_rpmb_resp_unpack_verify(resp, &rawdata, 1, NULL,
-						  NULL);
+		res = tee_rpmb_resp_unpack_verify(resp, &rawdata, 1, NULL);
 		if (res != TEE_SUCCESS) {
 			/*
 			 * To force wr_cnt sync next time, as it might get
@@ -1380,6 +1438,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 
 out:
 	tee_rpmb_free(&mem);
+	free(enc_blks);
 	return res;
 }
 
@@ -1400,11 +1459,11 @@ static bool tee_rpmb_write_is_atomic(uint16_t dev_id __unused, uint32_t addr,
  * @addr       Byte address of data.
  * @data       Pointer to the data.
  * @len        Size of data in bytes.
- * @fek        Encrypted File Encryption Key or NULL.
+ * @cctx       File data crypto context or NULL if data isn't encrypted.
  */
 static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 				 const uint8_t *data, uint32_t len,
-				 const uint8_t *fek, const TEE_UUID *uuid)
+				 struct tee_fs_crypt_ctx *cctx)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	uint8_t *data_tmp = NULL;
@@ -1419,8 +1478,7 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 	    ROUNDUP(len + byte_offset, RPMB_DATA_SIZE) / RPMB_DATA_SIZE;
 
 	if (byte_offset == 0 && (len % RPMB_DATA_SIZE) == 0) {
-		res = tee_rpmb_write_blk(dev_id, blk_idx, data, blkcnt, fek,
-					 uuid);
+		res = tee_rpmb_write_blk(dev_id, blk_idx, data, blkcnt, cctx);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 	} else {
@@ -1430,17 +1488,33 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 			goto func_exit;
 		}
 
-		/* Read the complete blocks */
-		res = tee_rpmb_read(dev_id, blk_idx * RPMB_DATA_SIZE, data_tmp,
-				    blkcnt * RPMB_DATA_SIZE, fek, uuid);
-		if (res != TEE_SUCCESS)
-			goto func_exit;
+		/*
+		 * Only the first and the last block can be partially
+		 * updated, read those to complete them.
+		 */
+		if (byte_offset) {
+			res = tee_rpmb_read(dev_id, blk_idx * RPMB_DATA_SIZE,
+					    data_tmp, RPMB_DATA_SIZE, cctx);
+			if (res != TEE_SUCCESS)
+				goto func_exit;
+		}
+		if ((byte_offset + len) % RPMB_DATA_SIZE &&
+		    (blkcnt > 1 || !byte_offset)) {
+			res = tee_rpmb_read(dev_id,
+					    (blk_idx + blkcnt - 1) *
+					    RPMB_DATA_SIZE,
+					    data_tmp + (blkcnt - 1) *
+					    RPMB_DATA_SIZE,
+					    RPMB_DATA_SIZE, cctx);
+			if (res != TEE_SUCCESS)
+				goto func_exit;
+		}
 
 		/* Partial update of the data blocks */
 		memcpy(data_tmp + byte_offset, data, len);
 
 		res = tee_rpmb_write_blk(dev_id, blk_idx, data_tmp, blkcnt,
-					 fek, uuid);
+					 cctx);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 	}
@@ -1510,325 +1584,358 @@ func_exit:
 static TEE_Result get_fat_start_address(uint32_t *addr);
 static TEE_Result rpmb_fs_setup(void);
 
-/**
- * fat_entry_dir_free: Free the FAT entry dir.
- */
-static void fat_entry_dir_free(void)
+static uint32_t fat_idx_to_address(uint32_t idx)
 {
-	if (fat_entry_dir) {
-		free(fat_entry_dir->rpmb_fat_entry_buf);
-		free(fat_entry_dir);
-		fat_entry_dir = NULL;
-	}
+	return fs_par->fat_start_address + idx * sizeof(struct rpmb_fat_entry);
 }
 
-/**
- * fat_entry_dir_init: Initialize the FAT FS entry buffer/cache
- * This function must be called before reading FAT FS entries using the
- * function fat_entry_dir_get_next. This initializes the buffer/cache with the
- * first FAT FS entries.
- */
-static TEE_Result fat_entry_dir_init(void)
+static uint32_t fat_address_to_idx(uint32_t fat_address)
 {
-	TEE_Result res = TEE_ERROR_GENERIC;
-	struct rpmb_fat_entry *fe = NULL;
-	uint32_t fat_address = 0;
-	uint32_t num_elems_read = 0;
+	return (fat_address - fs_par->fat_start_address) /
+	       sizeof(struct rpmb_fat_entry);
+}
 
-	if (fat_entry_dir)
-		return TEE_SUCCESS;
+/* FNV-1a hash of a filename */
+static uint32_t fat_name_hash(const char *name)
+{
+	uint32_t h = 2166136261;
+	size_t n = 0;
 
-	res = rpmb_fs_setup();
-	if (res)
-		return res;
+	for (n = 0; n < TEE_RPMB_FS_FILENAME_LENGTH && name[n]; n++) {
+		h ^= (uint8_t)name[n];
+		h *= 16777619;
+	}
 
-	res = get_fat_start_address(&fat_address);
-	if (res)
-		return res;
+	return h;
+}
 
-	fat_entry_dir = calloc(1, sizeof(struct rpmb_fat_entry_dir));
-	if (!fat_entry_dir)
-		return TEE_ERROR_OUT_OF_MEMORY;
+static uint32_t fat_name_slot(struct rpmb_fat *fat, uint32_t idx)
+{
+	return fat_name_hash(fat->entries[idx].filename) &
+	       (fat->num_name_slots - 1);
+}
 
-	/*
-	 * If caching is enabled, read in up to the maximum cache size, but
-	 * never more than the single read in size. Otherwise, read in as many
-	 * entries fit into the temporary buffer.
-	 */
-	if (CFG_RPMB_FS_CACHE_ENTRIES)
-		num_elems_read = MIN(CFG_RPMB_FS_CACHE_ENTRIES,
-				     CFG_RPMB_FS_RD_ENTRIES);
-	else
-		num_elems_read = CFG_RPMB_FS_RD_ENTRIES;
+static void fat_name_insert(struct rpmb_fat *fat, uint32_t idx)
+{
+	uint32_t mask = fat->num_name_slots - 1;
+	uint32_t s = fat_name_slot(fat, idx);
 
-	/*
-	 * Allocate memory for the FAT FS entries to read in.
-	 */
-	fe = calloc(num_elems_read, sizeof(struct rpmb_fat_entry));
-	if (!fe) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
+	while (fat->name_slots[s])
+		s = (s + 1) & mask;
+	fat->name_slots[s] = idx + 1;
+}
+
+static TEE_Result fat_name_add(struct rpmb_fat *fat, uint32_t idx)
+{
+	uint32_t *old_slots = fat->name_slots;
+	uint32_t old_num_slots = fat->num_name_slots;
+	uint32_t n = 0;
+
+	/* Keep the load factor at most 1/2 */
+	if ((fat->num_names + 1) * 2 > fat->num_name_slots) {
+		fat->num_name_slots = MAX(old_num_slots * 2, 16U);
+		fat->name_slots = calloc(fat->num_name_slots,
+					 sizeof(*fat->name_slots));
+		if (!fat->name_slots) {
+			fat->name_slots = old_slots;
+			fat->num_name_slots = old_num_slots;
+			return TEE_ERROR_OUT_OF_MEMORY;
+		}
+
+		for (n = 0; n < old_num_slots; n++)
+			if (old_slots[n])
+				fat_name_insert(fat, old_slots[n] - 1);
+		free(old_slots);
 	}
 
-	res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address, (uint8_t *)fe,
-			    num_elems_read * sizeof(*fe), NULL, NULL);
-	if (res)
-		goto out;
+	fat_name_insert(fat, idx);
+	fat->num_names++;
+
+	return TEE_SUCCESS;
+}
+
+static void fat_name_del(struct rpmb_fat *fat, uint32_t idx)
+{
+	uint32_t mask = fat->num_name_slots - 1;
+	uint32_t s = fat_name_slot(fat, idx);
+	uint32_t n = 0;
+	uint32_t h = 0;
 
-	fat_entry_dir->rpmb_fat_entry_buf = fe;
+	while (fat->name_slots[s] != idx + 1) {
+		assert(fat->name_slots[s]);
+		s = (s + 1) & mask;
+	}
 
 	/*
-	 * We use this variable when getting next entries from the buffer/cache
-	 * to see whether we have to read in more entries from storage.
+	 * Shift following entries of the probe sequence back into the
+	 * freed slot unless that would move them before their home slot.
 	 */
-	fat_entry_dir->num_buffered = num_elems_read;
+	fat->name_slots[s] = 0;
+	for (n = (s + 1) & mask; fat->name_slots[n]; n = (n + 1) & mask) {
+		h = fat_name_slot(fat, fat->name_slots[n] - 1);
+		if (((n - h) & mask) >= ((n - s) & mask)) {
+			fat->name_slots[s] = fat->name_slots[n];
+			fat->name_slots[n] = 0;
+			s = n;
+		}
+	}
 
-	return TEE_SUCCESS;
-out:
-	fat_entry_dir_free();
-	free(fe);
-	return res;
+	fat->num_names--;
 }
 
-/**
- * fat_entry_dir_deinit: If caching is enabled, free the temporary buffer for
- * FAT FS entries in case the cache was too small. Keep the elements in the
- * cache. Reset the counter variables to start the next traversal from fresh
- * from the first cached entry. If caching is disabled, just free the
- * temporary buffer by calling fat_entry_dir_free and return.
+/*
+ * fat_find_name: Find the active entry with the lowest index (the one a
+ * traversal of the FAT would find first) matching @name.
  */
-static void fat_entry_dir_deinit(void)
+static bool fat_find_name(struct rpmb_fat *fat, const char *name,
+			  uint32_t *idx)
+{
+	uint32_t mask = fat->num_name_slots - 1;
+	bool found = false;
+	uint32_t s = 0;
+	uint32_t i = 0;
+
+	if (!fat->num_names)
+		return false;
+
+	for (s = fat_name_hash(name) & mask; fat->name_slots[s];
+	     s = (s + 1) & mask) {
+		i = fat->name_slots[s] - 1;
+		if (!strncmp(fat->entries[i].filename, name,
+			     TEE_RPMB_FS_FILENAME_LENGTH) &&
+		    (!found || i < *idx)) {
+			*idx = i;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static TEE_Result fat_grow(struct rpmb_fat *fat, uint32_t num_entries)
 {
-	struct rpmb_fat_entry *fe = NULL;
+	uint32_t max_entries = 0;
+	void *p = NULL;
 
-	if (!fat_entry_dir)
-		return;
+	if (num_entries <= fat->max_entries)
+		return TEE_SUCCESS;
 
-	if (!CFG_RPMB_FS_CACHE_ENTRIES) {
-		fat_entry_dir_free();
-		return;
-	}
+	max_entries = MAX(num_entries, fat->max_entries * 2);
 
-	fe = fat_entry_dir->rpmb_fat_entry_buf;
-	fat_entry_dir->idx_curr = 0;
-	fat_entry_dir->num_total_read = 0;
-	fat_entry_dir->last_reached = false;
+	p = realloc(fat->entries, max_entries * sizeof(*fat->entries));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	fat->entries = p;
 
-	if (fat_entry_dir->num_buffered > CFG_RPMB_FS_CACHE_ENTRIES) {
-		fat_entry_dir->num_buffered = CFG_RPMB_FS_CACHE_ENTRIES;
+	p = realloc(fat->extents, max_entries * sizeof(*fat->extents));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	fat->extents = p;
+	memset(fat->extents + fat->max_entries, 0,
+	       (max_entries - fat->max_entries) * sizeof(*fat->extents));
 
-		fe = realloc(fe, fat_entry_dir->num_buffered * sizeof(*fe));
+	p = realloc(fat->unused, bitstr_size(max_entries));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	fat->unused = p;
+	bit_nclear(fat->unused, fat->max_entries, max_entries - 1);
 
-		/*
-		 * In case realloc fails, we are on the safe side if we destroy
-		 * the whole structure. Upon the next init, the cache has to be
-		 * re-established, but this case should not happen in practice.
-		 */
-		if (!fe)
-			fat_entry_dir_free();
-		else
-			fat_entry_dir->rpmb_fat_entry_buf = fe;
+	fat->max_entries = max_entries;
+
+	return TEE_SUCCESS;
+}
+
+/* Adds the entry at @idx to the name index, the pool and the unused map */
+static TEE_Result fat_add_entry(struct rpmb_fat *fat, uint32_t idx)
+{
+	struct rpmb_fat_entry *fe = fat->entries + idx;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (fe->flags & FILE_IS_ACTIVE) {
+		res = fat_name_add(fat, idx);
+		if (res)
+			return res;
+
+		if (fe->data_size) {
+			fat->extents[idx] = tee_mm_alloc2(&fat->pool,
+							  fe->start_address,
+							  fe->data_size);
+			if (!fat->extents[idx])
+				return TEE_ERROR_OUT_OF_MEMORY;
+		}
+	} else if (!(fe->flags & FILE_IS_LAST_ENTRY)) {
+		bit_set(fat->unused, idx);
 	}
+
+	return TEE_SUCCESS;
 }
 
-/**
- * fat_entry_dir_update: Updates a persisted FAT FS entry in the cache.
- * This function updates the FAT entry fat_entry that was written to address
- * fat_address onto RPMB storage in the cache.
- */
-static TEE_Result __maybe_unused fat_entry_dir_update
-					(struct rpmb_fat_entry *fat_entry,
-					 uint32_t fat_address)
+static void fat_remove_entry(struct rpmb_fat *fat, uint32_t idx)
 {
-	uint32_t fat_entry_buf_idx = 0;
-	/* Use a temp var to avoid compiler warning if caching disabled. */
-	uint32_t max_cache_entries = CFG_RPMB_FS_CACHE_ENTRIES;
+	if (fat->entries[idx].flags & FILE_IS_ACTIVE)
+		fat_name_del(fat, idx);
 
-	assert(!((fat_address - RPMB_FS_FAT_START_ADDRESS) %
-	       sizeof(struct rpmb_fat_entry)));
+	if (fat->extents[idx]) {
+		tee_mm_free(fat->extents[idx]);
+		fat->extents[idx] = NULL;
+	}
 
-	/* Nothing to update if the cache is not initialized. */
-	if (!fat_entry_dir)
-		return TEE_SUCCESS;
+	bit_clear(fat->unused, idx);
+}
 
-	fat_entry_buf_idx = (fat_address - RPMB_FS_FAT_START_ADDRESS) /
-			     sizeof(struct rpmb_fat_entry);
+/*
+ * fat_reserve: Reserve the space of @num_entries FAT entries (and what's
+ * in front of the FAT) in the pool.
+ */
+static TEE_Result fat_reserve(struct rpmb_fat *fat, uint32_t num_entries)
+{
+	paddr_t old_size = 0;
+
+	if (fat->fat_extent) {
+		old_size = tee_mm_get_bytes(fat->fat_extent);
+		tee_mm_free(fat->fat_extent);
+	}
 
-	/* Only need to write if index points to an entry in cache. */
-	if (fat_entry_buf_idx < fat_entry_dir->num_buffered &&
-	    fat_entry_buf_idx < max_cache_entries) {
-		memcpy(fat_entry_dir->rpmb_fat_entry_buf + fat_entry_buf_idx,
-		       fat_entry, sizeof(struct rpmb_fat_entry));
+	fat->fat_extent = tee_mm_alloc2(&fat->pool, RPMB_STORAGE_START_ADDRESS,
+					fat_idx_to_address(num_entries));
+	if (!fat->fat_extent) {
+		if (old_size)
+			fat->fat_extent = tee_mm_alloc2(&fat->pool,
+						RPMB_STORAGE_START_ADDRESS,
+						old_size);
+		return TEE_ERROR_OUT_OF_MEMORY;
 	}
 
 	return TEE_SUCCESS;
 }
 
+static void fat_free(void)
+{
+	if (rpmb_fat) {
+		tee_mm_final(&rpmb_fat->pool);
+		free(rpmb_fat->entries);
+		free(rpmb_fat->extents);
+		free(rpmb_fat->unused);
+		free(rpmb_fat->name_slots);
+		free(rpmb_fat);
+		rpmb_fat = NULL;
+	}
+}
+
 /**
- * fat_entry_dir_get_next: Get next FAT FS entry.
- * Read either from cache/buffer, or by reading from RPMB storage if the
- * elements in the buffer/cache are fully read. When reading in from RPMB
- * storage, the buffer is overwritten in case caching is disabled.
- * In case caching is enabled, the cache is either further filled, or a
- * temporary buffer populated if the cache is already full.
- * The FAT FS entry is written to fat_entry. The respective address in RPMB
- * storage is written to fat_address, if not NULL. When the last FAT FS entry
- * was previously read, the function indicates this case by writing a NULL
- * pointer to fat_entry.
- * Returns a value different TEE_SUCCESS if the next FAT FS entry could not be
- * retrieved.
+ * fat_load: Read in the FAT FS entries from RPMB storage, in chunks of
+ * CFG_RPMB_FS_RD_ENTRIES entries, until the last entry is found.
  */
-static TEE_Result fat_entry_dir_get_next(struct rpmb_fat_entry **fat_entry,
-					 uint32_t *fat_address)
+static TEE_Result fat_load(void)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
-	struct rpmb_fat_entry *fe = NULL;
+	uint32_t fat_address = 0;
 	uint32_t num_elems_read = 0;
-	uint32_t fat_address_local = 0;
+	uint32_t n = 0;
 
-	assert(fat_entry_dir && fat_entry);
+	rpmb_fat = calloc(1, sizeof(*rpmb_fat));
+	if (!rpmb_fat)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
-	/* Don't read further if we previously read the last FAT FS entry. */
-	if (fat_entry_dir->last_reached) {
-		*fat_entry = NULL;
-		return TEE_SUCCESS;
+	if (!tee_mm_init(&rpmb_fat->pool, RPMB_STORAGE_START_ADDRESS,
+			 fs_par->max_rpmb_address, RPMB_BLOCK_SIZE_SHIFT,
+			 TEE_MM_POOL_HI_ALLOC)) {
+		free(rpmb_fat);
+		rpmb_fat = NULL;
+		return TEE_ERROR_OUT_OF_MEMORY;
 	}
 
-	fe = fat_entry_dir->rpmb_fat_entry_buf;
+	fat_address = fs_par->fat_start_address;
+	while (true) {
+		if (fat_address >= fs_par->max_rpmb_address) {
+			res = TEE_ERROR_CORRUPT_OBJECT;
+			goto out;
+		}
 
-	/* Determine address of FAT FS entry in RPMB storage. */
-	fat_address_local = RPMB_FS_FAT_START_ADDRESS +
-			(fat_entry_dir->num_total_read *
-			sizeof(struct rpmb_fat_entry));
+		num_elems_read = MIN((uint32_t)CFG_RPMB_FS_RD_ENTRIES,
+				     (fs_par->max_rpmb_address - fat_address) /
+				     sizeof(struct rpmb_fat_entry));
+		res = fat_grow(rpmb_fat,
+			       rpmb_fat->num_entries + num_elems_read);
+		if (res)
+			goto out;
 
-	/*
-	 * We've read all so-far buffered elements, so we need to
-	 * read in more entries from RPMB storage.
-	 */
-	if (fat_entry_dir->idx_curr >= fat_entry_dir->num_buffered) {
-		/*
-		 * This is the case where we do not cache entries, so just read
-		 * in next set of FAT FS entries into the buffer.
-		 * Goto the end of the when statement if that is done.
-		 */
-		if (!CFG_RPMB_FS_CACHE_ENTRIES) {
-			num_elems_read = CFG_RPMB_FS_RD_ENTRIES;
-			fat_entry_dir->idx_curr = 0;
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+				    (uint8_t *)(rpmb_fat->entries +
+						rpmb_fat->num_entries),
+				    num_elems_read *
+				    sizeof(struct rpmb_fat_entry), NULL);
+		if (res)
+			goto out;
 
-			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
-					    fat_address_local, (uint8_t *)fe,
-					    num_elems_read * sizeof(*fe), NULL,
-					    NULL);
+		for (n = 0; n < num_elems_read; n++) {
+			res = fat_add_entry(rpmb_fat, rpmb_fat->num_entries);
 			if (res)
-				return res;
-			goto post_read_in;
+				goto out;
+			if (rpmb_fat->entries[rpmb_fat->num_entries++].flags &
+			    FILE_IS_LAST_ENTRY)
+				goto last_reached;
 		}
 
-		/*
-		 * We cache FAT FS entries, and the buffer is not completely
-		 * filled. Further keep on extending the buffer up to its max
-		 * size by reading in from RPMB.
-		 */
-		if (fat_entry_dir->num_total_read < RPMB_BUF_MAX_ENTRIES) {
-			/*
-			 * Read at most as many elements as fit in the buffer
-			 * and no more than the defined number of entries to
-			 * read in at once.
-			 */
-			num_elems_read = MIN(RPMB_BUF_MAX_ENTRIES -
-					     fat_entry_dir->num_total_read,
-					     (uint32_t)CFG_RPMB_FS_RD_ENTRIES);
+		fat_address += num_elems_read * sizeof(struct rpmb_fat_entry);
+	}
 
-			/*
-			 * Expand the buffer to fit in the additional entries.
-			 */
-			fe = realloc(fe,
-				     (fat_entry_dir->num_buffered +
-				      num_elems_read) * sizeof(*fe));
-			if (!fe)
-				return TEE_ERROR_OUT_OF_MEMORY;
+last_reached:
+	res = fat_reserve(rpmb_fat, rpmb_fat->num_entries);
+out:
+	if (res)
+		fat_free();
+	return res;
+}
 
-			fat_entry_dir->rpmb_fat_entry_buf = fe;
+/**
+ * fat_update: Update the resident FAT with an entry which has been
+ * written to RPMB storage.
+ */
+static void fat_update(uint32_t fat_address,
+		       const struct rpmb_fat_entry *fe)
+{
+	uint32_t idx = 0;
 
-			/* Read in to the next free slot in the buffer/cache. */
-			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
-					    fat_address_local,
-					    (uint8_t *)(fe +
-					    fat_entry_dir->num_total_read),
-					    num_elems_read * sizeof(*fe),
-					    NULL, NULL);
-			if (res)
-				return res;
+	if (!rpmb_fat || rpmb_fat->stale)
+		return;
 
-			fat_entry_dir->num_buffered += num_elems_read;
-		} else {
-			/*
-			 * This happens when we have read as many elements as
-			 * can possibly fit into the buffer.
-			 * As the first part of the buffer serves as our cache,
-			 * we only overwrite the last part that serves as our
-			 * temporary buffer used to iteratively read in entries
-			 * when the cache is full. Read in the temporary buffer
-			 * maximum size.
-			 */
-			num_elems_read = CFG_RPMB_FS_RD_ENTRIES;
-			/* Reset index to beginning of the temporary buffer. */
-			fat_entry_dir->idx_curr = CFG_RPMB_FS_CACHE_ENTRIES;
+	idx = fat_address_to_idx(fat_address);
+	if (idx > rpmb_fat->num_entries)
+		goto err;
 
-			/* Read in elements after the end of the cache. */
-			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
-					    fat_address_local,
-					    (uint8_t *)(fe +
-					    fat_entry_dir->idx_curr),
-					    num_elems_read * sizeof(*fe),
-					    NULL, NULL);
-			if (res)
-				return res;
-		}
+	if (idx == rpmb_fat->num_entries) {
+		if (fat_grow(rpmb_fat, idx + 1))
+			goto err;
+		rpmb_fat->num_entries++;
+	} else {
+		fat_remove_entry(rpmb_fat, idx);
 	}
 
-post_read_in:
-	if (fat_address)
-		*fat_address = fat_address_local;
-
-	*fat_entry = fe + fat_entry_dir->idx_curr;
-
-	fat_entry_dir->idx_curr++;
-	fat_entry_dir->num_total_read++;
-
-	/*
-	 * Indicate last entry was read.
-	 * Ensures we return a zero value for fat_entry on next invocation.
-	 */
-	if ((*fat_entry)->flags & FILE_IS_LAST_ENTRY)
-		fat_entry_dir->last_reached = true;
+	rpmb_fat->entries[idx] = *fe;
+	if (fat_add_entry(rpmb_fat, idx))
+		goto err;
 
-	return TEE_SUCCESS;
+	return;
+err:
+	rpmb_fat->stale = true;
 }
 
 #if (TRACE_LEVEL >= TRACE_FLOW)
 static void dump_fat(void)
 {
-	TEE_Result res = TEE_ERROR_SECURITY;
 	struct rpmb_fat_entry *fe = NULL;
+	uint32_t n = 0;
 
-	if (!fs_par)
-		return;
-
-	if (fat_entry_dir_init())
+	if (!rpmb_fat)
 		return;
 
-	while (true) {
-		res = fat_entry_dir_get_next(&fe, NULL);
-		if (res || !fe)
-			break;
-
+	for (n = 0; n < rpmb_fat->num_entries; n++) {
+		fe = rpmb_fat->entries + n;
 		FMSG("flags %#"PRIx32", size %"PRIu32", address %#"PRIx32
 		     ", filename '%s'",
 		     fe->flags, fe->data_size, fe->start_address, fe->filename);
 	}
-
-	fat_entry_dir_deinit();
 }
 #else
 static void dump_fat(void)
@@ -1850,6 +1957,39 @@ static void dump_fh(struct rpmb_file_handle *fh __unused)
 }
 #endif
 
+static void free_file_handle(struct rpmb_file_handle *fh)
+{
+	if (fh) {
+		tee_fs_crypt_ctx_free(fh->crypt_ctx);
+		free(fh);
+	}
+}
+
+/*
+ * get_crypt_ctx: Get the crypto context for the data of an open file.
+ * The FEK is decrypted and the key schedules set up on first use, then
+ * kept until the file handle is closed.
+ */
+static TEE_Result get_crypt_ctx(struct rpmb_file_handle *fh,
+				struct tee_fs_crypt_ctx **cctx)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!fh->crypt_ctx) {
+		/* The file was created with encryption disabled */
+		if (is_zero(fh->fat_entry.fek, sizeof(fh->fat_entry.fek)))
+			return TEE_ERROR_SECURITY;
+
+		res = tee_fs_crypt_ctx_alloc(fh->uuid, fh->fat_entry.fek,
+					     &fh->crypt_ctx);
+		if (res)
+			return res;
+	}
+
+	*cctx = fh->crypt_ctx;
+	return TEE_SUCCESS;
+}
+
 static struct rpmb_file_handle *alloc_file_handle(struct tee_pobj *po,
 						  bool temporary)
 {
@@ -1895,14 +2035,19 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 
 	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, fh->rpmb_fat_address,
 			     (uint8_t *)&fh->fat_entry,
-			     sizeof(struct rpmb_fat_entry), NULL, NULL);
+			     sizeof(struct rpmb_fat_entry), NULL);
 
-	dump_fat();
+	/*
+	 * The write is authenticated with the write counter, so if it
+	 * succeeded the resident FAT can be updated. Otherwise it's unknown
+	 * what ended up in RPMB storage and the FAT is read in again.
+	 */
+	if (!res)
+		fat_update(fh->rpmb_fat_address, &fh->fat_entry);
+	else if (rpmb_fat)
+		rpmb_fat->stale = true;
 
-	/* If caching enabled, update a successfully written entry in cache. */
-	if (CFG_RPMB_FS_CACHE_ENTRIES && !res)
-		res = fat_entry_dir_update(&fh->fat_entry,
-					   fh->rpmb_fat_address);
+	dump_fat();
 
 out:
 	return res;
@@ -1921,8 +2066,11 @@ static TEE_Result rpmb_fs_setup(void)
 	uint32_t max_rpmb_block = 0;
 
 	if (fs_par) {
-		res = TEE_SUCCESS;
-		goto out;
+		if (rpmb_fat && rpmb_fat->stale)
+			fat_free();
+		if (!rpmb_fat)
+			return fat_load();
+		return TEE_SUCCESS;
 	}
 
 	res = tee_rpmb_get_max_block(CFG_RPMB_FS_DEV_ID, &max_rpmb_block);
@@ -1937,7 +2085,7 @@ static TEE_Result rpmb_fs_setup(void)
 
 	res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, RPMB_STORAGE_START_ADDRESS,
 			    (uint8_t *)partition_data,
-			    sizeof(struct rpmb_fs_partition), NULL, NULL);
+			    sizeof(struct rpmb_fs_partition), NULL);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -1982,7 +2130,7 @@ static TEE_Result rpmb_fs_setup(void)
 		goto out;
 	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, RPMB_STORAGE_START_ADDRESS,
 			     (uint8_t *)partition_data,
-			     sizeof(struct rpmb_fs_partition), NULL, NULL);
+			     sizeof(struct rpmb_fs_partition), NULL);
 
 #ifndef CFG_RPMB_RESET_FAT
 store_fs_par:
@@ -1998,6 +2146,10 @@ store_fs_par:
 	fs_par->fat_start_address = partition_data->fat_start_address;
 	fs_par->max_rpmb_address = max_rpmb_block << RPMB_BLOCK_SIZE_SHIFT;
 
+	res = fat_load();
+	if (res)
+		goto out;
+
 	dump_fat();
 
 out:
@@ -2021,131 +2173,84 @@ static TEE_Result get_fat_start_address(uint32_t *addr)
 }
 
 /**
- * read_fat: Read FAT entries
- * Return matching FAT entry for read, rm rename and stat.
- * Build up memory pool and return matching entry for write operation.
- * "Last FAT entry" can be returned during write.
+ * fat_alloc_entry: Find a FAT entry for a new file, reusing an inactive
+ * entry if possible or else expanding the FAT.
  */
-static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
+static TEE_Result fat_alloc_entry(uint32_t *idx)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
-	tee_mm_entry_t *mm = NULL;
-	struct rpmb_fat_entry *fe = NULL;
-	uint32_t fat_address;
-	bool entry_found = false;
-	bool expand_fat = false;
-	struct rpmb_file_handle last_fh;
+	struct rpmb_file_handle last_fh = { };
+	uint32_t num_entries = rpmb_fat->num_entries;
+	int i = -1;
 
-	DMSG("fat_address %d", fh->rpmb_fat_address);
-
-	res = fat_entry_dir_init();
-	if (res)
-		goto out;
+	bit_ffs(rpmb_fat->unused, (int)num_entries, &i);
+	if (i >= 0) {
+		*idx = i;
+		return TEE_SUCCESS;
+	}
 
 	/*
-	 * The pool is used to represent the current RPMB layout. To find
-	 * a slot for the file tee_mm_alloc is called on the pool. Thus
-	 * if it is not NULL the entire FAT must be traversed to fill in
-	 * the pool.
+	 * A FAT expansion which wasn't used for a file: traversing the FAT
+	 * stops at the first last entry so that's the one to use.
 	 */
-	while (true) {
-		res = fat_entry_dir_get_next(&fe, &fat_address);
-		if (res || !fe)
-			break;
+	if (num_entries > 1 &&
+	    (rpmb_fat->entries[num_entries - 2].flags & FILE_IS_LAST_ENTRY)) {
+		*idx = num_entries - 2;
+		return TEE_SUCCESS;
+	}
 
-		/*
-		 * Look for an entry, matching filenames. (read, rm,
-		 * rename and stat.). Only store first filename match.
-		 */
-		if ((!strcmp(fh->filename, fe->filename)) &&
-		    (fe->flags & FILE_IS_ACTIVE) && !entry_found) {
-			entry_found = true;
-			fh->rpmb_fat_address = fat_address;
-			memcpy(&fh->fat_entry, fe, sizeof(*fe));
-			if (!p)
-				break;
-		}
+	/*
+	 * The last entry is used for the file and a new last entry is
+	 * written after it.
+	 */
+	res = fat_reserve(rpmb_fat, num_entries + 1);
+	if (res)
+		return res;
 
-		/* Add existing files to memory pool. (write) */
-		if (p) {
-			if ((fe->flags & FILE_IS_ACTIVE) && fe->data_size > 0) {
+	last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
+	last_fh.rpmb_fat_address = fat_idx_to_address(num_entries);
+	res = write_fat_entry(&last_fh, true);
+	if (res)
+		return res;
 
-				mm = tee_mm_alloc2(p, fe->start_address,
-						   fe->data_size);
-				if (!mm) {
-					res = TEE_ERROR_OUT_OF_MEMORY;
-					goto out;
-				}
-			}
+	*idx = num_entries - 1;
+	return TEE_SUCCESS;
+}
 
-			/* Unused FAT entries can be reused (write) */
-			if (((fe->flags & FILE_IS_ACTIVE) == 0) &&
-			    fh->rpmb_fat_address == 0) {
-				fh->rpmb_fat_address = fat_address;
-				memcpy(&fh->fat_entry, fe,
-				       sizeof(struct rpmb_fat_entry));
-			}
+/**
+ * read_fat: Look up FAT entries
+ * Return matching FAT entry for read, rm rename and stat.
+ * With @alloc_entry an unused FAT entry is returned for a new file during
+ * write, expanding the FAT if needed.
+ * Space for file data is allocated from the pool in the resident FAT.
+ */
+static TEE_Result read_fat(struct rpmb_file_handle *fh, bool alloc_entry)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	uint32_t idx = 0;
 
-			if (((fe->flags & FILE_IS_LAST_ENTRY) != 0) &&
-			    fh->rpmb_fat_address == fat_address) {
-
-				/*
-				 * If the last entry was reached and was chosen
-				 * by the previous check, then the FAT needs to
-				 * be expanded.
-				 * fh->rpmb_fat_address is the address chosen
-				 * to store the files FAT entry and fat_address
-				 * is the current FAT entry address being
-				 * compared.
-				 */
-				expand_fat = true;
-			}
-		}
-	}
+	DMSG("fat_address %d", fh->rpmb_fat_address);
 
+	res = rpmb_fs_setup();
 	if (res)
-		goto out;
-	/*
-	 * Represent the FAT table in the pool.
-	 */
-	if (p) {
-		/*
-		 * Since fat_address is the start of the last entry it needs to
-		 * be moved up by an entry.
-		 */
-		fat_address += sizeof(struct rpmb_fat_entry);
+		return res;
 
-		/* Make room for yet a FAT entry and add to memory pool. */
-		if (expand_fat)
-			fat_address += sizeof(struct rpmb_fat_entry);
+	if (!fat_find_name(rpmb_fat, fh->filename, &idx)) {
+		if (fh->rpmb_fat_address)
+			return TEE_SUCCESS;
+		if (!alloc_entry)
+			return TEE_ERROR_ITEM_NOT_FOUND;
 
-		mm = tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address);
-		if (!mm) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-
-		if (expand_fat) {
-			/*
-			 * Point fat_address to the beginning of the new
-			 * entry.
-			 */
-			fat_address -= sizeof(struct rpmb_fat_entry);
-			memset(&last_fh, 0, sizeof(last_fh));
-			last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
-			last_fh.rpmb_fat_address = fat_address;
-			res = write_fat_entry(&last_fh, true);
-			if (res != TEE_SUCCESS)
-				goto out;
-		}
+		res = fat_alloc_entry(&idx);
+		if (res)
+			return res;
 	}
 
-	if (!fh->rpmb_fat_address)
-		res = TEE_ERROR_ITEM_NOT_FOUND;
+	fh->rpmb_fat_address = fat_idx_to_address(idx);
+	memcpy(&fh->fat_entry, rpmb_fat->entries + idx,
+	       sizeof(struct rpmb_fat_entry));
 
-out:
-	fat_entry_dir_deinit();
-	return res;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result generate_fek(struct rpmb_fat_entry *fe, const TEE_UUID *uuid)
@@ -2166,8 +2271,6 @@ again:
 static TEE_Result rpmb_fs_open_internal(struct rpmb_file_handle *fh,
 					const TEE_UUID *uuid, bool create)
 {
-	tee_mm_pool_t p;
-	bool pool_result;
 	TEE_Result res = TEE_ERROR_GENERIC;
 
 	/* We need to do setup in order to make sure fs_par is filled in */
@@ -2176,28 +2279,9 @@ static TEE_Result rpmb_fs_open_internal(struct rpmb_file_handle *fh,
 		goto out;
 
 	fh->uuid = uuid;
-	if (create) {
-		/* Upper memory allocation must be used for RPMB_FS. */
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-
-		res = read_fat(fh, &p);
-		tee_mm_final(&p);
-		if (res != TEE_SUCCESS)
-			goto out;
-	} else {
-		res = read_fat(fh, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
-	}
+	res = read_fat(fh, create);
+	if (res != TEE_SUCCESS)
+		goto out;
 
 	/*
 	 * If this is opened with create and the entry found was not active
@@ -2212,6 +2296,8 @@ static TEE_Result rpmb_fs_open_internal(struct rpmb_file_handle *fh,
 			/* Start address and size are 0 */
 			fh->fat_entry.flags = FILE_IS_ACTIVE;
 
+			tee_fs_crypt_ctx_free(fh->crypt_ctx);
+			fh->crypt_ctx = NULL;
 			res = generate_fek(&fh->fat_entry, uuid);
 			if (res != TEE_SUCCESS)
 				goto out;
@@ -2235,7 +2321,7 @@ static void rpmb_fs_close(struct tee_file_handle **tfh)
 {
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)*tfh;
 
-	free(fh);
+	free_file_handle(fh);
 	*tfh = NULL;
 }
 
@@ -2244,6 +2330,7 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, size_t pos,
 {
 	TEE_Result res;
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
+	struct tee_fs_crypt_ctx *cctx = NULL;
 	size_t size = *len;
 
 	if (!size)
@@ -2253,7 +2340,7 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, size_t pos,
 
 	dump_fh(fh);
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2264,9 +2351,12 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, size_t pos,
 
 	size = MIN(size, fh->fat_entry.data_size - pos);
 	if (size) {
+		res = get_crypt_ctx(fh, &cctx);
+		if (res != TEE_SUCCESS)
+			goto out;
 		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 				    fh->fat_entry.start_address + pos, buf,
-				    size, fh->fat_entry.fek, fh->uuid);
+				    size, cctx);
 		if (res != TEE_SUCCESS)
 			goto out;
 	}
@@ -2277,19 +2367,92 @@ out:
 	return res;
 }
 
+/*
+ * extend_in_place: Extend the file in @fh to @pos + @size bytes with the
+ * @size bytes in @buf (or zeroes if NULL) at @pos by growing the extent of
+ * the file in place. This is possible when @pos is at or beyond the end of
+ * the file data and the space following the extent is free. Data blocks
+ * of the file aren't changed, except the last partially used one which is
+ * rewritten with its data intact, so the update is committed atomically
+ * with the FAT entry without relocating the file.
+ * @extended is set if the file was extended, else the file must be
+ * relocated.
+ */
+static TEE_Result extend_in_place(struct rpmb_file_handle *fh,
+				  struct tee_fs_crypt_ctx *cctx, size_t pos,
+				  const void *buf, size_t size, bool *extended)
+{
+	struct rpmb_fat_entry *fe = &fh->fat_entry;
+	uint32_t start = ROUNDDOWN(fe->data_size, RPMB_DATA_SIZE);
+	uint32_t alloc_start = ROUNDUP(fe->data_size, RPMB_DATA_SIZE);
+	size_t end = pos + size;
+	tee_mm_entry_t *mm = NULL;
+	uint8_t *newbuf = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	*extended = false;
+
+	if (!fe->data_size || pos < fe->data_size)
+		return TEE_SUCCESS;
+
+	if (end > alloc_start) {
+		mm = tee_mm_alloc2(&rpmb_fat->pool,
+				   fe->start_address + alloc_start,
+				   end - alloc_start);
+		if (!mm)
+			return TEE_SUCCESS;
+	}
+
+	newbuf = calloc(1, end - start);
+	if (!newbuf) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	if (fe->data_size > start) {
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
+				    fe->start_address + start, newbuf,
+				    fe->data_size - start, cctx);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	if (buf)
+		memcpy(newbuf + pos - start, buf, size);
+
+	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, fe->start_address + start,
+			     newbuf, end - start, cctx);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	/* The resident FAT claims the space when the entry is updated */
+	tee_mm_free(mm);
+	mm = NULL;
+
+	fe->data_size = end;
+	res = write_fat_entry(fh, true);
+	if (res == TEE_SUCCESS)
+		*extended = true;
+
+out:
+	tee_mm_free(mm);
+	free(newbuf);
+	return res;
+}
+
 static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 					  size_t pos, const void *buf,
 					  size_t size)
 {
 	TEE_Result res;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
+	struct tee_fs_crypt_ctx *cctx = NULL;
 	size_t end;
 	size_t newsize;
 	uint8_t *newbuf = NULL;
 	uintptr_t newaddr;
 	uint32_t start_addr;
+	bool extended = false;
 
 	if (!size)
 		return TEE_SUCCESS;
@@ -2301,24 +2464,17 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 	dump_fh(fh);
 
-	/* Upper memory allocation must be used for RPMB_FS. */
-	pool_result = tee_mm_init(&p,
-				  RPMB_STORAGE_START_ADDRESS,
-				  fs_par->max_rpmb_address,
-				  RPMB_BLOCK_SIZE_SHIFT,
-				  TEE_MM_POOL_HI_ALLOC);
-	if (!pool_result) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
-
-	res = read_fat(fh, &p);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	if (fh->fat_entry.flags & FILE_IS_LAST_ENTRY)
 		panic("invalid last entry flag");
 
+	res = get_crypt_ctx(fh, &cctx);
+	if (res != TEE_SUCCESS)
+		goto out;
+
 	if (ADD_OVERFLOW(pos, size, &end)) {
 		res = TEE_ERROR_BAD_PARAMETERS;
 		goto out;
@@ -2333,10 +2489,15 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		DMSG("Updating data in-place");
 		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, start_addr, buf,
-				     size, fh->fat_entry.fek, fh->uuid);
+				     size, cctx);
 		if (res != TEE_SUCCESS)
 			goto out;
 	} else {
+		/* Appending to the file doesn't need to move existing data */
+		res = extend_in_place(fh, cctx, pos, buf, size, &extended);
+		if (res != TEE_SUCCESS || extended)
+			goto out;
+
 		/*
 		 * File must be extended, or update cannot be atomic: allocate,
 		 * read, update, write.
@@ -2344,7 +2505,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		DMSG("Need to re-allocate");
 		newsize = MAX(end, fh->fat_entry.data_size);
-		mm = tee_mm_alloc(&p, newsize);
+		mm = tee_mm_alloc(&rpmb_fat->pool, newsize);
 		newbuf = calloc(1, newsize);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2355,7 +2516,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 					    fh->fat_entry.start_address,
 					    newbuf, fh->fat_entry.data_size,
-					    fh->fat_entry.fek, fh->uuid);
+					    cctx);
 			if (res != TEE_SUCCESS)
 				goto out;
 		}
@@ -2364,10 +2525,17 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		newaddr = tee_mm_get_smem(mm);
 		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, newaddr, newbuf,
-				     newsize, fh->fat_entry.fek, fh->uuid);
+				     newsize, cctx);
 		if (res != TEE_SUCCESS)
 			goto out;
 
+		/*
+		 * The resident FAT claims the space when the entry is
+		 * updated
+		 */
+		tee_mm_free(mm);
+		mm = NULL;
+
 		fh->fat_entry.data_size = newsize;
 		fh->fat_entry.start_address = newaddr;
 		res = write_fat_entry(fh, true);
@@ -2376,8 +2544,8 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 	}
 
 out:
-	if (pool_result)
-		tee_mm_final(&p);
+	if (mm)
+		tee_mm_free(mm);
 	if (newbuf)
 		free(newbuf);
 
@@ -2401,7 +2569,7 @@ static TEE_Result rpmb_fs_remove_internal(struct rpmb_file_handle *fh)
 {
 	TEE_Result res;
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res)
 		return res;
 
@@ -2459,11 +2627,11 @@ static  TEE_Result rpmb_fs_rename_internal(struct tee_pobj *old,
 		goto out;
 	}
 
-	res = read_fat(fh_old, NULL);
+	res = read_fat(fh_old, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = read_fat(fh_new, NULL);
+	res = read_fat(fh_new, false);
 	if (res == TEE_SUCCESS) {
 		if (!overwrite) {
 			res = TEE_ERROR_ACCESS_CONFLICT;
@@ -2505,13 +2673,13 @@ static  TEE_Result rpmb_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 {
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
+	struct tee_fs_crypt_ctx *cctx = NULL;
 	uint32_t newsize;
 	uint8_t *newbuf = NULL;
 	uintptr_t newaddr;
 	TEE_Result res = TEE_ERROR_GENERIC;
+	bool extended = false;
 
 	mutex_lock(&rpmb_mutex);
 
@@ -2521,27 +2689,24 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	}
 	newsize = length;
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	if (newsize > fh->fat_entry.data_size) {
 		/* Extend file */
 
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-		res = read_fat(fh, &p);
+		res = get_crypt_ctx(fh, &cctx);
 		if (res != TEE_SUCCESS)
 			goto out;
 
-		mm = tee_mm_alloc(&p, newsize);
+		res = extend_in_place(fh, cctx, fh->fat_entry.data_size, NULL,
+				      newsize - fh->fat_entry.data_size,
+				      &extended);
+		if (res != TEE_SUCCESS || extended)
+			goto out;
+
+		mm = tee_mm_alloc(&rpmb_fat->pool, newsize);
 		newbuf = calloc(1, newsize);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2552,17 +2717,23 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 					    fh->fat_entry.start_address,
 					    newbuf, fh->fat_entry.data_size,
-					    fh->fat_entry.fek, fh->uuid);
+					    cctx);
 			if (res != TEE_SUCCESS)
 				goto out;
 		}
 
 		newaddr = tee_mm_get_smem(mm);
 		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, newaddr, newbuf,
-				     newsize, fh->fat_entry.fek, fh->uuid);
+				     newsize, cctx);
 		if (res != TEE_SUCCESS)
 			goto out;
 
+		/*
+		 * The resident FAT claims the space when the entry is
+		 * updated
+		 */
+		tee_mm_free(mm);
+		mm = NULL;
 	} else {
 		/* Don't change file location */
 		newaddr = fh->fat_entry.start_address;
@@ -2574,9 +2745,9 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	res = write_fat_entry(fh, true);
 
 out:
+	if (mm)
+		tee_mm_free(mm);
 	mutex_unlock(&rpmb_mutex);
-	if (pool_result)
-		tee_mm_final(&p);
 	if (newbuf)
 		free(newbuf);
 
@@ -2603,40 +2774,31 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 {
 	struct tee_rpmb_fs_dirent *current = NULL;
 	struct rpmb_fat_entry *fe = NULL;
-	uint32_t fat_address;
+	uint32_t n = 0;
 	uint32_t filelen;
 	char *filename;
 	bool matched;
 	struct tee_rpmb_fs_dirent *next = NULL;
 	uint32_t pathlen;
 	TEE_Result res = TEE_ERROR_GENERIC;
-	char temp;
 
 	mutex_lock(&rpmb_mutex);
 
-	res = fat_entry_dir_init();
+	res = rpmb_fs_setup();
 	if (res)
 		goto out;
 
 	pathlen = strlen(path);
 
-	while (true) {
-		res = fat_entry_dir_get_next(&fe, &fat_address);
-		if (res || !fe)
-			break;
-
+	for (n = 0; n < rpmb_fat->num_entries; n++) {
+		fe = rpmb_fat->entries + n;
 		filename = fe->filename;
 		if (fe->flags & FILE_IS_ACTIVE) {
 			matched = false;
 			filelen = strlen(filename);
-			if (filelen > pathlen) {
-				temp = filename[pathlen];
-				filename[pathlen] = '\0';
-				if (strcmp(filename, path) == 0)
-					matched = true;
-
-				filename[pathlen] = temp;
-			}
+			if (filelen > pathlen &&
+			    !strncmp(filename, path, pathlen))
+				matched = true;
 
 			if (matched) {
 				next = malloc(sizeof(*next));
@@ -2662,9 +2824,6 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 		}
 	}
 
-	if (res)
-		goto out;
-
 	if (current)
 		res = TEE_SUCCESS;
 	else
@@ -2672,7 +2831,6 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 
 out:
 	mutex_unlock(&rpmb_mutex);
-	fat_entry_dir_deinit();
 	if (res)
 		rpmb_fs_dir_free(dir);
 
@@ -2833,7 +2991,7 @@ static TEE_Result rpmb_fs_create(struct tee_pobj *po, bool overwrite,
 out:
 	if (res) {
 		rpmb_fs_remove_internal(fh);
-		free(fh);
+		free_file_handle(fh);
 	} else {
 		*ret_fh = (struct tee_file_handle *)fh;
 	}
@@ -1007,6 +1007,13 @@ TEE_Result syscall_cryp_obj_get_attr(unsigned long obj, unsigned long attr_id,
 	return ops->to_user(attr, sess, buffer, size);
 }
 
+/* Drops what the crypto library has derived from the attributes of @o */
+static void obj_attr_changed(struct tee_obj *o)
+{
+	if (o->attr && o->info.objectType == TEE_TYPE_RSA_KEYPAIR)
+		crypto_acipher_rsa_keypair_changed(o->attr);
+}
+
 void tee_obj_attr_free(struct tee_obj *o)
 {
 	const struct tee_cryp_obj_type_props *tp;
@@ -1014,6 +1021,7 @@ void tee_obj_attr_free(struct tee_obj *o)
 
 	if (!o->attr)
 		return;
+	obj_attr_changed(o);
 	tp = tee_svc_find_type_props(o->info.objectType);
 	if (!tp)
 		return;
@@ -1032,6 +1040,7 @@ void tee_obj_attr_clear(struct tee_obj *o)
 
 	if (!o->attr)
 		return;
+	obj_attr_changed(o);
 	tp = tee_svc_find_type_props(o->info.objectType);
 	if (!tp)
 		return;
@@ -1093,6 +1102,7 @@ TEE_Result tee_obj_attr_from_binary(struct tee_obj *o, const void *data,
 	if (!tp)
 		return TEE_ERROR_BAD_STATE;
 
+	obj_attr_changed(o);
 	for (n = 0; n < tp->num_type_attrs; n++) {
 		const struct tee_cryp_obj_type_attrs *ta = tp->type_attrs + n;
 		void *attr = (uint8_t *)o->attr + ta->raw_offs;
@@ -1122,6 +1132,7 @@ TEE_Result tee_obj_attr_copy_from(struct tee_obj *o, const struct tee_obj *src)
 	if (!tp)
 		return TEE_ERROR_BAD_STATE;
 
+	obj_attr_changed(o);
 	if (o->info.objectType == src->info.objectType) {
 		have_attrs = src->have_attrs;
 		for (n = 0; n < tp->num_type_attrs; n++) {
@@ -1557,6 +1568,7 @@ static TEE_Result tee_svc_cryp_obj_populate_type(
 	const struct attr_ops *ops = NULL;
 	void *attr = NULL;
 
+	obj_attr_changed(o);
 	for (n = 0; n < attr_count; n++) {
 		idx = tee_svc_cryp_obj_find_type_attr_idx(
 							attrs[n].attributeID,
@@ -2388,11 +2400,10 @@ TEE_Result syscall_hash_init(unsigned long state,
 	return TEE_SUCCESS;
 }
 
-TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
-			size_t chunk_size)
+static TEE_Result hash_update(struct user_mode_ctx *uctx,
+			      struct tee_cryp_state *cs, const void *chunk,
+			      size_t chunk_size)
 {
-	struct ts_session *sess = ts_get_current_session();
-	struct tee_cryp_state *cs = NULL;
 	TEE_Result res = TEE_SUCCESS;
 
 	/* No data, but size provided isn't valid parameters. */
@@ -2403,17 +2414,13 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 	if (!chunk_size)
 		return TEE_SUCCESS;
 
-	res = vm_check_access_rights(&to_user_ta_ctx(sess->ctx)->uctx,
+	res = vm_check_access_rights(uctx,
 				     TEE_MEMORY_ACCESS_READ |
 				     TEE_MEMORY_ACCESS_ANY_OWNER,
 				     (uaddr_t)chunk, chunk_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
-	if (res != TEE_SUCCESS)
-		return res;
-
 	if (cs->state != CRYP_STATE_INITIALIZED)
 		return TEE_ERROR_BAD_STATE;
 
@@ -2435,6 +2442,21 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 	return TEE_SUCCESS;
 }
 
+TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
+			size_t chunk_size)
+{
+	struct ts_session *sess = ts_get_current_session();
+	struct tee_cryp_state *cs = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return hash_update(&to_user_ta_ctx(sess->ctx)->uctx, cs, chunk,
+			   chunk_size);
+}
+
 TEE_Result syscall_hash_final(unsigned long state, const void *chunk,
 			size_t chunk_size, void *hash, uint64_t *hash_len)
 {
@@ -2582,49 +2604,44 @@ TEE_Result syscall_cipher_init(unsigned long state, const void *iv,
 	return TEE_SUCCESS;
 }
 
-static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
-			bool last_block, const void *src, size_t src_len,
-			void *dst, uint64_t *dst_len)
+/*
+ * @dlen is the size of @dst on entry and the number of bytes produced on
+ * return. A NULL @dlen means that there's no output buffer, only valid
+ * when @src_len is 0.
+ */
+static TEE_Result cipher_update(struct user_mode_ctx *uctx,
+				struct tee_cryp_state *cs, bool last_block,
+				const void *src, size_t src_len, void *dst,
+				size_t *dlen)
 {
-	struct ts_session *sess = ts_get_current_session();
-	struct tee_cryp_state *cs = NULL;
 	TEE_Result res = TEE_SUCCESS;
-	size_t dlen = 0;
-
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
-	if (res != TEE_SUCCESS)
-		return res;
 
 	if (cs->state != CRYP_STATE_INITIALIZED)
 		return TEE_ERROR_BAD_STATE;
 
-	res = vm_check_access_rights(&to_user_ta_ctx(sess->ctx)->uctx,
+	res = vm_check_access_rights(uctx,
 				     TEE_MEMORY_ACCESS_READ |
 				     TEE_MEMORY_ACCESS_ANY_OWNER,
 				     (uaddr_t)src, src_len);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	if (!dst_len) {
-		dlen = 0;
-	} else {
-		struct user_mode_ctx *uctx = &to_user_ta_ctx(sess->ctx)->uctx;
+	if (dlen) {
 		uint32_t flags = TEE_MEMORY_ACCESS_READ |
 				 TEE_MEMORY_ACCESS_WRITE |
 				 TEE_MEMORY_ACCESS_ANY_OWNER;
 
-		res = get_user_u64_as_size_t(&dlen, dst_len);
-		if (res != TEE_SUCCESS)
-			return res;
-
-		res = vm_check_access_rights(uctx, flags, (uaddr_t)dst, dlen);
+		res = vm_check_access_rights(uctx, flags, (uaddr_t)dst, *dlen);
 		if (res != TEE_SUCCESS)
 			return res;
-	}
 
-	if (dlen < src_len) {
-		res = TEE_ERROR_SHORT_BUFFER;
-		goto out;
+		if (*dlen < src_len) {
+			*dlen = src_len;
+			return TEE_ERROR_SHORT_BUFFER;
+		}
+		*dlen = src_len;
+	} else if (src_len) {
+		return TEE_ERROR_SHORT_BUFFER;
 	}
 
 	if (src_len > 0) {
@@ -2638,12 +2655,36 @@ static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 		cs->ctx_finalize = NULL;
 	}
 
-out:
+	return res;
+}
+
+static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
+			bool last_block, const void *src, size_t src_len,
+			void *dst, uint64_t *dst_len)
+{
+	struct ts_session *sess = ts_get_current_session();
+	struct tee_cryp_state *cs = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	size_t dlen = 0;
+
+	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (dst_len) {
+		res = get_user_u64_as_size_t(&dlen, dst_len);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	res = cipher_update(&to_user_ta_ctx(sess->ctx)->uctx, cs, last_block,
+			    src, src_len, dst, dst_len ? &dlen : NULL);
+
 	if ((res == TEE_SUCCESS || res == TEE_ERROR_SHORT_BUFFER) &&
 	    dst_len != NULL) {
 		TEE_Result res2;
 
-		res2 = put_user_u64(dst_len, src_len);
+		res2 = put_user_u64(dst_len, dlen);
 		if (res2 != TEE_SUCCESS)
 			res = res2;
 	}
@@ -3242,24 +3283,19 @@ TEE_Result syscall_authenc_init(unsigned long state, const void *nonce,
 	return TEE_SUCCESS;
 }
 
-TEE_Result syscall_authenc_update_aad(unsigned long state,
-				      const void *aad_data, size_t aad_data_len)
+static TEE_Result authenc_update_aad(struct user_mode_ctx *uctx,
+				     struct tee_cryp_state *cs,
+				     const void *aad_data, size_t aad_data_len)
 {
-	struct ts_session *sess = ts_get_current_session();
 	TEE_Result res = TEE_SUCCESS;
-	struct tee_cryp_state *cs = NULL;
 
-	res = vm_check_access_rights(&to_user_ta_ctx(sess->ctx)->uctx,
+	res = vm_check_access_rights(uctx,
 				     TEE_MEMORY_ACCESS_READ |
 				     TEE_MEMORY_ACCESS_ANY_OWNER,
 				     (uaddr_t)aad_data, aad_data_len);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
-	if (res != TEE_SUCCESS)
-		return res;
-
 	if (cs->state != CRYP_STATE_INITIALIZED)
 		return TEE_ERROR_BAD_STATE;
 
@@ -3274,53 +3310,80 @@ TEE_Result syscall_authenc_update_aad(unsigned long state,
 	return TEE_SUCCESS;
 }
 
-TEE_Result syscall_authenc_update_payload(unsigned long state,
-					  const void *src_data,
-					  size_t src_len, void *dst_data,
-					  uint64_t *dst_len)
+TEE_Result syscall_authenc_update_aad(unsigned long state,
+				      const void *aad_data, size_t aad_data_len)
 {
 	struct ts_session *sess = ts_get_current_session();
-	struct tee_cryp_state *cs = NULL;
 	TEE_Result res = TEE_SUCCESS;
-	size_t dlen = 0;
+	struct tee_cryp_state *cs = NULL;
 
 	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
+	return authenc_update_aad(&to_user_ta_ctx(sess->ctx)->uctx, cs,
+				  aad_data, aad_data_len);
+}
+
+/*
+ * @dlen is the size of @dst_data on entry and the number of bytes
+ * produced on return.
+ */
+static TEE_Result authenc_update_payload(struct user_mode_ctx *uctx,
+					 struct tee_cryp_state *cs,
+					 const void *src_data, size_t src_len,
+					 void *dst_data, size_t *dlen)
+{
+	TEE_Result res = TEE_SUCCESS;
+
 	if (cs->state != CRYP_STATE_INITIALIZED)
 		return TEE_ERROR_BAD_STATE;
 
 	if (TEE_ALG_GET_CLASS(cs->algo) != TEE_OPERATION_AE)
 		return TEE_ERROR_BAD_STATE;
 
-	res = vm_check_access_rights(&to_user_ta_ctx(sess->ctx)->uctx,
+	res = vm_check_access_rights(uctx,
 				     TEE_MEMORY_ACCESS_READ |
 				     TEE_MEMORY_ACCESS_ANY_OWNER,
 				     (uaddr_t)src_data, src_len);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = get_user_u64_as_size_t(&dlen, dst_len);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	res = vm_check_access_rights(&to_user_ta_ctx(sess->ctx)->uctx,
+	res = vm_check_access_rights(uctx,
 				     TEE_MEMORY_ACCESS_READ |
 				     TEE_MEMORY_ACCESS_WRITE |
 				     TEE_MEMORY_ACCESS_ANY_OWNER,
-				     (uaddr_t)dst_data, dlen);
+				     (uaddr_t)dst_data, *dlen);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	if (dlen < src_len) {
-		res = TEE_ERROR_SHORT_BUFFER;
-		goto out;
-	}
+	if (*dlen < src_len)
+		return TEE_ERROR_SHORT_BUFFER;
 
-	res = crypto_authenc_update_payload(cs->ctx, cs->mode, src_data,
-					    src_len, dst_data, &dlen);
-out:
+	return crypto_authenc_update_payload(cs->ctx, cs->mode, src_data,
+					     src_len, dst_data, dlen);
+}
+
+TEE_Result syscall_authenc_update_payload(unsigned long state,
+					  const void *src_data,
+					  size_t src_len, void *dst_data,
+					  uint64_t *dst_len)
+{
+	struct ts_session *sess = ts_get_current_session();
+	struct tee_cryp_state *cs = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	size_t dlen = 0;
+
+	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = get_user_u64_as_size_t(&dlen, dst_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = authenc_update_payload(&to_user_ta_ctx(sess->ctx)->uctx, cs,
+				     src_data, src_len, dst_data, &dlen);
 	if (res == TEE_SUCCESS || res == TEE_ERROR_SHORT_BUFFER) {
 		TEE_Result res2 = put_user_u64(dst_len, dlen);
 
@@ -3331,6 +3394,114 @@ out:
 	return res;
 }
 
+/*
+ * Performs one update of syscall_cryp_update_batch(), the kind of update
+ * is selected by the algorithm class of @cs and the flags in @upd.
+ * upd->dst_len is updated as for the corresponding single update syscall.
+ */
+static TEE_Result cryp_update_one(struct user_mode_ctx *uctx,
+				  struct tee_cryp_state *cs,
+				  struct utee_cryp_update *upd)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t src_len = upd->src_len;
+	size_t dlen = upd->dst_len;
+	const void *src = NULL;
+	void *dst = NULL;
+
+	if (upd->src != (vaddr_t)upd->src || upd->dst != (vaddr_t)upd->dst ||
+	    upd->src_len != src_len || upd->dst_len != dlen)
+		return TEE_ERROR_BAD_PARAMETERS;
+	src = (const void *)(vaddr_t)upd->src;
+	dst = (void *)(vaddr_t)upd->dst;
+
+	if (upd->flags & ~UTEE_CRYP_UPDATE_AAD)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	switch (TEE_ALG_GET_CLASS(cs->algo)) {
+	case TEE_OPERATION_DIGEST:
+	case TEE_OPERATION_MAC:
+		if (upd->flags)
+			return TEE_ERROR_BAD_PARAMETERS;
+		res = hash_update(uctx, cs, src, src_len);
+		dlen = 0;
+		break;
+	case TEE_OPERATION_CIPHER:
+		if (upd->flags)
+			return TEE_ERROR_BAD_PARAMETERS;
+		res = cipher_update(uctx, cs, false /* last_block */, src,
+				    src_len, dst, &dlen);
+		break;
+	case TEE_OPERATION_AE:
+		if (upd->flags & UTEE_CRYP_UPDATE_AAD) {
+			res = authenc_update_aad(uctx, cs, src, src_len);
+			dlen = 0;
+		} else {
+			res = authenc_update_payload(uctx, cs, src, src_len,
+						     dst, &dlen);
+		}
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (res == TEE_SUCCESS || res == TEE_ERROR_SHORT_BUFFER)
+		upd->dst_len = dlen;
+
+	return res;
+}
+
+TEE_Result syscall_cryp_update_batch(struct utee_cryp_update *upd,
+				     size_t num_upd)
+{
+	struct ts_session *sess = ts_get_current_session();
+	struct user_mode_ctx *uctx = &to_user_ta_ctx(sess->ctx)->uctx;
+	struct utee_cryp_update buf[8] = { };
+	struct tee_cryp_state *cs = NULL;
+	TEE_Result res2 = TEE_SUCCESS;
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t state = 0;
+	size_t count = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	/*
+	 * The descriptors are copied in a few at a time to keep the
+	 * stack usage bounded. Since consecutive updates tend to use the
+	 * same state the last looked up state is reused.
+	 */
+	for (n = 0; n < num_upd; n += count) {
+		count = MIN(num_upd - n, ARRAY_SIZE(buf));
+		res = copy_from_user(buf, upd + n, count * sizeof(*buf));
+		if (res != TEE_SUCCESS)
+			return res;
+
+		for (m = 0; m < count && res == TEE_SUCCESS; m++) {
+			if (!cs || buf[m].state != state) {
+				state = buf[m].state;
+				res = tee_svc_cryp_get_state(sess,
+						uref_to_vaddr(state), &cs);
+				if (res != TEE_SUCCESS) {
+					cs = NULL;
+					buf[m].res = res;
+					continue;
+				}
+			}
+			res = cryp_update_one(uctx, cs, buf + m);
+			buf[m].res = res;
+		}
+
+		/* Report back the processed updates, including a failed one */
+		res2 = copy_to_user(upd + n, buf, m * sizeof(*buf));
+		if (res2 != TEE_SUCCESS)
+			return res2;
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 TEE_Result syscall_authenc_enc_final(unsigned long state, const void *src_data,
 				     size_t src_len, void *dst_data,
 				     uint64_t *dst_len, void *tag,
@@ -10,6 +10,7 @@
 #include <crypto/crypto_impl.h>
 #include <mbedtls/aes.h>
 #include <stdlib.h>
+#include <stdlib_ext.h>
 #include <string.h>
 #include <tee_api_types.h>
 #include <utee_defines.h>
@@ -84,7 +85,7 @@ static void mbed_aes_cbc_final(struct crypto_cipher_ctx *ctx)
 
 static void mbed_aes_cbc_free_ctx(struct crypto_cipher_ctx *ctx)
 {
-	free(to_aes_cbc_ctx(ctx));
+	free_wipe(to_aes_cbc_ctx(ctx));
 }
 
 static void mbed_aes_cbc_copy_state(struct crypto_cipher_ctx *dst_ctx,
@@ -7,6 +7,8 @@
 #include <assert.h>
 #include <compiler.h>
 #include <crypto/crypto.h>
+#include <initcall.h>
+#include <inttypes.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/ecdh.h>
 #include <mbedtls/ecdsa.h>
@@ -15,9 +17,29 @@
 #include <mbedtls/pk.h>
 #include <stdlib.h>
 #include <string.h>
+#include <trace.h>
+#include <util.h>
 
 #include "mbd_rand.h"
 
+/*
+ * Groups of the NIST curves for which the comb table of the generator
+ * (grp->T) is computed once at boot. Key generation and signing then
+ * only do the constant-time table lookups of ecp_mul_comb() instead of
+ * rebuilding the table on each call, verification reuses it for the
+ * u1 * G part. The groups aren't modified once ready so they're shared
+ * by all threads without locking.
+ */
+static struct ecc_group {
+	uint32_t curve;
+	bool ready;
+	mbedtls_ecp_group grp;
+} ecc_groups[] = {
+	{ .curve = TEE_ECC_CURVE_NIST_P256 },
+	{ .curve = TEE_ECC_CURVE_NIST_P384 },
+	{ .curve = TEE_ECC_CURVE_NIST_P521 },
+};
+
 /* Translate mbedtls result to TEE result */
 static TEE_Result get_tee_result(int lmd_res)
 {
@@ -135,31 +157,37 @@ static TEE_Result ecc_get_keysize(uint32_t curve, uint32_t algo,
 }
 
 /*
- * Clear some memory that was used to prepare the context
+ * Returns in @grp the shared group of @curve if there's one, else @tmp
+ * loaded with the curve parameters. @tmp must have been initialized
+ * and is to be freed by the caller.
  */
-static void ecc_clear_precomputed(mbedtls_ecp_group *grp)
+static int ecc_get_group(uint32_t curve, mbedtls_ecp_group *tmp,
+			 mbedtls_ecp_group **grp)
 {
-	size_t i = 0;
+	size_t n = 0;
 
-	if (grp->T) {
-		for (i = 0; i < grp->T_size; i++)
-			mbedtls_ecp_point_free(&grp->T[i]);
-		free(grp->T);
+	for (n = 0; n < ARRAY_SIZE(ecc_groups); n++) {
+		if (ecc_groups[n].ready && ecc_groups[n].curve == curve) {
+			*grp = &ecc_groups[n].grp;
+			return 0;
+		}
 	}
-	grp->T = NULL;
-	grp->T_size = 0;
+
+	*grp = tmp;
+	return mbedtls_ecp_group_load(tmp, curve);
 }
 
 TEE_Result crypto_acipher_gen_ecc_key(struct ecc_keypair *key, size_t key_size)
 {
 	TEE_Result res = TEE_SUCCESS;
 	int lmd_res = 0;
-	mbedtls_ecdsa_context ecdsa;
+	mbedtls_ecp_group tmp;
+	mbedtls_ecp_group *grp = NULL;
+	mbedtls_ecp_point q;
+	mbedtls_mpi d;
 	size_t key_size_bytes = 0;
 	size_t key_size_bits = 0;
 
-	memset(&ecdsa, 0, sizeof(ecdsa));
-
 	res = ecc_get_keysize(key->curve, 0, &key_size_bytes, &key_size_bits);
 	if (res != TEE_SUCCESS)
 		return res;
@@ -167,41 +195,51 @@ TEE_Result crypto_acipher_gen_ecc_key(struct ecc_keypair *key, size_t key_size)
 	if (key_size != key_size_bits)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	mbedtls_ecdsa_init(&ecdsa);
+	mbedtls_ecp_group_init(&tmp);
+	mbedtls_ecp_point_init(&q);
+	mbedtls_mpi_init(&d);
+
+	lmd_res = ecc_get_group(key->curve, &tmp, &grp);
+	if (lmd_res != 0) {
+		res = TEE_ERROR_NOT_SUPPORTED;
+		goto exit;
+	}
 
 	/* Generate the ECC key */
-	lmd_res = mbedtls_ecdsa_genkey(&ecdsa, key->curve, mbd_rand, NULL);
+	lmd_res = mbedtls_ecp_gen_keypair(grp, &d, &q, mbd_rand, NULL);
 	if (lmd_res != 0) {
 		res = TEE_ERROR_BAD_PARAMETERS;
-		FMSG("mbedtls_ecdsa_genkey failed.");
+		FMSG("mbedtls_ecp_gen_keypair failed.");
 		goto exit;
 	}
-	ecc_clear_precomputed(&ecdsa.grp);
 
 	/* check the size of the keys */
-	if ((mbedtls_mpi_bitlen(&ecdsa.Q.X) > key_size_bits) ||
-	    (mbedtls_mpi_bitlen(&ecdsa.Q.Y) > key_size_bits) ||
-	    (mbedtls_mpi_bitlen(&ecdsa.d) > key_size_bits)) {
+	if ((mbedtls_mpi_bitlen(&q.X) > key_size_bits) ||
+	    (mbedtls_mpi_bitlen(&q.Y) > key_size_bits) ||
+	    (mbedtls_mpi_bitlen(&d) > key_size_bits)) {
 		res = TEE_ERROR_BAD_PARAMETERS;
 		FMSG("Check the size of the keys failed.");
 		goto exit;
 	}
 
 	/* check LMD is returning z==1 */
-	if (mbedtls_mpi_bitlen(&ecdsa.Q.Z) != 1) {
+	if (mbedtls_mpi_bitlen(&q.Z) != 1) {
 		res = TEE_ERROR_BAD_PARAMETERS;
 		FMSG("Check LMD failed.");
 		goto exit;
 	}
 
 	/* Copy the key */
-	crypto_bignum_copy(key->d, (void *)&ecdsa.d);
-	crypto_bignum_copy(key->x, (void *)&ecdsa.Q.X);
-	crypto_bignum_copy(key->y, (void *)&ecdsa.Q.Y);
+	crypto_bignum_copy(key->d, (void *)&d);
+	crypto_bignum_copy(key->x, (void *)&q.X);
+	crypto_bignum_copy(key->y, (void *)&q.Y);
 
 	res = TEE_SUCCESS;
 exit:
-	mbedtls_ecdsa_free(&ecdsa);		/* Free the temporary key */
+	/* Free the temporary key */
+	mbedtls_mpi_free(&d);
+	mbedtls_ecp_point_free(&q);
+	mbedtls_ecp_group_free(&tmp);
 	return res;
 }
 
@@ -212,13 +250,13 @@ TEE_Result crypto_acipher_ecc_sign(uint32_t algo, struct ecc_keypair *key,
 	TEE_Result res = TEE_SUCCESS;
 	int lmd_res = 0;
 	const mbedtls_pk_info_t *pk_info = NULL;
-	mbedtls_ecdsa_context ecdsa;
+	mbedtls_ecp_group tmp;
+	mbedtls_ecp_group *grp = NULL;
 	size_t key_size_bytes = 0;
 	size_t key_size_bits = 0;
 	mbedtls_mpi r;
 	mbedtls_mpi s;
 
-	memset(&ecdsa, 0, sizeof(ecdsa));
 	memset(&r, 0, sizeof(r));
 	memset(&s, 0, sizeof(s));
 
@@ -228,15 +266,13 @@ TEE_Result crypto_acipher_ecc_sign(uint32_t algo, struct ecc_keypair *key,
 	mbedtls_mpi_init(&r);
 	mbedtls_mpi_init(&s);
 
-	mbedtls_ecdsa_init(&ecdsa);
-	lmd_res = mbedtls_ecp_group_load(&ecdsa.grp, key->curve);
+	mbedtls_ecp_group_init(&tmp);
+	lmd_res = ecc_get_group(key->curve, &tmp, &grp);
 	if (lmd_res != 0) {
 		res = TEE_ERROR_NOT_SUPPORTED;
 		goto out;
 	}
 
-	ecdsa.d = *(mbedtls_mpi *)key->d;
-
 	res = ecc_get_keysize(key->curve, algo, &key_size_bytes,
 			      &key_size_bits);
 	if (res != TEE_SUCCESS)
@@ -248,7 +284,7 @@ TEE_Result crypto_acipher_ecc_sign(uint32_t algo, struct ecc_keypair *key,
 		goto out;
 	}
 
-	lmd_res = mbedtls_ecdsa_sign(&ecdsa.grp, &r, &s, &ecdsa.d, msg,
+	lmd_res = mbedtls_ecdsa_sign(grp, &r, &s, (mbedtls_mpi *)key->d, msg,
 				     msg_len, mbd_rand, NULL);
 	if (lmd_res == 0) {
 		*sig_len = 2 * key_size_bytes;
@@ -268,9 +304,7 @@ TEE_Result crypto_acipher_ecc_sign(uint32_t algo, struct ecc_keypair *key,
 out:
 	mbedtls_mpi_free(&r);
 	mbedtls_mpi_free(&s);
-	/* Reset mpi to skip freeing here, those mpis will be freed with key */
-	mbedtls_mpi_init(&ecdsa.d);
-	mbedtls_ecdsa_free(&ecdsa);
+	mbedtls_ecp_group_free(&tmp);
 	return res;
 }
 
@@ -280,13 +314,14 @@ TEE_Result crypto_acipher_ecc_verify(uint32_t algo, struct ecc_public_key *key,
 {
 	TEE_Result res = TEE_SUCCESS;
 	int lmd_res = 0;
-	mbedtls_ecdsa_context ecdsa;
+	mbedtls_ecp_group tmp;
+	mbedtls_ecp_group *grp = NULL;
+	mbedtls_ecp_point q;
 	size_t key_size_bytes, key_size_bits = 0;
 	uint8_t one[1] = { 1 };
 	mbedtls_mpi r;
 	mbedtls_mpi s;
 
-	memset(&ecdsa, 0, sizeof(ecdsa));
 	memset(&r, 0, sizeof(r));
 	memset(&s, 0, sizeof(s));
 
@@ -295,18 +330,18 @@ TEE_Result crypto_acipher_ecc_verify(uint32_t algo, struct ecc_public_key *key,
 
 	mbedtls_mpi_init(&r);
 	mbedtls_mpi_init(&s);
+	mbedtls_ecp_point_init(&q);
 
-	mbedtls_ecdsa_init(&ecdsa);
-
-	lmd_res = mbedtls_ecp_group_load(&ecdsa.grp, key->curve);
+	mbedtls_ecp_group_init(&tmp);
+	lmd_res = ecc_get_group(key->curve, &tmp, &grp);
 	if (lmd_res != 0) {
 		res = TEE_ERROR_NOT_SUPPORTED;
 		goto out;
 	}
 
-	ecdsa.Q.X = *(mbedtls_mpi *)key->x;
-	ecdsa.Q.Y = *(mbedtls_mpi *)key->y;
-	mbedtls_mpi_read_binary(&ecdsa.Q.Z, one, sizeof(one));
+	q.X = *(mbedtls_mpi *)key->x;
+	q.Y = *(mbedtls_mpi *)key->y;
+	mbedtls_mpi_read_binary(&q.Z, one, sizeof(one));
 
 	res = ecc_get_keysize(key->curve, algo,
 			      &key_size_bytes, &key_size_bits);
@@ -324,8 +359,7 @@ TEE_Result crypto_acipher_ecc_verify(uint32_t algo, struct ecc_public_key *key,
 	mbedtls_mpi_read_binary(&r, sig, sig_len / 2);
 	mbedtls_mpi_read_binary(&s, sig + sig_len / 2, sig_len / 2);
 
-	lmd_res = mbedtls_ecdsa_verify(&ecdsa.grp, msg, msg_len, &ecdsa.Q,
-				       &r, &s);
+	lmd_res = mbedtls_ecdsa_verify(grp, msg, msg_len, &q, &r, &s);
 	if (lmd_res != 0) {
 		FMSG("mbedtls_ecdsa_verify failed, returned 0x%x", -lmd_res);
 		res = get_tee_result(lmd_res);
@@ -334,9 +368,10 @@ out:
 	mbedtls_mpi_free(&r);
 	mbedtls_mpi_free(&s);
 	/* Reset mpi to skip freeing here, those mpis will be freed with key */
-	mbedtls_mpi_init(&ecdsa.Q.X);
-	mbedtls_mpi_init(&ecdsa.Q.Y);
-	mbedtls_ecdsa_free(&ecdsa);
+	mbedtls_mpi_init(&q.X);
+	mbedtls_mpi_init(&q.Y);
+	mbedtls_ecp_point_free(&q);
+	mbedtls_ecp_group_free(&tmp);
 	return res;
 }
 
@@ -348,24 +383,41 @@ TEE_Result crypto_acipher_ecc_shared_secret(struct ecc_keypair *private_key,
 	TEE_Result res = TEE_SUCCESS;
 	int lmd_res = 0;
 	uint8_t one[1] = { 1 };
-	mbedtls_ecdh_context ecdh;
+	mbedtls_ecp_group tmp;
+	mbedtls_ecp_group *grp = NULL;
+	mbedtls_ecp_point qp;
+	mbedtls_mpi z;
 	size_t out_len = 0;
 
-	memset(&ecdh, 0, sizeof(ecdh));
-	mbedtls_ecdh_init(&ecdh);
-	lmd_res = mbedtls_ecp_group_load(&ecdh.grp, private_key->curve);
+	mbedtls_ecp_group_init(&tmp);
+	mbedtls_ecp_point_init(&qp);
+	mbedtls_mpi_init(&z);
+
+	lmd_res = ecc_get_group(private_key->curve, &tmp, &grp);
 	if (lmd_res != 0) {
 		res = TEE_ERROR_NOT_SUPPORTED;
 		goto out;
 	}
 
-	ecdh.d = *(mbedtls_mpi *)private_key->d;
-	ecdh.Qp.X = *(mbedtls_mpi *)public_key->x;
-	ecdh.Qp.Y = *(mbedtls_mpi *)public_key->y;
-	mbedtls_mpi_read_binary(&ecdh.Qp.Z, one, sizeof(one));
+	qp.X = *(mbedtls_mpi *)public_key->x;
+	qp.Y = *(mbedtls_mpi *)public_key->y;
+	mbedtls_mpi_read_binary(&qp.Z, one, sizeof(one));
+
+	lmd_res = mbedtls_ecdh_compute_shared(grp, &z, &qp,
+					      (mbedtls_mpi *)private_key->d,
+					      mbd_rand, NULL);
+	if (lmd_res != 0) {
+		res = get_tee_result(lmd_res);
+		goto out;
+	}
+
+	out_len = mbedtls_mpi_size(&grp->P);
+	if (out_len > *secret_len) {
+		res = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
 
-	lmd_res = mbedtls_ecdh_calc_secret(&ecdh, &out_len, secret,
-					   *secret_len, mbd_rand, NULL);
+	lmd_res = mbedtls_mpi_write_binary(&z, secret, out_len);
 	if (lmd_res != 0) {
 		res = get_tee_result(lmd_res);
 		goto out;
@@ -373,9 +425,49 @@ TEE_Result crypto_acipher_ecc_shared_secret(struct ecc_keypair *private_key,
 	*secret_len = out_len;
 out:
 	/* Reset mpi to skip freeing here, those mpis will be freed with key */
-	mbedtls_mpi_init(&ecdh.d);
-	mbedtls_mpi_init(&ecdh.Qp.X);
-	mbedtls_mpi_init(&ecdh.Qp.Y);
-	mbedtls_ecdh_free(&ecdh);
+	mbedtls_mpi_init(&qp.X);
+	mbedtls_mpi_init(&qp.Y);
+	mbedtls_ecp_point_free(&qp);
+	mbedtls_mpi_free(&z);
+	mbedtls_ecp_group_free(&tmp);
 	return res;
 }
+
+/*
+ * A multiplication of the generator by 1 is enough for ecp_mul_comb()
+ * to compute and attach the comb table to the group. No RNG is
+ * available yet, this is fine since neither the scalar nor the table
+ * are secret.
+ */
+static TEE_Result ecc_init_groups(void)
+{
+	struct ecc_group *g = NULL;
+	mbedtls_ecp_point r;
+	mbedtls_mpi one;
+	size_t n = 0;
+
+	mbedtls_ecp_point_init(&r);
+	mbedtls_mpi_init(&one);
+	if (mbedtls_mpi_lset(&one, 1))
+		goto out;
+
+	for (n = 0; n < ARRAY_SIZE(ecc_groups); n++) {
+		g = ecc_groups + n;
+		mbedtls_ecp_group_init(&g->grp);
+		if (mbedtls_ecp_group_load(&g->grp, g->curve) ||
+		    mbedtls_ecp_mul(&g->grp, &r, &one, &g->grp.G, NULL,
+				    NULL) ||
+		    !g->grp.T) {
+			DMSG("No precomputed table for curve %#"PRIx32,
+			     g->curve);
+			mbedtls_ecp_group_free(&g->grp);
+			continue;
+		}
+		g->ready = true;
+	}
+out:
+	mbedtls_ecp_point_free(&r);
+	mbedtls_mpi_free(&one);
+	return TEE_SUCCESS;
+}
+service_init(ecc_init_groups);
@@ -14,6 +14,7 @@
 #include <mbedtls/platform_util.h>
 #include <mbedtls/sha1.h>
 #include <mbedtls/sha256.h>
+#include <mbedtls/sha512.h>
 #include <stdlib.h>
 #include <string_ext.h>
 #include <string.h>
@@ -194,6 +195,62 @@ TEE_Result hash_sha256_check(const uint8_t *hash, const uint8_t *data,
 		return TEE_ERROR_SECURITY;
 	return TEE_SUCCESS;
 }
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+/*
+ * Compresses the full blocks the two messages have in common with both
+ * lanes interleaved, the tails are completed separately in @hs. The
+ * caller's context is reused to save stack, this may run on the abort
+ * stack when the pager loads pages.
+ */
+static void sha256_pair(mbedtls_sha256_context *hs,
+			struct hash_sha256_msg *msgs)
+{
+	uint32_t state[2][8] = { };
+	const void *src[2] = { msgs[0].data, msgs[1].data };
+	size_t blocks = MIN(msgs[0].data_size, msgs[1].data_size) / 64;
+	size_t n = 0;
+
+	blocks = MIN(blocks, (size_t)UINT_MAX);
+	mbedtls_sha256_starts(hs, 0);
+	for (n = 0; n < 2; n++)
+		memcpy(state[n], hs->state, sizeof(state[n]));
+
+	if (blocks)
+		crypto_accel_sha256_compress_x2(state, src, blocks);
+
+	for (n = 0; n < 2; n++) {
+		mbedtls_sha256_starts(hs, 0);
+		memcpy(hs->state, state[n], sizeof(state[n]));
+		hs->total[0] = blocks * 64;
+		hs->total[1] = (uint64_t)blocks * 64 >> 32;
+		mbedtls_sha256_update(hs, msgs[n].data + blocks * 64,
+				      msgs[n].data_size - blocks * 64);
+		mbedtls_sha256_finish(hs, msgs[n].digest);
+	}
+}
+#endif
+
+TEE_Result hash_sha256_multi(struct hash_sha256_msg *msgs, size_t num_msgs)
+{
+	mbedtls_sha256_context hs;
+	size_t n = 0;
+
+	memset(&hs, 0, sizeof(hs));
+	mbedtls_sha256_init(&hs);
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+	for (; n + 1 < num_msgs; n += 2)
+		sha256_pair(&hs, msgs + n);
+#endif
+	for (; n < num_msgs; n++) {
+		mbedtls_sha256_starts(&hs, 0);
+		mbedtls_sha256_update(&hs, msgs[n].data, msgs[n].data_size);
+		mbedtls_sha256_finish(&hs, msgs[n].digest);
+	}
+	mbedtls_sha256_free(&hs);
+
+	return TEE_SUCCESS;
+}
 #endif
 
 #if defined(MBEDTLS_SHA1_PROCESS_ALT)
@@ -225,3 +282,18 @@ int mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx,
 	return 0;
 }
 #endif /*MBEDTLS_SHA256_PROCESS_ALT*/
+
+#if defined(MBEDTLS_SHA512_PROCESS_ALT)
+int mbedtls_internal_sha512_process(mbedtls_sha512_context *ctx,
+				    const unsigned char data[128])
+{
+	MBEDTLS_INTERNAL_VALIDATE_RET(ctx != NULL,
+				      MBEDTLS_ERR_SHA512_BAD_INPUT_DATA);
+	MBEDTLS_INTERNAL_VALIDATE_RET((const unsigned char *)data != NULL,
+				      MBEDTLS_ERR_SHA512_BAD_INPUT_DATA);
+
+	crypto_accel_sha512_compress(ctx->state, data, 1);
+
+	return 0;
+}
+#endif /*MBEDTLS_SHA512_PROCESS_ALT*/
@@ -90,11 +90,33 @@ static uint32_t tee_algo_to_mbedtls_hash_algo(uint32_t algo)
 	}
 }
 
-static void rsa_init_from_key_pair(mbedtls_rsa_context *rsa,
-				struct rsa_keypair *key)
+/*
+ * The Montgomery constants RN, RP and RQ and the blinding values Vi and
+ * Vf of an mbedtls_rsa_context are computed on first use. The context
+ * is kept with the key so that they're reused by the following private
+ * key operations, the blinding values are then updated by squaring in
+ * rsa_prepare_blinding().
+ */
+struct rsa_precomp {
+	mbedtls_rsa_context rsa;
+};
+
+static mbedtls_rsa_context *rsa_get_ctx(struct rsa_keypair *key)
 {
-	mbedtls_rsa_init(rsa, 0, 0);
+	mbedtls_rsa_context *rsa = NULL;
 
+	if (!key->precomp) {
+		key->precomp = calloc(1, sizeof(*key->precomp));
+		if (!key->precomp)
+			return NULL;
+		mbedtls_rsa_init(&key->precomp->rsa, 0, 0);
+	}
+	rsa = &key->precomp->rsa;
+
+	/*
+	 * The bignums of the key may have been reallocated since last
+	 * time so they're assigned each time.
+	 */
 	rsa->E = *(mbedtls_mpi *)key->e;
 	rsa->N = *(mbedtls_mpi *)key->n;
 	rsa->D = *(mbedtls_mpi *)key->d;
@@ -106,22 +128,32 @@ static void rsa_init_from_key_pair(mbedtls_rsa_context *rsa,
 		rsa->DQ = *(mbedtls_mpi *)key->dq;
 	}
 	rsa->len = mbedtls_mpi_size(&rsa->N);
+
+	return rsa;
 }
 
-static void mbd_rsa_free(mbedtls_rsa_context *rsa)
+static void rsa_put_ctx(mbedtls_rsa_context *rsa)
 {
 	/* Reset mpi to skip freeing here, those mpis will be freed with key */
 	mbedtls_mpi_init(&rsa->E);
 	mbedtls_mpi_init(&rsa->N);
 	mbedtls_mpi_init(&rsa->D);
-	if (mbedtls_mpi_size(&rsa->P)) {
-		mbedtls_mpi_init(&rsa->P);
-		mbedtls_mpi_init(&rsa->Q);
-		mbedtls_mpi_init(&rsa->QP);
-		mbedtls_mpi_init(&rsa->DP);
-		mbedtls_mpi_init(&rsa->DQ);
-	}
-	mbedtls_rsa_free(rsa);
+	mbedtls_mpi_init(&rsa->P);
+	mbedtls_mpi_init(&rsa->Q);
+	mbedtls_mpi_init(&rsa->QP);
+	mbedtls_mpi_init(&rsa->DP);
+	mbedtls_mpi_init(&rsa->DQ);
+}
+
+void crypto_acipher_rsa_keypair_changed(struct rsa_keypair *s)
+{
+	if (!s->precomp)
+		return;
+
+	rsa_put_ctx(&s->precomp->rsa);
+	mbedtls_rsa_free(&s->precomp->rsa);
+	free(s->precomp);
+	s->precomp = NULL;
 }
 
 TEE_Result crypto_acipher_alloc_rsa_keypair(struct rsa_keypair *s,
@@ -194,6 +226,7 @@ void crypto_acipher_free_rsa_keypair(struct rsa_keypair *s)
 {
 	if (!s)
 		return;
+	crypto_acipher_rsa_keypair_changed(s);
 	crypto_bignum_free(s->e);
 	crypto_bignum_free(s->d);
 	crypto_bignum_free(s->n);
@@ -234,6 +267,7 @@ TEE_Result crypto_acipher_gen_rsa_key(struct rsa_keypair *key, size_t key_size)
 		crypto_bignum_copy(key->qp, (void *)&rsa.QP);
 		crypto_bignum_copy(key->dp, (void *)&rsa.DP);
 		crypto_bignum_copy(key->dq, (void *)&rsa.DQ);
+		crypto_acipher_rsa_keypair_changed(key);
 
 		res = TEE_SUCCESS;
 	}
@@ -306,14 +340,15 @@ TEE_Result crypto_acipher_rsanopad_decrypt(struct rsa_keypair *key,
 					   uint8_t *dst, size_t *dst_len)
 {
 	TEE_Result res = TEE_SUCCESS;
-	mbedtls_rsa_context rsa;
+	mbedtls_rsa_context *rsa = NULL;
 	int lmd_res = 0;
 	uint8_t *buf = NULL;
 	unsigned long blen = 0;
 	unsigned long offset = 0;
 
-	memset(&rsa, 0, sizeof(rsa));
-	rsa_init_from_key_pair(&rsa, key);
+	rsa = rsa_get_ctx(key);
+	if (!rsa)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	blen = CFG_CORE_BIGNUM_MAX_BITS / 8;
 	buf = malloc(blen);
@@ -323,9 +358,9 @@ TEE_Result crypto_acipher_rsanopad_decrypt(struct rsa_keypair *key,
 	}
 
 	memset(buf, 0, blen);
-	memcpy(buf + rsa.len - src_len, src, src_len);
+	memcpy(buf + rsa->len - src_len, src, src_len);
 
-	lmd_res = mbedtls_rsa_private(&rsa, NULL, NULL, buf, buf);
+	lmd_res = mbedtls_rsa_private(rsa, NULL, NULL, buf, buf);
 	if (lmd_res != 0) {
 		FMSG("mbedtls_rsa_private() returned 0x%x", -lmd_res);
 		res = get_tee_result(lmd_res);
@@ -334,20 +369,20 @@ TEE_Result crypto_acipher_rsanopad_decrypt(struct rsa_keypair *key,
 
 	/* Remove the zero-padding (leave one zero if buff is all zeroes) */
 	offset = 0;
-	while ((offset < rsa.len - 1) && (buf[offset] == 0))
+	while ((offset < rsa->len - 1) && (buf[offset] == 0))
 		offset++;
 
-	if (*dst_len < rsa.len - offset) {
-		*dst_len = rsa.len - offset;
+	if (*dst_len < rsa->len - offset) {
+		*dst_len = rsa->len - offset;
 		res = TEE_ERROR_SHORT_BUFFER;
 		goto out;
 	}
-	*dst_len = rsa.len - offset;
+	*dst_len = rsa->len - offset;
 	memcpy(dst, (char *)buf + offset, *dst_len);
 out:
 	if (buf)
 		free(buf);
-	mbd_rsa_free(&rsa);
+	rsa_put_ctx(rsa);
 	return res;
 }
 
@@ -363,12 +398,13 @@ TEE_Result crypto_acipher_rsaes_decrypt(uint32_t algo, struct rsa_keypair *key,
 	size_t blen = 0;
 	size_t mod_size = 0;
 	void *buf = NULL;
-	mbedtls_rsa_context rsa;
+	mbedtls_rsa_context *rsa = NULL;
 	const mbedtls_pk_info_t *pk_info = NULL;
 	uint32_t md_algo = MBEDTLS_MD_NONE;
 
-	memset(&rsa, 0, sizeof(rsa));
-	rsa_init_from_key_pair(&rsa, key);
+	rsa = rsa_get_ctx(key);
+	if (!rsa)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	/*
 	 * Use a temporary buffer since we don't know exactly how large
@@ -409,13 +445,13 @@ TEE_Result crypto_acipher_rsaes_decrypt(uint32_t algo, struct rsa_keypair *key,
 		}
 	}
 
-	mbedtls_rsa_set_padding(&rsa, lmd_padding, md_algo);
+	mbedtls_rsa_set_padding(rsa, lmd_padding, md_algo);
 
 	if (lmd_padding == MBEDTLS_RSA_PKCS_V15)
-		lmd_res = pk_info->decrypt_func(&rsa, src, src_len, buf, &blen,
+		lmd_res = pk_info->decrypt_func(rsa, src, src_len, buf, &blen,
 						blen, NULL, NULL);
 	else
-		lmd_res = pk_info->decrypt_func(&rsa, src, src_len, buf, &blen,
+		lmd_res = pk_info->decrypt_func(rsa, src, src_len, buf, &blen,
 						blen, mbd_rand, NULL);
 	if (lmd_res != 0) {
 		FMSG("decrypt_func() returned 0x%x", -lmd_res);
@@ -435,7 +471,7 @@ TEE_Result crypto_acipher_rsaes_decrypt(uint32_t algo, struct rsa_keypair *key,
 out:
 	if (buf)
 		free(buf);
-	mbd_rsa_free(&rsa);
+	rsa_put_ctx(rsa);
 	return res;
 }
 
@@ -520,12 +556,13 @@ TEE_Result crypto_acipher_rsassa_sign(uint32_t algo, struct rsa_keypair *key,
 	int lmd_padding = 0;
 	size_t mod_size = 0;
 	size_t hash_size = 0;
-	mbedtls_rsa_context rsa;
+	mbedtls_rsa_context *rsa = NULL;
 	const mbedtls_pk_info_t *pk_info = NULL;
 	uint32_t md_algo = 0;
 
-	memset(&rsa, 0, sizeof(rsa));
-	rsa_init_from_key_pair(&rsa, key);
+	rsa = rsa_get_ctx(key);
+	if (!rsa)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	switch (algo) {
 	case TEE_ALG_RSASSA_PKCS1_V1_5_MD5:
@@ -564,7 +601,7 @@ TEE_Result crypto_acipher_rsassa_sign(uint32_t algo, struct rsa_keypair *key,
 		res = TEE_ERROR_SHORT_BUFFER;
 		goto err;
 	}
-	rsa.len = mod_size;
+	rsa->len = mod_size;
 
 	md_algo = tee_algo_to_mbedtls_hash_algo(algo);
 	if (md_algo == MBEDTLS_MD_NONE) {
@@ -578,13 +615,13 @@ TEE_Result crypto_acipher_rsassa_sign(uint32_t algo, struct rsa_keypair *key,
 		goto err;
 	}
 
-	mbedtls_rsa_set_padding(&rsa, lmd_padding, md_algo);
+	mbedtls_rsa_set_padding(rsa, lmd_padding, md_algo);
 
 	if (lmd_padding == MBEDTLS_RSA_PKCS_V15)
-		lmd_res = pk_info->sign_func(&rsa, md_algo, msg, msg_len, sig,
+		lmd_res = pk_info->sign_func(rsa, md_algo, msg, msg_len, sig,
 					     sig_len, NULL, NULL);
 	else
-		lmd_res = pk_info->sign_func(&rsa, md_algo, msg, msg_len, sig,
+		lmd_res = pk_info->sign_func(rsa, md_algo, msg, msg_len, sig,
 					     sig_len, mbd_rand, NULL);
 	if (lmd_res != 0) {
 		FMSG("sign_func failed, returned 0x%x", -lmd_res);
@@ -593,7 +630,7 @@ TEE_Result crypto_acipher_rsassa_sign(uint32_t algo, struct rsa_keypair *key,
 	}
 	res = TEE_SUCCESS;
 err:
-	mbd_rsa_free(&rsa);
+	rsa_put_ctx(rsa);
 	return res;
 }
 
@@ -103,5 +103,66 @@
  */
 #define PTA_INVOKE_TESTS_CMD_MEMREF_NULL	10
 
+/*
+ * tee_mm allocation performance, compared with a reference singly linked
+ * list allocator
+ *
+ * [in]     value[0].a	number of entries in the pool
+ * [in]     value[0].b	number of free and allocate pairs, ORed with
+ *			PTA_INVOKE_TESTS_TEE_MM_HI_ALLOC to allocate from
+ *			the high end of the pool
+ * [out]    value[1].a	time spent in tee_mm in milliseconds
+ * [out]    value[1].b	time spent in the reference allocator in
+ *			milliseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_TEE_MM_PERF	11
+
+#define PTA_INVOKE_TESTS_TEE_MM_HI_ALLOC	0x80000000
+
+/*
+ * AES-GCM encryption of pages as done by the pager when evicting pages,
+ * one page at a time compared with batches of pages
+ *
+ * [in]     value[0].a	repetition count
+ * [in]     value[0].b	number of pages in a batch, at most
+ *			PTA_INVOKE_TESTS_PAGE_ENC_MAX_BATCH
+ * [out]    value[1].a	time spent encrypting one page at a time in
+ *			milliseconds
+ * [out]    value[1].b	time spent encrypting batches in milliseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_PAGE_ENC_PERF	12
+
+#define PTA_INVOKE_TESTS_PAGE_ENC_MAX_BATCH	16
+
+/*
+ * Compression of paged memory, round trips of different kinds of pages
+ * and decompression of truncated and corrupted data
+ */
+#define PTA_INVOKE_TESTS_CMD_PAGE_LZ		13
+
+/*
+ * ECDSA sign and verify performance with a generated key
+ *
+ * [in]     value[0].a	curve, TEE_ECC_CURVE_NIST_P256, _P384 or _P521
+ * [in]     value[0].b	repetition count
+ * [out]    value[1].a	time spent signing in milliseconds
+ * [out]    value[1].b	time spent verifying in milliseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_ECC_PERF		14
+
+/*
+ * SHA-2 throughput, hashing PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE bytes of
+ * random data per repetition after checking the digests of test vectors
+ *
+ * [in]     value[0].a	algorithm, TEE_ALG_SHA256, TEE_ALG_SHA384 or
+ *			TEE_ALG_SHA512
+ * [in]     value[0].b	repetition count
+ * [out]    value[1].a	time spent hashing in milliseconds
+ * [out]    value[1].b	throughput in KiB per second
+ */
+#define PTA_INVOKE_TESTS_CMD_HASH_PERF		15
+
+#define PTA_INVOKE_TESTS_HASH_PERF_BUF_SIZE	(64 * 1024)
+
 #endif /*__PTA_INVOKE_TESTS_H*/
 
@@ -62,4 +62,48 @@ TEE_Result tee_unmap(void *buf, size_t len);
  */
 TEE_Result tee_uuid_from_str(TEE_UUID *uuid, const char *s);
 
+/* Flags for struct tee_cryp_update */
+#define TEE_CRYP_UPDATE_AAD	0x00000001
+
+/*
+ * struct tee_cryp_update - One update of tee_cryp_update_batch()
+ * @op:		Digest, MAC, cipher or AE operation
+ * @src:	Input data
+ * @src_len:	Number of bytes in @src
+ * @dst:	Output buffer, used by cipher and AE payload updates only
+ * @dst_len:	In: size of @dst, out: number of bytes written to @dst
+ * @flags:	0 or TEE_CRYP_UPDATE_AAD to update the AAD of an AE operation
+ */
+struct tee_cryp_update {
+	TEE_OperationHandle op;
+	const void *src;
+	size_t src_len;
+	void *dst;
+	size_t dst_len;
+	uint32_t flags;
+};
+
+/*
+ * tee_cryp_update_batch() - Perform several updates with one syscall
+ * @upd:	Array of updates
+ * @num_upd:	Number of updates in @upd
+ *
+ * The updates are performed in order, each one as TEE_DigestUpdate(),
+ * TEE_MACUpdate(), TEE_CipherUpdate(), TEE_AEUpdateAAD() or TEE_AEUpdate()
+ * would depending on the class of the operation and @flags. The
+ * operations may be different or the same.
+ *
+ * Unlike TEE_CipherUpdate() and TEE_AEUpdate() no data is buffered in
+ * between updates. With a block cipher mode @src_len must be a multiple
+ * of the block size and the operation must not have any partial block
+ * buffered from an earlier update. AES-CTS and AES-XTS are not supported.
+ *
+ * Returns TEE_SUCCESS on success, TEE_ERROR_SHORT_BUFFER if the output
+ * buffer of an update is too small, then its @dst_len is updated with the
+ * required size and no update has been performed, or
+ * TEE_ERROR_BAD_PARAMETERS if an update isn't supported. Other errors
+ * panic the TA.
+ */
+TEE_Result tee_cryp_update_batch(struct tee_cryp_update *upd, size_t num_upd);
+
 #endif
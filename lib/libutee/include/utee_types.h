@@ -47,4 +47,27 @@ struct utee_attribute {
 	uint32_t attribute_id;
 };
 
+/* Flags for struct utee_cryp_update */
+#define UTEE_CRYP_UPDATE_AAD		0x00000001
+
+/*
+ * struct utee_cryp_update - one update of _utee_cryp_update_batch()
+ * @state:	handle of the crypto state
+ * @src:	input data
+ * @src_len:	length of input data
+ * @dst:	output buffer, used by cipher and AE payload updates only
+ * @dst_len:	in: size of output buffer, out: number of bytes written
+ * @flags:	0 or UTEE_CRYP_UPDATE_AAD to update the AAD of an AE state
+ * @res:	out: result of this update
+ */
+struct utee_cryp_update {
+	uint64_t state;
+	uint64_t src;
+	uint64_t src_len;
+	uint64_t dst;
+	uint64_t dst_len;
+	uint32_t flags;
+	uint32_t res;
+};
+
 #endif /* UTEE_TYPES_H */
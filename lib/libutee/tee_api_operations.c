@@ -1607,6 +1607,128 @@ out:
 	return res;
 }
 
+/* Cryptographic Operations API - Batched Update Functions (extension) */
+
+static TEE_Result check_cryp_update(struct tee_cryp_update *upd)
+{
+	TEE_OperationHandle op = upd->op;
+
+	if (op == TEE_HANDLE_NULL || (!upd->src && upd->src_len))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (upd->flags & ~TEE_CRYP_UPDATE_AAD)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if ((upd->flags & TEE_CRYP_UPDATE_AAD) &&
+	    op->info.operationClass != TEE_OPERATION_AE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	switch (op->info.operationClass) {
+	case TEE_OPERATION_DIGEST:
+		return TEE_SUCCESS;
+	case TEE_OPERATION_MAC:
+	case TEE_OPERATION_CIPHER:
+		if ((op->info.handleState & TEE_HANDLE_FLAG_INITIALIZED) == 0)
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (op->operationState != TEE_OPERATION_STATE_ACTIVE)
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (op->info.operationClass == TEE_OPERATION_MAC)
+			return TEE_SUCCESS;
+		break;
+	case TEE_OPERATION_AE:
+		if ((op->info.handleState & TEE_HANDLE_FLAG_INITIALIZED) == 0)
+			return TEE_ERROR_BAD_PARAMETERS;
+		if (upd->flags & TEE_CRYP_UPDATE_AAD)
+			return TEE_SUCCESS;
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	/*
+	 * Cipher or AE payload update, the data is passed as is to TEE
+	 * Core so nothing may need to be buffered in tee_buffer_update().
+	 */
+	if (op->block_size > 1 &&
+	    (op->buffer_two_blocks || op->buffer_offs ||
+	     upd->src_len % op->block_size))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (upd->dst_len < upd->src_len) {
+		upd->dst_len = upd->src_len;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_cryp_update_batch(struct tee_cryp_update *upd, size_t num_upd)
+{
+	struct utee_cryp_update buf[8] = { };
+	struct utee_cryp_update *u = buf;
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_u = 0;
+	size_t sz = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	if (!upd && num_upd)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/*
+	 * Check everything before the first update is performed, errors
+	 * after that are fatal as we can't restore sync with this API.
+	 */
+	for (n = 0; n < num_upd; n++) {
+		res = check_cryp_update(upd + n);
+		if (res != TEE_SUCCESS)
+			return res;
+		/* Empty updates have nothing to pass to TEE Core */
+		if (upd[n].src_len)
+			num_u++;
+	}
+
+	if (num_u > ARRAY_SIZE(buf)) {
+		if (MUL_OVERFLOW(num_u, sizeof(*u), &sz))
+			return TEE_ERROR_OUT_OF_MEMORY;
+		u = TEE_Malloc(sz, TEE_MALLOC_FILL_ZERO);
+		if (!u)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	for (n = 0; n < num_upd; n++) {
+		if (!upd[n].src_len)
+			continue;
+		u[m].state = upd[n].op->state;
+		u[m].src = (uintptr_t)upd[n].src;
+		u[m].src_len = upd[n].src_len;
+		u[m].dst = (uintptr_t)upd[n].dst;
+		u[m].dst_len = upd[n].dst_len;
+		u[m].flags = upd[n].flags;
+		m++;
+	}
+
+	res = _utee_cryp_update_batch(u, num_u);
+	if (res != TEE_SUCCESS)
+		TEE_Panic(res);
+
+	m = 0;
+	for (n = 0; n < num_upd; n++) {
+		if (upd[n].src_len) {
+			upd[n].dst_len = u[m].dst_len;
+			m++;
+		} else {
+			upd[n].dst_len = 0;
+		}
+		upd[n].op->operationState = TEE_OPERATION_STATE_ACTIVE;
+	}
+
+	if (u != buf)
+		TEE_Free(u);
+
+	return TEE_SUCCESS;
+}
+
 /* Cryptographic Operations API - Asymmetric Functions */
 
 TEE_Result TEE_AsymmetricEncrypt(TEE_OperationHandle operation,
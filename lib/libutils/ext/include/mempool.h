@@ -12,9 +12,10 @@
  * Memory pool for large temporary memory allocations that must not fail.
  * With the first allocation from an unused (idle or free) pool the pool
  * becomes reserved for that particular thread, until all allocations are
- * freed again. In order to avoid dead-lock and ease code review it is good
- * practise to free everything allocated by a certain function before
- * returning.
+ * freed again. A pool created with mempool_alloc_thread_pools() instead
+ * has one separate pool per thread. In order to avoid dead-lock and ease
+ * code review it is good practise to free everything allocated by a
+ * certain function before returning.
  */
 
 /*
@@ -49,6 +50,29 @@ extern struct mempool *mempool_default;
 struct mempool *mempool_alloc_pool(void *data, size_t size,
 				   void (*release_mem)(void *ptr, size_t size));
 
+#if defined(__KERNEL__)
+/*
+ * mempool_alloc_thread_pools() - Allocate a new memory pool with one
+ *				  separate pool per thread
+ * @data:		a block of memory of CFG_NUM_THREADS * @size bytes,
+ *			must have an alignment of MEMPOOL_ALIGN.
+ * @size:		size of the pool of each thread, must be a multiple
+ *			of MEMPOOL_ALIGN.
+ * @release_mem:	function to call when the pool of a thread has been
+ *			emptied, ignored if NULL.
+ *
+ * Items are carved out from the pool of the calling thread so threads
+ * never have to wait for each other. An item must be freed by the thread
+ * that allocated it. Since the pool of each thread is released separately
+ * @size should be a multiple of the granule used by @release_mem.
+ *
+ * returns a pointer to a valid pool on success or NULL on failure.
+ */
+struct mempool *
+mempool_alloc_thread_pools(void *data, size_t size,
+			   void (*release_mem)(void *ptr, size_t size));
+#endif
+
 /*
  * mempool_alloc() - Allocate an item from a memory pool
  * @pool:		A memory pool created with mempool_alloc_pool()
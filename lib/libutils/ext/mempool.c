@@ -63,6 +63,8 @@ struct mempool {
 #if defined(__KERNEL__)
 	void (*release_mem)(void *ptr, size_t size);
 	struct recursive_mutex mu;
+	/* One pool per thread, NULL if the pool is shared by all threads */
+	struct mempool *thread_pools;
 #endif
 };
 
@@ -70,16 +72,37 @@ struct mempool {
 struct mempool *mempool_default;
 #endif
 
-static void get_pool(struct mempool *pool __maybe_unused)
+/* Returns the pool of the calling thread if @pool has per-thread pools */
+static struct mempool *this_pool(struct mempool *pool)
 {
 #if defined(__KERNEL__)
-	mutex_lock_recursive(&pool->mu);
+	if (pool->thread_pools)
+		return pool->thread_pools + thread_get_id();
 #endif
+	return pool;
+}
+
+static struct mempool *get_pool(struct mempool *pool)
+{
+#if defined(__KERNEL__)
+	/* The pool of a thread is only used by that thread, no locking */
+	if (!pool->thread_pools)
+		mutex_lock_recursive(&pool->mu);
+#endif
+	return this_pool(pool);
 }
 
 static void put_pool(struct mempool *pool __maybe_unused)
 {
 #if defined(__KERNEL__)
+	struct mempool *p = this_pool(pool);
+
+	if (pool->thread_pools) {
+		if (p->last_offset < 0 && pool->release_mem)
+			pool->release_mem((void *)p->data, p->size);
+		return;
+	}
+
 	if (mutex_get_recursive_lock_depth(&pool->mu) == 1) {
 		/*
 		 * As the refcount is about to become 0 there should be no items
@@ -116,43 +139,78 @@ mempool_alloc_pool(void *data, size_t size,
 	return pool;
 }
 
+#if defined(__KERNEL__)
+struct mempool *
+mempool_alloc_thread_pools(void *data, size_t size,
+			   void (*release_mem)(void *ptr, size_t size))
+{
+	struct mempool *pool = calloc(1, sizeof(*pool));
+	size_t n = 0;
+
+	assert(!((vaddr_t)data & (MEMPOOL_ALIGN - 1)));
+	assert(!(size & (MEMPOOL_ALIGN - 1)));
+
+	if (!pool)
+		return NULL;
+
+	pool->thread_pools = calloc(CFG_NUM_THREADS, sizeof(*pool));
+	if (!pool->thread_pools) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->size = size * CFG_NUM_THREADS;
+	pool->data = (vaddr_t)data;
+	pool->last_offset = -1;
+	pool->release_mem = release_mem;
+	mutex_init_recursive(&pool->mu);
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		pool->thread_pools[n].size = size;
+		pool->thread_pools[n].data = (vaddr_t)data + n * size;
+		pool->thread_pools[n].last_offset = -1;
+	}
+
+	return pool;
+}
+#endif
+
 void *mempool_alloc(struct mempool *pool, size_t size)
 {
 	size_t offset;
 	struct mempool_item *new_item;
 	struct mempool_item *last_item = NULL;
+	struct mempool *p = get_pool(pool);
 
-	get_pool(pool);
-
-	if (pool->last_offset < 0) {
+	if (p->last_offset < 0) {
 		offset = 0;
 	} else {
-		last_item = (struct mempool_item *)(pool->data +
-						    pool->last_offset);
-		offset = pool->last_offset + last_item->size;
+		last_item = (struct mempool_item *)(p->data +
+						    p->last_offset);
+		offset = p->last_offset + last_item->size;
 
 		offset = ROUNDUP(offset, MEMPOOL_ALIGN);
-		if (offset > pool->size)
+		if (offset > p->size)
 			goto error;
 	}
 
 	size = sizeof(struct mempool_item) + size;
 	size = ROUNDUP(size, MEMPOOL_ALIGN);
-	if (offset + size > pool->size)
+	if (offset + size > p->size)
 		goto error;
 
-	new_item = (struct mempool_item *)(pool->data + offset);
+	new_item = (struct mempool_item *)(p->data + offset);
 	new_item->size = size;
-	new_item->prev_item_offset = pool->last_offset;
+	new_item->prev_item_offset = p->last_offset;
 	if (last_item)
 		last_item->next_item_offset = offset;
 	new_item->next_item_offset = -1;
-	pool->last_offset = offset;
+	p->last_offset = offset;
 #ifdef CFG_MEMPOOL_REPORT_LAST_OFFSET
-	if (pool->last_offset > pool->max_last_offset) {
-		pool->max_last_offset = pool->last_offset;
+	if (p->last_offset > p->max_last_offset) {
+		p->max_last_offset = p->last_offset;
 		DMSG("Max memory usage increased to %zu",
-		     (size_t)pool->max_last_offset);
+		     (size_t)p->max_last_offset);
 	}
 #endif
 
@@ -185,6 +243,7 @@ void mempool_free(struct mempool *pool, void *ptr)
 	struct mempool_item *prev_item;
 	struct mempool_item *next_item;
 	ssize_t last_offset = -1;
+	struct mempool *p = this_pool(pool);
 
 	if (!ptr)
 		return;
@@ -192,19 +251,19 @@ void mempool_free(struct mempool *pool, void *ptr)
 	item = (struct mempool_item *)((vaddr_t)ptr -
 				       sizeof(struct mempool_item));
 	if (item->prev_item_offset >= 0) {
-		prev_item = (struct mempool_item *)(pool->data +
+		prev_item = (struct mempool_item *)(p->data +
 						    item->prev_item_offset);
 		prev_item->next_item_offset = item->next_item_offset;
 		last_offset = item->prev_item_offset;
 	}
 
 	if (item->next_item_offset >= 0) {
-		next_item = (struct mempool_item *)(pool->data +
+		next_item = (struct mempool_item *)(p->data +
 						    item->next_item_offset);
 		next_item->prev_item_offset = item->prev_item_offset;
-		last_offset = pool->last_offset;
+		last_offset = p->last_offset;
 	}
 
-	pool->last_offset = last_offset;
+	p->last_offset = last_offset;
 	put_pool(pool);
 }
@@ -80,6 +80,7 @@
 #include <compiler.h>
 #include <malloc.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdlib_ext.h>
@@ -90,6 +91,7 @@
 #if defined(__KERNEL__)
 /* Compiling for TEE Core */
 #include <kernel/asan.h>
+#include <kernel/misc.h>
 #include <kernel/thread.h>
 #include <kernel/spinlock.h>
 #include <kernel/unwind.h>
@@ -141,6 +143,12 @@ static __maybe_unused void *memcpy_unchecked(void *dst, const void *src,
 
 #include "bget.c"		/* this is ugly, but this is bget */
 
+#if defined(__KERNEL__) && defined(CFG_CORE_MALLOC_MAGAZINES) && \
+	!defined(ENABLE_MDBG)
+#define WITH_MAGAZINES
+static size_t __maybe_unused mag_cached_bytes(void);
+#endif
+
 struct malloc_pool {
 	void *buf;
 	size_t len;
@@ -245,6 +253,10 @@ static void gen_malloc_get_stats(struct malloc_ctx *ctx,
 
 	memcpy_unchecked(stats, &ctx->mstats, sizeof(*stats));
 	stats->allocated = ctx->poolset.totalloc;
+#ifdef WITH_MAGAZINES
+	if (ctx == &malloc_ctx)
+		stats->allocated -= mag_cached_bytes();
+#endif
 	malloc_unlock(ctx, exceptions);
 }
 
@@ -438,6 +450,318 @@ out:
 	return p;
 }
 
+#ifdef WITH_MAGAZINES
+/*
+ * Small allocations from malloc_ctx are served from per-CPU magazines,
+ * small arrays of cached free objects which are accessed without taking
+ * the malloc lock. There's one magazine per CPU and size class, the size
+ * classes are powers of two from 16 to 512 bytes.
+ *
+ * Magazines are refilled from, and flushed to, a depot of slabs per size
+ * class protected by the malloc lock. A slab is a bget buffer holding
+ * MAG_SLAB_OBJS objects, each preceded by a struct mag_hdr which overlays
+ * struct bhead with a positive bsize so free() and realloc() can tell a
+ * slab object from a bget buffer. Slabs with no allocated objects are
+ * returned to bget unless it's the last one with free objects in the
+ * size class.
+ */
+#define MAG_MIN_SHIFT		4
+#define MAG_NUM_CLASSES		6
+#define MAG_MAX_SIZE		BIT(MAG_MIN_SHIFT + MAG_NUM_CLASSES - 1)
+#define MAG_CAPACITY		8
+#define MAG_SLAB_OBJS		16
+#define MAG_HDR_TAG		0x4d414700
+
+struct mag_slab {
+	struct mag_slab *next;
+	struct mag_slab *prev;
+	void *free_objs;
+	unsigned int num_free;
+	unsigned int class;
+};
+
+struct mag_hdr {
+	struct mag_slab *slab;
+	bufsize tag;
+};
+
+struct mag {
+	unsigned int count;
+	void *objs[MAG_CAPACITY];
+};
+
+static struct mag mags[CFG_TEE_CORE_NB_CORE][MAG_NUM_CLASSES];
+/* Slabs with free objects, protected by the malloc lock of malloc_ctx */
+static struct mag_slab *mag_depot[MAG_NUM_CLASSES];
+
+static size_t mag_class_size(unsigned int class)
+{
+	return BIT(MAG_MIN_SHIFT + class);
+}
+
+static unsigned int mag_class(size_t size)
+{
+	unsigned int class = 0;
+
+	while (mag_class_size(class) < size)
+		class++;
+
+	return class;
+}
+
+static struct mag_hdr *mag_get_hdr(void *ptr)
+{
+	struct mag_hdr *hdr = (struct mag_hdr *)ptr - 1;
+
+	COMPILE_TIME_ASSERT(sizeof(struct mag_hdr) == sizeof(struct bhead));
+	COMPILE_TIME_ASSERT(offsetof(struct mag_hdr, tag) ==
+			    offsetof(struct bhead, bsize));
+
+	/* Allocated bget buffers have a negative bsize */
+	if (hdr->tag <= 0)
+		return NULL;
+
+	assert((hdr->tag & ~0xff) == MAG_HDR_TAG);
+	return hdr;
+}
+
+static void mag_depot_link(struct mag_slab *slab)
+{
+	slab->prev = NULL;
+	slab->next = mag_depot[slab->class];
+	if (slab->next)
+		slab->next->prev = slab;
+	mag_depot[slab->class] = slab;
+}
+
+static void mag_depot_unlink(struct mag_slab *slab)
+{
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		mag_depot[slab->class] = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+}
+
+static struct mag_slab *mag_slab_alloc(unsigned int class)
+{
+	size_t stride = sizeof(struct mag_hdr) + mag_class_size(class);
+	size_t hdr_size = ROUNDUP(sizeof(struct mag_slab), SizeQuant);
+	size_t slab_size = hdr_size + MAG_SLAB_OBJS * stride;
+	struct mag_slab *slab = NULL;
+	struct mag_hdr *hdr = NULL;
+	size_t n = 0;
+
+	slab = raw_malloc(0, 0, slab_size, &malloc_ctx);
+	if (!slab)
+		return NULL;
+
+	slab->class = class;
+	slab->num_free = MAG_SLAB_OBJS;
+	slab->free_objs = NULL;
+	for (n = 0; n < MAG_SLAB_OBJS; n++) {
+		hdr = (void *)((uint8_t *)slab + hdr_size + n * stride);
+		hdr->slab = slab;
+		hdr->tag = MAG_HDR_TAG | class;
+		*(void **)(hdr + 1) = slab->free_objs;
+		slab->free_objs = hdr + 1;
+	}
+	tag_asan_free((uint8_t *)slab + hdr_size, slab_size - hdr_size);
+	mag_depot_link(slab);
+
+	return slab;
+}
+
+static void *mag_depot_get(unsigned int class)
+{
+	struct mag_slab *slab = mag_depot[class];
+	void *obj = NULL;
+
+	if (!slab) {
+		slab = mag_slab_alloc(class);
+		if (!slab)
+			return NULL;
+	}
+
+	obj = slab->free_objs;
+	slab->free_objs = *(void **)obj;
+	slab->num_free--;
+	if (!slab->num_free)
+		mag_depot_unlink(slab);
+
+	return obj;
+}
+
+static void mag_depot_put(void *obj)
+{
+	struct mag_slab *slab = mag_get_hdr(obj)->slab;
+
+	*(void **)obj = slab->free_objs;
+	slab->free_objs = obj;
+	if (!slab->num_free)
+		mag_depot_link(slab);
+	slab->num_free++;
+
+	if (slab->num_free == MAG_SLAB_OBJS &&
+	    (slab->next || slab->prev)) {
+		mag_depot_unlink(slab);
+		raw_free(slab, &malloc_ctx, false);
+	}
+}
+
+static void *mag_alloc(size_t size)
+{
+	uint32_t exceptions = 0;
+	unsigned int class = mag_class(size);
+	struct mag *m = NULL;
+	void *p = NULL;
+
+	/* The magazine of this CPU may only be used with exceptions masked */
+	exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	m = &mags[get_core_pos()][class];
+	if (!m->count) {
+		uint32_t e = malloc_lock(&malloc_ctx);
+
+		while (m->count < MAG_CAPACITY / 2) {
+			p = mag_depot_get(class);
+			if (!p)
+				break;
+			m->objs[m->count++] = p;
+		}
+		malloc_unlock(&malloc_ctx, e);
+	}
+	p = NULL;
+	if (m->count)
+		p = m->objs[--m->count];
+	thread_unmask_exceptions(exceptions);
+
+	if (p)
+		tag_asan_alloced(p, mag_class_size(class));
+
+	return p;
+}
+
+/* Returns false if @ptr isn't a slab object */
+static bool mag_free(void *ptr, bool wipe)
+{
+	struct mag_hdr *hdr = mag_get_hdr(ptr);
+	uint32_t exceptions = 0;
+	unsigned int class = 0;
+	struct mag *m = NULL;
+
+	if (!hdr)
+		return false;
+
+	class = hdr->tag & 0xff;
+	if (wipe)
+		memset_unchecked(ptr, 0x55, mag_class_size(class));
+	tag_asan_free(ptr, mag_class_size(class));
+
+	exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	m = &mags[get_core_pos()][class];
+	if (m->count == MAG_CAPACITY) {
+		uint32_t e = malloc_lock(&malloc_ctx);
+
+		while (m->count > MAG_CAPACITY / 2)
+			mag_depot_put(m->objs[--m->count]);
+		malloc_unlock(&malloc_ctx, e);
+	}
+	m->objs[m->count++] = ptr;
+	thread_unmask_exceptions(exceptions);
+
+	return true;
+}
+
+/*
+ * Bytes of free objects in magazines and slabs, these are allocated as
+ * far as bget is concerned. The magazines of other CPUs are read without
+ * synchronization so it's only an estimate. Called with the malloc lock
+ * held.
+ */
+static size_t mag_cached_bytes(void)
+{
+	struct mag_slab *slab = NULL;
+	size_t bytes = 0;
+	size_t n = 0;
+	size_t c = 0;
+
+	for (c = 0; c < MAG_NUM_CLASSES; c++) {
+		for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
+			bytes += mags[n][c].count * mag_class_size(c);
+		for (slab = mag_depot[c]; slab; slab = slab->next)
+			bytes += slab->num_free * mag_class_size(c);
+	}
+
+	return bytes;
+}
+
+static void *mag_realloc(void *ptr, struct mag_hdr *hdr, size_t size)
+{
+	size_t old_size = mag_class_size(hdr->tag & 0xff);
+	void *p = NULL;
+
+	if (size <= old_size)
+		return ptr;
+
+	p = malloc(size);
+	if (p) {
+		memcpy(p, ptr, old_size);
+		free(ptr);
+	}
+
+	return p;
+}
+
+/*
+ * Returns true unless @b is a slab where [@start, @end) isn't inside one
+ * allocated object. A bget buffer is a slab if its first object header
+ * points back at it. Called with the malloc lock held.
+ */
+static bool mag_buffer_is_within_alloced(void *b, size_t size,
+					 uint8_t *start, uint8_t *end)
+{
+	size_t hdr_size = ROUNDUP(sizeof(struct mag_slab), SizeQuant);
+	struct mag_slab *slab = b;
+	struct mag_hdr *hdr = NULL;
+	unsigned int class = 0;
+	size_t stride = 0;
+	uint8_t *obj = NULL;
+	void *p = NULL;
+	size_t n = 0;
+	size_t m = 0;
+
+	if (size < hdr_size + sizeof(*hdr))
+		return true;
+	hdr = (void *)((uint8_t *)b + hdr_size);
+	class = hdr->tag & 0xff;
+	if (hdr->slab != slab || (hdr->tag & ~0xff) != MAG_HDR_TAG ||
+	    class >= MAG_NUM_CLASSES)
+		return true;
+
+	stride = sizeof(*hdr) + mag_class_size(class);
+	if (start < (uint8_t *)(hdr + 1))
+		return false;
+	n = (start - (uint8_t *)(hdr + 1)) / stride;
+	if (n >= MAG_SLAB_OBJS)
+		return false;
+	obj = (uint8_t *)(hdr + 1) + n * stride;
+	if (start < obj || end > obj + mag_class_size(class))
+		return false;
+
+	/* Cached objects are free even if bget counts them as allocated */
+	for (p = slab->free_objs; p; p = *(void **)p)
+		if (p == obj)
+			return false;
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
+		for (m = 0; m < mags[n][class].count; m++)
+			if (mags[n][class].objs[m] == obj)
+				return false;
+
+	return true;
+}
+#endif /*WITH_MAGAZINES*/
+
 /* Most of the stuff in this function is copied from bgetr() in bget.c */
 static __maybe_unused bufsize bget_buf_size(void *buf)
 {
@@ -668,8 +992,17 @@ void mdbg_check(int bufdump)
 void *malloc(size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions;
+
+#ifdef WITH_MAGAZINES
+	if (size <= MAG_MAX_SIZE) {
+		p = mag_alloc(size);
+		if (p)
+			return p;
+	}
+#endif
 
+	exceptions = malloc_lock(&malloc_ctx);
 	p = raw_malloc(0, 0, size, &malloc_ctx);
 	malloc_unlock(&malloc_ctx, exceptions);
 	return p;
@@ -677,8 +1010,14 @@ void *malloc(size_t size)
 
 static void free_helper(void *ptr, bool wipe)
 {
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions;
 
+#ifdef WITH_MAGAZINES
+	if (ptr && mag_free(ptr, wipe))
+		return;
+#endif
+
+	exceptions = malloc_lock(&malloc_ctx);
 	raw_free(ptr, &malloc_ctx, wipe);
 	malloc_unlock(&malloc_ctx, exceptions);
 }
@@ -686,8 +1025,21 @@ static void free_helper(void *ptr, bool wipe)
 void *calloc(size_t nmemb, size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions;
+
+#ifdef WITH_MAGAZINES
+	size_t s = 0;
+
+	if (!MUL_OVERFLOW(nmemb, size, &s) && s <= MAG_MAX_SIZE) {
+		p = mag_alloc(s);
+		if (p) {
+			memset(p, 0, s);
+			return p;
+		}
+	}
+#endif
 
+	exceptions = malloc_lock(&malloc_ctx);
 	p = raw_calloc(0, 0, nmemb, size, &malloc_ctx);
 	malloc_unlock(&malloc_ctx, exceptions);
 	return p;
@@ -702,8 +1054,20 @@ static void *realloc_unlocked(struct malloc_ctx *ctx, void *ptr,
 void *realloc(void *ptr, size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions;
+
+#ifdef WITH_MAGAZINES
+	struct mag_hdr *hdr = NULL;
+
+	if (!ptr)
+		return malloc(size);
 
+	hdr = mag_get_hdr(ptr);
+	if (hdr)
+		return mag_realloc(ptr, hdr, size);
+#endif
+
+	exceptions = malloc_lock(&malloc_ctx);
 	p = realloc_unlocked(&malloc_ctx, ptr, size);
 	malloc_unlock(&malloc_ctx, exceptions);
 	return p;
@@ -791,6 +1155,12 @@ static bool gen_malloc_buffer_is_within_alloced(struct malloc_ctx *ctx,
 
 		if (start_buf >= start_b && end_buf <= end_b) {
 			ret = true;
+#ifdef WITH_MAGAZINES
+			if (ctx == &malloc_ctx)
+				ret = mag_buffer_is_within_alloced(start_b, s,
+								   start_buf,
+								   end_buf);
+#endif
 			goto out;
 		}
 	}
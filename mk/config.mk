@@ -97,7 +97,10 @@ CFG_MSG_LONG_PREFIX_MASK ?= 0x1a
 # Otherwise, you need to implement hw_get_random_byte() for your platform
 CFG_WITH_SOFTWARE_PRNG ?= y
 
-# Number of threads
+# Number of threads. The property "optee,num-threads" in the
+# /secure-chosen node of the embedded DT can lower the number of threads
+# used, but thread contexts are allocated statically for CFG_NUM_THREADS
+# threads.
 CFG_NUM_THREADS ?= 2
 
 # API implementation version
@@ -139,6 +142,13 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 # TEE_STORAGE_PRIVATE is passed to the trusted storage API)
 CFG_REE_FS ?= y
 
+# Enables a write-back cache of plaintext data blocks for each open file in
+# the REE FS when set to a value greater than zero. Repeated writes to the
+# same block are coalesced and the block is only encrypted and sent to
+# normal world when evicted or when the file is committed. Each open file
+# uses up to CFG_FS_HTREE_CACHE_BLOCKS * 4 kB of heap memory for the cache.
+CFG_FS_HTREE_CACHE_BLOCKS ?= 0
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -147,38 +157,22 @@ CFG_RPMB_FS ?= n
 # tee-supplicant process will open /dev/mmcblk<id>rpmb
 CFG_RPMB_FS_DEV_ID ?= 0
 
+# The FAT of the RPMB FS is read in once and then kept in memory, updated
+# as entries are written, so looking up files never needs to traverse the
+# FAT in RPMB. This requires sizeof(struct rpmb_fat_entry) = 256 bytes of
+# heap memory per FAT entry plus a small index.
 # This config variable determines the number of entries read in from RPMB at
-# once whenever a function traverses the RPMB FS. Increasing the default value
-# has the following consequences:
-# - More memory required on heap. A single FAT entry currently has a size of
-#   256 bytes.
-# - Potentially significant speed-ups for RPMB I/O. Depending on how many
-#   entries a function needs to traverse, the number of time-consuming RPMB
-#   read-in operations can be reduced.
-# Chosing a proper value is both platform- (available memory) and use-case-
-# dependent (potential number of FAT fs entries), so overwrite in platform
-# config files
+# once when the FAT is read in. Increasing the default value reduces the
+# number of time-consuming RPMB read-in operations at the cost of reserving
+# heap memory for a few more entries.
 CFG_RPMB_FS_RD_ENTRIES ?= 8
 
-# Enables caching of FAT FS entries when set to a value greater than zero.
-# When enabled, the cache stores the first 'CFG_RPMB_FS_CACHE_ENTRIES' FAT FS
-# entries. The cache is populated when FAT FS entries are initially read in.
-# When traversing the FAT FS entries, we read from the cache instead of reading
-# in the entries from RPMB storage. Consequently, when a FAT FS entry is
-# written, the cache is updated. In scenarios where an estimate of the number
-# of FAT FS entries can be made, the cache may be specifically tailored to
-# store all entries. The caching can improve RPMB I/O at the cost
-# of additional memory.
-# Without caching, we temporarily require
-# CFG_RPMB_FS_RD_ENTRIES*sizeof(struct rpmb_fat_entry) bytes of heap memory
-# while traversing the FAT FS (e.g. in read_fat).
-# For example 8*256 bytes = 2kB while in read_fat.
-# With caching, we constantly require up to
-# CFG_RPMB_FS_CACHE_ENTRIES*sizeof(struct rpmb_fat_entry) bytes of heap memory
-# depending on how many elements are in the cache, and additional temporary
-# CFG_RPMB_FS_RD_ENTRIES*sizeof(struct rpmb_fat_entry) bytes of heap memory
-# in case the cache is too small to hold all elements when traversing.
-CFG_RPMB_FS_CACHE_ENTRIES ?= 0
+# When enabled, authenticated RPMB writes pack as many data frames in one
+# request as the reliable write sector count of the device allows (up to 32
+# frames), instead of one frame per request. This requires a normal world
+# RPMB driver supporting multi-block reliable writes, so it's disabled by
+# default.
+CFG_RPMB_MULTIPLE_BLOCK_WRITE ?= n
 
 # Enables RPMB key programming by the TEE, in case the RPMB partition has not
 # been configured yet.
@@ -324,6 +318,16 @@ CFG_WITH_PAGER ?= n
 CFG_LOCKDEP ?= n
 CFG_LOCKDEP_RECORD_STACK ?= y
 
+# Maximum time in microseconds a thread spins on a write locked mutex while
+# the owner is running on another core, before sleeping in normal world.
+# Sleeping and being woken up costs two RPCs, much more than most critical
+# sections protected by a mutex. 0 disables spinning.
+CFG_MUTEX_SPIN_US ?= 20
+
+# Count, for each mutex, the number of times it was contended and how the
+# contention was resolved, see mutex_get_stats().
+CFG_MUTEX_STATS ?= $(CFG_TEE_CORE_DEBUG)
+
 # BestFit algorithm in bget reduces the fragmentation of the heap when running
 # with the pager enabled or lockdep
 CFG_CORE_BGET_BESTFIT ?= $(call cfg-one-enabled, CFG_WITH_PAGER CFG_LOCKDEP)
@@ -331,6 +335,32 @@ CFG_CORE_BGET_BESTFIT ?= $(call cfg-one-enabled, CFG_WITH_PAGER CFG_LOCKDEP)
 # Use the pager for user TAs
 CFG_PAGED_USER_TA ?= $(CFG_WITH_PAGER)
 
+# Compress read/write paged TA memory before it's encrypted and saved when
+# evicted. Pages are stored in slots sized after the compressed page and
+# pages with only zeroes aren't stored at all, which reduces the amount of
+# data to encrypt and decrypt as well as the TA RAM needed to store it.
+# CFG_PAGED_RW_COMPRESSION_RESERVE is the percentage of the pages for
+# which TA RAM is reserved when the memory is allocated, more is allocated
+# on demand. When no TA RAM is available a dirty page stays resident and
+# the pager evicts another page instead.
+CFG_PAGED_RW_COMPRESSION ?= n
+CFG_PAGED_RW_COMPRESSION_RESERVE ?= 50
+ifeq ($(CFG_PAGED_RW_COMPRESSION),y)
+$(call force,CFG_PAGED_USER_TA,y,required by CFG_PAGED_RW_COMPRESSION)
+endif
+
+# Page replacement policy of the pager. With CFG_PAGER_2Q=y pages loaded
+# once are kept apart from pages reloaded shortly after being evicted, so
+# a burst of pages used only once can't evict the frequently used pages.
+# With CFG_PAGER_2Q=n the oldest page is evicted, approximating LRU by
+# hiding the oldest third of the pages after each fault.
+CFG_PAGER_2Q ?= y
+
+# Maximum number of pages the pager reads ahead when faults on read-only
+# paged areas, like TA code, are sequential. The readahead window starts
+# at two pages and doubles on each sequential fault. 0 disables readahead.
+CFG_PAGER_READAHEAD_PAGES ?= 8
+
 # Enable support for detected undefined behavior in C
 # Uses a lot of memory, can't be enabled by default
 CFG_CORE_SANITIZE_UNDEFINED ?= n
@@ -399,6 +429,25 @@ CFG_BOOT_SECONDARY_REQUEST ?= n
 # Default heap size for Core, 64 kB
 CFG_CORE_HEAP_SIZE ?= 65536
 
+# When enabled, core heap allocations of up to 512 bytes are served from
+# per-CPU magazines of cached objects backed by slabs carved out of the
+# heap, which keeps them off the heap lock and the bget free list search.
+# This costs some heap memory held in magazines and partially used slabs.
+# Has no effect with CFG_TEE_CORE_MALLOC_DEBUG=y.
+CFG_CORE_MALLOC_MAGAZINES ?= n
+
+# Size of the scratch memory pool used for temporary big numbers in core,
+# 42 kB is needed for xtest to pass reliably on both ARM32 and ARM64.
+CFG_CORE_BIGNUM_MEMPOOL_SIZE ?= 43008
+
+# When enabled, each thread gets its own big number scratch memory pool of
+# CFG_CORE_BIGNUM_MEMPOOL_SIZE bytes instead of all threads sharing one
+# pool behind a mutex, so asymmetric crypto operations in different
+# threads can run in parallel. This costs CFG_NUM_THREADS times the memory
+# of the shared pool, though with pager it is pageable and only backed by
+# physical pages while in use.
+CFG_CORE_BIGNUM_MEMPOOL_PER_THREAD ?= n
+
 # Default size of nexus heap. 16 kB. Used only if CFG_VIRTUALIZATION
 # is enabled
 CFG_CORE_NEX_HEAP_SIZE ?= 16384
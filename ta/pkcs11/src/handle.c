@@ -17,53 +17,151 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
-void handle_db_init(struct handle_db *db)
+/*
+ * The used entries of db->ptrs are tracked in the bitmap db->used, which
+ * lets bit_ffc() find the lowest free handle without comparing each
+ * pointer. Handle 0 is invalid and always marked as used.
+ *
+ * The reverse index db->rev is an open addressed hash table of the
+ * allocated handles keyed on their pointer. It has twice as many slots as
+ * db->ptrs has entries so it's never more than half full. An empty slot
+ * holds 0.
+ */
+static uint32_t rev_slot(struct handle_db *db, void *ptr)
 {
-	TEE_MemFill(db, 0, sizeof(*db));
+	return (((uintptr_t)ptr >> 3) * 0x9e3779b1U) & (db->max_ptrs * 2 - 1);
 }
 
-void handle_db_destroy(struct handle_db *db)
+static void rev_insert(struct handle_db *db, uint32_t handle)
 {
-	if (db) {
-		TEE_Free(db->ptrs);
-		db->ptrs = NULL;
-		db->max_ptrs = 0;
-	}
+	uint32_t mask = db->max_ptrs * 2 - 1;
+	uint32_t s = rev_slot(db, db->ptrs[handle]);
+
+	while (db->rev[s])
+		s = (s + 1) & mask;
+	db->rev[s] = handle;
 }
 
-uint32_t handle_get(struct handle_db *db, void *ptr)
+static void rev_remove(struct handle_db *db, uint32_t handle)
 {
+	uint32_t mask = db->max_ptrs * 2 - 1;
+	uint32_t s = rev_slot(db, db->ptrs[handle]);
 	uint32_t n = 0;
-	void *p = NULL;
-	uint32_t new_max_ptrs = 0;
-
-	if (!db || !ptr)
-		return 0;
-
-	/* Try to find an empty location (index 0 is reserved as invalid) */
-	for (n = 1; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
+	uint32_t h = 0;
+
+	while (db->rev[s] != handle)
+		s = (s + 1) & mask;
+
+	/*
+	 * Shift following entries of the probe sequence back into the
+	 * freed slot unless that would move them before their home slot.
+	 */
+	db->rev[s] = 0;
+	for (n = (s + 1) & mask; db->rev[n]; n = (n + 1) & mask) {
+		h = rev_slot(db, db->ptrs[db->rev[n]]);
+		if (((n - h) & mask) >= ((n - s) & mask)) {
+			db->rev[s] = db->rev[n];
+			db->rev[n] = 0;
+			s = n;
 		}
 	}
+}
+
+static bool grow(struct handle_db *db)
+{
+	uint32_t new_max_ptrs = 0;
+	bitstr_t *used = NULL;
+	uint32_t *rev = NULL;
+	void *p = NULL;
+	uint32_t n = 0;
 
-	/* No location available, grow the ptrs array */
 	if (db->max_ptrs)
 		new_max_ptrs = db->max_ptrs * 2;
 	else
 		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+	if (new_max_ptrs > INT32_MAX)
+		return false;
+
+	rev = TEE_Malloc(new_max_ptrs * 2 * sizeof(*rev),
+			 TEE_MALLOC_FILL_ZERO);
+	if (!rev)
+		return false;
+
+	used = TEE_Malloc(bitstr_size(new_max_ptrs), TEE_MALLOC_FILL_ZERO);
+	if (!used) {
+		TEE_Free(rev);
+		return false;
+	}
 
 	p = TEE_Realloc(db->ptrs, new_max_ptrs * sizeof(void *));
-	if (!p)
-		return 0;
+	if (!p) {
+		TEE_Free(used);
+		TEE_Free(rev);
+		return false;
+	}
 	db->ptrs = p;
 	TEE_MemFill(db->ptrs + db->max_ptrs, 0,
 		    (new_max_ptrs - db->max_ptrs) * sizeof(void *));
+
+	if (db->used)
+		TEE_MemMove(used, db->used, bitstr_size(db->max_ptrs));
+	else
+		bit_set(used, 0);
+	TEE_Free(db->used);
+	db->used = used;
+
+	/* Rebuild the reverse index for the new size */
+	TEE_Free(db->rev);
+	db->rev = rev;
+	n = db->max_ptrs;
 	db->max_ptrs = new_max_ptrs;
+	while (n-- > 1)
+		if (db->ptrs[n])
+			rev_insert(db, n);
+
+	return true;
+}
+
+void handle_db_init(struct handle_db *db)
+{
+	TEE_MemFill(db, 0, sizeof(*db));
+}
+
+void handle_db_destroy(struct handle_db *db)
+{
+	if (db) {
+		TEE_Free(db->ptrs);
+		TEE_Free(db->used);
+		TEE_Free(db->rev);
+		db->ptrs = NULL;
+		db->used = NULL;
+		db->rev = NULL;
+		db->max_ptrs = 0;
+	}
+}
 
-	/* Since n stopped at db->max_ptrs there is an empty location there */
+uint32_t handle_get(struct handle_db *db, void *ptr)
+{
+	int n = -1;
+
+	if (!db || !ptr)
+		return 0;
+
+	if (db->max_ptrs)
+		bit_ffc(db->used, (int)db->max_ptrs, &n);
+	if (n < 0) {
+		/* No location available, grow the ptrs array */
+		n = db->max_ptrs;
+		if (!grow(db))
+			return 0;
+		if (!n)
+			n = 1;
+	}
+
+	bit_set(db->used, n);
 	db->ptrs[n] = ptr;
+	rev_insert(db, n);
+
 	return n;
 }
 
@@ -71,10 +169,12 @@ void *handle_put(struct handle_db *db, uint32_t handle)
 {
 	void *p = NULL;
 
-	if (!db || !handle || handle >= db->max_ptrs)
+	if (!db || !handle || handle >= db->max_ptrs || !db->ptrs[handle])
 		return NULL;
 
+	rev_remove(db, handle);
 	p = db->ptrs[handle];
+	bit_clear(db->used, handle);
 	db->ptrs[handle] = NULL;
 	return p;
 }
@@ -89,13 +189,15 @@ void *handle_lookup(struct handle_db *db, uint32_t handle)
 
 uint32_t handle_lookup_handle(struct handle_db *db, void *ptr)
 {
-	uint32_t n = 0;
+	uint32_t mask = db->max_ptrs * 2 - 1;
+	uint32_t s = 0;
 
-	if (ptr) {
-		for (n = 1; n < db->max_ptrs; n++)
-			if (db->ptrs[n] == ptr)
-				return n;
-	}
+	if (!ptr || !db->max_ptrs)
+		return 0;
+
+	for (s = rev_slot(db, ptr); db->rev[s]; s = (s + 1) & mask)
+		if (db->ptrs[db->rev[s]] == ptr)
+			return db->rev[s];
 
 	return 0;
 }
@@ -6,11 +6,21 @@
 #ifndef PKCS11_TA_HANDLE_H
 #define PKCS11_TA_HANDLE_H
 
+#include <bitstring.h>
 #include <stddef.h>
+#include <stdint.h>
 
+/*
+ * @ptrs:	registered pointers indexed by handle, NULL if unused
+ * @used:	bitmap of the used entries in @ptrs, handle 0 is always used
+ * @max_ptrs:	number of entries in @ptrs
+ * @rev:	reverse index of the handles keyed on pointer
+ */
 struct handle_db {
 	void **ptrs;
+	bitstr_t *used;
 	uint32_t max_ptrs;
+	uint32_t *rev;
 };
 
 /*
@@ -26,7 +36,8 @@ void handle_db_init(struct handle_db *db);
 void handle_db_destroy(struct handle_db *db);
 
 /*
- * Allocate a new handle ID and assigns the supplied pointer to it,
+ * Allocate a new handle ID and assigns the supplied pointer to it. The
+ * lowest free handle ID is always used.
  * The function returns > 0 on success and 0 on failure.
  */
 uint32_t handle_get(struct handle_db *db, void *ptr);